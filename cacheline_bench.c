@@ -0,0 +1,159 @@
+#include "client_server_shared.h"
+#include "completion_ring.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_ARGS 1
+#define MAX_BENCH_THREADS 64
+
+/**
+ * Microbenchmark of the poller -> requester completion handoff with the two
+ * context layouts. Each requester posts a request by bumping its posted
+ * counter, the poller thread completes it by copying posted into completed
+ * and the requester spins until it sees the completion.
+ * - packed: posted[] and completed[] are adjacent arrays in one struct, as
+ *   rtt_done[] and the requester fields used to share client_ctx_t, so the
+ *   poller and all requesters write the same cache lines
+ * - padded: per-thread blocks like client_dp_t, with the poller written and
+ *   requester written words on separate cache lines
+ * Run under `perf c2c record` to see the HITM difference
+ */
+typedef struct packed_layout_s {
+    volatile uint32_t posted[MAX_BENCH_THREADS];
+    volatile uint32_t completed[MAX_BENCH_THREADS];
+} packed_layout_t;
+
+typedef struct padded_slot_s {
+    volatile uint32_t posted __attribute__((aligned(CACHE_LINE_SZ)));
+    volatile uint32_t completed __attribute__((aligned(CACHE_LINE_SZ)));
+} __attribute__((aligned(CACHE_LINE_SZ))) padded_slot_t;
+
+typedef struct bench_s {
+    bool padded;
+    int nthreads;
+    volatile bool stop;
+    packed_layout_t packed;
+    padded_slot_t slot[MAX_BENCH_THREADS];
+    uint64_t handoffs[MAX_BENCH_THREADS];
+} bench_t;
+
+typedef struct bench_arg_s {
+    bench_t *b;
+    int tid;
+} bench_arg_t;
+
+static volatile uint32_t *posted(bench_t *b, int t) {
+    return (b->padded ? &(b->slot[t].posted) : &(b->packed.posted[t]));
+}
+
+static volatile uint32_t *completed(bench_t *b, int t) {
+    return (b->padded ? &(b->slot[t].completed) : &(b->packed.completed[t]));
+}
+
+static void *poller(void *arg) {
+    bench_t *b = (bench_t *)arg;
+    while (!b->stop) {
+        for (int t = 0; t < b->nthreads; t++) {
+            uint32_t p = __atomic_load_n(posted(b, t), __ATOMIC_ACQUIRE);
+            if (p != *completed(b, t)) {
+                __atomic_store_n(completed(b, t), p, __ATOMIC_RELEASE);
+            }
+        }
+    }
+
+    return (NULL);
+}
+
+static void *requester(void *arg) {
+    bench_arg_t *a = (bench_arg_t *)arg;
+    bench_t *b = a->b;
+    uint32_t seq = 0;
+    uint64_t n = 0;
+
+    while (!b->stop) {
+        __atomic_store_n(posted(b, a->tid), ++seq, __ATOMIC_RELEASE);
+        while (__atomic_load_n(completed(b, a->tid), __ATOMIC_ACQUIRE) != seq &&
+               !b->stop) {
+            cpu_relax();
+        }
+        n++;
+    }
+
+    b->handoffs[a->tid] = n;
+    return (NULL);
+}
+
+static int run_bench(bench_t *b, int nthreads, int seconds, bool padded) {
+    pthread_t pt, rt[MAX_BENCH_THREADS];
+    bench_arg_t args[MAX_BENCH_THREADS];
+    uint64_t total = 0, nsec = 0;
+
+    memset(b, 0, sizeof(bench_t));
+    b->padded = padded;
+    b->nthreads = nthreads;
+
+    TIME_DECLARATIONS();
+    TIME_START();
+    // pthread_create returns an errno, not -1
+    int rc = pthread_create(&pt, NULL, poller, b);
+    EXT_API_STATUS(
+        rc != 0, { return (-1); }, "Unable to create poller. Reason: %s\n",
+        strerror(rc));
+    int started = 0;
+    for (; started < nthreads; started++) {
+        args[started].b = b;
+        args[started].tid = started;
+        rc = pthread_create(&rt[started], NULL, requester, &args[started]);
+        EXT_API_STATUS(
+            rc != 0, { break; }, "Unable to create requester %d. Reason: %s\n",
+            started, strerror(rc));
+    }
+
+    if (started == nthreads) {
+        sleep(seconds);
+    }
+    b->stop = true;
+    for (int t = 0; t < started; t++) {
+        pthread_join(rt[t], NULL);
+        total += b->handoffs[t];
+    }
+    pthread_join(pt, NULL);
+    TIME_GET_ELAPSED_TIME(nsec);
+    if (started < nthreads) {
+        return (-1);
+    }
+
+    printf("[%s] Threads: %d, Handoffs: %lu, Rate: %.0f handoffs/sec, "
+           "Latency: %.1f nsec/handoff\n",
+           padded ? "PADDED" : "PACKED", nthreads, total,
+           (double)total * NSEC_TO_SEC / (double)nsec,
+           total ? ((double)nsec * nthreads / (double)total) : 0.0);
+    return (0);
+}
+
+int main(int argc, char *argv[]) {
+    int nthreads = (argc > BENCH_ARGS) ? atoi(argv[1]) : 4;
+    int seconds = (argc > BENCH_ARGS + 1) ? atoi(argv[2]) : 2;
+
+    if (nthreads < 1 || nthreads > MAX_BENCH_THREADS || seconds < 1) {
+        printf("Usage: ./RDMACacheLineBench [threads <= %d] [seconds]\n",
+               MAX_BENCH_THREADS);
+        return (1);
+    }
+
+    bench_t *b = aligned_alloc(CACHE_LINE_SZ, sizeof(bench_t));
+    API_NULL(
+        b, { return (1); }, "Unable to allocate benchmark state\n");
+
+    int rc = run_bench(b, nthreads, seconds, false);
+    if (rc == 0) {
+        rc = run_bench(b, nthreads, seconds, true);
+    }
+    free(b);
+    return ((rc) ? (1) : (0));
+}
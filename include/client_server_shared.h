@@ -6,6 +6,7 @@
 #include <netdb.h>
 #include <netinet/in.h>
 #include <rdma/rdma_cma.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -50,16 +51,124 @@
  * @name RDMA_ACCESS_FLAG
  * @brief shared flags for client/server datapath
  */
-#define RDMA_ACCESS_FLAGS (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE)
+#define RDMA_ACCESS_FLAGS                                                      \
+    (IBV_ACCESS_LOCAL_WRITE | IBV_ACCESS_REMOTE_WRITE |                        \
+     IBV_ACCESS_REMOTE_READ | IBV_ACCESS_REMOTE_ATOMIC)
 
 /**
- * @name OPC_RDMA_READ/OPC_SEND_ONLY/OPC_RDMA_WRITE
+ * @name OPC_RDMA_READ/OPC_SEND_ONLY/OPC_RDMA_WRITE/OPC_ATOMIC_FADD/CAS
  * @brief shared opcode(s) for client/server datapath
  */
 #define OPC_INVALID 0x0
 #define OPC_RDMA_READ 0x01
 #define OPC_SEND_ONLY 0x02
 #define OPC_RDMA_WRITE 0x04
+#define OPC_ATOMIC_FADD 0x08
+#define OPC_ATOMIC_CAS 0x10
+
+/**
+ * @name OPC_BW_START/OPC_BW_DATA/OPC_BW_WARMUP/OPC_BW_FIN
+ * @brief Immediate data of bandwidth round messages: round setup and its
+ * reply, timed and warm-up payload, end of stream carrying the sender totals
+ */
+#define OPC_BW_START 0x20
+#define OPC_BW_DATA 0x40
+#define OPC_BW_WARMUP 0x80
+#define OPC_BW_FIN 0x100
+
+/**
+ * @name OPC_WRPC_START/OPC_WRPC_FIN
+ * @brief Write-based RPC mode: the SEND switching the server to polling its
+ * request ring and the reply to it, and the opc of the slot trailer ending
+ * the mode
+ */
+#define OPC_WRPC_START 0x200
+#define OPC_WRPC_FIN 0x400
+
+/**
+ * @name OPC_WRITE_RPC
+ * @brief Client opcode of write-based RPC round trips, see
+ * start_client_wrpc. Requests carry OPC_SEND_ONLY in their slot trailer, so
+ * it never reaches the server
+ */
+#define OPC_WRITE_RPC 0x800
+
+/**
+ * @name WRPC_SLOT_SZ/WRPC_SLOTS/WRPC_RING_SZ
+ * @brief Write-based RPC rings: the server ring holds a request slot per
+ * client requester thread, the client ring a response slot per thread. A
+ * message ends at its slot end with a wrpc_tail_t
+ */
+#define WRPC_SLOT_SZ (64 * 1024)
+#define WRPC_SLOTS 16
+#define WRPC_RING_SZ (WRPC_SLOTS * WRPC_SLOT_SZ)
+#define WRPC_MAX_MSG (WRPC_SLOT_SZ - (int)sizeof(wrpc_tail_t))
+
+/**
+ * @name WRPC_SIGNAL_EVERY
+ * @brief Write-based RPC WRs are posted unsignaled but one in so many, whose
+ * completion retires the ones before it from the send queue
+ */
+#define WRPC_SIGNAL_EVERY 32
+
+/**
+ * @name BENCH_MODE_LAT/BENCH_MODE_BW/BENCH_MODE_BIBW/BENCH_MODE_OPEN/STORM
+ * @brief Client benchmark modes: request/response round trips, one-way
+ * streaming to the server, streaming in both directions at once, requests
+ * issued on a schedule regardless of outstanding responses, and connections
+ * opened and closed back to back
+ */
+#define BENCH_MODE_LAT 0
+#define BENCH_MODE_BW 1
+#define BENCH_MODE_BIBW 2
+#define BENCH_MODE_OPEN 3
+#define BENCH_MODE_STORM 4
+
+/**
+ * @name MAX_RATE_LIST/ARRIVAL_FIXED/ARRIVAL_POISSON
+ * @brief Offered rates an open-loop run sweeps and its inter-arrival
+ * distributions
+ */
+#define MAX_RATE_LIST 16
+#define ARRIVAL_FIXED 0
+#define ARRIVAL_POISSON 1
+
+/**
+ * @name TRANSPORT_RC/TRANSPORT_UD/TRANSPORT_XRC/TRANSPORT_TCP/TRANSPORT_URING
+ * @brief Reliable Connected QP per client, one connectionless Unreliable
+ * Datagram QP per server with application-level retransmit, requests sent
+ * over XRC into a shared receive queue of the server, or the kernel TCP
+ * baselines: a socket driven by plain syscalls or by io_uring
+ */
+#define TRANSPORT_RC 0
+#define TRANSPORT_UD 1
+#define TRANSPORT_XRC 2
+#define TRANSPORT_TCP 3
+#define TRANSPORT_URING 4
+
+/**
+ * @name SHM_MODE_OFF/SHM_MODE_AUTO/SHM_MODE_ON
+ * @brief Shared-memory path of a client: never, whenever the server runs on
+ * this host and publishes a segment, or required
+ */
+#define SHM_MODE_OFF 0
+#define SHM_MODE_AUTO 1
+#define SHM_MODE_ON 2
+
+/**
+ * @name DEFAULT_SEND_WR/DEFAULT_RECV_WR/CQ_POLL_BATCH
+ * @brief Queue depths of a connection unless configured, clamped to the
+ * device max_qp_wr, and completions drained per ibv_poll_cq call
+ */
+#define DEFAULT_SEND_WR 1024
+#define DEFAULT_RECV_WR 512
+#define CQ_POLL_BATCH 64
+
+/**
+ * @name MAX_ATOMIC_CTR
+ * @brief Number of 8-byte counters in the server-side atomic counter array
+ */
+#define MAX_ATOMIC_CTR 4096
 
 /**
  * @name MAX_MR_SZ
@@ -67,6 +176,38 @@
  */
 #define MAX_MR_SZ (1024 * 1024)
 
+/**
+ * @name RDMA_MAX_SGE/RDMA_MSG_HDR_SZ
+ * @brief Upper bound of scatter/gather entries per WR (further capped by the
+ * device max_sge) and size of the application header carried in front of the
+ * payload of a gathered message
+ */
+#define RDMA_MAX_SGE 16
+#define RDMA_MSG_HDR_SZ 64
+
+/**
+ * @name MAX_MSG_SZ_LIST
+ * @brief Maximum number of message sizes a single client run can sweep
+ */
+#define MAX_MSG_SZ_LIST 32
+
+/**
+ * @name MAX_RAILS/RAIL_STRIPE_MIN
+ * @brief Source/target address pairs a bandwidth run can stream over at
+ * once, and the default message size from which messages are split across
+ * the rails, or the QPs of a connection, rather than handed out whole
+ */
+#define MAX_RAILS 8
+#define RAIL_STRIPE_MIN (64 * 1024)
+
+/**
+ * @name MAX_CONN_QPS
+ * @brief RC QPs of one connection, the one RDMA CM connects included. The
+ * others are connected out of band, their numbers carried by the connect
+ * and accept private data
+ */
+#define MAX_CONN_QPS 8
+
 /**
  * @name TIME_DECLARATIONS/TIME_START/TIME_GET_ELAPSED_TIME
  * @brief shared wall-clock time measurement utilities for client/server
@@ -84,6 +225,38 @@
     (nsec_elapsed) = (__end.tv_nsec + (__end.tv_sec * NSEC_TO_SEC)) -          \
                      (__start.tv_nsec + (__start.tv_sec * NSEC_TO_SEC));
 
+/**
+ * @name MR_MODE_PINNED/MR_MODE_ODP/MR_MODE_IMPLICIT
+ * @brief Registration of the datapath buffers: pinned up front by
+ * ibv_reg_mr, on-demand paging (ODP) MRs the device faults in on first
+ * touch, or one implicit ODP MR spanning the whole address space
+ */
+#define MR_MODE_PINNED 0
+#define MR_MODE_ODP 1
+#define MR_MODE_IMPLICIT 2
+
+/**
+ * @struct rdma_qp_cfg_t
+ * @brief Queue sizing and buffer registration of a connection. Zero depths
+ * take the defaults, a zero cqe takes exactly what the queues completing on
+ * a CQ can hold
+ */
+typedef struct rdma_qp_cfg_s {
+    uint32_t send_wr; //< Send queue depth
+    uint32_t recv_wr; //< Receive queue depth
+    uint32_t cqe;     //< Entries per CQ
+    bool split_cq;    //< Separate send and receive CQs
+    uint32_t nqps;    //< RC QPs per connection, 0 = 1. All of them share
+                      //< the CQs, the extra ones carry bandwidth rounds
+    int mr_mode;      //< MR_MODE_* of the buffers
+    uint32_t odp_ops; //< IBV_ODP_SUPPORT_* ops an ODP run needs paged
+                      //< besides SEND and RECV
+    bool mr_prefetch; //< Fault ODP buffers in with ibv_advise_mr at
+                      //< registration
+    bool ex_verbs;    //< CQs of ibv_create_cq_ex read with ibv_start_poll,
+                      //< sends posted through ibv_qp_ex
+} rdma_qp_cfg_t;
+
 /**
  * @struct server_info_t
  * @brief Server Address Info Type
@@ -92,6 +265,13 @@ typedef struct server_info_s {
     struct sockaddr *ip_addr;
     uint16_t app_port;
     uint16_t rank;
+    int report_fmt;          //< report_fmt_t of the run report
+    const char *report_path; //< Run report destination, "-" for stdout
+    int transport;           //< TRANSPORT_*
+    rdma_qp_cfg_t qp_cfg;    //< Queue sizing of the connection
+    uint32_t accept_workers; //< Threads accepting connections, 0 = default
+    uint64_t accept_storm;   //< Connections to accept and report, 0 = serve
+    bool shm;                //< Serve same-host clients over shared memory
 } __attribute__((packed)) server_info_t;
 
 /**
@@ -105,8 +285,100 @@ typedef struct client_info_s {
     int iterations;
     int opcode;
     size_t msg_sz;
+    size_t msg_szs[MAX_MSG_SZ_LIST]; //< Message sizes to sweep, msg_sz first
+    int nmsg_sz;                     //< Number of valid entries in msg_szs
+    int nsge;      //< Number of SGEs to gather header + payload from
+    bool sge_copy; //< Copy header + payload into one buffer before send
+    int nthreads;  //< Number of client threads issuing requests
+    int nkeys;     //< Number of atomic counters targeted
+    int nhot_keys; //< Number of hot-spot counters among nkeys
+    double hot_frac; //< Fraction of requests targeting the hot-spot counters
+    int report_fmt;          //< report_fmt_t of the run report
+    const char *report_path; //< Run report destination, "-" for stdout
+    int mode;                //< BENCH_MODE_*
+    int qdepth;              //< Outstanding WRs of a bandwidth stream
+    uint64_t warmup;         //< Untimed messages before each measurement
+    uint64_t duration_nsec;  //< Timed window of a stream, 0 = iterations
+    uint64_t outlier_nsec;   //< Latency counted as an outlier, 0 = off
+    bool lock_bufs;          //< Pre-fault and mlock registered buffers
+    double rates[MAX_RATE_LIST]; //< Offered requests/sec to sweep (open)
+    int nrates;                  //< Number of valid entries in rates
+    int arrival;                 //< ARRIVAL_* inter-arrival distribution
+    int transport;               //< TRANSPORT_*
+    rdma_qp_cfg_t qp_cfg;        //< Queue sizing of the connection
+    int reconnect; //< Connect attempts per outage of lat/atomic runs, 0 = off
+    int shm;       //< SHM_MODE_* of a same-host server
+    int nfibers;   //< Fibers sharing the requester thread (lat), 1 = none
+    struct wl_spec_s *wl; //< Sizes, opcodes or trace of open-loop requests,
+                          //< NULL = opcode and size sweep of the arguments
+    int nrails; //< Address pairs streamed over (bw), 1 = my_addr/peer_addr
+    struct sockaddr *rail_src[MAX_RAILS]; //< Source of each rail, my_addr 1st
+    struct sockaddr *rail_dst[MAX_RAILS]; //< Target of each, peer_addr 1st
+    size_t stripe_min; //< Messages from this size up are split across rails
+                       //< or QPs
+    int qps[MAX_CONN_QPS]; //< QP counts of the connection to sweep (bw)
+    int nqps;              //< Number of valid entries in qps, 0 = one QP
+    bool first_touch; //< Time the first round trip of each size apart (lat)
 } __attribute__((packed)) client_info_t;
 
+/**
+ * @struct rdma_rbuf_t
+ * @brief Remote buffer descriptor advertised to the peer
+ */
+typedef struct rdma_rbuf_s {
+    uint64_t addr; //< Remote virtual address
+    uint32_t rkey; //< Remote key of the registered region
+    uint32_t len;  //< Length of the registered region
+} __attribute__((packed)) rdma_rbuf_t;
+
+/**
+ * @struct server_priv_t
+ * @brief Private data carried by rdma_accept from server to client
+ */
+typedef struct server_priv_s {
+    rdma_rbuf_t atomic; //< Server-side atomic counter array
+    rdma_rbuf_t sink;   //< Server-side target of RDMA_WRITE streams
+    uint32_t xrc_srqn;  //< XRC SRQ requests are sent to, 0 = no XRC
+    uint32_t xrc_qpn;   //< XRC_RECV QP facing the client XRC_SEND QP
+    rdma_rbuf_t wrpc;   //< Server-side ring of write-based RPC requests
+    uint32_t qpn[MAX_CONN_QPS - 1]; //< RC QPs facing the extra client ones
+} __attribute__((packed)) server_priv_t;
+
+/**
+ * @struct wrpc_tail_t
+ * @brief Trailer closing a write-based RPC message, right behind its
+ * payload. One RDMA_WRITE places payload and trailer, and seq, the last
+ * bytes of the slot, is polled for: it relies on the NIC placing the bytes
+ * of a write in increasing address order, as FaRM and HERD do. Naturally
+ * aligned, so seq can be loaded atomically
+ */
+typedef struct wrpc_tail_s {
+    uint64_t resp_addr; //< Client response slot, echoed to by the server
+    uint32_t resp_rkey; //< rkey of the client response ring
+    uint32_t len;       //< Payload bytes in front of the trailer
+    uint32_t opc;       //< OPC_SEND_ONLY, or OPC_WRPC_FIN to end the mode
+    uint32_t rsvd[2];   //< Keeps seq the last word of the slot
+    uint32_t seq;       //< Per-slot request number, 0 is never sent
+} wrpc_tail_t;
+
+/**
+ * @brief Trailer of slot idx in a ring of WRPC_SLOTS slots
+ */
+static inline wrpc_tail_t *wrpc_slot_tail(void *ring, uint32_t idx) {
+    uint8_t *end = (uint8_t *)ring + ((size_t)idx + 1) * WRPC_SLOT_SZ;
+    return ((wrpc_tail_t *)end - 1);
+}
+
+/**
+ * @struct client_priv_t
+ * @brief Private data carried by rdma_connect from client to server
+ */
+typedef struct client_priv_s {
+    uint32_t xrc_qpn; //< XRC_SEND QP of the client, 0 = no XRC
+    uint32_t nqps;    //< RC QPs of the connection, 0 = 1
+    uint32_t qpn[MAX_CONN_QPS - 1]; //< Extra RC QPs of the client
+} __attribute__((packed)) client_priv_t;
+
 /**
  * @struct msgbuf_t
  * @brief Server-side app rx/tx buffer
@@ -204,14 +476,29 @@ static inline client_info_t *parse_caddress_info(char *sip, char *__dip,
         obj->opcode = OPC_RDMA_WRITE;
     } else if (strncmp(opcode, "RDMA_READ", strlen(opcode)) == 0) {
         obj->opcode = OPC_RDMA_READ;
+    } else if (strncmp(opcode, "WRITE_RPC", strlen(opcode)) == 0) {
+        obj->opcode = OPC_WRITE_RPC;
+    } else if (strncmp(opcode, "ATOMIC_FADD", strlen(opcode)) == 0) {
+        obj->opcode = OPC_ATOMIC_FADD;
+    } else if (strncmp(opcode, "ATOMIC_CAS", strlen(opcode)) == 0) {
+        obj->opcode = OPC_ATOMIC_CAS;
     } else {
         obj->opcode = OPC_INVALID;
     }
 
-    obj->msg_sz = (size_t)atoi(msg_sz);
-    printf("Client IP: %s, Iterations: %s, Rank: %u, %s Msg Size: %zu bytes => "
+    // Message size is either a single size or a comma separated sweep
+    char *szs = strdup(msg_sz), *save = NULL;
+    for (char *tok = strtok_r(szs, ",", &save);
+         tok && obj->nmsg_sz < MAX_MSG_SZ_LIST;
+         tok = strtok_r(NULL, ",", &save)) {
+        obj->msg_szs[obj->nmsg_sz++] = (size_t)atoi(tok);
+    }
+    free(szs);
+    obj->msg_sz = obj->msg_szs[0];
+    obj->nsge = 1;
+    printf("Client IP: %s, Iterations: %s, Rank: %u, %s Msg Size: %s bytes => "
            "Target Server: %s:%s\n",
-           sip, iterations, obj->rank, opcode, obj->msg_sz, dip, port);
+           sip, iterations, obj->rank, opcode, msg_sz, dip, port);
     free(dip);
     return obj;
 }
@@ -242,6 +529,72 @@ static inline int randomize_buf(void **buf, size_t nbytes) {
     return (0);
 }
 
+// xorshift64* generator, cheap enough to run per request on every thread
+static inline uint64_t fast_rand(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return (x * 0x2545F4914F6CDD1DULL);
+}
+
+// <n>[s|ms|us|ns], seconds if no unit, 0 if malformed
+static inline uint64_t parse_duration_nsec(const char *str) {
+    char *unit = NULL;
+    double v = strtod(str, &unit);
+    if (unit == str || v <= 0) {
+        return (0);
+    }
+
+    if (*unit == '\0' || strcmp(unit, "s") == 0) {
+        return ((uint64_t)(v * 1e9));
+    } else if (strcmp(unit, "ms") == 0) {
+        return ((uint64_t)(v * 1e6));
+    } else if (strcmp(unit, "us") == 0) {
+        return ((uint64_t)(v * 1e3));
+    } else if (strcmp(unit, "ns") == 0) {
+        return ((uint64_t)v);
+    }
+
+    return (0);
+}
+
+/**
+ * @brief Resolve cfg against the device: defaults are clamped to max_qp_wr,
+ * explicit depths beyond it are refused. nsq send queues complete on the
+ * send CQ; without split_cq the receive queue completes there as well, and
+ * the CQ must hold every completion its queues can have outstanding
+ */
+static inline int rdma_size_qp(const struct ibv_device_attr *dev,
+                               rdma_qp_cfg_t *cfg, uint32_t nsq) {
+    uint32_t max_wr = (uint32_t)dev->max_qp_wr;
+    if (!cfg->send_wr) {
+        cfg->send_wr = (DEFAULT_SEND_WR < max_wr) ? DEFAULT_SEND_WR : max_wr;
+    }
+    if (!cfg->recv_wr) {
+        cfg->recv_wr = (DEFAULT_RECV_WR < max_wr) ? DEFAULT_RECV_WR : max_wr;
+    }
+    EXT_API_STATUS(
+        (cfg->send_wr > max_wr || cfg->recv_wr > max_wr), { return (-1); },
+        "Queue depths send: %u recv: %u exceed device max_qp_wr %u\n",
+        cfg->send_wr, cfg->recv_wr, max_wr);
+
+    uint32_t scqe = nsq * cfg->send_wr, rcqe = cfg->recv_wr;
+    uint32_t need = (cfg->split_cq) ? ((scqe > rcqe) ? scqe : rcqe)
+                                    : (scqe + rcqe);
+    cfg->cqe = (cfg->cqe) ? (cfg->cqe) : (need);
+    EXT_API_STATUS(
+        cfg->cqe < need, { return (-1); },
+        "CQ of %u entries overruns with %u send + %u recv completions%s\n",
+        cfg->cqe, scqe, rcqe, (cfg->split_cq) ? " on separate CQs" : "");
+    EXT_API_STATUS(
+        cfg->cqe > (uint32_t)dev->max_cqe, { return (-1); },
+        "CQ of %u entries exceeds device max_cqe %d\n", cfg->cqe,
+        dev->max_cqe);
+    return (0);
+}
+
 __attribute__((unused)) static const char *
 wc_opcode_str(enum ibv_wc_opcode opc) {
     switch (opc) {
@@ -255,6 +608,10 @@ wc_opcode_str(enum ibv_wc_opcode opc) {
         return "WC_RDMA_WRITE";
     case IBV_WC_RDMA_READ:
         return "WC_RDMA_READ";
+    case IBV_WC_FETCH_ADD:
+        return "WC_FETCH_ADD";
+    case IBV_WC_COMP_SWAP:
+        return "WC_COMP_SWAP";
     default:
         return "UNKNOWN WCQE OPCODE";
     }
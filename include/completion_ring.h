@@ -0,0 +1,150 @@
+#ifndef COMPLETION_RING_H
+#define COMPLETION_RING_H
+
+#include <infiniband/verbs.h>
+#include <linux/futex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * @name CACHE_LINE_SZ/CQ_RING_SZ/CQ_RING_SPIN/CQ_RING_PARK_NSEC
+ * @brief Completion ring geometry and waiting policy. Consumers spin
+ * CQ_RING_SPIN polls on the producer sequence before parking on a futex for
+ * at most CQ_RING_PARK_NSEC so that liveness flags are re-checked
+ */
+#define CACHE_LINE_SZ 64
+#define CQ_RING_SZ 1024
+#define CQ_RING_SPIN 4096
+#define CQ_RING_PARK_NSEC (10 * 1000 * 1000)
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpu_relax() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define cpu_relax() __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpu_relax() __asm__ __volatile__("" ::: "memory")
+#endif
+
+/**
+ * @struct cq_rec_t
+ * @brief Completion record handed from the CQ poller to a requester thread
+ */
+typedef struct cq_rec_s {
+    uint64_t wr_id;    //< Work request identifier of the completion
+    uint64_t ts_nsec;  //< CLOCK_MONOTONIC time the CQE was polled
+    uint32_t byte_len; //< Bytes received for RECV completions
+    uint32_t imm;      //< Immediate data (opcode) for RECV completions
+    uint16_t opcode;   //< enum ibv_wc_opcode
+    uint16_t status;   //< enum ibv_wc_status
+} cq_rec_t;
+
+/**
+ * @struct cq_ring_t
+ * @brief Lock-free single-producer/single-consumer ring of completion
+ * records. Producer and consumer indices live on separate cache lines and
+ * each side keeps a private copy of the other's index to avoid bouncing the
+ * shared line on every record
+ */
+typedef struct cq_ring_s {
+    /* Producer (CQ poller) owned line */
+    uint32_t head __attribute__((aligned(CACHE_LINE_SZ))); //< Futex word
+    uint32_t tail_cache; //< Producer's view of tail
+
+    /* Consumer (requester) owned line */
+    uint32_t tail __attribute__((aligned(CACHE_LINE_SZ)));
+    uint32_t head_cache; //< Consumer's view of head
+    uint32_t parked;     //< Consumer is (about to be) asleep on head
+
+    cq_rec_t rec[CQ_RING_SZ] __attribute__((aligned(CACHE_LINE_SZ)));
+} cq_ring_t;
+
+static inline uint64_t cq_ring_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec);
+}
+
+static inline void cq_ring_init(cq_ring_t *r) { memset(r, 0, sizeof(*r)); }
+
+static inline void cq_ring_rec_from_wc(cq_rec_t *rec, const struct ibv_wc *wc,
+                                       uint64_t ts_nsec) {
+    rec->wr_id = wc->wr_id;
+    rec->ts_nsec = ts_nsec;
+    rec->byte_len = wc->byte_len;
+    rec->imm = wc->imm_data;
+    rec->opcode = (uint16_t)wc->opcode;
+    rec->status = (uint16_t)wc->status;
+}
+
+// Producer: publish one record, waking the consumer only if it parked
+static inline void cq_ring_push(cq_ring_t *r, const cq_rec_t *rec) {
+    uint32_t head = r->head;
+    // Outstanding WRs are bounded below CQ_RING_SZ, so this rarely spins
+    while ((head - r->tail_cache) >= CQ_RING_SZ) {
+        r->tail_cache = __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE);
+    }
+
+    r->rec[head & (CQ_RING_SZ - 1)] = *rec;
+    __atomic_store_n(&(r->head), head + 1, __ATOMIC_RELEASE);
+    // Pairs with the fence in cq_ring_pop so a parking consumer is never lost
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(r->parked), __ATOMIC_RELAXED)) {
+        syscall(SYS_futex, &(r->head), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+    }
+}
+
+// Wake a parked consumer without publishing, e.g. on disconnect
+static inline void cq_ring_wake(cq_ring_t *r) {
+    syscall(SYS_futex, &(r->head), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+// Consumer: non-blocking pop
+static inline bool cq_ring_try_pop(cq_ring_t *r, cq_rec_t *rec) {
+    uint32_t tail = r->tail;
+    if (tail == r->head_cache) {
+        r->head_cache = __atomic_load_n(&(r->head), __ATOMIC_ACQUIRE);
+        if (tail == r->head_cache) {
+            return (false);
+        }
+    }
+
+    *rec = r->rec[tail & (CQ_RING_SZ - 1)];
+    __atomic_store_n(&(r->tail), tail + 1, __ATOMIC_RELEASE);
+    return (true);
+}
+
+// Consumer: spin, then futex-wait on head until a record arrives or
+// *alive turns false
+static inline bool cq_ring_pop(cq_ring_t *r, cq_rec_t *rec,
+                               const bool *alive) {
+    struct timespec park = {0, CQ_RING_PARK_NSEC};
+    while (1) {
+        for (int i = 0; i < CQ_RING_SPIN; i++) {
+            if (cq_ring_try_pop(r, rec)) {
+                return (true);
+            }
+            cpu_relax();
+        }
+
+        if (!__atomic_load_n(alive, __ATOMIC_ACQUIRE)) {
+            return (cq_ring_try_pop(r, rec));
+        }
+
+        __atomic_store_n(&(r->parked), 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        uint32_t head = __atomic_load_n(&(r->head), __ATOMIC_RELAXED);
+        if (head == r->tail) {
+            syscall(SYS_futex, &(r->head), FUTEX_WAIT_PRIVATE, head, &park,
+                    NULL, 0);
+        }
+        __atomic_store_n(&(r->parked), 0, __ATOMIC_RELAXED);
+    }
+
+    return (false);
+}
+
+#endif /*! COMPLETION_RING_H */
@@ -0,0 +1,90 @@
+#ifndef RDMA_ACCEPT_H
+#define RDMA_ACCEPT_H
+
+#include "client_server_shared.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @name ACCEPT_POOL_SZ/MAX_ACCEPT_WORKERS/DEFAULT_ACCEPT_WORKERS
+ * @brief Warm QPs kept ready for incoming connections, and threads that
+ * accept connection requests off the RDMA CM event thread
+ */
+#define ACCEPT_POOL_SZ 32
+#define MAX_ACCEPT_WORKERS 16
+#define DEFAULT_ACCEPT_WORKERS 2
+
+/**
+ * @name MAX_ACCEPT_SAMPLES
+ * @brief Connection request to ESTABLISHED latencies kept by the server
+ */
+#define MAX_ACCEPT_SAMPLES 65536
+
+/**
+ * @name EXTRA_QP_PSN
+ * @brief Starting PSN of both ends of the RC QPs a connection adds to the
+ * one RDMA CM connects
+ */
+#define EXTRA_QP_PSN 0
+
+/**
+ * @struct accept_pool_t
+ * @brief RC QPs created ahead of connection requests on the PD and CQs
+ * shared by every connection of a server. Pooled QPs stay in RESET until a
+ * request takes one
+ */
+typedef struct accept_pool_s {
+    pthread_mutex_t mtx;               //< Guards qp, nqp and the counters
+    struct ibv_pd *pd;                 //< PD every QP is created on
+    struct ibv_qp_init_attr attr;      //< Caps and CQs of every QP
+    bool ex;                           //< QPs allow the rdma_post_ex ops
+    struct ibv_qp *qp[ACCEPT_POOL_SZ]; //< Warm QPs
+    uint32_t nqp;                      //< Number of valid entries in qp
+    uint64_t hits;                     //< Requests handed a warm QP
+    uint64_t misses;                   //< Requests that created their own
+} accept_pool_t;
+
+/**
+ * @brief Set up an empty pool of QPs created on pd with attr, extended QPs
+ * if ex
+ */
+int accept_pool_init(accept_pool_t *pool, struct ibv_pd *pd,
+                     const struct ibv_qp_init_attr *attr, bool ex);
+
+/**
+ * @brief Create QPs until the pool holds ACCEPT_POOL_SZ of them. QPs are
+ * created outside the pool lock, so requests are served meanwhile. Returns
+ * the number of QPs added or -1
+ */
+int accept_pool_fill(accept_pool_t *pool);
+
+/**
+ * @brief Take a warm QP, or create one if the pool ran dry
+ */
+struct ibv_qp *accept_pool_get(accept_pool_t *pool);
+
+/**
+ * @brief Destroy the QPs left in the pool
+ */
+void accept_pool_destroy(accept_pool_t *pool);
+
+/**
+ * @brief Move an RC QP created outside RDMA CM through INIT, RTR and RTS
+ * on the path of id, which carries a connection request, as rdma_accept
+ * would for a QP of its own. responder_resources and initiator_depth are
+ * the RDMA READ/atomic depths accepted for the connection
+ */
+int accept_connect_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                      uint8_t responder_resources, uint8_t initiator_depth);
+
+/**
+ * @brief Connect an extra RC QP of the connection of id, client or server
+ * side, to peer QP dest_qpn. It takes the path of id and EXTRA_QP_PSN in
+ * both directions; extra QPs stream SENDs and RDMA_WRITEs only, so they get
+ * no RDMA READ/atomic depth
+ */
+int accept_connect_extra_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                            uint32_t dest_qpn);
+
+#endif /*! RDMA_ACCEPT_H */
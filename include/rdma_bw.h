@@ -0,0 +1,158 @@
+#ifndef RDMA_BW_H
+#define RDMA_BW_H
+
+#include "client_server_shared.h"
+#include "completion_ring.h"
+#include "rdma_stats.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @name MAX_BW_QDEPTH
+ * @brief Upper bound of outstanding streamed WRs per direction, whatever the
+ * number of QPs they are spread over. The receiver keeps twice as many recvs
+ * posted, so both fit CQ_RING_SZ together; rounds deeper than the queues
+ * sized at connect are refused, the QPs of a connection share CQs sized for
+ * one
+ */
+#define MAX_BW_QDEPTH 128
+
+/**
+ * @name BW_WR_FLAG/BW_WR_FIN/BW_WR_QP_SHIFT
+ * @brief wr_id bits of streamed WRs. CQ pollers only hand SEND, RDMA_WRITE
+ * and RDMA_READ completions to the ring when BW_WR_FLAG is set; BW_WR_FIN
+ * marks the end of stream message and the bits from BW_WR_QP_SHIFT the QP
+ * of the round the WR was posted on
+ */
+#define BW_WR_FLAG (1ULL << 31)
+#define BW_WR_FIN (1ULL << 30)
+#define BW_WR_QP_SHIFT 24
+#define BW_WR_QP_MASK (BW_WR_FIN - (1ULL << BW_WR_QP_SHIFT))
+#define BW_WR_SEQ_MASK ((1ULL << BW_WR_QP_SHIFT) - 1)
+
+/**
+ * @struct bw_cfg_t
+ * @brief Bandwidth round parameters, sent by the client with OPC_BW_START
+ * and no larger than the RDMA_MSG_HDR_SZ header slot the server scatters
+ * them into
+ */
+typedef struct bw_cfg_s {
+    uint32_t opcode;        //< OPC_SEND_ONLY or OPC_RDMA_WRITE
+    uint32_t bidir;         //< Server streams back at the same time
+    uint32_t qdepth;        //< Outstanding WRs per direction
+    uint32_t msg_sz;        //< Payload bytes per message
+    uint64_t warmup;        //< Messages sent before the timed window
+    uint64_t iterations;    //< Timed messages, if duration_nsec is 0
+    uint64_t duration_nsec; //< Length of the timed window
+    rdma_rbuf_t sink;       //< Client buffer the server RDMA_WRITEs into
+    uint32_t nqps;          //< QPs of the connection streamed over, 0 = 1
+    uint32_t stripe;        //< Messages are split across the QPs rather
+                            //< than dealt out whole, round-robin
+} __attribute__((packed)) bw_cfg_t;
+
+/**
+ * @struct bw_result_t
+ * @brief Timed window of one stream direction, also the FIN payload
+ */
+typedef struct bw_result_s {
+    uint64_t messages;     //< Messages completed within the window
+    uint64_t bytes;        //< Payload bytes completed within the window
+    uint64_t elapsed_nsec; //< First to last completion of the window
+} __attribute__((packed)) bw_result_t;
+
+/**
+ * @struct bw_stream_t
+ * @brief One side of a bandwidth round: the QPs, the completion ring they
+ * are fed from and the registered buffers data and FIN messages use
+ */
+typedef struct bw_stream_s {
+    struct ibv_qp *qp[MAX_CONN_QPS]; //< QPs to stream on, cfg.nqps of them.
+                                     //< START and FIN go over the first
+    struct ibv_qp_ex *qpx[MAX_CONN_QPS]; //< Data posts through ibv_wr_*
+                                         //< on qp[q] if set
+    cq_ring_t *ring;     //< Completions of the QPs routed to this thread
+    const bool *alive;   //< Connection liveness flag
+    uint64_t wr_id_base; //< Routing bits of wr_id, BW_WR_FLAG included
+    void *send_buf;      //< Registered source of data messages
+    uint32_t send_lkey;  //< lkey of send_buf
+    struct ibv_sge recv_sge[2]; //< Layout of every posted recv
+    int recv_nsge;              //< Valid entries of recv_sge
+    void *fin_buf;       //< Registered source of the FIN payload
+    uint32_t fin_lkey;   //< lkey of fin_buf
+    rdma_rbuf_t sink;    //< Peer buffer for RDMA_WRITE streams
+    bw_cfg_t cfg;        //< Round parameters
+    bool tx;             //< This side streams data
+    bool peer_tx;        //< The peer streams data to this side
+    bool fin_after_rx;   //< Hold the FIN back until the peer's FIN arrived
+    uint64_t wr_seq;     //< Next wr_id sequence
+    uint32_t rx_posted[MAX_CONN_QPS]; //< Recvs posted on each QP and not
+                                      //< consumed yet
+    rdma_stats_t *stats; //< Counters of the streaming thread
+} bw_stream_t;
+
+/**
+ * @brief Number of QPs a round streams over
+ */
+static inline uint32_t bw_nqps(const bw_cfg_t *cfg) {
+    return ((cfg->nqps) ? (cfg->nqps) : (1));
+}
+
+/**
+ * @brief Outstanding WRs per QP: qdepth is shared out between the QPs, so
+ * a sweep over the QP count keeps the same number of WRs in flight
+ */
+static inline uint32_t bw_qp_depth(const bw_cfg_t *cfg) {
+    return (cfg->qdepth / bw_nqps(cfg));
+}
+
+/**
+ * @brief Number of recvs a side needs posted on QP q for a round, excluding
+ * the OPC_BW_START messages
+ */
+static inline uint32_t bw_rx_depth(const bw_cfg_t *cfg, bool peer_tx,
+                                   uint32_t q) {
+    // Data recvs for SEND streams plus one for the FIN on the first QP
+    return (((peer_tx && cfg->opcode == OPC_SEND_ONLY)
+                 ? (2 * bw_qp_depth(cfg))
+                 : (0)) +
+            ((q == 0) ? (1) : (0)));
+}
+
+/**
+ * @brief Number of recvs a side needs posted for a round over all its QPs,
+ * which complete on the same receive CQ
+ */
+static inline uint32_t bw_rx_total(const bw_cfg_t *cfg, bool peer_tx) {
+    uint32_t n = 0;
+    for (uint32_t q = 0; q < bw_nqps(cfg); q++) {
+        n += bw_rx_depth(cfg, peer_tx, q);
+    }
+
+    return (n);
+}
+
+/**
+ * @brief Post recvs of s->recv_sge until every QP of the round holds
+ * bw_rx_depth of them, and extra more on the first QP for messages outside
+ * of the stream. Recvs left over by a round stay posted and count towards
+ * the next one, so the owner of a QP must post its own recvs with the same
+ * layout
+ */
+int bw_post_recvs(bw_stream_t *s, uint32_t extra);
+
+/**
+ * @brief Pop completions until the peer's OPC_BW_START arrives
+ */
+int bw_wait_start(bw_stream_t *s);
+
+/**
+ * @brief Run one round: stream cfg.warmup + timed messages if s->tx, count
+ * the peer's stream if s->peer_tx, and exchange FINs. Both sides send a FIN
+ * with their tx totals; the side with fin_after_rx sends it last, so the
+ * round is over on both sides once the other side has seen it. Over several
+ * QPs, a message is complete once every chunk of it is, and a SEND stream
+ * is counted until the messages the FIN announces all arrived
+ */
+int bw_stream_run(bw_stream_t *s, bw_result_t *tx, bw_result_t *rx);
+
+#endif /*! RDMA_BW_H */
@@ -1,36 +1,117 @@
 #ifndef RDMA_CLIENT_LIB_H
 #define RDMA_CLIENT_LIB_H
 
+#include "client_server_shared.h"
+#include "completion_ring.h"
+#include "rdma_bw.h"
+#include "rdma_core.h"
+#include "rdma_fiber.h"
+#include "rdma_shm.h"
+#include "rdma_tcp.h"
+#include "rdma_stats.h"
 #include <netinet/in.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 
-#define MAX_SEND_WR 1024
-#define MAX_RECV_WR 512
-#define MAX_CQE 512
+#define MAX_USER_MR 8
+#define MAX_CLIENT_DP 256
 
 /**
- * @struct thread_fn_t
- * @brief Client Thread Function Type
+ * @name RECONNECT_BACKOFF_MIN_NSEC/RECONNECT_BACKOFF_MAX_NSEC
+ * @brief Wait before the second connect attempt of reconnect_client, doubled
+ * after every further failed attempt up to the max
  */
-typedef void *(*thread_fn_t)(void *);
+#define RECONNECT_BACKOFF_MIN_NSEC 10000000ULL
+#define RECONNECT_BACKOFF_MAX_NSEC 1000000000ULL
+
+/**
+ * @name MAX_CLIENT_OUTAGES
+ * @brief Outages whose duration, failure to first completed request on the
+ * new session, is kept in the client context
+ */
+#define MAX_CLIENT_OUTAGES 64
+
+/**
+ * @name CLIENT_EVT_POLL_MSEC
+ * @brief Longest the event thread blocks on the CM channel before it checks
+ * whether destroy_client asked it to exit
+ */
+#define CLIENT_EVT_POLL_MSEC 100
+
+/**
+ * @struct client_dp_t
+ * @brief Per requester thread hot datapath state. Everything a request
+ * touches is copied here at attach time and the block, completion ring
+ * included, is cache line aligned, so a requester never writes a line that
+ * the CQ poller or another requester writes
+ */
+typedef struct client_dp_s {
+    struct ibv_qp *qp;    //< QP requests are posted on
+    struct ibv_qp_ex *qpx; //< qp for the ibv_wr_* calls, NULL = ibv_post_send
+    struct ibv_qp *xrc_qp; //< XRC_SEND QP requests go out on instead, or NULL
+    struct ibv_qp_ex *xrc_qpx; //< xrc_qp for the ibv_wr_* calls, or NULL
+    uint32_t xrc_srqn;     //< Server XRC SRQ requests are sent to
+    void *send_buf;       //< RDMA compliant send buf
+    void *recv_buf;       //< RDMA compliant recv buf
+    void *bounce_buf;     //< RDMA compliant buf to linearize iovecs
+    uint32_t send_lkey;   //< lkey of send_buf
+    uint32_t recv_lkey;   //< lkey of recv_buf
+    uint32_t bounce_lkey; //< lkey of bounce_buf
+    uint32_t idx;         //< Index of this block, upper 32 bits of wr_id
+    pthread_t owner;      //< Requester thread the block is attached to
+    uint32_t wr_seq;      //< Next wr_id sequence, lower 32 bits of wr_id
+    uint32_t gen;         //< Session the QP fields above belong to
+    int max_sge;          //< SGEs per WR, capped by device max_sge
+    bool quiet;           //< Skip the per-request latency printf
+    uint64_t last_rtt_nsec; //< Latency of the last completed round trip
+    uint32_t rx_posted;     //< Stream/open-loop recvs left posted
+    void *wrpc_buf;         //< Write RPC ring, NULL until first used
+    uint32_t wrpc_lkey;     //< lkey of wrpc_buf
+    uint32_t wrpc_rkey;     //< rkey of wrpc_buf, the responses land there
+    uint32_t wrpc_seq;      //< seq of the last write RPC of this thread
+    uint32_t wrpc_unsig;    //< Write RPCs posted since a signaled one
+    rdma_rbuf_t wrpc_ring;  //< Server ring of write RPC requests
+    rdma_stats_t *stats;    //< Counters of this thread
+    cq_ring_t ring;         //< Completions routed to this thread
+} __attribute__((aligned(CACHE_LINE_SZ))) client_dp_t;
 
 /**
  * @struct client_ctx_t
  * @brief Client Connection Context Info
  */
 typedef struct client_ctx_s {
+    /* Read-mostly state shared by the CQ poller and requesters */
+    struct ibv_cq *scq;             //< Verbs Send CQ
+    struct ibv_cq *rcq;             //< Verbs Recv CQ, scq unless split
+    bool is_connected;              //< RDMA Client-Server Connected
+    uint32_t ndp;                   //< Number of requester threads attached
+    client_dp_t *dp[MAX_CLIENT_DP]; //< Per requester thread datapath state
+    uint32_t gen;                   //< Session, bumped by every reconnect
+    uint32_t qpn;                   //< RC QP of the current session
+    uint32_t xrc_qpn;               //< XRC_SEND QP of the current session
+    uint32_t nqps;                  //< RC QPs, cm_id->qp and extra_qp
+    struct ibv_qp *extra_qp[MAX_CONN_QPS - 1]; //< Extra QPs of bw rounds
+    uint64_t resume_nsec; //< Outage start until a request completes again
+
     /* RDMA Connection Specific Attributes */
     struct rdma_cm_id *cm_id;      //< RDMA CM Core Identifier
     struct rdma_cm_id *addr_id;    //< RDMA CM Address Identifier
     struct rdma_cm_id *connect_id; //< RDMA CM Connect Identifier
+    struct sockaddr_storage src_addr; //< Bound source, kept for reconnects
+    struct sockaddr_storage dst_addr; //< Server, kept for reconnects
+    bool xrc;                         //< Requests go over an XRC_SEND QP
+    int cm_error; //< RDMA CM failure event of the connect in progress, or 0
+    msg_xport_t *xport; //< Shared memory or TCP instead of verbs, or NULL
     struct ibv_context *verbs;     //< Verbs Context
     struct ibv_pd *pd;             //< Verbs Protection Domain
-    struct ibv_cq *scq;            //< Verbs Send CQ
-    struct ibv_cq *rcq;            //< Verbs Recv CQ
+    int max_sge;                   //< SGEs per WR, capped by device max_sge
+    rdma_qp_cfg_t qp_cfg;          //< Queue sizing resolved against device
+    bool quiet;                    //< Skip the per-request latency printf
+    bool lock_bufs; //< Pre-fault and mlock buffers of prepare/register
 
     /* Event Monitor Specific attributes */
     struct rdma_event_channel *channel; //< RDMA Event Channel
@@ -38,13 +119,27 @@ typedef struct client_ctx_s {
     thread_fn_t evt_fn;                 //< RDMA Event Thread Function Callback
     pthread_mutex_t evt_mtx;            //< RDMA Event Thread Sync Mtx
     pthread_cond_t evt_cv;              //< RDMA Event Thread Sync Cv
-    bool is_connected;                  //< RDMA Client-Server Connected
+    bool evt_stop;                      //< Event thread asked to exit
+    bool evt_exited;                    //< Event thread gone, under evt_mtx
+    server_priv_t server_priv;          //< Buffers advertised by the server
+    struct ibv_qp *xrc_qp; //< XRC_SEND QP of send requests, or NULL for RC
+    uint32_t extra_rx_posted[MAX_CONN_QPS - 1]; //< bw recvs left on extra_qp
 
     /* Poll Monitor Specific attributes */
     pthread_t wcq_thread;
     thread_fn_t wcq_fn;
-    pthread_mutex_t wcq_mtx;
-    pthread_cond_t wcq_cv;
+    bool wcq_running; //< Poller of the session not exited, under evt_mtx
+    rdma_stats_set_t stats;   //< Counters of the poller and requesters
+    rdma_stats_t *poll_stats; //< Counters of the poller, every session
+
+    /* Session layer, see reconnect_client */
+    pthread_mutex_t sess_mtx;         //< Serializes reconnects
+    struct rdma_cm_id *retired_id;    //< Previous session, QP in error state
+    struct ibv_qp *retired_xrc_qp;    //< XRC_SEND QP of the previous session
+    uint64_t fault_nsec;              //< First failure seen, 0 while healthy
+    uint32_t reconnects;              //< Sessions re-established
+    uint32_t noutages;                //< Outages measured, all of them
+    uint64_t outage_nsec[MAX_CLIENT_OUTAGES]; //< First MAX_CLIENT_OUTAGES
 
     /* Memory to be registered and used by client-server communication */
     void *send_client_buf;      //< RDMA compliant send buf
@@ -53,16 +148,82 @@ typedef struct client_ctx_s {
     size_t recv_client_buf_sz;  //< size of recv for send buf
     struct ibv_mr *send_buf_mr; //< RDMA compliant send buf mr
     struct ibv_mr *recv_buf_mr; //< RDMA compliant recv buf mr
-    bool rtt_done[MAX_SEND_WR]; //< Condition to be set if a single send/recv
-                                // round-trip is done on client
+    void *bounce_client_buf;    //< RDMA compliant buf to linearize iovecs
+    struct ibv_mr *bounce_buf_mr;       //< RDMA compliant bounce buf mr
+    void *wrpc_client_buf;      //< Write RPC responses, then trailers sent
+    struct ibv_mr *wrpc_buf_mr; //< RDMA compliant write RPC buf mr
+    struct ibv_mr *user_mr[MAX_USER_MR]; //< Application registered buf mrs
+    int nuser_mr;                        //< Number of valid user_mr entries
+    struct ibv_mr *implicit_mr; //< Whole address space MR of MR_MODE_IMPLICIT
 } client_ctx_t;
 
+/**
+ * @struct client_storm_t
+ * @brief Connection storm state of one thread. The PD and CQ are created
+ * with the first connection and shared by the later ones
+ */
+typedef struct client_storm_s {
+    struct ibv_context *verbs; //< Device of the first connection
+    struct ibv_pd *pd;         //< PD of every storm QP
+    struct ibv_cq *cq;         //< CQ of every storm QP, never polled
+    bool xrc;                  //< Pair an XRC_SEND QP with every RC QP
+    uint64_t last_nsec;        //< Address resolution to ESTABLISHED
+} client_storm_t;
+
 /**
  * @brief Given a source and target IP address, setup & connect a client
- * control plane to a target server
+ * control plane to a target server over transport (TRANSPORT_RC/XRC/TCP/
+ * URING). With TRANSPORT_XRC, send requests travel over an XRC_SEND QP into
+ * a shared receive queue of the server while responses, atomics and
+ * bandwidth rounds keep the RC QP. qp_cfg sizes the queues and CQs, NULL for
+ * the defaults; its nqps adds RC QPs bandwidth rounds can stream over, RC
+ * connections only. With shm (SHM_MODE_*) an RC server on this host is reached
+ * over its shared-memory segment instead. TCP and URING connect a kernel
+ * TCP socket, driven by plain socket calls or by io_uring. Neither involves
+ * a device, and both carry SEND requests, open-loop requests and one-way
+ * SEND streams of one requester thread, messages of up to xport->max_msg
+ * bytes
  */
 client_ctx_t *setup_client(struct sockaddr *src_addr,
-                           struct sockaddr *dst_addr);
+                           struct sockaddr *dst_addr, int transport,
+                           const rdma_qp_cfg_t *qp_cfg, int shm);
+
+/**
+ * @brief Disconnect from the server and release everything setup_client and
+ * prepare_client_data gave ctx, ctx included. Every thread attached to ctx
+ * other than the caller must have exited
+ */
+void destroy_client(client_ctx_t *ctx);
+
+/**
+ * @brief Replace the session the calling thread failed on: fail what is in
+ * flight, then connect a new QP to the same server on the same PD and CQs,
+ * so registered buffers stay valid, retrying up to max_attempts times with
+ * exponential backoff. Returns 0 at once if another thread already did so.
+ * The outage lasts until the next request completes and is recorded in
+ * ctx->outage_nsec. Stream and open-loop recvs are not re-posted
+ */
+int reconnect_client(client_ctx_t *ctx, int max_attempts);
+
+/**
+ * @brief Open one connection to the server and close it again, the minimal
+ * connection of a connection storm: one WR deep QP, no buffers, no event
+ * thread. The time to ESTABLISHED is left in st->last_nsec
+ */
+int storm_client_connect(client_storm_t *st, struct sockaddr *src_addr,
+                         struct sockaddr *dst_addr);
+
+/**
+ * @brief Release the PD and CQ of a connection storm thread
+ */
+void storm_client_destroy(client_storm_t *st);
+
+/**
+ * @brief Attach the calling thread to its own datapath state of a prepared
+ * client context. Request APIs attach implicitly on first use, and pick up a
+ * session replaced by reconnect_client
+ */
+client_dp_t *attach_client_thread(client_ctx_t *ctx);
 
 /**
  * @brief Process client response received
@@ -75,7 +236,104 @@ int process_client_response(client_ctx_t *ctx, int opc, size_t msg_sz);
 int send_client_request(client_ctx_t *ctx, int opc, size_t msg_sz);
 
 /**
- * @brief Prepare client request & response to be send/recv
+ * @brief Send client request gathered from siov to server and scatter the
+ * response into riov. Every iovec must lie within a buffer registered by
+ * prepare_client_data or register_client_buf. If linearize is set, or siov
+ * has more entries than the device supports, the request is copied into the
+ * bounce buffer and sent with a single SGE. OPC_RDMA_WRITE writes the
+ * request into the server sink instead, and the response is a notify with
+ * no payload
+ */
+int send_client_request_iov(client_ctx_t *ctx, int opc,
+                            const struct iovec *siov, int siovcnt,
+                            const struct iovec *riov, int riovcnt,
+                            bool linearize);
+
+/**
+ * @brief Issue a fetch-and-add (OPC_ATOMIC_FADD) or compare-and-swap
+ * (OPC_ATOMIC_CAS) on the server counter at index idx and wait for its
+ * completion. For FADD, compare_add is the addend; for CAS, compare_add is
+ * the expected value and swap the new one. The prior value is returned in
+ * old. Safe to call from multiple threads sharing the connection
+ */
+int send_client_atomic(client_ctx_t *ctx, int opc, uint32_t idx,
+                       uint64_t compare_add, uint64_t swap, uint64_t *old);
+
+/**
+ * @brief Switch the connection to write-based RPCs. The server stops taking
+ * SEND requests and polls a ring of request slots instead, one per requester
+ * thread, which send_client_request(OPC_WRITE_RPC) writes into; the echo is
+ * written back into a response slot of the thread, polled the same way. No
+ * recv WR or recv completion is involved on either side. Up to WRPC_SLOTS
+ * threads of up to WRPC_MAX_MSG bytes; none may send other requests until
+ * stop_client_wrpc
+ */
+int start_client_wrpc(client_ctx_t *ctx);
+
+/**
+ * @brief Hand the connection back to SEND requests
+ */
+int stop_client_wrpc(client_ctx_t *ctx);
+
+/**
+ * @brief Run one bandwidth round with the server: stream cfg->opcode
+ * messages for cfg->iterations or cfg->duration_nsec after cfg->warmup
+ * untimed ones, and with cfg->bidir count the server's stream at the same
+ * time. cfg->sink is filled in with the client buffer the server writes to.
+ * cfg->nqps of the connection's QPs are streamed over, with cfg->stripe
+ * messages are split across them. Stream recvs must not be mixed with
+ * send_client_request on a thread, nor rounds over several QPs run by more
+ * than one thread
+ */
+int stream_client_bw(client_ctx_t *ctx, bw_cfg_t *cfg, bw_result_t *tx,
+                     bw_result_t *rx);
+
+/**
+ * @brief Keep n response recvs of the calling thread posted for
+ * post_client_request. Like stream recvs, they must not be mixed with
+ * send_client_request on a thread
+ */
+int post_client_recvs(client_ctx_t *ctx, uint32_t n);
+
+/**
+ * @brief Post a request of msg_sz bytes from the send buffer without waiting
+ * for its response. Responses are picked up with poll_client_response.
+ * OPC_RDMA_WRITE and OPC_RDMA_READ target the server sink without involving
+ * the server: their own completion stands for the response
+ */
+int post_client_request(client_ctx_t *ctx, int opc, size_t msg_sz);
+
+/**
+ * @brief Hand out the next response of the calling thread without blocking:
+ * a SEND response in request order or a one-sided completion in posting
+ * order, told apart by rec->opcode. Returns 1 with rec filled in, 0 if none
+ * arrived yet and -1 on failure or disconnect
+ */
+int poll_client_response(client_ctx_t *ctx, cq_rec_t *rec);
+
+/**
+ * @brief Run the fibers spawned on s on the calling thread until all of
+ * them returned. A request API called from a fiber posts its WRs, then
+ * yields to the other fibers until its own wr_id completes instead of
+ * blocking the thread, so sequential code keeps one request in flight per
+ * fiber. Up to the send and recv queue depths of fibers; they share the
+ * registered buffers of the thread. Atomics and write RPCs are refused
+ */
+int run_client_fibers(client_ctx_t *ctx, fiber_sched_t *s);
+
+/**
+ * @brief Register an application buffer so that it can be referenced by the
+ * iovecs of send_client_request_iov. Over shared memory any buffer can be
+ * and NULL is returned
+ */
+struct ibv_mr *register_client_buf(client_ctx_t *ctx, void *buf, size_t len);
+
+/**
+ * @brief Prepare client request & response to be send/recv. With
+ * ctx->lock_bufs set, buffers are pre-faulted and mlock'd before
+ * registration so that no page fault lands in a timed loop. Buffers are
+ * registered as ctx->qp_cfg.mr_mode asks, ODP ones faulted in by the device
+ * on first touch unless prefetched
  */
 int prepare_client_data(client_ctx_t *ctx, int opc);
 
@@ -0,0 +1,216 @@
+#ifndef RDMA_CORE_H
+#define RDMA_CORE_H
+
+#include "client_server_shared.h"
+#include "completion_ring.h"
+#include "rdma_bw.h"
+#include "rdma_stats.h"
+#include <infiniband/verbs.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @name RDMA_QP_EX_SEND_OPS
+ * @brief Send ops extended QPs are created with: those of rdma_wr_fn, and
+ * the atomics send_client_atomic posts through ibv_wr_atomic_*
+ */
+#define RDMA_QP_EX_SEND_OPS                                                    \
+    (IBV_QP_EX_WITH_SEND | IBV_QP_EX_WITH_SEND_WITH_IMM |                      \
+     IBV_QP_EX_WITH_RDMA_WRITE | IBV_QP_EX_WITH_RDMA_WRITE_WITH_IMM |          \
+     IBV_QP_EX_WITH_RDMA_READ | IBV_QP_EX_WITH_ATOMIC_FETCH_AND_ADD |         \
+     IBV_QP_EX_WITH_ATOMIC_CMP_AND_SWP)
+
+/**
+ * @struct thread_fn_t
+ * @brief Thread Function Type of the event, poller and worker threads
+ */
+typedef void *(*thread_fn_t)(void *);
+
+/**
+ * @struct rdma_cq_poller_t
+ * @brief CQ poller state shared by both endpoints: the CQs to drain, in
+ * turns when split, and the counters of the polling thread
+ */
+typedef struct rdma_cq_poller_s {
+    struct ibv_cq *scq;  //< Send CQ, also the recv CQ unless split
+    struct ibv_cq *rcq;  //< Recv CQ, scq unless split
+    bool rx_turn;        //< rcq is polled next
+    bool ex;             //< CQs of ibv_create_cq_ex, see rdma_create_cqs
+    rdma_stats_t *stats; //< Counters of the polling thread
+} rdma_cq_poller_t;
+
+/**
+ * @brief Start fn(arg) on a detached thread
+ */
+int rdma_start_thread(pthread_t *thread, thread_fn_t fn, void *arg);
+
+/**
+ * @brief Create the send CQ of cfg->cqe entries on verbs, and a recv CQ of
+ * the same size if cfg->split_cq, else *rcq = *scq. With cfg->ex_verbs
+ * they are extended CQs reporting only byte_len, imm_data and qp_num past
+ * the fixed fields; *scq and *rcq are their ibv_cq_ex_to_cq
+ */
+int rdma_create_cqs(struct ibv_context *verbs, const rdma_qp_cfg_t *cfg,
+                    struct ibv_cq **scq, struct ibv_cq **rcq);
+
+/**
+ * @brief Destroy CQs of rdma_create_cqs, either may be NULL
+ */
+void rdma_destroy_cqs(struct ibv_cq *scq, struct ibv_cq *rcq);
+
+/**
+ * @brief Check that verbs pages RC SEND, RECV and the IBV_ODP_SUPPORT_* ops
+ * on demand, and implicitly for MR_MODE_IMPLICIT, through
+ * ibv_query_device_ex. MR_MODE_PINNED always passes
+ */
+int rdma_check_mr_mode(struct ibv_context *verbs, int mr_mode, uint32_t ops);
+
+/**
+ * @brief RC ops verbs pages on demand, IBV_ODP_SUPPORT_* bits, 0 if it
+ * has no ODP
+ */
+uint32_t rdma_odp_ops(struct ibv_context *verbs);
+
+/**
+ * @brief Register len bytes at buf on pd as cfg->mr_mode asks. In
+ * MR_MODE_IMPLICIT every buffer gets *implicit, registered over the whole
+ * address space on first use. ODP buffers are prefetched for write if
+ * cfg->mr_prefetch
+ */
+struct ibv_mr *rdma_reg_buf(struct ibv_pd *pd, const rdma_qp_cfg_t *cfg,
+                            struct ibv_mr **implicit, void *buf, size_t len);
+
+/**
+ * @brief Deregister an MR of rdma_reg_buf, unless it is implicit, which its
+ * owner deregisters once every buffer is gone
+ */
+void rdma_dereg_buf(struct ibv_mr *mr, const struct ibv_mr *implicit);
+
+/**
+ * @brief Poll up to CQ_POLL_BATCH completions into wc from the CQ whose
+ * turn it is and count them. Returns the number of completions or a
+ * negative ibv_poll_cq error. Extended CQs are read with ibv_start_poll and
+ * ibv_next_poll, which fill wr_id, status, opcode, byte_len, imm_data,
+ * wc_flags and qp_num only
+ */
+int rdma_cq_poll(rdma_cq_poller_t *p, struct ibv_wc *wc);
+
+/**
+ * @brief Create an RC QP of attr on pd, through ibv_create_qp_ex allowing
+ * the send ops of rdma_post_ex if ex, else ibv_create_qp
+ */
+struct ibv_qp *rdma_create_rc_qp(struct ibv_pd *pd,
+                                 struct ibv_qp_init_attr *attr, bool ex);
+
+/**
+ * @brief Extended attributes of attr on pd, allowing the send ops of
+ * rdma_post_ex, for the creators taking an ibv_qp_init_attr_ex
+ */
+void rdma_qp_attr_ex(struct ibv_pd *pd, const struct ibv_qp_init_attr *attr,
+                     struct ibv_qp_init_attr_ex *ex);
+
+/**
+ * @struct rdma_wr_fn_t
+ * @brief ibv_wr_* builder of one send opcode, taking the remote buffer and
+ * immediate it needs and ignoring the others
+ */
+typedef void (*rdma_wr_fn_t)(struct ibv_qp_ex *qpx, uint32_t rkey,
+                             uint64_t raddr, uint32_t imm);
+
+static inline void rdma_wr_send(struct ibv_qp_ex *qpx, uint32_t rkey,
+                                uint64_t raddr, uint32_t imm) {
+    ibv_wr_send(qpx);
+}
+
+static inline void rdma_wr_send_imm(struct ibv_qp_ex *qpx, uint32_t rkey,
+                                    uint64_t raddr, uint32_t imm) {
+    ibv_wr_send_imm(qpx, imm);
+}
+
+static inline void rdma_wr_write(struct ibv_qp_ex *qpx, uint32_t rkey,
+                                 uint64_t raddr, uint32_t imm) {
+    ibv_wr_rdma_write(qpx, rkey, raddr);
+}
+
+static inline void rdma_wr_write_imm(struct ibv_qp_ex *qpx, uint32_t rkey,
+                                     uint64_t raddr, uint32_t imm) {
+    ibv_wr_rdma_write_imm(qpx, rkey, raddr, imm);
+}
+
+static inline void rdma_wr_read(struct ibv_qp_ex *qpx, uint32_t rkey,
+                                uint64_t raddr, uint32_t imm) {
+    ibv_wr_rdma_read(qpx, rkey, raddr);
+}
+
+/**
+ * @brief Builder of SEND, SEND_WITH_IMM, RDMA_WRITE, RDMA_WRITE_WITH_IMM or
+ * RDMA_READ, NULL for other opcodes. Resolved once per QP or stream, so
+ * that posts do not switch on the opcode
+ */
+static inline rdma_wr_fn_t rdma_wr_fn(enum ibv_wr_opcode opc) {
+    switch (opc) {
+    case IBV_WR_SEND:
+        return (rdma_wr_send);
+    case IBV_WR_SEND_WITH_IMM:
+        return (rdma_wr_send_imm);
+    case IBV_WR_RDMA_WRITE:
+        return (rdma_wr_write);
+    case IBV_WR_RDMA_WRITE_WITH_IMM:
+        return (rdma_wr_write_imm);
+    case IBV_WR_RDMA_READ:
+        return (rdma_wr_read);
+    default:
+        return (NULL);
+    }
+}
+
+/**
+ * @brief Post one WR of builder wr and nsge SGEs through the ibv_wr_* calls
+ * of qpx, with no ibv_send_wr walked by the provider. imm is carried as
+ * is, like ibv_send_wr.imm_data. Returns 0 or an errno
+ */
+static inline int rdma_post_ex(struct ibv_qp_ex *qpx, rdma_wr_fn_t wr,
+                               uint64_t wr_id, unsigned int flags,
+                               uint32_t imm, uint64_t raddr, uint32_t rkey,
+                               const struct ibv_sge *sge, size_t nsge) {
+    ibv_wr_start(qpx);
+    qpx->wr_id = wr_id;
+    qpx->wr_flags = flags;
+    wr(qpx, rkey, raddr, imm);
+    if (nsge == 1) {
+        ibv_wr_set_sge(qpx, sge->lkey, sge->addr, sge->length);
+    } else {
+        ibv_wr_set_sge_list(qpx, nsge, sge);
+    }
+
+    return (ibv_wr_complete(qpx));
+}
+
+/**
+ * @brief A completion some thread waits for: errors, whose opcode is not
+ * valid, receives, atomics, and the sends and reads flagged BW_WR_FLAG by
+ * bandwidth streams and pipelined requests. Other send completions only
+ * keep the SQ drained
+ */
+static inline bool rdma_wc_routed(const struct ibv_wc *wc) {
+    if (wc->status != IBV_WC_SUCCESS) {
+        return (true);
+    }
+
+    switch (wc->opcode) {
+    case IBV_WC_RECV:
+    case IBV_WC_RECV_RDMA_WITH_IMM:
+    case IBV_WC_FETCH_ADD:
+    case IBV_WC_COMP_SWAP:
+        return (true);
+    case IBV_WC_RDMA_WRITE:
+    case IBV_WC_RDMA_READ:
+    case IBV_WC_SEND:
+        return ((wc->wr_id & BW_WR_FLAG) != 0);
+    default:
+        return (false);
+    }
+}
+
+#endif /*! RDMA_CORE_H */
@@ -0,0 +1,107 @@
+#ifndef RDMA_FIBER_H
+#define RDMA_FIBER_H
+
+#include "completion_ring.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <ucontext.h>
+
+/**
+ * @name MAX_FIBERS/FIBER_STACK_SZ
+ * @brief Fibers a scheduler runs at most, as many as the completion ring of
+ * their thread can hold records for, and the default stack of each, a guard
+ * page included
+ */
+#define MAX_FIBERS CQ_RING_SZ
+#define FIBER_STACK_SZ (64 * 1024)
+
+struct fiber_sched_s;
+
+/**
+ * @struct fiber_t
+ * @brief User-level thread of a scheduler: its saved context and stack, and
+ * the completion it is parked on
+ */
+typedef struct fiber_s {
+    ucontext_t uc;                //< Saved context while not running
+    void *stack;                  //< mmap'd stack, guard page at the bottom
+    void (*fn)(void *arg);        //< Body, the fiber is done once it returns
+    void *arg;                    //< Argument of fn
+    struct fiber_sched_s *sched;  //< Scheduler the fiber belongs to
+    uint64_t key;                 //< wr_id waited on, if waiting
+    bool waiting;                 //< Parked in the wait table
+    bool aborted;                 //< Woken without its completion
+    bool done;                    //< fn returned
+    cq_rec_t rec;                 //< Completion the fiber was woken with
+    struct fiber_s *next;         //< Next fiber of the wait table bucket
+} fiber_t;
+
+/**
+ * @brief Called by fiber_sched_run when no fiber is runnable. Blocks until
+ * at least one completion arrived and hands them to fiber_wake; non-zero
+ * aborts every waiting fiber
+ */
+typedef int (*fiber_poll_fn)(struct fiber_sched_s *s, void *arg);
+
+/**
+ * @struct fiber_sched_t
+ * @brief Cooperative scheduler of the fibers of one thread. A fiber runs
+ * until it waits on a wr_id; the scheduler then resumes the next runnable
+ * one, and polls for completions once none is left. Nothing is shared with
+ * another thread, so nothing is locked
+ */
+typedef struct fiber_sched_s {
+    ucontext_t main;      //< Context of fiber_sched_run
+    fiber_t *fibers;      //< max_fibers fibers, nfibers spawned
+    uint32_t max_fibers;  //< Capacity of fibers and of the run queue
+    uint32_t nfibers;     //< Fibers spawned
+    uint32_t nlive;       //< Fibers spawned and not done
+    size_t stack_sz;      //< Stack bytes per fiber
+    fiber_t **runq;       //< Runnable fibers, max_fibers entries
+    uint32_t runq_head;   //< Next fiber to resume
+    uint32_t runq_tail;   //< Next free run queue entry
+    fiber_t **wait;       //< Waiting fibers hashed by key, wait_mask + 1
+    uint32_t wait_mask;   //< Buckets of wait - 1, a power of 2 minus 1
+} fiber_sched_t;
+
+/**
+ * @brief Prepare a scheduler of up to max_fibers fibers with stack_sz byte
+ * stacks, 0 for FIBER_STACK_SZ
+ */
+int fiber_sched_init(fiber_sched_t *s, uint32_t max_fibers, size_t stack_sz);
+
+/**
+ * @brief Release the stacks and tables of a scheduler that is not running
+ */
+void fiber_sched_destroy(fiber_sched_t *s);
+
+/**
+ * @brief Add a fiber running fn(arg) at the next fiber_sched_run
+ */
+int fiber_spawn(fiber_sched_t *s, void (*fn)(void *), void *arg);
+
+/**
+ * @brief Run the fibers of s on the calling thread until every one of them
+ * returned, polling with poll(s, arg) whenever all of them wait
+ */
+int fiber_sched_run(fiber_sched_t *s, fiber_poll_fn poll, void *arg);
+
+/**
+ * @brief Fiber running on the calling thread, or NULL outside of fibers
+ */
+fiber_t *fiber_self(void);
+
+/**
+ * @brief Park the calling fiber until the completion of wr_id key is handed
+ * to fiber_wake, and copy it into rec. Returns -1 if the wait was aborted
+ */
+int fiber_wait(uint64_t key, cq_rec_t *rec);
+
+/**
+ * @brief Make the fiber waiting on rec->wr_id runnable. Returns false if no
+ * fiber waits on it
+ */
+bool fiber_wake(fiber_sched_t *s, const cq_rec_t *rec);
+
+#endif /*! RDMA_FIBER_H */
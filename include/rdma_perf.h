@@ -0,0 +1,65 @@
+#ifndef RDMA_PERF_H
+#define RDMA_PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @name PERF_CYCLES/PERF_INSTRUCTIONS/PERF_CACHE_MISSES/PERF_CTX_SW/PERF_NCTR
+ * @brief Counters of a measurement: CPU cycles, instructions retired, cache
+ * misses (the last level cache on most CPUs) and context switches
+ */
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_CACHE_MISSES 2
+#define PERF_CTX_SW 3
+#define PERF_NCTR 4
+
+/**
+ * @name MAX_PERF_TASKS
+ * @brief Threads of the process counted at most; threads they spawn during
+ * the measurement are counted with them
+ */
+#define MAX_PERF_TASKS 64
+
+/**
+ * @struct perf_set_t
+ * @brief perf_event_open counters of every thread of the process around one
+ * measurement. A set that is not on counts nothing and costs nothing
+ */
+typedef struct perf_set_s {
+    bool on;                           //< Measurements are counted
+    bool user_only;                    //< perf_event_paranoid bars the kernel
+    bool avail[PERF_NCTR];             //< Counters the PMU and kernel have
+    int fd[MAX_PERF_TASKS][PERF_NCTR]; //< Counter of each thread, -1 = none
+    uint32_t ntask;                    //< Threads counted
+} perf_set_t;
+
+/**
+ * @struct perf_sample_t
+ * @brief Counts of one measurement summed over the threads
+ */
+typedef struct perf_sample_s {
+    uint64_t val[PERF_NCTR]; //< Counts, scaled up if the PMU was shared
+    bool valid[PERF_NCTR];   //< The kernel counted it on at least one thread
+} perf_sample_t;
+
+/**
+ * @brief Check that this kernel and CPU count at least one of the counters,
+ * and set p on. Counters the PMU lacks are left out of every sample
+ */
+int perf_init(perf_set_t *p);
+
+/**
+ * @brief Open and enable the counters of every thread of the process, ahead
+ * of a measurement. No-op unless p is on
+ */
+int perf_start(perf_set_t *p);
+
+/**
+ * @brief Stop the counters of perf_start, sum them into s and close them.
+ * s is all invalid unless p is on
+ */
+void perf_stop(perf_set_t *p, perf_sample_t *s);
+
+#endif /*! RDMA_PERF_H */
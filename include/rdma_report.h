@@ -0,0 +1,181 @@
+#ifndef RDMA_REPORT_H
+#define RDMA_REPORT_H
+
+#include "rdma_perf.h"
+#include "rdma_stats.h"
+#include <infiniband/verbs.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+/**
+ * @name REPORT_SCHEMA
+ * @brief Version tag of the JSON/CSV report layout. Bump it whenever a field
+ * is renamed or removed; new fields are only ever appended
+ */
+#define REPORT_SCHEMA "rdmacs-report/1"
+#define MAX_REPORT_CONFIG 64
+#define MAX_REPORT_RESULTS 64
+
+/**
+ * @enum report_fmt_t
+ * @brief Output format of a benchmark report
+ */
+typedef enum report_fmt_e {
+    REPORT_TEXT = 0,
+    REPORT_JSON,
+    REPORT_CSV,
+} report_fmt_t;
+
+/**
+ * @struct lat_stats_t
+ * @brief Latency samples of one measurement
+ */
+typedef struct lat_stats_s {
+    uint64_t *nsec; //< Samples in nsec
+    size_t n;       //< Number of samples recorded
+    size_t cap;     //< Capacity of nsec
+    uint64_t outlier_nsec; //< Samples above are counted as outliers, 0 = off
+} lat_stats_t;
+
+/**
+ * @struct lat_summary_t
+ * @brief Latency distribution of one measurement in nsec
+ */
+typedef struct lat_summary_s {
+    uint64_t n;
+    uint64_t min;
+    uint64_t avg;
+    uint64_t p50;
+    uint64_t p90;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t p9999;
+    uint64_t max;
+    uint64_t outlier_nsec; //< Outlier threshold, 0 = not counted
+    uint64_t outliers;     //< Samples above outlier_nsec
+} lat_summary_t;
+
+/**
+ * @struct report_result_t
+ * @brief Result of one measured (test, message size) pair
+ */
+typedef struct report_result_s {
+    char test[32];       //< e.g. SEND-RECV, ATOMIC_FADD
+    size_t msg_sz;       //< Payload bytes per message
+    uint64_t messages;   //< Messages completed
+    double elapsed_sec;  //< Wall time of the measurement
+    double bw_gbps;      //< Payload bandwidth in Gb/s
+    double msg_rate;     //< Messages per second
+    lat_summary_t lat;   //< Latency distribution, n = 0 if not measured
+    double offered_rate; //< Scheduled requests/sec of open loop, 0 = closed
+    double post_cyc;     //< rdma_cycles per send post, 0 = not measured
+    double poll_cyc;     //< rdma_cycles of polling per completion
+    perf_sample_t perf;  //< CPU counters of the measurement, none valid if
+                         //< not counted; reported per message
+} report_result_t;
+
+/**
+ * @struct report_kv_t
+ * @brief One run configuration entry
+ */
+typedef struct report_kv_s {
+    char key[32];
+    char val[64];
+    bool is_num;
+} report_kv_t;
+
+/**
+ * @struct report_t
+ * @brief Benchmark report of one client or server process
+ */
+typedef struct report_s {
+    report_fmt_t fmt; //< Output format
+    FILE *out;        //< Report stream, stdout unless redirected to a file
+    const char *role; //< client or server
+
+    report_kv_t config[MAX_REPORT_CONFIG]; //< Run configuration
+    int nconfig;
+
+    bool has_device;               //< Device and port attributes valid
+    char dev_name[64];             //< ibv_get_device_name
+    uint8_t port_num;              //< Port used by the connection
+    struct ibv_device_attr dev;    //< ibv_query_device
+    struct ibv_port_attr port;     //< ibv_query_port
+
+    report_result_t results[MAX_REPORT_RESULTS];
+    int nresults;
+
+    struct rusage ru_start;   //< Process CPU usage at report creation
+    struct timespec ts_start; //< Wall time at report creation
+} report_t;
+
+/**
+ * @brief Parse text|json|csv, return -1 if unknown
+ */
+int report_parse_fmt(const char *str, report_fmt_t *fmt);
+
+/**
+ * @brief Create a report. For json/csv written to stdout ("-" or NULL path),
+ * free-form logs are moved to stderr so stdout only carries the report
+ */
+report_t *report_create(report_fmt_t fmt, const char *role, const char *path);
+
+/**
+ * @brief Record a run configuration entry
+ */
+void report_config_str(report_t *r, const char *key, const char *val);
+void report_config_num(report_t *r, const char *key, double val);
+
+/**
+ * @brief Record the device and port attributes used by a connection
+ */
+int report_device(report_t *r, struct ibv_context *verbs, uint8_t port_num);
+
+/**
+ * @brief Append one result
+ */
+int report_add_result(report_t *r, const report_result_t *res);
+
+/**
+ * @brief Write the report, CPU utilisation included, and release it
+ */
+int report_finish(report_t *r);
+
+/**
+ * @brief Latency sample helpers
+ */
+int lat_stats_init(lat_stats_t *s, size_t cap);
+void lat_stats_free(lat_stats_t *s);
+void lat_stats_merge(lat_stats_t *dst, const lat_stats_t *src);
+void lat_stats_summarize(lat_stats_t *s, lat_summary_t *sum);
+
+static inline void lat_stats_add(lat_stats_t *s, uint64_t nsec) {
+    if (s->n < s->cap) {
+        s->nsec[s->n++] = nsec;
+    }
+}
+
+/**
+ * @brief Fill the derived rate fields of a result
+ */
+void report_result_rates(report_result_t *res);
+
+/**
+ * @brief Fill the per post and per completion cycles of a result from the
+ * counters of its connection before and after the measurement
+ */
+void report_result_cycles(report_result_t *res,
+                          const rdma_stats_snap_t *start,
+                          const rdma_stats_snap_t *end);
+
+/**
+ * @brief Append the result of a streamed (bandwidth) measurement, which has
+ * no per-message latency
+ */
+int report_add_stream(report_t *r, const char *test, size_t msg_sz,
+                      uint64_t messages, uint64_t elapsed_nsec);
+
+#endif /*! RDMA_REPORT_H */
@@ -1,6 +1,13 @@
 #ifndef RDMA_SERVER_LIB_H
 #define RDMA_SERVER_LIB_H
 
+#include "completion_ring.h"
+#include "rdma_accept.h"
+#include "rdma_bw.h"
+#include "rdma_core.h"
+#include "rdma_shm.h"
+#include "rdma_tcp.h"
+#include "rdma_stats.h"
 #include <netinet/in.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -8,28 +15,113 @@
 #include <stdio.h>
 #include <sys/types.h>
 
-#define MAX_SEND_WR 1024
-#define MAX_RECV_WR 512
-#define MAX_CQE 512
+#define SERVER_RX_DEPTH 128
 
 /**
- * @struct thread_fn_t
- * @brief Server Thread Function Type
+ * @struct server_dp_t
+ * @brief Hot datapath state of the send_recv_server thread. Copied from the
+ * control plane once buffers are registered and cache line aligned, its
+ * completion ring included, so the CQ poller only shares the ring lines
  */
-typedef void *(*thread_fn_t)(void *);
+typedef struct server_dp_s {
+    struct ibv_qp *qp;    //< QP responses are posted on
+    struct ibv_qp_ex *qpx; //< qp for the ibv_wr_* calls, NULL = ibv_post_send
+    struct ibv_srq *srq;  //< XRC SRQ requests land in instead of qp, or NULL
+    void *recv_buf;       //< RDMA compliant recv buf
+    void *hdr_buf;        //< RDMA compliant msg header buf
+    uint32_t recv_buf_sz; //< size of recv buf
+    uint32_t recv_lkey;   //< lkey of recv_buf
+    uint32_t hdr_lkey;    //< lkey of hdr_buf
+    uint32_t wr_seq;      //< Next wr_id
+    int max_sge;          //< SGEs per WR, capped by device max_sge
+    uint64_t rx_msgs;     //< Requests served
+    uint64_t rx_bytes;    //< Request bytes received
+    uint32_t bw_rounds;   //< Bandwidth rounds completed
+    uint32_t wrpc_unsig;  //< Write RPC responses posted since a signaled one
+    uint32_t rx_posted;   //< Recvs posted and not consumed yet
+    bw_cfg_t bw_cfg;      //< Parameters of the last bandwidth round
+    bw_result_t bw_tx;    //< Server stream of the last bibw round
+    bw_result_t bw_rx;    //< Client stream of the last bandwidth round
+    rdma_stats_t *stats;  //< Counters of send_recv_server
+    cq_ring_t ring;       //< Completions routed to send_recv_server
+} __attribute__((aligned(CACHE_LINE_SZ))) server_dp_t;
+
+/**
+ * @name SERVER_CONN_ACCEPTING/ESTABLISHED/CLAIMED/CLOSED
+ * @brief Life of a connection in the accept pipeline: accepted and waiting
+ * for ESTABLISHED, ready to be served, served by connect_server, and gone
+ * before anyone served it
+ */
+#define SERVER_CONN_ACCEPTING 0
+#define SERVER_CONN_ESTABLISHED 1
+#define SERVER_CONN_CLAIMED 2
+#define SERVER_CONN_CLOSED 3
+
+/**
+ * @struct server_conn_t
+ * @brief One client connection of the accept pipeline, from its connection
+ * request until it is torn down. Set as the context of its cm_id
+ */
+typedef struct server_conn_s {
+    struct rdma_cm_id *id;            //< RDMA CM Identifier of the client
+    struct ibv_qp *qp; //< RC QP from the warm pool, a send-only one under XRC
+    int state;                        //< SERVER_CONN_*
+    uint64_t req_nsec;                //< Connection request seen
+    uint8_t peer_initiator_depth;     //< RDMA READ/atomics client may issue
+    uint8_t peer_responder_resources; //< RDMA READ/atomics client may serve
+    uint32_t peer_xrc_qpn;            //< XRC_SEND QP of the client, 0 = RC
+    uint32_t nqps;                    //< RC QPs, qp and extra_qp
+    struct ibv_qp *extra_qp[MAX_CONN_QPS - 1]; //< Extra QPs of bw rounds
+    uint32_t extra_rx_posted[MAX_CONN_QPS - 1]; //< bw recvs left on them
+    struct ibv_qp *xrc_qp;            //< XRC_RECV QP facing the client
+    uint32_t held_qps;                //< QPs counted in server_ctx_t live
+    uint32_t held_rq_wrs;             //< Receive WRs of those QPs
+    struct server_conn_s *next;       //< Next accepted connection
+} server_conn_t;
+
+struct server_ctx_s;
+
+/**
+ * @name ACC_PRIV_SZ
+ * @brief Client private data slots of an accept worker. Twice its ring, so
+ * the event thread never refills the slot the worker still reads
+ */
+#define ACC_PRIV_SZ (2 * CQ_RING_SZ)
+
+/**
+ * @struct server_acc_worker_t
+ * @brief Accept worker. The event thread hands it the connection requests
+ * and teardowns of the cm_ids hashing to it over an SPSC ring, and the
+ * private data of each request, too large for a record, alongside in priv
+ */
+typedef struct server_acc_worker_s {
+    struct server_ctx_s *ctx; //< Server the worker accepts for
+    pthread_t thread;         //< Worker thread
+    cq_ring_t ring;           //< CM events from the event thread
+    client_priv_t priv[ACC_PRIV_SZ]; //< Private data of the connection
+                                     //< requests in ring, in order
+    uint32_t priv_head; //< Requests the event thread handed over
+    uint32_t priv_tail; //< Requests the worker took
+} __attribute__((aligned(CACHE_LINE_SZ))) server_acc_worker_t;
 
 /**
  * @struct server_ctx_t
  * @brief Server Connection Context Info
  */
 typedef struct server_ctx_s {
+    /* Read-mostly state shared by the CQ poller and send_recv_server */
+    struct ibv_cq *scq; //< Verbs Send CQ
+    struct ibv_cq *rcq; //< Verbs Recv CQ, scq unless split
+    bool is_connected;  //< RDMA Client-Server Connected
+    server_dp_t *dp;    //< Hot datapath state of send_recv_server
+
     /* RDMA Connection Specific Attributes */
     struct rdma_cm_id *cm_id;     //< RDMA CM Identifier
     struct rdma_cm_id *listen_id; //< RDMA CM Listen Identifier
     struct ibv_context *verbs;    //< Verbs Context
     struct ibv_pd *pd;            //< Verbs Protection Domain
-    struct ibv_cq *scq;           //< Verbs Send CQ
-    struct ibv_cq *rcq;           //< Verbs Recv CQ
+    int max_sge;                  //< SGEs per WR, capped by device max_sge
+    rdma_qp_cfg_t qp_cfg;         //< Queue sizing, resolved on connect
 
     /* Event Monitor Specific attributes */
     struct rdma_event_channel *channel; //< RDMA Event Channel
@@ -37,13 +129,47 @@ typedef struct server_ctx_s {
     thread_fn_t evt_fn;                 //< RDMA Event Thread Function Callback
     pthread_mutex_t evt_mtx;            //< RDMA Event Thread Sync Mtx
     pthread_cond_t evt_cv;              //< RDMA Event Thread Sync Cv
-    bool is_connected;
+
+    /* Accept pipeline, see setup_server */
+    pthread_mutex_t acc_mtx; //< Guards conns, shared resources and stats
+    pthread_cond_t acc_cv;   //< Signalled when a connection is established
+    bool shared_ready;       //< PD, CQs, shared MRs and pool are set up
+    bool acc_running;        //< Accept workers keep going while set
+    accept_pool_t pool;      //< Warm QPs on the shared PD and CQs
+    uint32_t nworkers;       //< Number of accept workers
+    server_acc_worker_t *workers; //< Accept workers
+    server_conn_t *conns;         //< Connections accepted, not torn down
+    server_conn_t *conn;          //< Connection served by connect_server
+    struct ibv_qp *qp;            //< RC QP of the connection served
+    uint8_t max_rd_atom;          //< Device max_qp_rd_atom
+    uint8_t max_init_rd_atom;     //< Device max_qp_init_rd_atom
+    uint64_t accepted;            //< Connections established
+    uint64_t rejected;            //< Connection requests refused
+    uint64_t first_req_nsec;      //< First connection request seen
+    uint64_t last_est_nsec;       //< Latest connection established
+    uint64_t *accept_nsec; //< Request to ESTABLISHED, first MAX_ACCEPT_SAMPLES
+    uint32_t live_conns;   //< Connections accepted and not torn down
+    uint32_t live_qps;     //< QPs of those, XRC_RECV QPs included
+    uint64_t live_rq_wrs;  //< Receive WRs of those QPs plus the XRC SRQ
+    uint32_t peak_conns;   //< Most live_conns seen
+    uint32_t peak_qps;     //< Most live_qps seen
+    uint64_t peak_rq_wrs;  //< Most live_rq_wrs seen
+    bool xrc_srq_held;     //< XRC SRQ counted in live_rq_wrs
+
+    /* Clients over a message transport, see setup_server(_tcp) */
+    shm_ctx_t *shm;          //< Segment published under the address, or NULL
+    int listen_fd;           //< TCP listener of setup_server_tcp
+    bool uring;              //< TCP clients are served over io_uring
+    thread_fn_t xport_fn;    //< Waits for the next client of the transport
+    pthread_t xport_thread;  //< Runs xport_fn
+    msg_xport_t *xport_next; //< Client waiting to be served, under acc_mtx
+    msg_xport_t *xport;      //< The connection served is this client
 
     /* Poll Monitor Specific attributes */
     pthread_t wcq_thread;
     thread_fn_t wcq_fn;
-    pthread_mutex_t wcq_mtx;
-    pthread_cond_t wcq_cv;
+    rdma_stats_set_t stats;   //< Counters of the poller and the server
+    rdma_stats_t *poll_stats; //< Counters of the poller
 
     /* Memory to be registered and used by client-server communication */
     void *send_server_buf;      //< RDMA compliant send buf
@@ -52,27 +178,61 @@ typedef struct server_ctx_s {
     size_t recv_server_buf_sz;  //< size of recv for send buf
     struct ibv_mr *send_buf_mr; //< RDMA compliant send buf mr
     struct ibv_mr *recv_buf_mr; //< RDMA compliant recv buf mr
-    int recv_opc[MAX_SEND_WR];  //< RDMA received immediate opcode from client
-    size_t recv_sz;             //< RDMA WCQE byte len
+    void *hdr_server_buf;       //< RDMA compliant buf scattering msg header
+    struct ibv_mr *hdr_buf_mr;  //< RDMA compliant msg header buf mr
+    uint64_t *atomic_server_buf;  //< RDMA compliant atomic counter array
+    struct ibv_mr *atomic_buf_mr; //< RDMA compliant atomic counter mr
+    void *sink_server_buf;        //< RDMA compliant RDMA_WRITE stream target
+    struct ibv_mr *sink_buf_mr;   //< RDMA compliant stream target mr
+    void *wrpc_server_buf;        //< RDMA compliant write-based RPC ring
+    struct ibv_mr *wrpc_buf_mr;   //< RDMA compliant write-based RPC ring mr
+    struct ibv_mr *implicit_mr; //< Whole address space MR of MR_MODE_IMPLICIT
+
+    /* XRC receive side, domain and SRQ shared by every XRC connection */
+    struct ibv_xrcd *xrcd;   //< XRC domain of the SRQ and XRC_RECV QPs
+    struct ibv_srq *xrc_srq; //< Shared receive queue of client requests
+    struct ibv_qp *xrc_qp;   //< XRC_RECV QP of the connection served
 } server_ctx_t;
 
 /**
- * @brief Given a user-defined IP and port, setup the server
- * control plane
+ * @brief Given a user-defined IP and port, setup the server control plane
+ * and start accepting. nworkers threads (0 for DEFAULT_ACCEPT_WORKERS)
+ * accept connection requests in parallel, each onto a QP from a warm pool
+ * sharing one PD, the CQs and the atomic/sink MRs. Those are created here
+ * if the address names a device, else on the first request. qp_cfg sizes
+ * the queues and CQs against the device capabilities, NULL for the defaults.
+ * With shm, a shared-memory segment is published too and a client on this
+ * host attaching to it is served like an established connection
  */
-server_ctx_t *setup_server(struct sockaddr *addr, uint16_t port_id);
+server_ctx_t *setup_server(struct sockaddr *addr, uint16_t port_id,
+                           const rdma_qp_cfg_t *qp_cfg, uint32_t nworkers,
+                           bool shm);
 
 /**
- * @brief Given a server context, setup its connection to client
+ * @brief Given a user-defined IP and port, listen for clients on a kernel
+ * TCP socket instead, no device involved. With uring the connection served
+ * is driven through io_uring rather than plain socket calls. Served like an
+ * established connection: SEND requests and one-way SEND streams
+ */
+server_ctx_t *setup_server_tcp(struct sockaddr *addr, bool uring);
+
+/**
+ * @brief Given a server context, wait for an established connection nobody
+ * serves yet and serve it
  */
 int connect_server(server_ctx_t *ctx);
 
 /**
  * @brief Given a previously connected server context, teardown its connection
- * to a client
+ * to a client. The PD, CQs and shared MRs stay for the next connection
  */
 int disconnect_server(server_ctx_t *ctx);
 
+/**
+ * @brief Wait until n connections in total have been established
+ */
+int wait_server_accepts(server_ctx_t *ctx, uint64_t n);
+
 /**
  * @brief Prepare the input/output req/response data for server
  */
@@ -80,7 +240,9 @@ int prepare_server_data(server_ctx_t *ctx);
 
 /**
  * @brief Recv the request, based on the immediate opcode, send response
- * to client
+ * to client. OPC_BW_START runs a whole bandwidth round, its results are left
+ * in dp->bw_rx/bw_tx and dp->bw_rounds is bumped. OPC_WRPC_START serves
+ * write-based RPCs out of the request ring until a client ends the mode
  */
 int send_recv_server(server_ctx_t *ctx);
 
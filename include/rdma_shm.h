@@ -0,0 +1,147 @@
+#ifndef RDMA_SHM_H
+#define RDMA_SHM_H
+
+#include "completion_ring.h"
+#include "rdma_xport.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+/**
+ * @name SHM_SLOTS/SHM_SLOT_SZ
+ * @brief Geometry of a shared-memory ring: messages in flight per direction
+ * and the largest message a slot holds
+ */
+#define SHM_SLOTS 64
+#define SHM_SLOT_SZ (64 * 1024)
+
+/**
+ * @name SHM_SEG_FREE/ATTACHED/CLOSED
+ * @brief Life of a segment: waiting for a client, serving one, and given up
+ * by the server
+ */
+#define SHM_SEG_FREE 0
+#define SHM_SEG_ATTACHED 1
+#define SHM_SEG_CLOSED 2
+
+/**
+ * @struct shm_slot_t
+ * @brief One message of a ring. The sequence flag has a cache line of its
+ * own, so the consumer spinning on it only pulls the line the producer
+ * writes last
+ */
+typedef struct shm_slot_s {
+    uint32_t seq __attribute__((aligned(CACHE_LINE_SZ))); //< Message no. + 1
+    uint32_t len; //< Bytes in data
+    uint32_t opc; //< OPC_* of the message
+    uint8_t data[SHM_SLOT_SZ] __attribute__((aligned(CACHE_LINE_SZ)));
+} shm_slot_t;
+
+/**
+ * @struct shm_ring_t
+ * @brief Single-producer/single-consumer ring of message slots. A message
+ * is published by its slot seq and handed back by tail, each a futex word
+ * the other side sleeps on once it stops spinning
+ */
+typedef struct shm_ring_s {
+    /* Consumer owned line */
+    uint32_t tail __attribute__((aligned(CACHE_LINE_SZ))); //< Msgs consumed
+    uint32_t rx_parked; //< Consumer is (about to be) asleep on a slot seq
+
+    /* Producer owned line */
+    uint32_t tx_parked __attribute__((aligned(CACHE_LINE_SZ))); //< On tail
+
+    shm_slot_t slot[SHM_SLOTS];
+} shm_ring_t;
+
+/**
+ * @struct shm_seg_t
+ * @brief Shared-memory segment a server publishes under its address, one
+ * client at a time
+ */
+typedef struct shm_seg_s {
+    uint64_t magic; //< SHM_MAGIC once the server initialised the segment
+    uint32_t state __attribute__((aligned(CACHE_LINE_SZ))); //< SHM_SEG_*
+    pid_t server_pid; //< Owner of the segment
+    pid_t client_pid; //< Client served, 0 while free
+    shm_ring_t req;   //< Client to server
+    shm_ring_t resp;  //< Server to client
+} shm_seg_t;
+
+/**
+ * @struct shm_ctx_t
+ * @brief Process-local end of a segment. As a msg_xport_t, closing it
+ * resets the segment of a server and leaves the one of a client
+ */
+typedef struct shm_ctx_s {
+    msg_xport_t xport; //< Operations, first so the two convert
+    shm_seg_t *seg;    //< Mapped segment
+    char name[64];     //< POSIX shm name of the segment
+    bool server;       //< This end owns the segment
+    shm_ring_t *tx;    //< Ring this end produces
+    shm_ring_t *rx;    //< Ring this end consumes
+    uint32_t tx_head;  //< Messages published on tx
+    uint32_t tx_tail;  //< Producer's view of tx->tail
+    uint32_t rx_next;  //< Next message expected on rx
+    bool rx_held;      //< Message rx_next is handed out, not released yet
+    uint32_t rx_miss;  //< Empty non-blocking receives since a liveness check
+} shm_ctx_t;
+
+/**
+ * @brief True if addr is one of the addresses of this host
+ */
+bool shm_peer_is_local(const struct sockaddr *addr);
+
+/**
+ * @brief Publish a segment for the server listening on addr, replacing one
+ * left behind by an earlier server
+ */
+shm_ctx_t *shm_server_open(const struct sockaddr *addr);
+
+/**
+ * @brief Wait until a client attached to the segment. Returns 0 once one
+ * did, -1 if the segment was closed
+ */
+int shm_server_wait_attach(shm_ctx_t *shm);
+
+/**
+ * @brief Empty the rings of a client that left and take the next one
+ */
+void shm_server_reset(shm_ctx_t *shm);
+
+/**
+ * @brief Attach to the segment of a live server listening on addr, or NULL
+ * if there is none or it serves another client
+ */
+shm_ctx_t *shm_client_attach(const struct sockaddr *addr);
+
+/**
+ * @brief Gather iov into the next tx slot and publish it, waiting for a
+ * free slot. Fails on messages above SHM_SLOT_SZ or once the peer is gone
+ */
+int shm_send(shm_ctx_t *shm, uint32_t opc, const struct iovec *iov,
+             int iovcnt);
+
+/**
+ * @brief Hand out the next rx message in place until shm_release. With
+ * wait, block until it arrives. Returns 1 with opc, data and len filled in,
+ * 0 if none arrived yet and -1 once the peer is gone
+ */
+int shm_recv(shm_ctx_t *shm, uint32_t *opc, void **data, uint32_t *len,
+             bool wait);
+
+/**
+ * @brief Give the slot of the last shm_recv back to the producer
+ */
+void shm_release(shm_ctx_t *shm);
+
+/**
+ * @brief Leave the segment, waking the peer. The server also removes its
+ * name. The mapping stays until the process exits, so threads still
+ * waiting on it return instead of faulting. NULL is ignored
+ */
+void shm_close(shm_ctx_t *shm);
+
+#endif /*! RDMA_SHM_H */
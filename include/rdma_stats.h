@@ -0,0 +1,155 @@
+#ifndef RDMA_STATS_H
+#define RDMA_STATS_H
+
+#include "completion_ring.h"
+#include <infiniband/verbs.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @name MAX_STATS_BLOCKS/MAX_STATS_SETS
+ * @brief Counter blocks per connection (requester threads and the CQ
+ * poller) and connections a process reports
+ */
+#define MAX_STATS_BLOCKS 272
+#define MAX_STATS_SETS 16
+
+/**
+ * @struct rdma_ctr_t
+ * @brief Counters of a thread or of a connection. Occupancy follows from
+ * them: rx_posted - rx_msgs recvs are waiting to be filled
+ */
+typedef struct rdma_ctr_s {
+    uint64_t tx_msgs;   //< Send WRs posted: requests, responses, streams
+    uint64_t tx_bytes;  //< Payload bytes of tx_msgs
+    uint64_t rx_posted; //< Receive WRs posted
+    uint64_t rx_msgs;   //< Receive completions
+    uint64_t rx_bytes;  //< Bytes of rx_msgs
+    uint64_t post_err;  //< Post calls the provider refused
+    uint64_t cqe;       //< Completions polled
+    uint64_t cqe_err;   //< Completions in error, any status
+    uint64_t rnr_err;   //< Of which RNR retries exceeded
+    uint64_t flush_err; //< Of which flushed by a QP in error
+    uint64_t poll_hit;  //< ibv_poll_cq calls returning completions
+    uint64_t poll_miss; //< ibv_poll_cq calls returning none
+    uint64_t post_n;    //< Send posts timed into post_cyc
+    uint64_t post_cyc;  //< rdma_cycles spent in those posts
+    uint64_t poll_cyc;  //< rdma_cycles of the polls returning completions
+} rdma_ctr_t;
+
+/**
+ * @struct rdma_stats_t
+ * @brief Counter block of one thread. Only the owner thread writes it, with
+ * plain relaxed stores, and the block is cache line aligned so counting
+ * never shares a line with another thread
+ */
+typedef struct rdma_stats_s {
+    rdma_ctr_t ctr;        //< Counters of the owner thread
+    const cq_ring_t *ring; //< Completion ring the owner drains, or NULL
+} __attribute__((aligned(CACHE_LINE_SZ))) rdma_stats_t;
+
+/**
+ * @struct rdma_stats_snap_t
+ * @brief Counters summed over the blocks of a connection, and the
+ * completions routed to its threads and not consumed yet
+ */
+typedef struct rdma_stats_snap_s {
+    rdma_ctr_t sum;        //< Sum of every block
+    uint64_t ring_backlog; //< Records waiting in the completion rings
+} rdma_stats_snap_t;
+
+/**
+ * @struct rdma_stats_set_t
+ * @brief Counter blocks of one connection
+ */
+typedef struct rdma_stats_set_s {
+    char name[64];                         //< Shown on every stats line
+    pthread_mutex_t mtx;                   //< Guards block and nblock
+    rdma_stats_t *block[MAX_STATS_BLOCKS]; //< Blocks of the threads
+    uint32_t nblock;                       //< Number of valid blocks
+    rdma_stats_snap_t last;                //< Snapshot of the last line
+} rdma_stats_set_t;
+
+// Owner thread only: no locked instruction, and readers never see a torn
+// value
+#define STATS_ADD(s, field, n)                                                 \
+    __atomic_store_n(&((s)->ctr.field),                                        \
+                     __atomic_load_n(&((s)->ctr.field), __ATOMIC_RELAXED) +    \
+                         (n),                                                  \
+                     __ATOMIC_RELAXED)
+
+// CPU time stamp counter, or the virtual counter on arm64, to weigh short
+// datapath calls. Falls back to nsec elsewhere
+static inline uint64_t rdma_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return (__builtin_ia32_rdtsc());
+#elif defined(__aarch64__)
+    uint64_t v = 0;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(v));
+    return (v);
+#else
+    return (cq_ring_now());
+#endif
+}
+
+// Error completion of any kind, then its cause if it is one counted apart
+static inline void rdma_stats_wc_err(rdma_stats_t *s,
+                                     enum ibv_wc_status status) {
+    STATS_ADD(s, cqe_err, 1);
+    if (status == IBV_WC_RNR_RETRY_EXC_ERR) {
+        STATS_ADD(s, rnr_err, 1);
+    } else if (status == IBV_WC_WR_FLUSH_ERR) {
+        STATS_ADD(s, flush_err, 1);
+    }
+}
+
+/**
+ * @brief Name a connection, with no counter blocks yet
+ */
+int rdma_stats_set_init(rdma_stats_set_t *set, const char *name);
+
+/**
+ * @brief Add set to the connections the stats line and the stats socket
+ * report. set must live until it is unregistered or the process exits
+ */
+int rdma_stats_register(rdma_stats_set_t *set);
+
+/**
+ * @brief Drop set from the reported connections. Once it returns the stats
+ * thread no longer reads set
+ */
+void rdma_stats_unregister(rdma_stats_set_t *set);
+
+/**
+ * @brief Free the counter blocks of an unregistered set whose threads
+ * stopped counting
+ */
+void rdma_stats_set_free(rdma_stats_set_t *set);
+
+/**
+ * @brief Allocate a zeroed counter block of the calling thread in set.
+ * ring is the completion ring the thread drains, NULL if none
+ */
+rdma_stats_t *rdma_stats_new(rdma_stats_set_t *set, const cq_ring_t *ring);
+
+/**
+ * @brief Sum the blocks of set while their threads keep counting
+ */
+void rdma_stats_snap(rdma_stats_set_t *set, rdma_stats_snap_t *snap);
+
+/**
+ * @brief Format a snapshot as one line of key=value pairs
+ */
+int rdma_stats_format(char *buf, size_t len, const char *name,
+                      const rdma_stats_snap_t *snap);
+
+/**
+ * @brief Start the stats thread: every interval_nsec (0 = never) it prints
+ * one line per connection with the message rates since the previous line,
+ * and with a sock_path (NULL = none) it answers every connection on that
+ * Unix socket with the lines of every connection and their total
+ */
+int rdma_stats_start(uint64_t interval_nsec, const char *sock_path);
+
+#endif /*! RDMA_STATS_H */
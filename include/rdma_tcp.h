@@ -0,0 +1,79 @@
+#ifndef RDMA_TCP_H
+#define RDMA_TCP_H
+
+#include "rdma_uring.h"
+#include "rdma_xport.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/socket.h>
+
+/**
+ * @name TCP_URING_ENTRIES/TCP_URING_BUFS
+ * @brief io_uring engine geometry: SQEs of the ring, and provided buffers of
+ * TCP_URING_BUF_SZ bytes the multishot receive lands in
+ */
+#define TCP_URING_ENTRIES 64
+#define TCP_URING_BUFS 64
+#define TCP_URING_BUF_SZ (64 * 1024)
+
+/**
+ * @struct tcp_hdr_t
+ * @brief Framing of a message on the byte stream
+ */
+typedef struct __attribute__((packed)) tcp_hdr_s {
+    uint32_t opc; //< OPC_* of the message
+    uint32_t len; //< Bytes following the header
+} tcp_hdr_t;
+
+/**
+ * @struct tcp_ctx_t
+ * @brief One end of a TCP connection carrying framed messages, over plain
+ * socket calls or over io_uring with a registered send buffer and a
+ * multishot receive into provided buffers
+ */
+typedef struct tcp_ctx_s {
+    msg_xport_t xport; //< Operations, first so the two convert
+    int fd;            //< Connected socket
+    bool server;       //< Accepted end, freed by close
+
+    /* Receive side, shared by both engines */
+    uint8_t *rx_buf; //< Bytes read off the stream, not consumed yet
+    size_t rx_sz;    //< Capacity of rx_buf
+    size_t rx_off;   //< First byte of the next message
+    size_t rx_len;   //< Bytes in rx_buf past rx_off
+    size_t rx_held;  //< Bytes of the message handed out, 0 if none
+    bool rx_eof;     //< Peer shut the connection
+
+    /* io_uring engine */
+    bool uring;       //< Datapath goes through ring instead of syscalls
+    uring_t ring;     //< Instance, registered tx_buf and provided buffers
+    uint8_t *tx_buf;  //< Registered buffer sends are gathered into
+    bool rx_armed;    //< Multishot receive is outstanding
+    int tx_res;       //< Result of the send in flight
+    bool tx_done;     //< Send in flight completed
+
+    // Receive completions reaped by a send while a message is handed out.
+    // Each holds a provided buffer or ends the multishot, so no overflow
+    struct io_uring_cqe rx_stash[TCP_URING_BUFS + 1];
+    uint32_t stash_head; //< Oldest stashed completion
+    uint32_t stash_cnt;  //< Completions stashed
+} tcp_ctx_t;
+
+/**
+ * @brief Listen for clients on addr
+ */
+int tcp_listen(const struct sockaddr *addr);
+
+/**
+ * @brief Accept the next client on lfd, with uring over io_uring
+ */
+tcp_ctx_t *tcp_accept(int lfd, bool uring);
+
+/**
+ * @brief Connect from src, if not NULL, to the server on dst, with uring
+ * over io_uring
+ */
+tcp_ctx_t *tcp_connect(const struct sockaddr *src, const struct sockaddr *dst,
+                       bool uring);
+
+#endif /*! RDMA_TCP_H */
@@ -0,0 +1,142 @@
+#ifndef RDMA_UD_H
+#define RDMA_UD_H
+
+#include "client_server_shared.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @name UD_GRH_SZ
+ * @brief Every UD receive lands behind a 40-byte Global Routing Header slot,
+ * whether or not the fabric fills it in
+ */
+#define UD_GRH_SZ 40
+
+/**
+ * @name UD_SERVER_SLOTS/UD_CLIENT_SLOTS
+ * @brief Receive slots per QP. A server slot stays busy until the echo sent
+ * from it completes; a client only expects the response to its own request
+ * plus stale retransmits
+ */
+#define UD_SERVER_SLOTS 512
+#define UD_CLIENT_SLOTS 32
+
+/**
+ * @name UD_MAX_PEERS
+ * @brief Address handles cached by a server, keyed by the peer QP and
+ * address. A full cache evicts the entry a new peer hashes to
+ */
+#define UD_MAX_PEERS 4096
+
+/**
+ * @name UD_RTO_NSEC/UD_MAX_RETRIES
+ * @brief Client retransmit timeout and attempts before a request fails
+ */
+#define UD_RTO_NSEC 10000000ULL
+#define UD_MAX_RETRIES 8
+
+/**
+ * @name UD_WR_SEND
+ * @brief wr_id bit of server echoes, the rest of the wr_id is the slot the
+ * echo is sent from and re-posted once it completes
+ */
+#define UD_WR_SEND (1ULL << 63)
+
+/**
+ * @struct ud_ah_t
+ * @brief Address handle shared by a peer cache entry and the echoes posted
+ * with it, destroyed once the last of them lets go
+ */
+typedef struct ud_ah_s {
+    struct ibv_ah *ah; //< Verbs address handle
+    uint32_t refs;     //< Cache entry, plus one per echo in flight
+} ud_ah_t;
+
+/**
+ * @struct ud_peer_t
+ * @brief Server side address handle of one client QP
+ */
+typedef struct ud_peer_s {
+    uint32_t qp_num;   //< Client QP, 0 = free entry
+    uint16_t lid;      //< Source LID, 0 on RoCE
+    union ibv_gid gid; //< Source GID, zero without a GRH
+    ud_ah_t *ah;       //< Handle responses are addressed with
+    uint32_t seq;      //< Last request sequence served
+} ud_peer_t;
+
+/**
+ * @struct ud_ctx_t
+ * @brief Connectionless endpoint: one UD QP with its own CQ, polled by the
+ * thread owning the context. RDMA CM only resolves addresses: a client
+ * learns the server QP from the SIDR reply, a server learns each client
+ * from the source of its requests
+ */
+typedef struct ud_ctx_s {
+    struct rdma_event_channel *channel; //< RDMA Event Channel
+    struct rdma_cm_id *cm_id; //< Client id, or the server listen id
+    struct ibv_context *verbs; //< Verbs Context
+    struct ibv_pd *pd;         //< Verbs Protection Domain
+    struct ibv_cq *cq;         //< Send and recv completions of qp
+    struct ibv_qp *qp;         //< UD QP
+    uint8_t port_num;          //< Port qp is bound to
+    uint32_t mtu;              //< Largest message, active MTU of the port
+
+    /* Receive slots of UD_GRH_SZ + mtu bytes, posted one per recv */
+    void *slots;             //< RDMA compliant slot array
+    size_t slot_sz;          //< Bytes per slot
+    uint32_t nslots;         //< Number of slots
+    struct ibv_mr *slot_mr;  //< RDMA compliant slot array mr
+    void *send_buf;          //< RDMA compliant client request buf
+    struct ibv_mr *send_mr;  //< RDMA compliant client request buf mr
+
+    /* Client: server address from the SIDR reply */
+    struct ibv_ah *ah;       //< Handle requests are addressed with
+    uint32_t remote_qpn;     //< Server QP
+    uint32_t remote_qkey;    //< Server Q_Key
+    uint32_t seq;            //< Sequence of the last request
+    uint64_t retransmits;    //< Requests sent again after UD_RTO_NSEC
+    uint64_t last_rtt_nsec;  //< Latency of the last completed request
+
+    /* Server: clients seen so far and resolution of new ones */
+    ud_peer_t *peers;        //< UD_MAX_PEERS entry address handle cache
+    ud_ah_t **slot_ah;       //< Handle of the echo in flight from a slot
+    uint32_t npeers;         //< Valid entries of peers
+    uint64_t rx_msgs;        //< Requests served, retransmits excluded
+    uint64_t rx_bytes;       //< Request bytes received, retransmits excluded
+    uint64_t dup_msgs;       //< Retransmitted requests echoed again
+    pthread_t evt_thread;    //< RDMA Event Thread answering resolutions
+} ud_ctx_t;
+
+/**
+ * @brief Bind a UD server QP to addr and answer address resolutions of any
+ * number of clients, all served by this QP
+ */
+ud_ctx_t *ud_setup_server(struct sockaddr *addr);
+
+/**
+ * @brief Serve the requests that arrived since the last call: echo each
+ * payload to its source with the request sequence. Returns the number of
+ * completions handled, -1 on failure
+ */
+int ud_serve_server(ud_ctx_t *ctx);
+
+/**
+ * @brief Resolve the server at dst_addr and set up a UD client QP
+ */
+ud_ctx_t *ud_setup_client(struct sockaddr *src_addr,
+                          struct sockaddr *dst_addr);
+
+/**
+ * @brief Send msg_sz bytes of the request buffer and wait for their echo.
+ * The request is sent again every UD_RTO_NSEC, up to UD_MAX_RETRIES times;
+ * the latency in ctx->last_rtt_nsec runs from the first attempt
+ */
+int ud_call_client(ud_ctx_t *ctx, size_t msg_sz);
+
+/**
+ * @brief Release the QP, buffers, address handles and CM resources
+ */
+void ud_destroy(ud_ctx_t *ctx);
+
+#endif /*! RDMA_UD_H */
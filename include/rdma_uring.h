@@ -0,0 +1,100 @@
+#ifndef RDMA_URING_H
+#define RDMA_URING_H
+
+#include <linux/io_uring.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/**
+ * @struct uring_t
+ * @brief Minimal io_uring instance driven through the raw syscalls: the
+ * mapped submission and completion rings, and one ring of provided buffers
+ * that buffer-select receives fill
+ */
+typedef struct uring_s {
+    int fd; //< io_uring instance
+
+    /* Submission ring */
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_mask;
+    uint32_t *sq_array;
+    struct io_uring_sqe *sqes;
+    uint32_t sq_local;   //< Tail of the SQEs filled in, published on enter
+    uint32_t sq_pending; //< SQEs queued and not submitted yet
+
+    /* Completion ring */
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    uint32_t *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    /* Provided buffer ring */
+    struct io_uring_buf_ring *br; //< Ring the kernel takes buffers from
+    uint8_t *bufs;                //< nbufs buffers of buf_sz bytes
+    uint32_t nbufs;               //< Entries of br, a power of 2
+    uint32_t buf_sz;              //< Bytes per provided buffer
+    uint16_t bgid;                //< Buffer group of br
+    uint16_t br_tail;             //< Buffers handed to the kernel so far
+
+    void *sq_ring; //< Mapping of both rings, single mmap
+    size_t sq_ring_sz;
+    size_t sqes_sz;
+} uring_t;
+
+/**
+ * @brief Set up an io_uring of entries SQEs, twice as many CQEs
+ */
+int uring_init(uring_t *u, uint32_t entries);
+
+/**
+ * @brief Tear down the ring, its provided buffers and its registrations
+ */
+void uring_destroy(uring_t *u);
+
+/**
+ * @brief Next free SQE, zeroed, or NULL if the submission ring is full
+ */
+struct io_uring_sqe *uring_get_sqe(uring_t *u);
+
+/**
+ * @brief Submit the queued SQEs and wait for at least wait_nr completions
+ */
+int uring_enter(uring_t *u, uint32_t wait_nr);
+
+/**
+ * @brief Oldest completion not seen yet, or NULL
+ */
+struct io_uring_cqe *uring_peek_cqe(uring_t *u);
+
+/**
+ * @brief Hand the completion of uring_peek_cqe back to the kernel
+ */
+void uring_cqe_seen(uring_t *u);
+
+/**
+ * @brief Register nr fixed buffers for the *_FIXED opcodes
+ */
+int uring_register_buffers(uring_t *u, const struct iovec *iov, uint32_t nr);
+
+/**
+ * @brief Provide nbufs (a power of 2) buffers of buf_sz bytes as buffer
+ * group bgid, for receives with IOSQE_BUFFER_SELECT
+ */
+int uring_provide_bufs(uring_t *u, uint16_t bgid, uint32_t nbufs,
+                       uint32_t buf_sz);
+
+/**
+ * @brief Provided buffer bid, as reported in the flags of a completion
+ */
+static inline void *uring_buf(const uring_t *u, uint16_t bid) {
+    return (u->bufs + ((size_t)bid * u->buf_sz));
+}
+
+/**
+ * @brief Give provided buffer bid back to the kernel
+ */
+void uring_recycle_buf(uring_t *u, uint16_t bid);
+
+#endif /*! RDMA_URING_H */
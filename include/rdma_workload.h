@@ -0,0 +1,137 @@
+#ifndef RDMA_WORKLOAD_H
+#define RDMA_WORKLOAD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @name WL_SIZE_FIXED/WL_SIZE_UNIFORM/WL_SIZE_BIMODAL/WL_SIZE_CDF
+ * @brief Request size distributions: one size, uniform over a range, one of
+ * two sizes, or an empirical CDF read from a file
+ */
+#define WL_SIZE_FIXED 0
+#define WL_SIZE_UNIFORM 1
+#define WL_SIZE_BIMODAL 2
+#define WL_SIZE_CDF 3
+
+/**
+ * @name WL_MAX_OPS/WL_MAX_CDF/WL_MAX_TRACE
+ * @brief Opcodes a mix draws from (SEND, RDMA_WRITE, RDMA_READ), points of
+ * an empirical size CDF and requests of a replayed trace
+ */
+#define WL_MAX_OPS 3
+#define WL_MAX_CDF 1024
+#define WL_MAX_TRACE (1 << 24)
+
+/**
+ * @name WL_TRACE_MAGIC/WL_TRACE_VERSION
+ * @brief Leading bytes and layout version of a binary request trace
+ */
+#define WL_TRACE_MAGIC "RDMACSTR"
+#define WL_TRACE_VERSION 1
+
+/**
+ * @struct wl_trace_hdr_t
+ * @brief Header of a binary request trace, followed by nrec wl_trace_rec_t.
+ * Fields are little-endian
+ */
+typedef struct wl_trace_hdr_s {
+    char magic[8];    //< WL_TRACE_MAGIC, not NUL terminated
+    uint32_t version; //< WL_TRACE_VERSION
+    uint32_t rsvd;    //< Zero
+    uint64_t nrec;    //< Records following the header
+} __attribute__((packed)) wl_trace_hdr_t;
+
+/**
+ * @struct wl_trace_rec_t
+ * @brief One request of a trace
+ */
+typedef struct wl_trace_rec_s {
+    uint64_t t_nsec; //< Send time from the start of the trace, ascending
+    uint32_t msg_sz; //< Payload bytes
+    uint32_t opcode; //< OPC_SEND_ONLY, OPC_RDMA_WRITE or OPC_RDMA_READ
+} __attribute__((packed)) wl_trace_rec_t;
+
+/**
+ * @struct wl_spec_t
+ * @brief Requests of an open-loop run: sizes and opcodes drawn from their
+ * distributions, or replayed from a trace
+ */
+typedef struct wl_spec_s {
+    int size_dist;   //< WL_SIZE_*
+    size_t size_lo;  //< Fixed size, low end of uniform, first bimodal mode
+    size_t size_hi;  //< High end of uniform, second bimodal mode
+    double p_lo;     //< Probability of size_lo (bimodal)
+    size_t *cdf_sz;  //< Sizes of the empirical CDF, ascending
+    double *cdf_p;   //< Cumulative probability of each size, the last is 1
+    uint32_t ncdf;   //< Points of the CDF
+    int ops[WL_MAX_OPS];       //< OPC_* of the mix
+    double op_cum[WL_MAX_OPS]; //< Cumulative weight of each, the last is 1
+    int nops;                  //< Opcodes of the mix
+    wl_trace_rec_t *trace; //< Requests replayed instead of drawn, or NULL
+    uint64_t ntrace;       //< Requests of trace
+    uint64_t seed;         //< fast_rand state of the draws
+} wl_spec_t;
+
+/**
+ * @brief Fixed msg_sz requests of opcode opc, the default workload
+ */
+void wl_spec_init(wl_spec_t *w, int opc, size_t msg_sz);
+
+/**
+ * @brief Release the CDF and the trace of a workload
+ */
+void wl_spec_free(wl_spec_t *w);
+
+/**
+ * @brief Set the size distribution from fixed:<n>, uniform:<lo>-<hi>,
+ * bimodal:<a>,<b>,<p of a> or cdf:<path>. A CDF file holds one
+ * "<size> <cumulative probability>" line per point, both ascending, '#'
+ * starting a comment
+ */
+int wl_parse_sizes(wl_spec_t *w, const char *str);
+
+/**
+ * @brief Set the opcode mix from <op>:<weight>[,<op>:<weight>...], op one of
+ * SEND, RDMA_WRITE and RDMA_READ, e.g. SEND:80,RDMA_READ:20
+ */
+int wl_parse_mix(wl_spec_t *w, const char *str);
+
+/**
+ * @brief Load a binary trace from path, replacing sizes and mix. The opcodes
+ * found make up the mix, in order of first appearance
+ */
+int wl_trace_load(wl_spec_t *w, const char *path);
+
+/**
+ * @brief Draw the size of the next request
+ */
+size_t wl_next_size(wl_spec_t *w);
+
+/**
+ * @brief Draw the opcode of the next request, as an index into w->ops
+ */
+int wl_next_op(wl_spec_t *w);
+
+/**
+ * @brief Index of opcode opc in w->ops, -1 if it is not part of the mix
+ */
+int wl_op_index(const wl_spec_t *w, int opc);
+
+/**
+ * @brief Largest request size the workload can produce
+ */
+size_t wl_max_size(const wl_spec_t *w);
+
+/**
+ * @brief True if the mix holds RDMA_WRITE or RDMA_READ requests
+ */
+bool wl_one_sided(const wl_spec_t *w);
+
+/**
+ * @brief Short name of a mix opcode, as used in result names
+ */
+const char *wl_op_str(int opc);
+
+#endif /*! RDMA_WORKLOAD_H */
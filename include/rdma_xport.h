@@ -0,0 +1,46 @@
+#ifndef RDMA_XPORT_H
+#define RDMA_XPORT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+/**
+ * @struct msg_xport_t
+ * @brief Message transport a client or server session runs over instead of
+ * verbs: shared memory or a kernel TCP socket. Messages carry an OPC_* and
+ * are received in place, valid until release or the next recv
+ */
+typedef struct msg_xport_s {
+    const char *name; //< Datapath in reports, e.g. "shm"
+    const char *tag;  //< Prefix of its test names, e.g. "SHM-"
+    uint32_t max_msg; //< Largest message carried
+
+    /**
+     * @brief Send the message gathered from iov. Fails on messages above
+     * max_msg or once the peer is gone
+     */
+    int (*send)(struct msg_xport_s *x, uint32_t opc, const struct iovec *iov,
+                int iovcnt);
+
+    /**
+     * @brief Hand out the next message, with wait until it arrives. Returns
+     * 1 with opc, data and len filled in, 0 if none arrived yet and -1 once
+     * the peer is gone
+     */
+    int (*recv)(struct msg_xport_s *x, uint32_t *opc, void **data,
+                uint32_t *len, bool wait);
+
+    /**
+     * @brief Done with the message of the last recv
+     */
+    void (*release)(struct msg_xport_s *x);
+
+    /**
+     * @brief End the session. A server is ready for the next client after
+     * it, a client must not use the transport again
+     */
+    void (*close)(struct msg_xport_s *x);
+} msg_xport_t;
+
+#endif /*! RDMA_XPORT_H */
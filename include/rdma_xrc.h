@@ -0,0 +1,22 @@
+#ifndef RDMA_XRC_H
+#define RDMA_XRC_H
+
+#include "client_server_shared.h"
+#include <stdint.h>
+
+/**
+ * @name XRC_PSN
+ * @brief Starting PSN of both ends of an XRC_SEND/XRC_RECV pair
+ */
+#define XRC_PSN 0
+
+/**
+ * @brief Move an XRC_SEND (to RTS) or XRC_RECV (to RTR) QP created outside
+ * RDMA CM onto the path of the connected cm_id id, facing the peer XRC QP
+ * dest_qpn. The RC connection of id only serves as the address resolution
+ * of the pair
+ */
+int xrc_connect_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                   uint32_t dest_qpn);
+
+#endif /*! RDMA_XRC_H */
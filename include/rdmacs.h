@@ -0,0 +1,39 @@
+#ifndef RDMACS_H
+#define RDMACS_H
+
+/**
+ * @file rdmacs.h
+ * @brief Public API of librdmacs, the datapath RDMAClient and RDMAServer are
+ * built on. Link librdmacs.so or librdmacs.a and include this header only:
+ *  - rdma_client_lib.h: setup_client, send/post/poll requests, atomics,
+ *    bandwidth streams, reconnect_client, run_client_fibers
+ *  - rdma_server_lib.h: setup_server, connect_server, send_recv_server,
+ *    disconnect_server
+ *  - rdma_ud.h/rdma_xrc.h: Unreliable Datagram and XRC transports
+ *  - rdma_shm.h: shared-memory rings of same-host clients
+ *  - rdma_tcp.h/rdma_uring.h: kernel TCP baselines, plain or over io_uring
+ *  - rdma_xport.h: message transport interface of shm and TCP sessions
+ *  - rdma_stats.h: datapath counters and the stats thread
+ *  - rdma_report.h: latency stats and run reports
+ *  - rdma_fiber.h: per-thread fiber scheduler of overlapped requests
+ *  - rdma_workload.h: size distributions, opcode mixes and request traces
+ *  - rdma_core.h: CQ polling, CQ creation and threads both endpoints share
+ */
+
+#include "client_server_shared.h"
+#include "completion_ring.h"
+#include "rdma_core.h"
+#include "rdma_fiber.h"
+#include "rdma_client_lib.h"
+#include "rdma_report.h"
+#include "rdma_server_lib.h"
+#include "rdma_shm.h"
+#include "rdma_stats.h"
+#include "rdma_tcp.h"
+#include "rdma_ud.h"
+#include "rdma_uring.h"
+#include "rdma_workload.h"
+#include "rdma_xport.h"
+#include "rdma_xrc.h"
+
+#endif /*! RDMACS_H */
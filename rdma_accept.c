@@ -0,0 +1,145 @@
+#include "rdma_accept.h"
+#include "client_server_shared.h"
+#include "rdma_core.h"
+#include <errno.h>
+#include <rdma/rdma_cma.h>
+#include <stdio.h>
+#include <string.h>
+
+int accept_pool_init(accept_pool_t *pool, struct ibv_pd *pd,
+                     const struct ibv_qp_init_attr *attr, bool ex) {
+    memset(pool, 0, sizeof(accept_pool_t));
+    pool->pd = pd;
+    pool->attr = *attr;
+    pool->ex = ex;
+    return (pthread_mutex_init(&(pool->mtx), NULL) ? -1 : 0);
+}
+
+int accept_pool_fill(accept_pool_t *pool) {
+    int added = 0;
+
+    while (1) {
+        pthread_mutex_lock(&(pool->mtx));
+        bool full = (pool->nqp >= ACCEPT_POOL_SZ);
+        pthread_mutex_unlock(&(pool->mtx));
+        if (full) {
+            break;
+        }
+
+        // ibv_create_qp may modify its attr, hand it a copy
+        struct ibv_qp_init_attr attr = pool->attr;
+        struct ibv_qp *qp = rdma_create_rc_qp(pool->pd, &attr, pool->ex);
+        API_NULL(
+            qp, { return (-1); }, "Unable to create pooled QP. Reason: %s\n",
+            strerror(errno));
+
+        pthread_mutex_lock(&(pool->mtx));
+        if (pool->nqp < ACCEPT_POOL_SZ) {
+            pool->qp[pool->nqp++] = qp;
+            qp = NULL;
+            added++;
+        }
+        pthread_mutex_unlock(&(pool->mtx));
+        // Another thread filled the last slot first
+        if (qp) {
+            ibv_destroy_qp(qp);
+            break;
+        }
+    }
+
+    return (added);
+}
+
+struct ibv_qp *accept_pool_get(accept_pool_t *pool) {
+    struct ibv_qp *qp = NULL;
+
+    pthread_mutex_lock(&(pool->mtx));
+    if (pool->nqp) {
+        qp = pool->qp[--pool->nqp];
+        pool->hits++;
+    } else {
+        pool->misses++;
+    }
+    pthread_mutex_unlock(&(pool->mtx));
+
+    if (!qp) {
+        struct ibv_qp_init_attr attr = pool->attr;
+        qp = rdma_create_rc_qp(pool->pd, &attr, pool->ex);
+        API_NULL(
+            qp, { return (NULL); }, "Unable to create QP. Reason: %s\n",
+            strerror(errno));
+    }
+
+    return (qp);
+}
+
+void accept_pool_destroy(accept_pool_t *pool) {
+    pthread_mutex_lock(&(pool->mtx));
+    while (pool->nqp) {
+        ibv_destroy_qp(pool->qp[--pool->nqp]);
+    }
+    pthread_mutex_unlock(&(pool->mtx));
+    pthread_mutex_destroy(&(pool->mtx));
+}
+
+// Path attributes of id for state, RDMA READ/atomic depths as accepted.
+// A dest_qpn other than 0 faces another QP than the one of id
+static int accept_modify_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                            enum ibv_qp_state state,
+                            uint8_t responder_resources,
+                            uint8_t initiator_depth, uint32_t dest_qpn) {
+    struct ibv_qp_attr attr = {0};
+    int mask = 0, rc = 0;
+
+    attr.qp_state = state;
+    rc = rdma_init_qp_attr(id, &attr, &mask);
+    API_STATUS(
+        rc, { return (-1); },
+        "Unable to get QP attributes of state %d. Reason: %s\n", state,
+        strerror(errno));
+
+    if (state == IBV_QPS_RTR) {
+        attr.max_dest_rd_atomic = responder_resources;
+        if (dest_qpn) {
+            attr.dest_qp_num = dest_qpn;
+            attr.rq_psn = EXTRA_QP_PSN;
+        }
+    } else if (state == IBV_QPS_RTS) {
+        attr.max_rd_atomic = initiator_depth;
+        attr.sq_psn = (dest_qpn) ? (EXTRA_QP_PSN) : (attr.sq_psn);
+    }
+
+    rc = ibv_modify_qp(qp, &attr, mask);
+    EXT_API_STATUS(
+        rc, { return (-1); }, "Unable to move QP %u to state %d. Reason: %s\n",
+        qp->qp_num, state, strerror(rc));
+    return (0);
+}
+
+int accept_connect_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                      uint8_t responder_resources, uint8_t initiator_depth) {
+    enum ibv_qp_state states[] = {IBV_QPS_INIT, IBV_QPS_RTR, IBV_QPS_RTS};
+
+    for (int i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+        API_STATUS(
+            accept_modify_qp(id, qp, states[i], responder_resources,
+                             initiator_depth, 0),
+            { return (-1); }, "Unable to connect QP %u\n", qp->qp_num);
+    }
+
+    return (0);
+}
+
+int accept_connect_extra_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                            uint32_t dest_qpn) {
+    enum ibv_qp_state states[] = {IBV_QPS_INIT, IBV_QPS_RTR, IBV_QPS_RTS};
+
+    for (int i = 0; i < sizeof(states) / sizeof(states[0]); i++) {
+        API_STATUS(
+            accept_modify_qp(id, qp, states[i], 0, 0, dest_qpn),
+            { return (-1); }, "Unable to connect QP %u to peer QP %u\n",
+            qp->qp_num, dest_qpn);
+    }
+
+    return (0);
+}
@@ -0,0 +1,318 @@
+#include "rdma_bw.h"
+#include "client_server_shared.h"
+#include "rdma_core.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+static int bw_post_qp_recvs(bw_stream_t *s, uint32_t q, uint32_t n) {
+    struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
+    int rc = 0;
+
+    // Every recv lands in the same buffers, only a FIN payload is ever read
+    recv_wr.next = NULL;
+    recv_wr.sg_list = &(s->recv_sge[0]);
+    recv_wr.num_sge = s->recv_nsge;
+    while (s->rx_posted[q] < n) {
+        recv_wr.wr_id = s->wr_id_base | ((uint64_t)q << BW_WR_QP_SHIFT) |
+                        (s->wr_seq++ & BW_WR_SEQ_MASK);
+        rc = ibv_post_recv(s->qp[q], &recv_wr, &recv_bad_wr);
+        API_STATUS(
+            rc,
+            {
+                STATS_ADD(s->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to post stream recv. Reason: %s\n", strerror(errno));
+        s->rx_posted[q]++;
+        STATS_ADD(s->stats, rx_posted, 1);
+    }
+
+    return (0);
+}
+
+int bw_post_recvs(bw_stream_t *s, uint32_t extra) {
+    for (uint32_t q = 0; q < bw_nqps(&(s->cfg)); q++) {
+        API_STATUS(
+            bw_post_qp_recvs(s, q,
+                             bw_rx_depth(&(s->cfg), s->peer_tx, q) +
+                                 ((q == 0) ? (extra) : (0))),
+            { return (-1); }, "Unable to post recvs of stream QP %u\n", q);
+    }
+
+    return (0);
+}
+
+static bool bw_is_recv(const cq_rec_t *rec) {
+    return (rec->opcode == IBV_WC_RECV ||
+            rec->opcode == IBV_WC_RECV_RDMA_WITH_IMM);
+}
+
+// QP of the round a completion comes from. Recvs the owner of the first QP
+// posted itself carry none of the stream bits
+static uint32_t bw_rec_qp(const cq_rec_t *rec) {
+    return ((rec->wr_id & BW_WR_FLAG)
+                ? ((uint32_t)((rec->wr_id & BW_WR_QP_MASK) >> BW_WR_QP_SHIFT))
+                : (0));
+}
+
+int bw_wait_start(bw_stream_t *s) {
+    cq_rec_t rec = {0};
+    while (cq_ring_pop(s->ring, &rec, s->alive)) {
+        EXT_API_STATUS(
+            rec.status != IBV_WC_SUCCESS, { return (-1); },
+            "Stream WR[%lx] failed. Status: %s\n", rec.wr_id,
+            ibv_wc_status_str(rec.status));
+        if (bw_is_recv(&rec)) {
+            s->rx_posted[bw_rec_qp(&rec)]--;
+            EXT_API_STATUS(
+                rec.imm != OPC_BW_START, { return (-1); },
+                "Unexpected message %x before bandwidth round start\n",
+                rec.imm);
+            return (0);
+        }
+    }
+
+    printf("Stream aborted, peer disconnected\n");
+    return (-1);
+}
+
+// len bytes at off of a message on QP q: all of it, or one stripe. wr is
+// the builder of the stream opcode for the QPs of rdma_post_ex
+static int bw_post_data(bw_stream_t *s, rdma_wr_fn_t wr, uint32_t q,
+                        uint32_t off, uint32_t len, bool warmup) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+
+    sge.addr = (uint64_t)s->send_buf + off;
+    sge.length = len;
+    sge.lkey = s->send_lkey;
+    send_wr.wr_id = s->wr_id_base | ((uint64_t)q << BW_WR_QP_SHIFT) |
+                    (s->wr_seq++ & BW_WR_SEQ_MASK);
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    if (s->cfg.opcode == OPC_RDMA_WRITE) {
+        // Writes are invisible to the peer CPU, the FIN carries the totals
+        send_wr.opcode = IBV_WR_RDMA_WRITE;
+        send_wr.wr.rdma.remote_addr = s->sink.addr + off;
+        send_wr.wr.rdma.rkey = s->sink.rkey;
+    } else {
+        send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+        send_wr.imm_data = warmup ? OPC_BW_WARMUP : OPC_BW_DATA;
+    }
+
+    uint64_t t0 = rdma_cycles();
+    int rc = (s->qpx[q])
+                 ? (rdma_post_ex(s->qpx[q], wr, send_wr.wr_id,
+                                 send_wr.send_flags, send_wr.imm_data,
+                                 send_wr.wr.rdma.remote_addr,
+                                 send_wr.wr.rdma.rkey, &sge, 1))
+                 : (ibv_post_send(s->qp[q], &send_wr, &send_bad_wr));
+    STATS_ADD(s->stats, post_cyc, rdma_cycles() - t0);
+    STATS_ADD(s->stats, post_n, 1);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(s->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post stream send. Reason: %s\n", strerror(errno));
+    STATS_ADD(s->stats, tx_msgs, 1);
+    STATS_ADD(s->stats, tx_bytes, len);
+    return (0);
+}
+
+// Message seq of the stream: whole on the next QP in turn, or striped with
+// chunk q on QP q. Returns 1 if the QPs it goes to have no room left
+static int bw_post_msg(bw_stream_t *s, rdma_wr_fn_t wr, uint64_t seq,
+                       uint64_t *qposted, const uint64_t *qdone,
+                       bool warmup) {
+    uint32_t n = bw_nqps(&(s->cfg)), depth = bw_qp_depth(&(s->cfg));
+
+    if (!s->cfg.stripe) {
+        uint32_t q = seq % n;
+        if (qposted[q] - qdone[q] >= depth) {
+            return (1);
+        }
+        API_STATUS(
+            bw_post_data(s, wr, q, 0, s->cfg.msg_sz, warmup),
+            { return (-1); },
+            "Unable to post stream message\n");
+        qposted[q]++;
+        return (0);
+    }
+
+    for (uint32_t q = 0; q < n; q++) {
+        if (qposted[q] - qdone[q] >= depth) {
+            return (1);
+        }
+    }
+    // The first msg_sz % n chunks take one byte more
+    uint32_t chunk = s->cfg.msg_sz / n, rem = s->cfg.msg_sz % n;
+    for (uint32_t q = 0; q < n; q++) {
+        uint32_t off = q * chunk + ((q < rem) ? (q) : (rem));
+        API_STATUS(
+            bw_post_data(s, wr, q, off, chunk + ((q < rem) ? (1) : (0)),
+                         warmup),
+            { return (-1); }, "Unable to post stream stripe\n");
+        qposted[q]++;
+    }
+
+    return (0);
+}
+
+static int bw_post_fin(bw_stream_t *s, const bw_result_t *tx) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+
+    memcpy(s->fin_buf, tx, sizeof(bw_result_t));
+    sge.addr = (uint64_t)s->fin_buf;
+    sge.length = sizeof(bw_result_t);
+    sge.lkey = s->fin_lkey;
+    send_wr.wr_id = s->wr_id_base | BW_WR_FIN;
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.imm_data = OPC_BW_FIN;
+    int rc = (s->qpx[0])
+                 ? (rdma_post_ex(s->qpx[0], rdma_wr_send_imm, send_wr.wr_id,
+                                 send_wr.send_flags, send_wr.imm_data, 0, 0,
+                                 &sge, 1))
+                 : (ibv_post_send(s->qp[0], &send_wr, &send_bad_wr));
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(s->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post stream FIN. Reason: %s\n", strerror(errno));
+    STATS_ADD(s->stats, tx_msgs, 1);
+    STATS_ADD(s->stats, tx_bytes, sizeof(bw_result_t));
+    return (0);
+}
+
+int bw_stream_run(bw_stream_t *s, bw_result_t *tx, bw_result_t *rx) {
+    uint64_t posted = 0, done = 0, t0 = 0, t_last = 0;
+    uint64_t r0 = 0, r_last = 0, rx_seen = 0, rx_expect = 0;
+    uint64_t qposted[MAX_CONN_QPS] = {0}, qdone[MAX_CONN_QPS] = {0};
+    uint64_t total = s->cfg.warmup + s->cfg.iterations;
+    uint32_t n = bw_nqps(&(s->cfg));
+    uint32_t units = (s->cfg.stripe) ? (n) : (1);
+    bool posting = s->tx, fin_posted = false, tx_done = false, rx_done = false;
+    bool fin_seen = false;
+    bw_result_t fin = {0};
+    cq_rec_t rec = {0};
+    // Writes are invisible to the peer CPU, the FIN carries the totals
+    rdma_wr_fn_t wr = (s->cfg.opcode == OPC_RDMA_WRITE) ? (rdma_wr_write)
+                                                        : (rdma_wr_send_imm);
+
+    memset(tx, 0, sizeof(bw_result_t));
+    memset(rx, 0, sizeof(bw_result_t));
+    // Without warm-up the window opens with the first post
+    t0 = (s->cfg.warmup) ? (0) : (cq_ring_now());
+
+    while (!tx_done || !rx_done) {
+        // Keep every QP qdepth / n WRs deep until the window closes
+        while (posting) {
+            if ((s->cfg.duration_nsec == 0 && posted >= total) ||
+                (s->cfg.duration_nsec && t0 &&
+                 (cq_ring_now() - t0) >= s->cfg.duration_nsec)) {
+                posting = false;
+                break;
+            }
+
+            int rc = bw_post_msg(s, wr, posted, qposted, qdone,
+                                 posted < s->cfg.warmup);
+            API_STATUS(
+                rc, { return (-1); }, "Unable to post stream data\n");
+            if (rc) {
+                break;
+            }
+            posted++;
+        }
+
+        // FIN once the data is out, and after the peer's if asked to
+        if (!posting && !fin_posted && done == posted &&
+            (!s->fin_after_rx || rx_done)) {
+            tx->elapsed_nsec = (t_last > t0) ? (t_last - t0) : (0);
+            API_STATUS(
+                bw_post_fin(s, tx), { return (-1); },
+                "Unable to finish stream\n");
+            fin_posted = true;
+        }
+
+        EXT_API_STATUS(
+            !cq_ring_pop(s->ring, &rec, s->alive), { return (-1); },
+            "Stream aborted, peer disconnected\n");
+        EXT_API_STATUS(
+            rec.status != IBV_WC_SUCCESS, { return (-1); },
+            "Stream WR[%lx] failed. Status: %s\n", rec.wr_id,
+            ibv_wc_status_str(rec.status));
+        uint32_t q = bw_rec_qp(&rec);
+
+        if (!bw_is_recv(&rec)) {
+            if (rec.wr_id & BW_WR_FIN) {
+                tx_done = true;
+                continue;
+            }
+
+            // A striped message is done once its slowest chunk is
+            uint64_t now_done = done + 1;
+            qdone[q]++;
+            for (uint32_t i = 0; s->cfg.stripe && i < n; i++) {
+                now_done = (i == 0 || qdone[i] < now_done) ? (qdone[i])
+                                                           : (now_done);
+            }
+            for (; done < now_done; done++) {
+                if (done + 1 == s->cfg.warmup) {
+                    t0 = rec.ts_nsec;
+                } else if (done + 1 > s->cfg.warmup) {
+                    t_last = rec.ts_nsec;
+                    tx->messages++;
+                    tx->bytes += s->cfg.msg_sz;
+                }
+            }
+            continue;
+        }
+
+        s->rx_posted[q]--;
+        if (rec.imm == OPC_BW_FIN) {
+            // Read before a late stripe of another QP overwrites it
+            memcpy(&fin, (void *)s->recv_sge[0].addr, sizeof(bw_result_t));
+            // RDMA_WRITE streams can only be accounted by the sender
+            if (s->peer_tx && s->cfg.opcode == OPC_RDMA_WRITE) {
+                *rx = fin;
+            } else if (s->peer_tx) {
+                rx_expect = (s->cfg.warmup + fin.messages) * units;
+            }
+            fin_seen = true;
+        } else {
+            if (rec.imm == OPC_BW_DATA) {
+                r0 = (r0) ? (r0) : (rec.ts_nsec);
+                r_last = rec.ts_nsec;
+                rx->messages++;
+                rx->bytes += rec.byte_len;
+            }
+            rx_seen++;
+
+            API_STATUS(
+                bw_post_qp_recvs(s, q, s->rx_posted[q] + 1), { return (-1); },
+                "Unable to replenish stream recvs\n");
+        }
+
+        // Other QPs may still deliver what was sent ahead of the FIN
+        if (fin_seen && !rx_done && rx_seen >= rx_expect) {
+            if (!s->peer_tx || s->cfg.opcode != OPC_RDMA_WRITE) {
+                rx->messages /= units;
+                rx->elapsed_nsec = (r_last > r0) ? (r_last - r0) : (0);
+            }
+            rx_done = true;
+        }
+    }
+
+    return (0);
+}
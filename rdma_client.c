@@ -1,55 +1,2012 @@
 #include "client_server_shared.h"
 #include "rdma_client_lib.h"
+#include "rdma_perf.h"
+#include "rdma_report.h"
+#include "rdma_stats.h"
+#include "rdma_ud.h"
+#include "rdma_workload.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/epoll.h>
 #include <sys/types.h>
+#include <sys/uio.h>
+#include <time.h>
 #include <unistd.h>
 
 #define CLIENT_ARGS 6
+// Half the server recv pool, so bursts queue at the server instead of RNR
+#define MAX_OPEN_INFLIGHT 64
+// Samples kept per open-loop measurement of a duration bounded run
+#define MAX_OPEN_SAMPLES (1 << 24)
 
-static int start_client(const client_info_t *sv) {
+static const struct option client_opts[] = {
+    {"sge", required_argument, NULL, 's'},
+    {"copy", no_argument, NULL, 'c'},
+    {"threads", required_argument, NULL, 't'},
+    {"keys", required_argument, NULL, 'k'},
+    {"hot-keys", required_argument, NULL, 'h'},
+    {"hot-frac", required_argument, NULL, 'f'},
+    {"format", required_argument, NULL, 'F'},
+    {"output", required_argument, NULL, 'o'},
+    {"mode", required_argument, NULL, 'm'},
+    {"qdepth", required_argument, NULL, 'q'},
+    {"duration", required_argument, NULL, 'd'},
+    {"warmup", required_argument, NULL, 'w'},
+    {"outlier", required_argument, NULL, 'O'},
+    {"mlock", no_argument, NULL, 'l'},
+    {"rate", required_argument, NULL, 'r'},
+    {"arrival", required_argument, NULL, 'a'},
+    {"transport", required_argument, NULL, 'T'},
+    {"send-wr", required_argument, NULL, 'S'},
+    {"recv-wr", required_argument, NULL, 'R'},
+    {"cqe", required_argument, NULL, 'C'},
+    {"split-cq", no_argument, NULL, 'P'},
+    {"reconnect", required_argument, NULL, 'x'},
+    {"stats-interval", required_argument, NULL, 'i'},
+    {"stats-sock", required_argument, NULL, 'u'},
+    {"shm", required_argument, NULL, 'M'},
+    {"fibers", required_argument, NULL, 'b'},
+    {"sizes", required_argument, NULL, 'z'},
+    {"mix", required_argument, NULL, 'X'},
+    {"trace", required_argument, NULL, 'Y'},
+    {"rail", required_argument, NULL, 'L'},
+    {"stripe-min", required_argument, NULL, 'B'},
+    {"qps", required_argument, NULL, 'Q'},
+    {"mr", required_argument, NULL, 'g'},
+    {"prefetch", no_argument, NULL, 'p'},
+    {"first-touch", no_argument, NULL, 'I'},
+    {"verbs", required_argument, NULL, 'V'},
+    {"perf", no_argument, NULL, 'K'},
+    {NULL, 0, NULL, 0},
+};
+
+static void usage(void) {
+    printf("Usage: ./RDMAClient [options] <source IP> <target IP:target port> "
+           "<opcode> <iterations> <message size[,message size...]>\n"
+           "Options:\n"
+           "  --sge <n>   gather a %d byte header + payload split over n-1 "
+           "SGEs\n"
+           "  --copy      copy header + payload into one buffer before send\n"
+           "  --threads <n>     client threads sharing the connection "
+           "(ATOMIC_*), or each opening its own (storm)\n"
+           "  --keys <n>        server counters targeted, up to %d "
+           "(ATOMIC_*)\n"
+           "  --hot-keys <n>    size of the hot-spot among the counters "
+           "(ATOMIC_*)\n"
+           "  --hot-frac <f>    fraction of requests on the hot-spot "
+           "(ATOMIC_*)\n"
+           "  --format <fmt>    report format: text (default), json, csv\n"
+           "  --output <path>   write the report to path instead of stdout\n"
+           "  --mode <mode>     lat (default): round trips, WRITE_RPC "
+           "ones as write RPCs polled in memory, bw: stream to the server, "
+           "bibw: stream both ways (SEND, RDMA_WRITE), open: requests on a "
+           "schedule (SEND), storm: open and close iterations connections "
+           "per thread\n"
+           "  --qdepth <n>      outstanding WRs per stream, up to %d (bw)\n"
+           "  --duration <t>    timed window per size, e.g. 10s, 500ms; "
+           "default: iterations messages (bw)\n"
+           "  --warmup <n>      untimed requests before each measurement\n"
+           "  --outlier <t>     count latencies above t, e.g. 20us\n"
+           "  --mlock           pre-fault and mlock the registered buffers\n"
+           "  --rate <r[,r...]> offered requests/sec to sweep, up to %d "
+           "(open)\n"
+           "  --arrival <dist>  fixed (default) or poisson inter-arrival "
+           "times (open)\n"
+           "  --transport <t>   rc (default), ud: one server QP for all "
+           "clients, retransmit on loss (SEND, lat), xrc: requests into a "
+           "server SRQ (SEND, lat/open), tcp, uring: kernel TCP baselines "
+           "over socket calls or io_uring, no device (SEND, lat/open/bw)\n"
+           "  --send-wr <n>     send queue depth, default %d capped by the "
+           "device\n"
+           "  --recv-wr <n>     receive queue depth, default %d capped by the "
+           "device\n"
+           "  --cqe <n>         entries per CQ, default what the queues need\n"
+           "  --split-cq        complete sends and recvs on separate CQs\n"
+           "  --reconnect <n>   on failure, reconnect up to n times with "
+           "backoff and retry the request (lat, ATOMIC_*)\n"
+           "  --stats-interval <t> print datapath counters every t, e.g. 1s\n"
+           "  --stats-sock <path>  serve datapath counters to every "
+           "connection on a Unix socket\n"
+           "  --shm <mode>      auto (default): reach a server on this host "
+           "over shared memory if it serves it, on: require it, off: always "
+           "verbs (rc, SEND lat/open/bw up to %d bytes)\n"
+           "  --fibers <n>      round trips of n fibers in flight at once on "
+           "the one requester thread, up to %d (SEND, lat)\n"
+           "  --sizes <dist>    request sizes instead of the size argument: "
+           "fixed:<n>, uniform:<lo>-<hi>, bimodal:<a>,<b>,<p of a> or "
+           "cdf:<file> of \"<size> <cumulative p>\" lines (open)\n"
+           "  --mix <op:w,...>  opcode mix instead of SEND, e.g. "
+           "SEND:80,RDMA_READ:20; RDMA_WRITE/READ target the server sink "
+           "(open, rc/xrc)\n"
+           "  --trace <file>    replay the sizes, opcodes and send times of "
+           "a binary request trace instead of --rate (open)\n"
+           "  --rail <src IP>,<target IP:port>  stream over one more address "
+           "pair, up to %d rails with the arguments' one (bw, rc)\n"
+           "  --stripe-min <n>  split messages of n bytes and up across the "
+           "rails or QPs, default %d; smaller ones are dealt out whole\n"
+           "  --qps <n[,n...]>  RC QPs of the connection to stream over, "
+           "up to %d, swept for every size; qdepth is shared out between "
+           "them (bw/bibw, rc)\n"
+           "  --mr <mode>       register buffers pinned (default), odp: "
+           "paged in by the device on first touch, implicit: one ODP MR "
+           "over the whole address space (rc)\n"
+           "  --prefetch        fault ODP buffers in at registration with "
+           "ibv_advise_mr (rc)\n"
+           "  --first-touch     report the first round trip of each size "
+           "apart, ahead of warm-up (lat)\n"
+           "  --verbs <api>     legacy (default): ibv_post_send and "
+           "ibv_poll_cq, ex: post through ibv_qp_ex and poll extended CQs "
+           "(rc/xrc)\n"
+           "  --perf            count CPU cycles, instructions, cache misses "
+           "and context switches of every thread around each timed loop "
+           "with perf_event_open (lat/bw/bibw/open/atomics)\n",
+           RDMA_MSG_HDR_SZ, MAX_ATOMIC_CTR, MAX_BW_QDEPTH, MAX_RATE_LIST,
+           DEFAULT_SEND_WR, DEFAULT_RECV_WR, SHM_SLOT_SZ, MAX_FIBERS,
+           MAX_RAILS, RAIL_STRIPE_MIN, MAX_CONN_QPS);
+}
+
+static const char *bench_mode_str[] = {
+    [BENCH_MODE_LAT] = "lat",
+    [BENCH_MODE_BW] = "bw",
+    [BENCH_MODE_BIBW] = "bibw",
+    [BENCH_MODE_OPEN] = "open",
+    [BENCH_MODE_STORM] = "storm",
+};
+
+static const char *transport_str[] = {
+    [TRANSPORT_RC] = "rc",
+    [TRANSPORT_UD] = "ud",
+    [TRANSPORT_XRC] = "xrc",
+    [TRANSPORT_TCP] = "tcp",
+    [TRANSPORT_URING] = "uring",
+};
+
+static const char *shm_mode_str[] = {
+    [SHM_MODE_OFF] = "off",
+    [SHM_MODE_AUTO] = "auto",
+    [SHM_MODE_ON] = "on",
+};
+
+static const char *mr_mode_str[] = {
+    [MR_MODE_PINNED] = "pinned",
+    [MR_MODE_ODP] = "odp",
+    [MR_MODE_IMPLICIT] = "implicit",
+};
+
+static const char *verbs_api_str[] = {"legacy", "ex"};
+
+// Counters of every timed loop with --perf, left off otherwise
+static perf_set_t client_perf;
+
+static int parse_mode(const char *str) {
+    for (int m = BENCH_MODE_LAT; m <= BENCH_MODE_STORM; m++) {
+        if (strcmp(str, bench_mode_str[m]) == 0) {
+            return (m);
+        }
+    }
+
+    return (-1);
+}
+
+// r1,r2,... requests/sec, number of rates or 0 if malformed
+static int parse_rates(const char *str, double *rates) {
+    char *list = strdup(str), *save = NULL, *tok = NULL;
+    int n = 0;
+    for (tok = strtok_r(list, ",", &save); tok && n < MAX_RATE_LIST;
+         tok = strtok_r(NULL, ",", &save)) {
+        rates[n] = atof(tok);
+        if (rates[n] <= 0) {
+            n = 0;
+            break;
+        }
+        n++;
+    }
+
+    free(list);
+    return (n);
+}
+
+// n1,n2,... QP counts, number of counts or 0 if malformed
+static int parse_qps(const char *str, int *qps) {
+    char *list = strdup(str), *save = NULL, *tok = NULL;
+    int n = 0;
+    for (tok = strtok_r(list, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        int v = atoi(tok);
+        if (n >= MAX_CONN_QPS || v < 1 || v > MAX_CONN_QPS) {
+            n = 0;
+            break;
+        }
+        qps[n++] = v;
+    }
+
+    free(list);
+    return (n);
+}
+
+// <source IP>,<target IP:port> of an extra rail, IPv4 like the arguments
+static int parse_rail(const char *str, struct sockaddr **src,
+                      struct sockaddr **dst) {
+    struct sockaddr_in *sin = calloc(1, sizeof(struct sockaddr_in));
+    struct sockaddr_in *din = calloc(1, sizeof(struct sockaddr_in));
+    char *pair = strdup(str), *port = NULL;
+    char *target = strchr(pair, ',');
+    int rc = -1;
+
+    if (target) {
+        *target++ = '\0';
+        port = strchr(target, ':');
+    }
+    if (sin && din && port) {
+        *port++ = '\0';
+        sin->sin_family = AF_INET;
+        din->sin_family = AF_INET;
+        din->sin_port = htons((uint16_t)atoi(port));
+        if (inet_pton(AF_INET, pair, &(sin->sin_addr)) == 1 &&
+            inet_pton(AF_INET, target, &(din->sin_addr)) == 1) {
+            *src = (struct sockaddr *)sin;
+            *dst = (struct sockaddr *)din;
+            rc = 0;
+        }
+    }
+
+    free(pair);
+    if (rc) {
+        free(sin);
+        free(din);
+    }
+    return (rc);
+}
+
+/**
+ * @struct bench_gate_t
+ * @brief Holds worker threads until every one of them was created, or sends
+ * them home if one could not be
+ */
+typedef struct bench_gate_s {
+    pthread_mutex_t mtx;
+    pthread_cond_t cv;
+    int state; //< 0 while closed, 1 once opened, -1 once aborted
+} bench_gate_t;
+
+static void bench_gate_init(bench_gate_t *g) {
+    pthread_mutex_init(&(g->mtx), NULL);
+    pthread_cond_init(&(g->cv), NULL);
+    g->state = 0;
+}
+
+static void bench_gate_open(bench_gate_t *g, bool go) {
+    pthread_mutex_lock(&(g->mtx));
+    g->state = (go) ? (1) : (-1);
+    pthread_cond_broadcast(&(g->cv));
+    pthread_mutex_unlock(&(g->mtx));
+}
+
+// 0 once opened, -1 if aborted
+static int bench_gate_wait(bench_gate_t *g) {
+    pthread_mutex_lock(&(g->mtx));
+    while (!g->state) {
+        pthread_cond_wait(&(g->cv), &(g->mtx));
+    }
+    int state = g->state;
+    pthread_mutex_unlock(&(g->mtx));
+    return ((state > 0) ? (0) : (-1));
+}
+
+static void bench_gate_destroy(bench_gate_t *g) {
+    pthread_cond_destroy(&(g->cv));
+    pthread_mutex_destroy(&(g->mtx));
+}
+
+/**
+ * @struct atomic_worker_t
+ * @brief Per-thread state and results of the atomic benchmark
+ */
+typedef struct atomic_worker_s {
+    pthread_t thread;
+    client_ctx_t *ctx;
+    const client_info_t *sv;
+    int tid;
+    int rc;
+    uint64_t ops;        //< Atomics completed
+    uint64_t cas_fail;   //< CAS attempts that observed a stale value
+    uint64_t total_nsec; //< Sum of per-atomic latencies
+    uint64_t max_nsec;   //< Worst per-atomic latency
+    lat_stats_t lat;     //< Per-atomic latency samples
+    bench_gate_t *gate;      //< Opened once every thread was created
+    pthread_barrier_t *warm; //< Crossed once every thread has warmed up
+} atomic_worker_t;
+
+// Hot-spot skew: hot_frac of requests land on the first nhot_keys counters
+static uint32_t pick_atomic_key(const client_info_t *sv, uint64_t *seed) {
+    double r = (double)(fast_rand(seed) >> 11) / (double)(1ULL << 53);
+    if (r < sv->hot_frac) {
+        return (fast_rand(seed) % sv->nhot_keys);
+    }
+
+    return (fast_rand(seed) % sv->nkeys);
+}
+
+static void *atomic_worker(void *arg) {
+    atomic_worker_t *w = (atomic_worker_t *)arg;
+    const client_info_t *sv = w->sv;
+    uint64_t seed = 0x9E3779B97F4A7C15ULL * (w->tid + 1), old = 0, nsec = 0;
+    bool warmed = false;
+
+    // The warm-up barrier only counts once every thread exists
+    if (bench_gate_wait(w->gate)) {
+        w->rc = -1;
+        return (NULL);
+    }
+
+    // Last value observed per counter, used as the CAS expected value
+    uint64_t *expected = calloc(sv->nkeys, sizeof(uint64_t));
+    API_NULL(
+        expected,
+        {
+            w->rc = -1;
+            if (sv->warmup) {
+                pthread_barrier_wait(w->warm);
+            }
+            return (NULL);
+        },
+        "Unable to allocate CAS expected values\n");
+
+    for (uint64_t i = 0; i < sv->warmup + sv->iterations; i++) {
+        // The timed window opens for all threads at once
+        if (sv->warmup && i == sv->warmup) {
+            pthread_barrier_wait(w->warm);
+            warmed = true;
+        }
+
+        uint32_t key = pick_atomic_key(sv, &seed);
+        TIME_DECLARATIONS();
+        do {
+            TIME_START();
+            if (sv->opcode == OPC_ATOMIC_FADD) {
+                w->rc = send_client_atomic(w->ctx, OPC_ATOMIC_FADD, key, 1, 0,
+                                           &old);
+            } else {
+                w->rc =
+                    send_client_atomic(w->ctx, OPC_ATOMIC_CAS, key,
+                                       expected[key], expected[key] + 1, &old);
+            }
+            TIME_GET_ELAPSED_TIME(nsec);
+        } while (w->rc && sv->reconnect &&
+                 !reconnect_client(w->ctx, sv->reconnect));
+        API_STATUS(
+            w->rc, { break; }, "Unable to send atomic to server\n");
+        if (sv->opcode == OPC_ATOMIC_CAS) {
+            w->cas_fail += (old != expected[key]);
+            expected[key] = (old != expected[key]) ? (old) : (old + 1);
+        }
+        if (i < sv->warmup) {
+            continue;
+        }
+
+        w->ops++;
+        lat_stats_add(&(w->lat), nsec);
+        w->total_nsec += nsec;
+        w->max_nsec = (nsec > w->max_nsec) ? (nsec) : (w->max_nsec);
+    }
+
+    // Never leave the others waiting on a thread that failed in warm-up
+    if (sv->warmup && !warmed) {
+        pthread_barrier_wait(w->warm);
+    }
+
+    free(expected);
+    return (NULL);
+}
+
+static int start_atomic_client(client_ctx_t *ctx, const client_info_t *sv,
+                               report_t *r) {
+    const char *name = (sv->opcode == OPC_ATOMIC_FADD) ? "ATOMIC_FADD"
+                                                       : "ATOMIC_CAS";
+    report_result_t res = {0};
+    lat_stats_t lat = {0};
+    pthread_barrier_t warm;
+    bench_gate_t gate;
+    uint64_t ops = 0, nsec = 0;
+    int t = 0, rc = -1;
+
+    atomic_worker_t *w = calloc(sv->nthreads, sizeof(atomic_worker_t));
+    API_NULL(
+        w, { return (-1); }, "Unable to allocate atomic workers\n");
+    API_STATUS(
+        lat_stats_init(&lat, (size_t)sv->nthreads * sv->iterations),
+        { goto free_workers; }, "Unable to allocate latency samples\n");
+    lat.outlier_nsec = sv->outlier_nsec;
+    for (t = 0; t < sv->nthreads; t++) {
+        API_STATUS(
+            lat_stats_init(&(w[t].lat), sv->iterations), { goto free_lat; },
+            "Unable to allocate latency samples\n");
+    }
+
+    pthread_barrier_init(&warm, NULL, sv->nthreads + 1);
+    bench_gate_init(&gate);
+    for (t = 0; t < sv->nthreads; t++) {
+        w[t].ctx = ctx;
+        w[t].sv = sv;
+        w[t].tid = t;
+        w[t].gate = &gate;
+        w[t].warm = &warm;
+        // pthread_create returns an errno, not -1. On failure nobody may
+        // reach the warm-up barrier, it is short of threads
+        EXT_API_STATUS(
+            pthread_create(&(w[t].thread), NULL, atomic_worker, &w[t]) != 0,
+            {
+                bench_gate_open(&gate, false);
+                while (t > 0) {
+                    pthread_join(w[--t].thread, NULL);
+                }
+                goto destroy_sync;
+            },
+            "Unable to create atomic worker %d\n", t);
+    }
+    bench_gate_open(&gate, true);
+
+    // Warm-up atomics are neither timed nor sampled
+    if (sv->warmup) {
+        pthread_barrier_wait(&warm);
+    }
+    // The workers run on regardless, collect them before bailing out
+    rc = perf_start(&client_perf);
+    API_STATUS(
+        rc, {}, "Unable to start CPU counters\n");
+    TIME_DECLARATIONS();
+    TIME_START();
+
+    for (t = 0; t < sv->nthreads; t++) {
+        pthread_join(w[t].thread, NULL);
+    }
+    TIME_GET_ELAPSED_TIME(nsec);
+    if (rc) {
+        goto destroy_sync;
+    }
+    perf_stop(&client_perf, &(res.perf));
+
+    for (t = 0; t < sv->nthreads; t++) {
+        printf("[%s] Thread: %d, Ops: %lu, Avg Latency: %lu nsec, Max "
+               "Latency: %lu nsec, CAS Failures: %lu\n",
+               name, t, w[t].ops, w[t].ops ? (w[t].total_nsec / w[t].ops) : 0,
+               w[t].max_nsec, w[t].cas_fail);
+        ops += w[t].ops;
+        rc = (w[t].rc) ? (w[t].rc) : (rc);
+        lat_stats_merge(&lat, &(w[t].lat));
+        lat_stats_free(&(w[t].lat));
+    }
+
+    printf("[%s] Threads: %d, Keys: %d, Hot Keys: %d, Hot Fraction: %.2f, "
+           "Throughput: %.0f ops/sec\n",
+           name, sv->nthreads, sv->nkeys, sv->nhot_keys, sv->hot_frac,
+           (double)ops * NSEC_TO_SEC / (double)nsec);
+
+    snprintf(res.test, sizeof(res.test), "%s", name);
+    res.msg_sz = sizeof(uint64_t);
+    res.messages = ops;
+    res.elapsed_sec = (double)nsec / NSEC_TO_SEC;
+    report_result_rates(&res);
+    lat_stats_summarize(&lat, &(res.lat));
+    report_add_result(r, &res);
+
+destroy_sync:
+    bench_gate_destroy(&gate);
+    pthread_barrier_destroy(&warm);
+free_lat:
+    for (t = 0; t < sv->nthreads; t++) {
+        lat_stats_free(&(w[t].lat));
+    }
+    lat_stats_free(&lat);
+free_workers:
+    free(w);
+    return (rc);
+}
+
+/**
+ * @struct storm_worker_t
+ * @brief Per-thread state and results of the connection storm
+ */
+typedef struct storm_worker_s {
+    pthread_t thread;
+    const client_info_t *sv;
+    const bool *stop; //< Set when the run is abandoned, ends the loop early
+    int rc;
+    uint64_t conns;  //< Connections established
+    lat_stats_t lat; //< Per-connection time to ESTABLISHED
+} storm_worker_t;
+
+static void *storm_worker(void *arg) {
+    storm_worker_t *w = (storm_worker_t *)arg;
+    const client_info_t *sv = w->sv;
+    client_storm_t st = {0};
+
+    st.xrc = (sv->transport == TRANSPORT_XRC);
+    for (uint64_t i = 0; i < sv->warmup + sv->iterations; i++) {
+        if (__atomic_load_n(w->stop, __ATOMIC_ACQUIRE)) {
+            w->rc = -1;
+            break;
+        }
+        w->rc = storm_client_connect(&st, sv->my_addr, sv->peer_addr);
+        API_STATUS(
+            w->rc, { break; }, "Unable to complete storm connection\n");
+        if (i < sv->warmup) {
+            continue;
+        }
+
+        w->conns++;
+        lat_stats_add(&(w->lat), st.last_nsec);
+    }
+
+    storm_client_destroy(&st);
+    return (NULL);
+}
+
+// Every thread opens and closes <iterations> connections back to back
+static int start_storm_client(const client_info_t *sv, report_t *r) {
+    report_result_t res = {0};
+    lat_stats_t lat = {0};
+    uint64_t conns = 0, nsec = 0;
+    bool stop = false;
+    int t = 0, rc = 0;
+
+    storm_worker_t *w = calloc(sv->nthreads, sizeof(storm_worker_t));
+    API_NULL(
+        w, { return (-1); }, "Unable to allocate storm workers\n");
+    API_STATUS(
+        lat_stats_init(&lat, (size_t)sv->nthreads * sv->iterations),
+        { goto free_workers; }, "Unable to allocate latency samples\n");
+    lat.outlier_nsec = sv->outlier_nsec;
+
+    TIME_DECLARATIONS();
+    TIME_START();
+    for (t = 0; t < sv->nthreads; t++) {
+        w[t].sv = sv;
+        w[t].stop = &stop;
+        API_STATUS(
+            lat_stats_init(&(w[t].lat), sv->iterations), { goto stop_workers; },
+            "Unable to allocate latency samples\n");
+        EXT_API_STATUS(
+            pthread_create(&(w[t].thread), NULL, storm_worker, &w[t]) != 0,
+            {
+                lat_stats_free(&(w[t].lat));
+                goto stop_workers;
+            },
+            "Unable to create storm worker %d\n", t);
+    }
+
+    for (t = 0; t < sv->nthreads; t++) {
+        pthread_join(w[t].thread, NULL);
+    }
+    TIME_GET_ELAPSED_TIME(nsec);
+
+    for (t = 0; t < sv->nthreads; t++) {
+        conns += w[t].conns;
+        rc = (w[t].rc) ? (w[t].rc) : (rc);
+        lat_stats_merge(&lat, &(w[t].lat));
+        lat_stats_free(&(w[t].lat));
+    }
+
+    const char *tag = (sv->transport == TRANSPORT_XRC) ? ("XRC-") : ("");
+    printf("[%sCONNECT] Threads: %d, Connections: %lu, Rate: %.0f conn/sec\n",
+           tag, sv->nthreads, conns,
+           (double)conns * NSEC_TO_SEC / (double)nsec);
+    snprintf(res.test, sizeof(res.test), "%sCONNECT", tag);
+    res.messages = conns;
+    res.elapsed_sec = (double)nsec / NSEC_TO_SEC;
+    report_result_rates(&res);
+    lat_stats_summarize(&lat, &(res.lat));
+    report_add_result(r, &res);
+    lat_stats_free(&lat);
+    free(w);
+    return (rc);
+
+stop_workers:
+    // Workers already started are told to stop between connections
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    while (t > 0) {
+        t--;
+        pthread_join(w[t].thread, NULL);
+        lat_stats_free(&(w[t].lat));
+    }
+    lat_stats_free(&lat);
+free_workers:
+    free(w);
+    return (-1);
+}
+
+// One-sided ops the run posts, which an ODP device must page besides SEND
+// and RECV
+static uint32_t client_odp_ops(const client_info_t *sv) {
+    uint32_t ops = 0;
+    if (sv->opcode == OPC_RDMA_WRITE || sv->opcode == OPC_WRITE_RPC ||
+        (sv->wl && wl_op_index(sv->wl, OPC_RDMA_WRITE) >= 0)) {
+        ops |= IBV_ODP_SUPPORT_WRITE;
+    }
+    if (sv->opcode == OPC_RDMA_READ ||
+        (sv->wl && wl_op_index(sv->wl, OPC_RDMA_READ) >= 0)) {
+        ops |= IBV_ODP_SUPPORT_READ;
+    }
+    if (sv->opcode == OPC_ATOMIC_FADD || sv->opcode == OPC_ATOMIC_CAS) {
+        ops |= IBV_ODP_SUPPORT_ATOMIC;
+    }
+
+    return (ops);
+}
+
+// Test name of the round trips of a latency run
+static const char *lat_test_name(const client_info_t *sv) {
+    if (sv->opcode == OPC_WRITE_RPC) {
+        return ("WRITE-RPC");
+    }
+    if (sv->opcode == OPC_RDMA_WRITE) {
+        return ((sv->nsge > 1)
+                    ? (sv->sge_copy ? "WRITE-IMM-COPY" : "WRITE-IMM-SGE")
+                    : ("WRITE-IMM"));
+    }
+
+    return ((sv->nsge > 1)
+                ? (sv->sge_copy ? "SEND-RECV-COPY" : "SEND-RECV-SGE")
+                : ("SEND-RECV"));
+}
+
+// Send request based the opcode
+static int send_client_req(client_ctx_t *ctx, const client_info_t *sv,
+                           size_t msg_sz, const struct iovec *siov,
+                           int siovcnt, const struct iovec *riov) {
+    if (sv->nsge > 1) {
+        return (send_client_request_iov(ctx, sv->opcode, siov, siovcnt, riov,
+                                        2, sv->sge_copy));
+    }
+
+    return (send_client_request(ctx, sv->opcode, msg_sz));
+}
+
+// One request/response round trip of the latency loop. With --reconnect, a
+// request that fails is retried on a new session; only the one that
+// completes is sampled
+static int send_client_rtt(client_ctx_t *ctx, const client_info_t *sv,
+                           size_t msg_sz, const struct iovec *siov,
+                           int siovcnt, const struct iovec *riov) {
+    int rc = 0;
+    while ((rc = send_client_req(ctx, sv, msg_sz, siov, siovcnt, riov)) &&
+           sv->reconnect && !reconnect_client(ctx, sv->reconnect)) {
+    }
+    API_STATUS(
+        rc, { return -1; }, "Unable to send request to server\n");
+
+    // Recv response based on the opcode
+    API_STATUS(
+        process_client_response(ctx, sv->opcode, msg_sz), { return -1; },
+        "Unable to recv response from server\n");
+    return (0);
+}
+
+/**
+ * @struct lat_fiber_t
+ * @brief One fiber of a latency run and its share of the round trips
+ */
+typedef struct lat_fiber_s {
+    client_ctx_t *ctx;
+    const client_info_t *sv;
+    const client_dp_t *dp; //< Requester thread the fibers share
+    size_t msg_sz;
+    const struct iovec *siov;
+    int siovcnt;
+    const struct iovec *riov;
+    uint64_t n;       //< Round trips to complete
+    lat_stats_t *lat; //< Samples of every fiber of the thread
+    int rc;
+} lat_fiber_t;
+
+static void lat_fiber(void *arg) {
+    lat_fiber_t *f = (lat_fiber_t *)arg;
+    for (uint64_t i = 0; i < f->n; i++) {
+        f->rc = send_client_rtt(f->ctx, f->sv, f->msg_sz, f->siov,
+                                f->siovcnt, f->riov);
+        API_STATUS(
+            f->rc, { return; }, "Unable to complete round trip\n");
+        // Nothing yields in between, so the latency is still this fiber's
+        lat_stats_add(f->lat, f->dp->last_rtt_nsec);
+    }
+}
+
+// The iterations of one message size, split over sv->nfibers fibers of the
+// calling thread. nsec spans the first post to the last response
+static int run_lat_fibers(client_ctx_t *ctx, const client_info_t *sv,
+                          const client_dp_t *dp, size_t msg_sz,
+                          const struct iovec *siov, int siovcnt,
+                          const struct iovec *riov, lat_stats_t *lat,
+                          uint64_t *nsec) {
+    lat_fiber_t *f = calloc(sv->nfibers, sizeof(lat_fiber_t));
+    fiber_sched_t sched = {0};
+    int rc = 0;
+
+    API_NULL(
+        f, { return (-1); }, "Unable to allocate fiber state\n");
+    API_STATUS(
+        fiber_sched_init(&sched, sv->nfibers, 0),
+        {
+            free(f);
+            return (-1);
+        },
+        "Unable to prepare fiber scheduler\n");
+    for (int i = 0; i < sv->nfibers && !rc; i++) {
+        f[i] = (lat_fiber_t){ctx, sv, dp, msg_sz, siov, siovcnt, riov,
+                             sv->iterations / sv->nfibers, lat, 0};
+        f[i].n += (i < (sv->iterations % sv->nfibers)) ? (1) : (0);
+        rc = fiber_spawn(&sched, lat_fiber, &f[i]);
+    }
+
+    TIME_DECLARATIONS();
+    TIME_START();
+    rc = (rc) ? (rc) : run_client_fibers(ctx, &sched);
+    TIME_GET_ELAPSED_TIME(*nsec);
+    for (int i = 0; i < sv->nfibers; i++) {
+        rc = (f[i].rc) ? (f[i].rc) : (rc);
+    }
+
+    fiber_sched_destroy(&sched);
+    free(f);
+    return (rc);
+}
+
+// Failure to first completed request of every reconnect
+static void report_client_outages(report_t *r, const client_ctx_t *ctx) {
+    report_result_t res = {0};
+    lat_stats_t lat = {0};
+    uint32_t n = (ctx->noutages < MAX_CLIENT_OUTAGES) ? (ctx->noutages)
+                                                      : (MAX_CLIENT_OUTAGES);
+    if (!ctx->reconnects || lat_stats_init(&lat, n)) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+        lat_stats_add(&lat, ctx->outage_nsec[i]);
+        res.elapsed_sec += (double)ctx->outage_nsec[i] / NSEC_TO_SEC;
+    }
+    printf("[RECONNECT] Reconnects: %u, Outages measured: %u\n",
+           ctx->reconnects, ctx->noutages);
+    snprintf(res.test, sizeof(res.test), "RECONNECT");
+    res.messages = ctx->reconnects;
+    lat_stats_summarize(&lat, &(res.lat));
+    report_add_result(r, &res);
+    lat_stats_free(&lat);
+}
+
+// Split the payload in send buf into nsge - 1 chunks behind the header
+static int build_sge_iov(client_ctx_t *ctx, const client_info_t *sv,
+                         size_t msg_sz, void *hdr_tx, void *hdr_rx,
+                         struct iovec *siov, struct iovec *riov) {
+    int nchunk = sv->nsge - 1, i = 0;
+    size_t chunk = msg_sz / nchunk, off = 0;
+
+    siov[0].iov_base = hdr_tx;
+    siov[0].iov_len = RDMA_MSG_HDR_SZ;
+    for (i = 0; i < nchunk; i++) {
+        siov[i + 1].iov_base = ctx->send_client_buf + off;
+        siov[i + 1].iov_len = (i == nchunk - 1) ? (msg_sz - off) : (chunk);
+        off += siov[i + 1].iov_len;
+    }
+
+    riov[0].iov_base = hdr_rx;
+    riov[0].iov_len = RDMA_MSG_HDR_SZ;
+    riov[1].iov_base = ctx->recv_client_buf;
+    riov[1].iov_len = msg_sz;
+    return (sv->nsge);
+}
+
+// Prefix of the test names of a run, telling the datapath apart
+static const char *client_test_tag(const client_ctx_t *ctx,
+                                   const client_info_t *sv) {
+    if (ctx->xport) {
+        return (ctx->xport->tag);
+    }
+
+    return ((sv->transport == TRANSPORT_XRC) ? ("XRC-") : (""));
+}
+
+// Messages from stripe_min up are split into n chunks, sizes at most a
+// byte apart, over as many rails or QPs
+static bool msg_striped(const client_info_t *sv, size_t msg_sz, int n) {
+    return (n > 1 && msg_sz >= sv->stripe_min && msg_sz >= (size_t)n);
+}
+
+static int start_bw_client(client_ctx_t *ctx, const client_info_t *sv,
+                           report_t *r) {
+    bool bidir = (sv->mode == BENCH_MODE_BIBW);
+    const char *opc = (sv->opcode == OPC_RDMA_WRITE) ? "RDMA_WRITE" : "SEND";
+    const char *path = client_test_tag(ctx, sv);
+    char test[32] = {0}, qps[8] = {0};
+    bw_result_t tx = {0}, rx = {0};
+    rdma_stats_snap_t start = {0}, end = {0};
+    perf_sample_t perf = {0};
+    int nqps = (sv->nqps) ? (sv->nqps) : (1);
+
+    for (int s = 0; s < sv->nmsg_sz; s++) {
+        for (int q = 0; q < nqps; q++) {
+            bw_cfg_t cfg = {0};
+            cfg.opcode = sv->opcode;
+            cfg.bidir = bidir;
+            cfg.qdepth = sv->qdepth;
+            cfg.msg_sz = sv->msg_szs[s];
+            cfg.warmup = sv->warmup;
+            cfg.iterations = sv->iterations;
+            cfg.duration_nsec = sv->duration_nsec;
+            cfg.nqps = (sv->nqps) ? (sv->qps[q]) : (1);
+            cfg.stripe = msg_striped(sv, cfg.msg_sz, cfg.nqps);
+            rdma_stats_snap(&(ctx->stats), &start);
+            API_STATUS(
+                perf_start(&client_perf), { return (-1); },
+                "Unable to start CPU counters\n");
+            API_STATUS(
+                stream_client_bw(ctx, &cfg, &tx, &rx), { return (-1); },
+                "Unable to stream %u byte messages over %u QPs\n",
+                cfg.msg_sz, cfg.nqps);
+            perf_stop(&client_perf, &perf);
+            rdma_stats_snap(&(ctx->stats), &end);
+
+            // A QP count sweep tells its rounds apart by name
+            if (sv->nqps) {
+                snprintf(qps, sizeof(qps), "-%uQP", cfg.nqps);
+            }
+            snprintf(test, sizeof(test), "%s%s-%s%s%s", path,
+                     bidir ? "BIBW" : "BW", opc, bidir ? "-TX" : "", qps);
+            // Warm-up and START/FIN included, a round posts little else
+            if (report_add_stream(r, test, cfg.msg_sz, tx.messages,
+                                  tx.elapsed_nsec) == 0) {
+                report_result_t *res = &(r->results[r->nresults - 1]);
+                report_result_cycles(res, &start, &end);
+                res->perf = perf;
+            }
+            if (bidir) {
+                snprintf(test, sizeof(test), "%sBIBW-%s-RX%s", path, opc,
+                         qps);
+                report_add_stream(r, test, cfg.msg_sz, rx.messages,
+                                  rx.elapsed_nsec);
+            }
+        }
+    }
+
+    return (0);
+}
+
+/**
+ * @struct rail_worker_t
+ * @brief One rail of a multi-rail bandwidth run: a connection of its own
+ * over one source/target pair, streamed by its own thread
+ */
+typedef struct rail_worker_s {
+    pthread_t thread;
+    client_ctx_t *ctx;
+    const client_info_t *sv;
+    int rail;
+    int rc;
+    bench_gate_t *gate;       //< Opened once every rail thread was created
+    pthread_barrier_t *round; //< Crossed by every rail before each round
+    uint32_t msg_sz[MAX_MSG_SZ_LIST]; //< Bytes per message of each round
+    bw_result_t tx[MAX_MSG_SZ_LIST];  //< Timed window of each round
+} rail_worker_t;
+
+// Striped messages are split into one chunk per rail and each rail streams
+// every message. Smaller ones are dealt out whole, a rail streaming its
+// share of the iterations; a timed run streams on every rail for the
+// window, each rail taking as many messages as it completes
+static bool rail_striped(const client_info_t *sv, size_t msg_sz) {
+    return (msg_striped(sv, msg_sz, sv->nrails));
+}
+
+static void *rail_worker(void *arg) {
+    rail_worker_t *w = (rail_worker_t *)arg;
+    const client_info_t *sv = w->sv;
+    int n = sv->nrails;
+
+    // Not every rail made it, nobody would cross the barrier with it
+    if (bench_gate_wait(w->gate)) {
+        w->rc = -1;
+        return (NULL);
+    }
+
+    for (int s = 0; s < sv->nmsg_sz; s++) {
+        size_t msg_sz = sv->msg_szs[s];
+        bw_cfg_t cfg = {0};
+        cfg.opcode = sv->opcode;
+        cfg.qdepth = sv->qdepth;
+        cfg.warmup = sv->warmup;
+        cfg.duration_nsec = sv->duration_nsec;
+        if (rail_striped(sv, msg_sz)) {
+            cfg.msg_sz = msg_sz / n + (w->rail < (int)(msg_sz % n));
+            cfg.iterations = sv->iterations;
+        } else {
+            cfg.msg_sz = msg_sz;
+            cfg.iterations =
+                sv->iterations / n + (w->rail < sv->iterations % n);
+        }
+        w->msg_sz[s] = cfg.msg_sz;
+
+        // Rounds of every rail overlap, a failed rail keeps crossing
+        pthread_barrier_wait(w->round);
+        if (w->rc == 0) {
+            bw_result_t rx = {0};
+            w->rc = stream_client_bw(w->ctx, &cfg, &(w->tx[s]), &rx);
+            API_STATUS(
+                w->rc, {}, "Unable to stream %u byte messages on rail %d\n",
+                cfg.msg_sz, w->rail);
+        }
+    }
+
+    return (NULL);
+}
+
+// Bandwidth streams over several source/target pairs at once, each rail a
+// connection to the server on its target; large messages are striped
+// across the rails and only complete once every chunk did
+static int start_rails_client(const client_info_t *sv, report_t *r) {
+    const char *opc = (sv->opcode == OPC_RDMA_WRITE) ? "RDMA_WRITE" : "SEND";
+    pthread_barrier_t round;
+    bench_gate_t gate;
+    perf_sample_t perf = {0};
+    uint64_t total = 0;
+    char test[32], key[32], val[64];
+    int t = 0, rc = -1;
+
+    rail_worker_t *w = calloc(sv->nrails, sizeof(rail_worker_t));
+    API_NULL(
+        w, { return (-1); }, "Unable to allocate rail workers\n");
+    for (t = 0; t < sv->nrails; t++) {
+        rdma_qp_cfg_t qp_cfg = sv->qp_cfg;
+        w[t].ctx = setup_client(sv->rail_src[t], sv->rail_dst[t],
+                                sv->transport, &qp_cfg, SHM_MODE_OFF);
+        API_NULL(
+            w[t].ctx, { goto free_ctxs; }, "Unable to connect rail %d\n", t);
+        w[t].ctx->quiet = (sv->report_fmt != REPORT_TEXT);
+        w[t].ctx->lock_bufs = sv->lock_bufs;
+        API_STATUS(
+            prepare_client_data(w[t].ctx, sv->opcode), { goto free_ctxs; },
+            "Unable to prepare the data of rail %d\n", t);
+
+        // Which NIC the CM bound each source address to
+        const char *dev = ibv_get_device_name(w[t].ctx->verbs->device);
+        snprintf(val, sizeof(val), "%s", SKADDR_TO_IP(sv->rail_src[t]));
+        printf("[RAIL%d] %s -> %s over %s port %u\n", t, val,
+               SKADDR_TO_IP(sv->rail_dst[t]), dev, w[t].ctx->cm_id->port_num);
+        snprintf(key, sizeof(key), "rail_%d_dev", t);
+        snprintf(val, sizeof(val), "%s:%u", dev, w[t].ctx->cm_id->port_num);
+        report_config_str(r, key, val);
+    }
+    report_config_str(r, "datapath", "verbs");
+    report_device(r, w[0].ctx->verbs, w[0].ctx->cm_id->port_num);
+
+    // Rails cross the round barrier only once the gate let all of them go
+    pthread_barrier_init(&round, NULL, sv->nrails);
+    bench_gate_init(&gate);
+    for (t = 0; t < sv->nrails; t++) {
+        w[t].sv = sv;
+        w[t].rail = t;
+        w[t].gate = &gate;
+        w[t].round = &round;
+        EXT_API_STATUS(
+            pthread_create(&(w[t].thread), NULL, rail_worker, &w[t]) != 0,
+            {
+                bench_gate_open(&gate, false);
+                while (t > 0) {
+                    pthread_join(w[--t].thread, NULL);
+                }
+                goto destroy_sync;
+            },
+            "Unable to create rail worker %d\n", t);
+    }
+    // Rounds of every size are counted as a whole, once every rail
+    // thread exists. The rails run on regardless, collect them first
+    rc = perf_start(&client_perf);
+    API_STATUS(
+        rc, {}, "Unable to start CPU counters\n");
+    bench_gate_open(&gate, true);
+    for (t = 0; t < sv->nrails; t++) {
+        pthread_join(w[t].thread, NULL);
+        rc = (w[t].rc) ? (w[t].rc) : (rc);
+    }
+    perf_stop(&client_perf, &perf);
+    for (int s = 0; s < sv->nmsg_sz; s++) {
+        for (t = 0; t < sv->nrails; t++) {
+            total += w[t].tx[s].messages;
+        }
+    }
+
+    for (int s = 0; rc == 0 && s < sv->nmsg_sz; s++) {
+        bool striped = rail_striped(sv, sv->msg_szs[s]);
+        uint64_t messages = (striped) ? (UINT64_MAX) : (0), nsec = 0;
+        for (t = 0; t < sv->nrails; t++) {
+            const bw_result_t *tx = &(w[t].tx[s]);
+            snprintf(test, sizeof(test), "RAIL%d-BW-%s", t, opc);
+            report_add_stream(r, test, w[t].msg_sz[s], tx->messages,
+                              tx->elapsed_nsec);
+            // A striped message is done once its last chunk is
+            if (striped) {
+                messages = (tx->messages < messages) ? (tx->messages)
+                                                     : (messages);
+            } else {
+                messages += tx->messages;
+            }
+            nsec = (tx->elapsed_nsec > nsec) ? (tx->elapsed_nsec) : (nsec);
+        }
+        snprintf(test, sizeof(test), "RAILS-BW-%s", opc);
+        if (report_add_stream(r, test, sv->msg_szs[s], messages, nsec) == 0) {
+            // Each size takes the share of the counts its rail messages had
+            report_result_t *res = &(r->results[r->nresults - 1]);
+            uint64_t round = 0;
+            for (t = 0; t < sv->nrails; t++) {
+                round += w[t].tx[s].messages;
+            }
+            res->perf = perf;
+            for (int c = 0; total && c < PERF_NCTR; c++) {
+                res->perf.val[c] =
+                    (uint64_t)((double)perf.val[c] * round / total);
+            }
+        }
+    }
+
+destroy_sync:
+    bench_gate_destroy(&gate);
+    pthread_barrier_destroy(&round);
+free_ctxs:
+    for (t = 0; t < sv->nrails; t++) {
+        if (w[t].ctx) {
+            destroy_client(w[t].ctx);
+        }
+    }
+    free(w);
+    return (rc);
+}
+
+/**
+ * @struct open_fifo_t
+ * @brief Open-loop requests awaiting their response, oldest first. SEND
+ * responses come back in request order and one-sided completions in posting
+ * order, so each kind has its own FIFO
+ */
+typedef struct open_fifo_s {
+    uint64_t intended[MAX_OPEN_INFLIGHT]; //< Scheduled send time
+    size_t msg_sz[MAX_OPEN_INFLIGHT];     //< Request bytes
+    uint8_t op[MAX_OPEN_INFLIGHT];        //< Index into the ops of the mix
+    bool timed[MAX_OPEN_INFLIGHT];        //< Sent past the warm-up
+    uint64_t head;                        //< Oldest request
+    uint64_t tail;                        //< Next free entry
+} open_fifo_t;
+
+// Gap to the next scheduled request of an open-loop run
+static uint64_t open_gap_nsec(int arrival, double rate, uint64_t *seed) {
+    if (arrival == ARRIVAL_FIXED) {
+        return ((uint64_t)(1e9 / rate));
+    }
+
+    // Exponential inter-arrival times make a Poisson process
+    double u = (double)(fast_rand(seed) >> 11) / (double)(1ULL << 53);
+    return ((uint64_t)(-log1p(-u) * 1e9 / rate));
+}
+
+// Requests of a trace replay: the whole trace, capped by warm-up plus
+// iterations when no duration bounds the run
+static uint64_t open_trace_total(const client_info_t *sv, const wl_spec_t *w) {
+    uint64_t total = sv->warmup + sv->iterations;
+    if (sv->duration_nsec || total > w->ntrace) {
+        return (w->ntrace);
+    }
+
+    return (total);
+}
+
+// Append the result of one open-loop measurement, n requests of bytes in
+// total; name follows the tag of the run
+static void open_add_result(report_t *r, const char *tag, const char *name,
+                            uint64_t n, uint64_t bytes, double elapsed_sec,
+                            double rate, lat_stats_t *lat,
+                            const perf_sample_t *perf) {
+    report_result_t res = {0};
+    if (perf) {
+        res.perf = *perf;
+    }
+    snprintf(res.test, sizeof(res.test), "%s%s", tag, name);
+    res.msg_sz = (n) ? (bytes / n) : (0);
+    res.messages = n;
+    res.elapsed_sec = elapsed_sec;
+    res.offered_rate = rate;
+    report_result_rates(&res);
+    lat_stats_summarize(lat, &(res.lat));
+    report_add_result(r, &res);
+}
+
+// One open-loop measurement: requests leave at their scheduled time whether
+// or not earlier responses arrived, and latency is taken from the scheduled
+// rather than the actual send time, so a stalled server is not hidden by a
+// stalled client (coordinated omission). Sizes and opcodes are drawn from w,
+// or replayed along with their schedule from its trace. lat holds the
+// samples of every request, then those of each opcode of a mix
+static int run_open_client(client_ctx_t *ctx, const client_info_t *sv,
+                           wl_spec_t *w, double rate, lat_stats_t *lat,
+                           report_t *r) {
+    open_fifo_t fifo[2] = {0}; // SEND responses, one-sided completions
+    uint64_t msgs[WL_MAX_OPS + 1] = {0}, bytes[WL_MAX_OPS + 1] = {0};
+    uint64_t seed = 0x9E3779B97F4A7C15ULL, sent = 0, done = 0;
+    uint64_t total = (w->trace) ? (open_trace_total(sv, w))
+                                : (sv->warmup + sv->iterations);
+    uint64_t start = cq_ring_now(), next = start, t0 = 0, t_last = 0;
+    int nlat = (w->nops > 1) ? (w->nops + 1) : (1);
+    bool posting = true;
+    cq_rec_t rec = {0};
+    perf_sample_t perf = {0};
+    char name[24];
+    int rc = 0;
+
+    for (int i = 0; i < nlat; i++) {
+        lat[i].n = 0;
+    }
+    API_STATUS(
+        perf_start(&client_perf), { return (-1); },
+        "Unable to start CPU counters\n");
+    while (posting || done < sent) {
+        // Issue whatever is due, the inflight cap only delays the backlog
+        uint64_t now = cq_ring_now();
+        while (posting && next <= now &&
+               (sent - done) < MAX_OPEN_INFLIGHT) {
+            if (sent == sv->warmup) {
+                t0 = next;
+            }
+            if ((sv->duration_nsec == 0 && sent >= total) ||
+                (sv->duration_nsec && sent >= sv->warmup &&
+                 (next - t0) >= sv->duration_nsec) ||
+                (w->trace && sent >= total)) {
+                posting = false;
+                break;
+            }
+
+            const wl_trace_rec_t *trec = (w->trace) ? (&(w->trace[sent]))
+                                                    : (NULL);
+            int op = (trec) ? (wl_op_index(w, trec->opcode)) : (wl_next_op(w));
+            size_t msg_sz = (trec) ? (trec->msg_sz) : (wl_next_size(w));
+            API_STATUS(
+                post_client_request(ctx, w->ops[op], msg_sz), { return (-1); },
+                "Unable to post open-loop request\n");
+            open_fifo_t *q = &(fifo[w->ops[op] != OPC_SEND_ONLY]);
+            uint64_t e = (q->tail++) % MAX_OPEN_INFLIGHT;
+            q->intended[e] = next;
+            q->msg_sz[e] = msg_sz;
+            q->op[e] = op;
+            q->timed[e] = (sent >= sv->warmup);
+            sent++;
+            if (!w->trace) {
+                next += open_gap_nsec(sv->arrival, rate, &seed);
+            } else if (sent < total) {
+                next = start + (w->trace[sent].t_nsec - w->trace[0].t_nsec);
+            }
+        }
+
+        rc = poll_client_response(ctx, &rec);
+        API_STATUS(
+            rc, { return (-1); }, "Unable to recv open-loop response\n");
+        if (rc == 0) {
+            continue;
+        }
+
+        bool resp = (rec.opcode == IBV_WC_RECV ||
+                     rec.opcode == IBV_WC_RECV_RDMA_WITH_IMM);
+        open_fifo_t *q = &(fifo[!resp]);
+        uint64_t e = (q->head++) % MAX_OPEN_INFLIGHT;
+        if (q->timed[e]) {
+            uint64_t nsec = rec.ts_nsec - q->intended[e];
+            lat_stats_add(&(lat[0]), nsec);
+            msgs[0]++;
+            bytes[0] += q->msg_sz[e];
+            if (nlat > 1) {
+                lat_stats_add(&(lat[q->op[e] + 1]), nsec);
+                msgs[q->op[e] + 1]++;
+                bytes[q->op[e] + 1] += q->msg_sz[e];
+            }
+            t_last = rec.ts_nsec;
+        }
+        done++;
+        if (resp) {
+            API_STATUS(
+                post_client_recvs(ctx, MAX_OPEN_INFLIGHT), { return (-1); },
+                "Unable to replenish open-loop recvs\n");
+        }
+    }
+
+    // Warm-up requests are interleaved with the timed ones, their share of
+    // the counts is taken out pro rata
+    perf_stop(&client_perf, &perf);
+    for (int c = 0; done && c < PERF_NCTR; c++) {
+        perf.val[c] = (uint64_t)((double)perf.val[c] * msgs[0] / done);
+    }
+
+    // A replayed trace offers the rate of its own schedule
+    if (w->trace && total > sv->warmup + 1) {
+        uint64_t span = w->trace[total - 1].t_nsec -
+                        w->trace[sv->warmup].t_nsec;
+        rate = (span) ? ((double)(total - sv->warmup - 1) * 1e9 / span) : (0);
+    }
+
+    double elapsed = (t_last > t0) ? ((double)(t_last - t0) / 1e9) : (0);
+    const char *tag = client_test_tag(ctx, sv);
+    if (!sv->wl) {
+        snprintf(name, sizeof(name), "OPEN-%s", wl_op_str(w->ops[0]));
+        open_add_result(r, tag, name, msgs[0], bytes[0], elapsed, rate,
+                        &(lat[0]), &perf);
+        return (0);
+    }
+
+    // The whole workload, then each opcode of a mix on its own
+    const char *kind = (w->trace) ? ("TRACE") : ("OPEN-MIX");
+    open_add_result(r, tag, kind, msgs[0], bytes[0], elapsed, rate, &(lat[0]),
+                    &perf);
+    for (int i = 1; i < nlat; i++) {
+        snprintf(name, sizeof(name), "%s-%s", kind, wl_op_str(w->ops[i - 1]));
+        open_add_result(r, tag, name, msgs[i], bytes[i], elapsed, rate,
+                        &(lat[i]), NULL);
+    }
+
+    return (0);
+}
+
+static int start_open_client(client_ctx_t *ctx, const client_info_t *sv,
+                             report_t *r) {
+    lat_stats_t lat[WL_MAX_OPS + 1] = {0};
+    wl_spec_t fixed = {0};
+    wl_spec_t *w = (sv->wl) ? (sv->wl) : (&fixed);
+    // A workload of its own replaces the size sweep, a trace the rates too
+    int nsz = (sv->wl) ? (1) : (sv->nmsg_sz);
+    int nrates = (w->trace) ? (1) : (sv->nrates);
+    int nlat = (w->nops > 1) ? (w->nops + 1) : (1);
+    double max_rate = 0;
+    size_t cap = sv->iterations;
+    int rc = -1;
+
+    for (int i = 0; i < sv->nrates; i++) {
+        max_rate = (sv->rates[i] > max_rate) ? (sv->rates[i]) : (max_rate);
+    }
+    if (w->trace) {
+        cap = open_trace_total(sv, w);
+    } else if (sv->duration_nsec) {
+        double n = max_rate * sv->duration_nsec / 1e9 + 1;
+        cap = (n < MAX_OPEN_SAMPLES) ? ((size_t)n) : (MAX_OPEN_SAMPLES);
+    }
+
+    for (int i = 0; i < nlat; i++) {
+        API_STATUS(
+            lat_stats_init(&(lat[i]), cap), { goto free_lat; },
+            "Unable to allocate latency samples\n");
+        lat[i].outlier_nsec = sv->outlier_nsec;
+    }
+    API_STATUS(
+        post_client_recvs(ctx, MAX_OPEN_INFLIGHT), { goto free_lat; },
+        "Unable to post open-loop recvs\n");
+
+    for (int s = 0; s < nsz; s++) {
+        if (!sv->wl) {
+            wl_spec_init(&fixed, sv->opcode, sv->msg_szs[s]);
+        }
+        for (int i = 0; i < nrates; i++) {
+            API_STATUS(
+                run_open_client(ctx, sv, w, sv->rates[i], lat, r),
+                { goto free_lat; }, "Unable to offer %.0f requests/sec\n",
+                sv->rates[i]);
+        }
+    }
+    rc = 0;
+
+free_lat:
+    for (int i = 0; i < nlat; i++) {
+        lat_stats_free(&(lat[i]));
+    }
+    return (rc);
+}
+
+// Round trips over UD, messages are limited to the path MTU
+static int start_ud_client(const client_info_t *sv, report_t *r) {
+    lat_stats_t lat = {0};
+    uint64_t nsec = 0;
+
+    ud_ctx_t *ctx = ud_setup_client(sv->my_addr, sv->peer_addr);
+    API_NULL(
+        ctx, { return -1; }, "Unable to resolve UD server\n");
+    report_device(r, ctx->verbs, ctx->port_num);
+    API_STATUS(
+        lat_stats_init(&lat, sv->iterations), { return -1; },
+        "Unable to allocate latency samples\n");
+    lat.outlier_nsec = sv->outlier_nsec;
+
+    for (int s = 0; s < sv->nmsg_sz; s++) {
+        report_result_t res = {0};
+        size_t msg_sz = sv->msg_szs[s];
+        uint64_t retransmits = ctx->retransmits;
+        for (uint64_t w = 0; w < sv->warmup; w++) {
+            API_STATUS(
+                ud_call_client(ctx, msg_sz), { return -1; },
+                "Unable to complete warm-up round trip\n");
+        }
+
+        lat.n = 0;
+        API_STATUS(
+            perf_start(&client_perf), { return -1; },
+            "Unable to start CPU counters\n");
+        TIME_DECLARATIONS();
+        TIME_START();
+        for (int i = 0; i < sv->iterations; i++) {
+            API_STATUS(
+                ud_call_client(ctx, msg_sz), { return -1; },
+                "Unable to complete round trip\n");
+            lat_stats_add(&lat, ctx->last_rtt_nsec);
+        }
+        TIME_GET_ELAPSED_TIME(nsec);
+        perf_stop(&client_perf, &(res.perf));
+        printf("[UD-SEND-RECV] Size: %zu bytes, Retransmits: %lu\n", msg_sz,
+               ctx->retransmits - retransmits);
+
+        snprintf(res.test, sizeof(res.test), "UD-SEND-RECV");
+        res.msg_sz = msg_sz;
+        res.messages = sv->iterations;
+        res.elapsed_sec = (double)nsec / NSEC_TO_SEC;
+        report_result_rates(&res);
+        lat_stats_summarize(&lat, &(res.lat));
+        report_add_result(r, &res);
+    }
+
+    lat_stats_free(&lat);
+    ud_destroy(ctx);
+    return 0;
+}
+
+static int start_client(const client_info_t *sv, report_t *r) {
+
+    int i = 0, s = 0, siovcnt = 0;
+    struct iovec siov[RDMA_MAX_SGE] = {0}, riov[2] = {0};
+    void *hdr_tx = NULL, *hdr_rx = NULL;
+    lat_stats_t lat = {0};
+    rdma_stats_snap_t start = {0}, end = {0};
+    uint64_t nsec = 0;
+    int rc = -1;
+
+    if (sv->transport == TRANSPORT_UD) {
+        return (start_ud_client(sv, r));
+    }
+
+    if (sv->mode == BENCH_MODE_STORM) {
+        return (start_storm_client(sv, r));
+    }
+
+    if (sv->nrails > 1) {
+        return (start_rails_client(sv, r));
+    }
 
-    int i = 0;
     // TODO: Debug the struct to ip conversion bug !
-    client_ctx_t *ctx = setup_client(sv->my_addr, sv->peer_addr);
+    rdma_qp_cfg_t qp_cfg = sv->qp_cfg;
+    client_ctx_t *ctx = setup_client(sv->my_addr, sv->peer_addr, sv->transport,
+                                     &qp_cfg, sv->shm);
     API_NULL(
         ctx, { return -1; },
         "Unable to setup client control plane and connect to server\n");
+    report_config_str(r, "datapath",
+                      (ctx->xport) ? (ctx->xport->name) : ("verbs"));
+    if (!ctx->xport) {
+        report_config_num(r, "send_wr", ctx->qp_cfg.send_wr);
+        report_config_num(r, "recv_wr", ctx->qp_cfg.recv_wr);
+        report_config_num(r, "cqe", ctx->qp_cfg.cqe);
+        report_config_num(r, "split_cq", ctx->qp_cfg.split_cq);
+        report_device(r, ctx->verbs, ctx->cm_id->port_num);
+    }
+    // Per-request lines would interleave with a machine-readable report
+    ctx->quiet = (sv->report_fmt != REPORT_TEXT);
+    ctx->lock_bufs = sv->lock_bufs;
 
     // Prepare request/response structures
     API_STATUS(
-        prepare_client_data(ctx, sv->opcode), { return -1; },
+        prepare_client_data(ctx, sv->opcode), { goto destroy_ctx; },
         "Unable to prepare the client request data\n");
 
-    for (i = 0; i < sv->iterations; i++) {
-        // Send request based the opcode
+    if (sv->opcode == OPC_ATOMIC_FADD || sv->opcode == OPC_ATOMIC_CAS) {
+        rc = start_atomic_client(ctx, sv, r);
+        report_client_outages(r, ctx);
+        goto destroy_ctx;
+    }
+
+    if (sv->mode == BENCH_MODE_OPEN) {
+        rc = start_open_client(ctx, sv, r);
+        goto destroy_ctx;
+    }
+
+    if (sv->mode != BENCH_MODE_LAT) {
+        rc = start_bw_client(ctx, sv, r);
+        goto destroy_ctx;
+    }
+
+    // Header lives in its own registered buffer, apart from the payload
+    if (sv->nsge > 1) {
+        EXT_API_STATUS(
+            ctx->max_sge < 2, { goto destroy_ctx; },
+            "Device supports %d SGE(s), unable to scatter response\n",
+            ctx->max_sge);
+        hdr_tx = aligned_alloc(RDMA_MSG_HDR_SZ, RDMA_MSG_HDR_SZ);
+        hdr_rx = aligned_alloc(RDMA_MSG_HDR_SZ, RDMA_MSG_HDR_SZ);
+        EXT_API_STATUS(
+            (!hdr_tx || !hdr_rx), { goto destroy_ctx; },
+            "Unable to allocate msg header buffers\n");
+        randomize_buf(&hdr_tx, RDMA_MSG_HDR_SZ);
+        // Message transports copy from any buffer
+        API_NULL(
+            (ctx->xport) ? (hdr_tx)
+                         : (register_client_buf(ctx, hdr_tx, RDMA_MSG_HDR_SZ)),
+            { goto destroy_ctx; }, "Unable to register msg header buffer\n");
+        API_NULL(
+            (ctx->xport) ? (hdr_rx)
+                         : (register_client_buf(ctx, hdr_rx, RDMA_MSG_HDR_SZ)),
+            { goto destroy_ctx; }, "Unable to register msg header buffer\n");
+    }
+
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { goto destroy_ctx; }, "Unable to attach client thread\n");
+    API_STATUS(
+        lat_stats_init(&lat, sv->iterations), { goto destroy_ctx; },
+        "Unable to allocate latency samples\n");
+    lat.outlier_nsec = sv->outlier_nsec;
+    // Write-based RPCs are polled on both sides
+    if (sv->opcode == OPC_WRITE_RPC) {
+        API_STATUS(
+            start_client_wrpc(ctx), { goto destroy_ctx; },
+            "Unable to start write RPCs\n");
+    }
+
+    const char *name = lat_test_name(sv);
+    for (s = 0; s < sv->nmsg_sz; s++) {
+        report_result_t res = {0};
+        size_t msg_sz = sv->msg_szs[s];
+        EXT_API_STATUS(
+            (msg_sz + RDMA_MSG_HDR_SZ) > MAX_MR_SZ, { goto destroy_ctx; },
+            "Message size %zu exceeds %d bytes\n", msg_sz,
+            MAX_MR_SZ - RDMA_MSG_HDR_SZ);
+        if (sv->nsge > 1) {
+            siovcnt = build_sge_iov(ctx, sv, msg_sz, hdr_tx, hdr_rx, siov,
+                                    riov);
+        }
+
+        // Ahead of warm-up, the first round trip of an ODP buffer takes the
+        // device page faults of the pages no smaller size touched yet
+        if (sv->first_touch) {
+            report_result_t first = {0};
+            API_STATUS(
+                send_client_rtt(ctx, sv, msg_sz, siov, siovcnt, riov),
+                { goto destroy_ctx; }, "Unable to complete first round trip\n");
+            lat.n = 0;
+            lat_stats_add(&lat, dp->last_rtt_nsec);
+            snprintf(first.test, sizeof(first.test), "%s%s-FIRST",
+                     client_test_tag(ctx, sv), name);
+            first.msg_sz = msg_sz;
+            first.messages = 1;
+            first.elapsed_sec = (double)dp->last_rtt_nsec / NSEC_TO_SEC;
+            report_result_rates(&first);
+            lat_stats_summarize(&lat, &(first.lat));
+            report_add_result(r, &first);
+        }
+
+        // Warm caches, MTT/MPT entries and the server before timing
+        bool quiet = dp->quiet;
+        dp->quiet = true;
+        for (uint64_t w = 0; w < sv->warmup; w++) {
+            API_STATUS(
+                send_client_rtt(ctx, sv, msg_sz, siov, siovcnt, riov),
+                { goto destroy_ctx; },
+                "Unable to complete warm-up round trip\n");
+        }
+        dp->quiet = quiet;
+
+        lat.n = 0;
+        rdma_stats_snap(&(ctx->stats), &start);
         API_STATUS(
-            send_client_request(ctx, sv->opcode, sv->msg_sz), { return -1; },
-            "Unable to send request to server\n");
+            perf_start(&client_perf), { goto destroy_ctx; },
+            "Unable to start CPU counters\n");
+        if (sv->nfibers > 1) {
+            API_STATUS(
+                run_lat_fibers(ctx, sv, dp, msg_sz, siov, siovcnt, riov, &lat,
+                               &nsec),
+                { goto destroy_ctx; },
+                "Unable to complete fiber round trips\n");
+        } else {
+            TIME_DECLARATIONS();
+            TIME_START();
+            for (i = 0; i < sv->iterations; i++) {
+                API_STATUS(
+                    send_client_rtt(ctx, sv, msg_sz, siov, siovcnt, riov),
+                    { goto destroy_ctx; }, "Unable to complete round trip\n");
+                lat_stats_add(&lat, dp->last_rtt_nsec);
+            }
+            TIME_GET_ELAPSED_TIME(nsec);
+        }
+        perf_stop(&client_perf, &(res.perf));
+        rdma_stats_snap(&(ctx->stats), &end);
 
-        // Recv response based on the opcode
+        snprintf(res.test, sizeof(res.test), "%s%s", client_test_tag(ctx, sv),
+                 name);
+        res.msg_sz = msg_sz;
+        res.messages = sv->iterations;
+        res.elapsed_sec = (double)nsec / NSEC_TO_SEC;
+        report_result_rates(&res);
+        report_result_cycles(&res, &start, &end);
+        lat_stats_summarize(&lat, &(res.lat));
+        report_add_result(r, &res);
+    }
+
+    if (sv->opcode == OPC_WRITE_RPC) {
         API_STATUS(
-            process_client_response(ctx, sv->opcode, sv->msg_sz),
-            { return -1; }, "Unable to recv response from server\n");
+            stop_client_wrpc(ctx), { goto destroy_ctx; },
+            "Unable to stop write RPCs\n");
     }
 
-    return 0;
+    report_client_outages(r, ctx);
+    rc = 0;
+
+destroy_ctx:
+    lat_stats_free(&lat);
+    destroy_client(ctx);
+    // Their MRs went with the ctx
+    free(hdr_tx);
+    free(hdr_rx);
+    return (rc);
+}
+
+static void report_client_config(report_t *r, const client_info_t *sv,
+                                 char *argv[]) {
+    report_config_str(r, "source", argv[1]);
+    report_config_str(r, "target", argv[2]);
+    report_config_str(r, "opcode", argv[3]);
+    report_config_num(r, "iterations", sv->iterations);
+    report_config_str(r, "msg_sz", argv[5]);
+    report_config_num(r, "sge", sv->nsge);
+    report_config_num(r, "copy", sv->sge_copy);
+    report_config_num(r, "threads", sv->nthreads);
+    report_config_num(r, "keys", sv->nkeys);
+    report_config_num(r, "hot_keys", sv->nhot_keys);
+    report_config_num(r, "hot_frac", sv->hot_frac);
+    report_config_str(r, "mode", bench_mode_str[sv->mode]);
+    report_config_num(r, "qdepth", sv->qdepth);
+    report_config_num(r, "warmup", sv->warmup);
+    report_config_num(r, "duration_sec", (double)sv->duration_nsec / 1e9);
+    report_config_num(r, "outlier_ns", sv->outlier_nsec);
+    report_config_num(r, "mlock", sv->lock_bufs);
+    report_config_str(r, "transport", transport_str[sv->transport]);
+    report_config_str(r, "arrival",
+                      (sv->arrival == ARRIVAL_POISSON) ? "poisson" : "fixed");
+    for (int i = 0; i < sv->nrates; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "rate_%d", i);
+        report_config_num(r, key, sv->rates[i]);
+    }
+    report_config_num(r, "reconnect", sv->reconnect);
+    report_config_str(r, "shm", shm_mode_str[sv->shm]);
+    report_config_num(r, "fibers", sv->nfibers);
+    report_config_num(r, "rails", sv->nrails);
+    report_config_num(r, "stripe_min", sv->stripe_min);
+    for (int i = 0; i < sv->nqps; i++) {
+        char key[32];
+        snprintf(key, sizeof(key), "qps_%d", i);
+        report_config_num(r, key, sv->qps[i]);
+    }
+    report_config_str(r, "mr", mr_mode_str[sv->qp_cfg.mr_mode]);
+    report_config_num(r, "prefetch", sv->qp_cfg.mr_prefetch);
+    report_config_num(r, "first_touch", sv->first_touch);
+    report_config_str(r, "verbs", verbs_api_str[sv->qp_cfg.ex_verbs]);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < CLIENT_ARGS) {
-        printf(
-            "Usage: ./RDMAClient <source IP> <target IP:target port> <opcode> "
-            "<iterations> <message size>\n");
+    int opt = 0, nsge = 1, nthreads = 1, nkeys = 1024, nhot_keys = 1;
+    double hot_frac = 0.0;
+    bool sge_copy = false;
+    report_fmt_t fmt = REPORT_TEXT;
+    const char *path = NULL;
+    int mode = BENCH_MODE_LAT, qdepth = 64;
+    uint64_t warmup = 0, duration_nsec = 0, outlier_nsec = 0;
+    bool lock_bufs = false;
+    double rates[MAX_RATE_LIST] = {0};
+    int nrates = 0, arrival = ARRIVAL_FIXED, transport = TRANSPORT_RC;
+    rdma_qp_cfg_t qp_cfg = {0};
+    int reconnect = 0;
+    uint64_t stats_nsec = 0;
+    const char *stats_sock = NULL;
+    int shm = SHM_MODE_AUTO;
+    int nfibers = 1;
+    const char *sizes = NULL, *mix = NULL, *trace = NULL;
+    wl_spec_t wl = {0};
+    struct sockaddr *rail_src[MAX_RAILS] = {0}, *rail_dst[MAX_RAILS] = {0};
+    int nrails = 1;
+    size_t stripe_min = RAIL_STRIPE_MIN;
+    int qps[MAX_CONN_QPS] = {0}, nqps = 0;
+    bool first_touch = false, perf = false;
+
+    wl_spec_init(&wl, OPC_SEND_ONLY, 0);
+    while ((opt = getopt_long(argc, argv, "", client_opts, NULL)) != -1) {
+        switch (opt) {
+        case 's':
+            nsge = atoi(optarg);
+            break;
+        case 'c':
+            sge_copy = true;
+            break;
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 'k':
+            nkeys = atoi(optarg);
+            break;
+        case 'h':
+            nhot_keys = atoi(optarg);
+            break;
+        case 'f':
+            hot_frac = atof(optarg);
+            break;
+        case 'F':
+            if (report_parse_fmt(optarg, &fmt)) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'm':
+            mode = parse_mode(optarg);
+            break;
+        case 'q':
+            qdepth = atoi(optarg);
+            break;
+        case 'd':
+            duration_nsec = parse_duration_nsec(optarg);
+            if (!duration_nsec) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'w':
+            warmup = strtoull(optarg, NULL, 0);
+            break;
+        case 'O':
+            outlier_nsec = parse_duration_nsec(optarg);
+            if (!outlier_nsec) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'l':
+            lock_bufs = true;
+            break;
+        case 'r':
+            nrates = parse_rates(optarg, rates);
+            if (!nrates) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'a':
+            if (strcmp(optarg, "fixed") == 0) {
+                arrival = ARRIVAL_FIXED;
+            } else if (strcmp(optarg, "poisson") == 0) {
+                arrival = ARRIVAL_POISSON;
+            } else {
+                usage();
+                return 1;
+            }
+            break;
+        case 'T':
+            if (strcmp(optarg, "rc") == 0) {
+                transport = TRANSPORT_RC;
+            } else if (strcmp(optarg, "ud") == 0) {
+                transport = TRANSPORT_UD;
+            } else if (strcmp(optarg, "xrc") == 0) {
+                transport = TRANSPORT_XRC;
+            } else if (strcmp(optarg, "tcp") == 0) {
+                transport = TRANSPORT_TCP;
+            } else if (strcmp(optarg, "uring") == 0) {
+                transport = TRANSPORT_URING;
+            } else {
+                usage();
+                return 1;
+            }
+            break;
+        case 'S':
+            qp_cfg.send_wr = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            qp_cfg.recv_wr = strtoul(optarg, NULL, 0);
+            break;
+        case 'C':
+            qp_cfg.cqe = strtoul(optarg, NULL, 0);
+            break;
+        case 'P':
+            qp_cfg.split_cq = true;
+            break;
+        case 'x':
+            reconnect = atoi(optarg);
+            break;
+        case 'i':
+            stats_nsec = parse_duration_nsec(optarg);
+            if (!stats_nsec) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'u':
+            stats_sock = optarg;
+            break;
+        case 'M':
+            for (shm = SHM_MODE_ON; shm >= SHM_MODE_OFF; shm--) {
+                if (strcmp(optarg, shm_mode_str[shm]) == 0) {
+                    break;
+                }
+            }
+            if (shm < SHM_MODE_OFF) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'b':
+            nfibers = atoi(optarg);
+            break;
+        case 'z':
+            sizes = optarg;
+            if (wl_parse_sizes(&wl, optarg)) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'X':
+            mix = optarg;
+            if (wl_parse_mix(&wl, optarg)) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'Y':
+            trace = optarg;
+            break;
+        case 'L':
+            if (nrails >= MAX_RAILS ||
+                parse_rail(optarg, &(rail_src[nrails]), &(rail_dst[nrails]))) {
+                usage();
+                return 1;
+            }
+            nrails++;
+            break;
+        case 'B':
+            stripe_min = strtoull(optarg, NULL, 0);
+            break;
+        case 'Q':
+            nqps = parse_qps(optarg, qps);
+            if (!nqps) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'g':
+            for (qp_cfg.mr_mode = MR_MODE_IMPLICIT;
+                 qp_cfg.mr_mode >= MR_MODE_PINNED; qp_cfg.mr_mode--) {
+                if (strcmp(optarg, mr_mode_str[qp_cfg.mr_mode]) == 0) {
+                    break;
+                }
+            }
+            if (qp_cfg.mr_mode < MR_MODE_PINNED) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'p':
+            qp_cfg.mr_prefetch = true;
+            break;
+        case 'I':
+            first_touch = true;
+            break;
+        case 'V':
+            if (strcmp(optarg, "legacy") && strcmp(optarg, "ex")) {
+                usage();
+                return 1;
+            }
+            qp_cfg.ex_verbs = (strcmp(optarg, "ex") == 0);
+            break;
+        case 'K':
+            perf = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if ((argc - optind) < (CLIENT_ARGS - 1) || nsge < 1 ||
+        nsge > RDMA_MAX_SGE || nthreads < 1 ||
+        nthreads > MAX_CLIENT_DP || nkeys < 1 || nkeys > MAX_ATOMIC_CTR ||
+        nhot_keys < 1 || nhot_keys > nkeys || hot_frac < 0.0 ||
+        hot_frac > 1.0 || mode < 0 || qdepth < 1 || qdepth > MAX_BW_QDEPTH ||
+        (mode == BENCH_MODE_OPEN && !nrates && !trace) || reconnect < 0 ||
+        nfibers < 1 || nfibers > MAX_FIBERS ||
+        (trace && (sizes || mix)) || stripe_min < 1) {
+        usage();
         return 1;
     }
 
-    const client_info_t *sv =
+    // Created first so that every log line is kept off a json/csv stdout
+    report_t *r = report_create(fmt, "client", path);
+    API_NULL(
+        r, { return 1; }, "Unable to create run report\n");
+
+    argv += (optind - 1);
+    client_info_t *sv =
         parse_caddress_info(argv[1], argv[2], argv[3], argv[4], argv[5]);
-    return (start_client(sv));
+    sv->nsge = nsge;
+    sv->sge_copy = sge_copy;
+    sv->nthreads = nthreads;
+    sv->nkeys = nkeys;
+    sv->nhot_keys = nhot_keys;
+    sv->hot_frac = hot_frac;
+    sv->report_fmt = fmt;
+    sv->report_path = path;
+    sv->mode = mode;
+    sv->qdepth = qdepth;
+    sv->warmup = warmup;
+    sv->duration_nsec = duration_nsec;
+    sv->outlier_nsec = outlier_nsec;
+    sv->lock_bufs = lock_bufs;
+    memcpy(sv->rates, rates, sizeof(rates));
+    sv->nrates = nrates;
+    sv->arrival = arrival;
+    sv->transport = transport;
+    sv->qp_cfg = qp_cfg;
+    sv->reconnect = reconnect;
+    sv->nfibers = nfibers;
+    if (trace) {
+        API_STATUS(
+            wl_trace_load(&wl, trace), { return 1; },
+            "Unable to load request trace %s\n", trace);
+    } else if (!sizes) {
+        wl.size_lo = wl.size_hi = sv->msg_sz;
+    }
+    sv->wl = (sizes || mix || trace) ? (&wl) : (NULL);
+    sv->nrails = nrails;
+    sv->rail_src[0] = sv->my_addr;
+    sv->rail_dst[0] = sv->peer_addr;
+    for (int i = 1; i < nrails; i++) {
+        sv->rail_src[i] = rail_src[i];
+        sv->rail_dst[i] = rail_dst[i];
+    }
+    sv->stripe_min = stripe_min;
+    memcpy(sv->qps, qps, sizeof(qps));
+    sv->nqps = nqps;
+    sv->first_touch = first_touch;
+    // The connection opens the most QPs a round of the sweep streams over
+    for (int i = 0; i < nqps; i++) {
+        sv->qp_cfg.nqps = ((uint32_t)qps[i] > sv->qp_cfg.nqps)
+                              ? ((uint32_t)qps[i])
+                              : (sv->qp_cfg.nqps);
+    }
+    EXT_API_STATUS(
+        (mode != BENCH_MODE_LAT && mode != BENCH_MODE_STORM &&
+         sv->opcode != OPC_SEND_ONLY && sv->opcode != OPC_RDMA_WRITE),
+        { return 1; }, "Bandwidth modes stream SEND or RDMA_WRITE\n");
+    EXT_API_STATUS(
+        (mode == BENCH_MODE_OPEN && sv->opcode != OPC_SEND_ONLY),
+        { return 1; }, "Open-loop mode issues SEND requests, others with "
+                       "--mix\n");
+    EXT_API_STATUS(
+        (sv->wl && mode != BENCH_MODE_OPEN), { return 1; },
+        "Workloads of --sizes, --mix and --trace run in open-loop mode\n");
+    EXT_API_STATUS(
+        (sv->wl &&
+         wl_max_size(sv->wl) > (size_t)(MAX_MR_SZ - RDMA_MSG_HDR_SZ)),
+        { return 1; }, "Workload requests exceed %d bytes\n",
+        MAX_MR_SZ - RDMA_MSG_HDR_SZ);
+    // One-sided requests of a mix need a verbs QP to the server sink
+    bool one_sided = (sv->wl && wl_one_sided(sv->wl));
+    EXT_API_STATUS(
+        (one_sided && transport != TRANSPORT_RC && transport != TRANSPORT_XRC),
+        { return 1; }, "RDMA_WRITE/READ requests of a workload run over "
+                       "rc/xrc\n");
+    EXT_API_STATUS(
+        (transport == TRANSPORT_UD &&
+         (mode != BENCH_MODE_LAT || sv->opcode != OPC_SEND_ONLY ||
+          nsge > 1)),
+        { return 1; }, "UD transport runs single SGE SEND round trips\n");
+    // Every payload SGE carries at least one byte
+    for (int i = 0; nsge > 1 && i < sv->nmsg_sz; i++) {
+        EXT_API_STATUS(
+            sv->msg_szs[i] < (size_t)(nsge - 1), { return 1; },
+            "Message size %zu is too small to split over %d SGEs\n",
+            sv->msg_szs[i], nsge - 1);
+    }
+    EXT_API_STATUS(
+        (transport == TRANSPORT_XRC &&
+         (mode == BENCH_MODE_BW || mode == BENCH_MODE_BIBW ||
+          sv->opcode != OPC_SEND_ONLY)),
+        { return 1; },
+        "XRC transport carries SEND requests (lat, open, storm)\n");
+    EXT_API_STATUS(
+        ((transport == TRANSPORT_TCP || transport == TRANSPORT_URING) &&
+         (mode == BENCH_MODE_BIBW || sv->opcode != OPC_SEND_ONLY)),
+        { return 1; },
+        "TCP transports carry SEND requests and one-way streams\n");
+    EXT_API_STATUS(
+        (sv->opcode == OPC_WRITE_RPC &&
+         (mode != BENCH_MODE_LAT || nsge > 1 || reconnect)),
+        { return 1; }, "Write RPCs run single buffer round trips (lat) "
+                       "without --reconnect\n");
+    EXT_API_STATUS(
+        (nfibers > 1 &&
+         (mode != BENCH_MODE_LAT || sv->opcode != OPC_SEND_ONLY || reconnect ||
+          (transport != TRANSPORT_RC && transport != TRANSPORT_XRC))),
+        { return 1; },
+        "Fibers overlap SEND round trips over rc/xrc without --reconnect\n");
+    EXT_API_STATUS(
+        (mode == BENCH_MODE_STORM && transport != TRANSPORT_RC &&
+         transport != TRANSPORT_XRC),
+        { return 1; }, "Connection storms open RC or XRC connections\n");
+    EXT_API_STATUS(
+        (nrails > 1 && (mode != BENCH_MODE_BW || transport != TRANSPORT_RC)),
+        { return 1; }, "Rails carry RC bandwidth streams (bw)\n");
+    EXT_API_STATUS(
+        (nqps &&
+         ((mode != BENCH_MODE_BW && mode != BENCH_MODE_BIBW) ||
+          transport != TRANSPORT_RC || nrails > 1 || reconnect ||
+          (int)sv->qp_cfg.nqps > qdepth)),
+        { return 1; },
+        "QPs of a connection carry RC bandwidth streams (bw/bibw) of one "
+        "rail, at least one WR each, without --reconnect\n");
+    // ODP pages what is not pinned, the UD slot ring always is
+    bool odp = (qp_cfg.mr_mode != MR_MODE_PINNED);
+    EXT_API_STATUS(
+        ((odp && (transport != TRANSPORT_RC || lock_bufs)) ||
+         (qp_cfg.mr_prefetch && !odp)),
+        { return 1; }, "ODP registers rc buffers without --mlock, "
+                       "--prefetch needs --mr odp/implicit\n");
+    EXT_API_STATUS(
+        (first_touch && (mode != BENCH_MODE_LAT || transport == TRANSPORT_UD ||
+                         sv->opcode == OPC_ATOMIC_FADD ||
+                         sv->opcode == OPC_ATOMIC_CAS)),
+        { return 1; }, "First touch is timed on lat round trips\n");
+    EXT_API_STATUS(
+        (qp_cfg.ex_verbs && transport != TRANSPORT_RC &&
+         transport != TRANSPORT_XRC),
+        { return 1; }, "Extended verbs post and poll rc/xrc QPs\n");
+    // Runs shared memory cannot carry keep the verbs path under auto
+    bool shm_fits = (transport == TRANSPORT_RC && nfibers == 1 &&
+                     nrails == 1 && !nqps && !odp && !qp_cfg.ex_verbs &&
+                     sv->opcode == OPC_SEND_ONLY && !one_sided &&
+                     mode != BENCH_MODE_BIBW && mode != BENCH_MODE_STORM);
+    EXT_API_STATUS(
+        (shm == SHM_MODE_ON && !shm_fits), { return 1; },
+        "Shared memory carries SEND requests and one-way streams (rc)\n");
+    sv->shm = (shm_fits) ? (shm) : (SHM_MODE_OFF);
+    sv->qp_cfg.odp_ops = client_odp_ops(sv);
+    report_client_config(r, sv, argv);
+    report_config_num(r, "stats_interval_sec", (double)stats_nsec / 1e9);
+    report_config_str(r, "stats_sock", (stats_sock) ? (stats_sock) : (""));
+    report_config_str(r, "sizes", (sizes) ? (sizes) : (""));
+    report_config_str(r, "mix", (mix) ? (mix) : (""));
+    report_config_str(r, "trace", (trace) ? (trace) : (""));
+    report_config_num(r, "perf", perf);
+    API_STATUS(
+        rdma_stats_start(stats_nsec, stats_sock), { return 1; },
+        "Unable to start stats thread\n");
+    API_STATUS(
+        (perf) ? (perf_init(&client_perf)) : (0), { return 1; },
+        "Unable to count CPU events with perf_event_open\n");
+    // A server gone mid-write fails the write instead of killing the run
+    signal(SIGPIPE, SIG_IGN);
+
+    int rc = start_client(sv, r);
+    report_finish(r);
+    wl_spec_free(&wl);
+    return (rc);
 }
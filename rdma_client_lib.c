@@ -1,8 +1,13 @@
 #include "rdma_client_lib.h"
 #include "client_server_shared.h"
+#include "rdma_accept.h"
+#include "rdma_bw.h"
+#include "rdma_core.h"
+#include "rdma_xrc.h"
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <pthread.h>
 #include <rdma/rdma_cma.h>
 #include <stdio.h>
@@ -15,20 +20,32 @@
 #include <time.h>
 #include <unistd.h>
 
+// ctx and datapath block the calling thread attached to last
+static __thread client_ctx_t *tls_ctx = NULL;
+static __thread client_dp_t *tls_dp = NULL;
+
+// Start of an outage, kept from the first failure seen until reconnected
+static void client_note_fault(client_ctx_t *ctx, uint64_t now) {
+    uint64_t none = 0;
+    __atomic_compare_exchange_n(&(ctx->fault_nsec), &none, now, false,
+                                __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
 static void *client_event_monitor(void *arg) {
     client_ctx_t *ctx = (client_ctx_t *)(arg);
-    struct rdma_cm_event *event = malloc(sizeof(struct rdma_cm_event));
+    struct rdma_cm_event *event = NULL;
+    struct pollfd pfd = {.fd = ctx->channel->fd, .events = POLLIN};
     int rc = 0;
 
-    while (1) {
+    while (!__atomic_load_n(&(ctx->evt_stop), __ATOMIC_ACQUIRE)) {
+        // Wake up now and then to notice destroy_client
+        if (poll(&pfd, 1, CLIENT_EVT_POLL_MSEC) <= 0) {
+            continue;
+        }
         rc = rdma_get_cm_event(ctx->channel, &event);
         API_STATUS(
-            rc,
-            {
-                free(event);
-                return (NULL);
-            },
-            "Invalid RDMA CM Event. Reason: %s\n", strerror(errno));
+            rc, { break; }, "Invalid RDMA CM Event. Reason: %s\n",
+            strerror(errno));
         printf("Got RDMA CM Event: %s\n", rdma_event_str(event->event));
         switch (event->event) {
         case RDMA_CM_EVENT_ADDR_RESOLVED: {
@@ -45,15 +62,48 @@ static void *client_event_monitor(void *arg) {
         } break;
         case RDMA_CM_EVENT_ESTABLISHED: {
             pthread_mutex_lock(&(ctx->evt_mtx));
+            // Private data is only valid until the event is acked
+            if (event->param.conn.private_data) {
+                memcpy(&(ctx->server_priv), event->param.conn.private_data,
+                       (event->param.conn.private_data_len <
+                        sizeof(server_priv_t))
+                           ? event->param.conn.private_data_len
+                           : sizeof(server_priv_t));
+            }
             ctx->is_connected = true;
             pthread_cond_signal(&(ctx->evt_cv));
             pthread_mutex_unlock(&(ctx->evt_mtx));
         } break;
+        case RDMA_CM_EVENT_ADDR_ERROR:
+        case RDMA_CM_EVENT_ROUTE_ERROR:
+        case RDMA_CM_EVENT_CONNECT_ERROR:
+        case RDMA_CM_EVENT_UNREACHABLE:
+        case RDMA_CM_EVENT_REJECTED: {
+            // Fail the resolve/connect waiting on this id
+            pthread_mutex_lock(&(ctx->evt_mtx));
+            if (event->id == ctx->cm_id) {
+                ctx->cm_error = event->event;
+                pthread_cond_signal(&(ctx->evt_cv));
+            }
+            pthread_mutex_unlock(&(ctx->evt_mtx));
+        } break;
         case RDMA_CM_EVENT_DISCONNECTED: {
+            // A retired session going away is no news
             pthread_mutex_lock(&(ctx->evt_mtx));
-            ctx->is_connected = false;
-            pthread_cond_signal(&(ctx->evt_cv));
+            bool current = (event->id == ctx->cm_id);
+            if (current) {
+                client_note_fault(ctx, cq_ring_now());
+                ctx->is_connected = false;
+                pthread_cond_signal(&(ctx->evt_cv));
+            }
             pthread_mutex_unlock(&(ctx->evt_mtx));
+            // Kick parked requesters so they observe the disconnect
+            for (uint32_t d = 0; current && d < ctx->ndp && d < MAX_CLIENT_DP;
+                 d++) {
+                if (ctx->dp[d]) {
+                    cq_ring_wake(&(ctx->dp[d]->ring));
+                }
+            }
         } break;
         default:
             break;
@@ -62,55 +112,49 @@ static void *client_event_monitor(void *arg) {
         rdma_ack_cm_event(event);
     }
 
-    free(event);
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->evt_exited = true;
+    pthread_cond_broadcast(&(ctx->evt_cv));
+    pthread_mutex_unlock(&(ctx->evt_mtx));
     return (NULL);
 }
 
-client_ctx_t *setup_client(struct sockaddr *src_addr,
-                           struct sockaddr *dst_addr) {
-    int rc = 0;
-    pthread_attr_t tattr;
-    int ndevices = 0;
-    struct ibv_context **rdma_verbs = NULL;
-    struct ibv_qp_init_attr qp_attr = {};
-    struct rdma_conn_param conn_param = {};
-    memset(&qp_attr, 0, sizeof(struct ibv_qp_init_attr));
-    memset(&conn_param, 0, sizeof(struct rdma_conn_param));
-
-    // Check if any RDMA devices exist
-    rdma_verbs = rdma_get_devices(&ndevices);
-    API_NULL(
-        rdma_verbs, { return (NULL); }, "No RDMA devices found\n");
-    printf("Got %d RDMA devices\n", ndevices);
-    rdma_free_devices(rdma_verbs);
+// Called once is_connected is false, which ends the poller loop. Sleeps
+// until the poller signals its exit instead of spinning a core on it
+static void client_wait_poller(client_ctx_t *ctx) {
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    while (ctx->wcq_running) {
+        pthread_cond_wait(&(ctx->evt_cv), &(ctx->evt_mtx));
+    }
+    pthread_mutex_unlock(&(ctx->evt_mtx));
+}
 
-    // Allocate a context instance
-    client_ctx_t *ctx = calloc(1, sizeof(client_ctx_t));
-    API_NULL(
-        ctx, { return (NULL); }, "Unable to allocate client context\n");
+// Ask the event thread to exit and wait until it did
+static void client_stop_events(client_ctx_t *ctx) {
+    __atomic_store_n(&(ctx->evt_stop), true, __ATOMIC_RELEASE);
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    while (!ctx->evt_exited) {
+        pthread_cond_wait(&(ctx->evt_cv), &(ctx->evt_mtx));
+    }
+    pthread_mutex_unlock(&(ctx->evt_mtx));
+}
 
-    // create an event channel
-    ctx->channel = rdma_create_event_channel();
-    API_NULL(
-        ctx->channel, { goto free_ctx_fields; },
-        "Unable to create RDMA event channel. Reason: %s\n", strerror(errno));
+// Resolve the server over a fresh CM id, which becomes ctx->cm_id
+static int client_resolve(client_ctx_t *ctx) {
+    struct sockaddr *src_addr = (struct sockaddr *)&(ctx->src_addr);
+    struct sockaddr *dst_addr = (struct sockaddr *)&(ctx->dst_addr);
+    struct rdma_cm_id *id = NULL;
 
-    // open a connection
-    rc = rdma_create_id(ctx->channel, &(ctx->cm_id), NULL, RDMA_PS_TCP);
+    int rc = rdma_create_id(ctx->channel, &id, NULL, RDMA_PS_TCP);
     API_STATUS(
-        rc, { goto free_channel; },
+        rc, { return (-1); },
         "Unable to create RDMA Connection ID. Reason: %s\n", strerror(errno));
-
-    // initialize event monitor
-    ctx->evt_fn = &client_event_monitor;
-    pthread_attr_init(&tattr);
-    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
-    pthread_mutex_init(&(ctx->evt_mtx), NULL);
-    pthread_cond_init(&(ctx->evt_cv), NULL);
-    rc = pthread_create(&(ctx->evt_thread), &tattr, ctx->evt_fn, (void *)ctx);
-    API_STATUS(
-        rc, { goto free_cm_id; },
-        "Unable to create RDMA event channel monitor\n");
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->cm_id = id;
+    ctx->addr_id = NULL;
+    ctx->connect_id = NULL;
+    ctx->cm_error = 0;
+    pthread_mutex_unlock(&(ctx->evt_mtx));
 
     printf("Attempting to connect between src: %s dst: %s\n",
            SKADDR_TO_IP(src_addr), SKADDR_TO_IP(dst_addr));
@@ -130,10 +174,14 @@ client_ctx_t *setup_client(struct sockaddr *src_addr,
         SKADDR_TO_IP(dst_addr), strerror(errno));
 
     pthread_mutex_lock(&(ctx->evt_mtx));
-    while (!ctx->addr_id) {
+    while (!ctx->addr_id && !ctx->cm_error) {
         pthread_cond_wait(&(ctx->evt_cv), &(ctx->evt_mtx));
     }
     pthread_mutex_unlock(&(ctx->evt_mtx));
+    EXT_API_STATUS(
+        ctx->cm_error, { goto free_cm_id; },
+        "Unable to resolve RDMA address for IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), rdma_event_str(ctx->cm_error));
 
     // resolve an RDMA route
     rc = rdma_resolve_route(ctx->cm_id, 2000);
@@ -143,37 +191,91 @@ client_ctx_t *setup_client(struct sockaddr *src_addr,
         SKADDR_TO_IP(dst_addr), strerror(errno));
 
     pthread_mutex_lock(&(ctx->evt_mtx));
-    while (!ctx->connect_id) {
+    while (!ctx->connect_id && !ctx->cm_error) {
         pthread_cond_wait(&(ctx->evt_cv), &(ctx->evt_mtx));
     }
     pthread_mutex_unlock(&(ctx->evt_mtx));
+    EXT_API_STATUS(
+        ctx->cm_error, { goto free_cm_id; },
+        "Unable to resolve RDMA route for IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), rdma_event_str(ctx->cm_error));
+    return (0);
 
-    // init RDMA device resources - CQs/PDs/etc
-    ctx->verbs = ctx->cm_id->verbs;
-    ctx->pd = ibv_alloc_pd(ctx->verbs);
-    API_NULL(
-        ctx->pd, { goto free_cm_id; },
-        "Unable to alloc RDMA Protection Domain. Reason: %s\n",
-        strerror(errno));
+free_cm_id:
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->cm_id = NULL;
+    pthread_mutex_unlock(&(ctx->evt_mtx));
+    rdma_destroy_id(id);
+    return (-1);
+}
 
-    ctx->scq = ibv_create_cq(ctx->verbs, MAX_CQE, NULL, NULL, 0);
-    API_NULL(
-        ctx->scq, { goto free_pd; },
-        "Unable to create RDMA Send CQE of size %d entries. Reason: %s\n",
-        MAX_CQE, strerror(errno));
+// Create the QPs of a resolved ctx->cm_id on the PD and CQs of ctx and
+// connect them to the server
+static int client_connect_qp(client_ctx_t *ctx) {
+    struct ibv_qp_init_attr qp_attr = {};
+    struct rdma_conn_param conn_param = {};
+    client_priv_t priv = {0};
+    int rc = 0;
 
     // Create RDMA QPs for initialized RDMA device rsc
-    qp_attr.cap.max_send_wr = MAX_SEND_WR;
-    qp_attr.cap.max_recv_wr = MAX_RECV_WR;
-    qp_attr.cap.max_send_sge = 1;
-    qp_attr.cap.max_recv_sge = 1;
+    qp_attr.cap.max_send_wr = ctx->qp_cfg.send_wr;
+    qp_attr.cap.max_recv_wr = ctx->qp_cfg.recv_wr;
+    qp_attr.cap.max_send_sge = ctx->max_sge;
+    qp_attr.cap.max_recv_sge = ctx->max_sge;
     qp_attr.qp_type = IBV_QPT_RC;
     qp_attr.send_cq = ctx->scq;
-    qp_attr.recv_cq = ctx->scq;
-    rc = rdma_create_qp(ctx->cm_id, ctx->pd, &qp_attr);
+    qp_attr.recv_cq = ctx->rcq;
+    if (ctx->qp_cfg.ex_verbs) {
+        struct ibv_qp_init_attr_ex attr_ex;
+        rdma_qp_attr_ex(ctx->pd, &qp_attr, &attr_ex);
+        rc = rdma_create_qp_ex(ctx->cm_id, &attr_ex);
+    } else {
+        rc = rdma_create_qp(ctx->cm_id, ctx->pd, &qp_attr);
+    }
     API_STATUS(
-        rc, { goto free_cq; }, "Unable to RDMA QPs. Reason: %s\n",
+        rc, { return (-1); }, "Unable to RDMA QPs. Reason: %s\n",
         strerror(errno));
+    ctx->qpn = ctx->cm_id->qp->qp_num;
+
+    // Extra RC QPs on the same CQs, the server connects its own to them
+    // before accepting
+    for (ctx->nqps = 1; ctx->nqps < ctx->qp_cfg.nqps; ctx->nqps++) {
+        struct ibv_qp *qp =
+            rdma_create_rc_qp(ctx->pd, &qp_attr, ctx->qp_cfg.ex_verbs);
+        API_NULL(
+            qp, { goto free_qp; },
+            "Unable to create extra RC QP. Reason: %s\n", strerror(errno));
+        ctx->extra_qp[ctx->nqps - 1] = qp;
+        priv.qpn[ctx->nqps - 1] = qp->qp_num;
+    }
+    priv.nqps = ctx->nqps;
+    if (ctx->nqps > 1) {
+        conn_param.private_data = &priv;
+        conn_param.private_data_len = sizeof(client_priv_t);
+    }
+
+    // The server connects its XRC_RECV QP to this one before accepting
+    if (ctx->xrc) {
+        struct ibv_qp_init_attr_ex xrc_attr = {0};
+        xrc_attr.qp_type = IBV_QPT_XRC_SEND;
+        xrc_attr.comp_mask = IBV_QP_INIT_ATTR_PD;
+        xrc_attr.pd = ctx->pd;
+        if (ctx->qp_cfg.ex_verbs) {
+            xrc_attr.comp_mask |= IBV_QP_INIT_ATTR_SEND_OPS_FLAGS;
+            xrc_attr.send_ops_flags = RDMA_QP_EX_SEND_OPS;
+        }
+        xrc_attr.send_cq = ctx->scq;
+        xrc_attr.cap.max_send_wr = ctx->qp_cfg.send_wr;
+        xrc_attr.cap.max_send_sge = ctx->max_sge;
+        ctx->xrc_qp = ibv_create_qp_ex(ctx->verbs, &xrc_attr);
+        API_NULL(
+            ctx->xrc_qp, { goto free_qp; },
+            "Unable to create XRC_SEND QP. Reason: %s\n", strerror(errno));
+        ctx->xrc_qpn = ctx->xrc_qp->qp_num;
+        priv.xrc_qpn = ctx->xrc_qp->qp_num;
+        conn_param.private_data = &priv;
+        conn_param.private_data_len = sizeof(client_priv_t);
+    }
 
     // Connect to the target RDMA address
     conn_param.initiator_depth = 16;
@@ -181,171 +283,1191 @@ client_ctx_t *setup_client(struct sockaddr *src_addr,
     conn_param.retry_count =
         5; // maximum # of retry for send/RDMA for conn when conn error occurs
     conn_param.rnr_retry_count =
-        1; // maximum # of retry for send/RDMA for conn when data arrives before
-           // request is posted
+        7; // maximum # of retry for send/RDMA for conn when data arrives before
+           // request is posted, 7 = infinite so streamed SENDs may outrun
+           // the receiver's recv replenishment
     rc = rdma_connect(ctx->cm_id, &conn_param);
     API_STATUS(
-        rc, { goto disconnect_free_cq; },
+        rc, { goto free_qp; },
         "Unable to connect to RDMA device IP: %s. Reason: %s\n",
-        SKADDR_TO_IP(dst_addr), strerror(errno));
+        SKADDR_TO_IP(&(ctx->dst_addr)), strerror(errno));
 
     // Assert that connection to target is established
     pthread_mutex_lock(&(ctx->evt_mtx));
-    while (!ctx->is_connected) {
+    while (!ctx->is_connected && !ctx->cm_error) {
         pthread_cond_wait(&(ctx->evt_cv), &(ctx->evt_mtx));
     }
     pthread_mutex_unlock(&(ctx->evt_mtx));
+    EXT_API_STATUS(
+        ctx->cm_error, { goto free_qp; },
+        "Unable to connect to RDMA device IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(&(ctx->dst_addr)), rdma_event_str(ctx->cm_error));
 
-    printf("Connected RDMA_RC between src: %s dst: %s\n",
-           SKADDR_TO_IP(rdma_get_local_addr(ctx->cm_id)),
-           SKADDR_TO_IP(rdma_get_peer_addr(ctx->cm_id)));
+    if (ctx->xrc_qp) {
+        EXT_API_STATUS(
+            !ctx->server_priv.xrc_srqn, { goto disconnect_free_qp; },
+            "Server did not set up an XRC SRQ\n");
+        API_STATUS(
+            xrc_connect_qp(ctx->cm_id, ctx->xrc_qp, ctx->server_priv.xrc_qpn),
+            { goto disconnect_free_qp; },
+            "Unable to connect XRC_SEND QP to server QP %u\n",
+            ctx->server_priv.xrc_qpn);
+        printf("Connected RDMA_XRC QP %u to server SRQ %u\n",
+               ctx->xrc_qp->qp_num, ctx->server_priv.xrc_srqn);
+    }
 
-    pthread_attr_destroy(&tattr);
-    return (ctx);
+    for (uint32_t i = 1; i < ctx->nqps; i++) {
+        uint32_t dest_qpn = ctx->server_priv.qpn[i - 1];
+        EXT_API_STATUS(
+            !dest_qpn, { goto disconnect_free_qp; },
+            "Server did not set up %u RC QPs\n", ctx->nqps);
+        API_STATUS(
+            accept_connect_extra_qp(ctx->cm_id, ctx->extra_qp[i - 1],
+                                    dest_qpn),
+            { goto disconnect_free_qp; },
+            "Unable to connect extra QP to server QP %u\n", dest_qpn);
+    }
+    if (ctx->nqps > 1) {
+        printf("Connected %u extra RC QPs to the server\n", ctx->nqps - 1);
+    }
+
+    printf("Connected RDMA_RC between src: %s dst: %s, Max SGE: %d\n",
+           SKADDR_TO_IP(rdma_get_local_addr(ctx->cm_id)),
+           SKADDR_TO_IP(rdma_get_peer_addr(ctx->cm_id)), ctx->max_sge);
+    return (0);
 
-disconnect_free_cq:
+disconnect_free_qp:
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->is_connected = false;
+    pthread_mutex_unlock(&(ctx->evt_mtx));
     rdma_disconnect(ctx->cm_id);
-    pthread_attr_destroy(&tattr);
+free_qp:
+    if (ctx->xrc_qp) {
+        ibv_destroy_qp(ctx->xrc_qp);
+        ctx->xrc_qp = NULL;
+    }
+    while (ctx->nqps > 1) {
+        ctx->nqps--;
+        ibv_destroy_qp(ctx->extra_qp[ctx->nqps - 1]);
+    }
+    rdma_destroy_qp(ctx->cm_id);
+    return (-1);
+}
 
-free_cq:
-    if (ctx->scq || ctx->rcq) {
-        ibv_destroy_cq(ctx->scq);
+client_ctx_t *setup_client(struct sockaddr *src_addr,
+                           struct sockaddr *dst_addr, int transport,
+                           const rdma_qp_cfg_t *qp_cfg, int shm) {
+    int rc = 0;
+    int ndevices = 0;
+    struct ibv_context **rdma_verbs = NULL;
+    msg_xport_t *xport = NULL;
+    bool xrc = (transport == TRANSPORT_XRC);
+
+    if (transport == TRANSPORT_TCP || transport == TRANSPORT_URING) {
+        tcp_ctx_t *tcp = tcp_connect(src_addr, dst_addr,
+                                     transport == TRANSPORT_URING);
+        API_NULL(
+            tcp, { return (NULL); }, "Unable to reach server %s over TCP\n",
+            SKADDR_TO_IP(dst_addr));
+        xport = &(tcp->xport);
+    } else if (shm != SHM_MODE_OFF && !xrc && shm_peer_is_local(dst_addr)) {
+        // A server on this host is reached without the NIC if it lets us
+        shm_ctx_t *shm_ctx = shm_client_attach(dst_addr);
+        xport = (shm_ctx) ? (&(shm_ctx->xport)) : (NULL);
+    }
+    EXT_API_STATUS(
+        (shm == SHM_MODE_ON && !xport), { return (NULL); },
+        "Unable to reach server %s over shared memory\n",
+        SKADDR_TO_IP(dst_addr));
+
+    // Check if any RDMA devices exist
+    if (!xport) {
+        rdma_verbs = rdma_get_devices(&ndevices);
+        API_NULL(
+            rdma_verbs, { return (NULL); }, "No RDMA devices found\n");
+        printf("Got %d RDMA devices\n", ndevices);
+        rdma_free_devices(rdma_verbs);
+    }
+
+    // Allocate a context instance
+    client_ctx_t *ctx = calloc(1, sizeof(client_ctx_t));
+    API_NULL(
+        ctx,
+        {
+            if (xport) {
+                xport->close(xport);
+            }
+            return (NULL);
+        },
+        "Unable to allocate client context\n");
+    ctx->xport = xport;
+    memcpy(&(ctx->src_addr), src_addr,
+           (src_addr->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6)
+                                             : sizeof(struct sockaddr_in));
+    memcpy(&(ctx->dst_addr), dst_addr,
+           (dst_addr->sa_family == AF_INET6) ? sizeof(struct sockaddr_in6)
+                                             : sizeof(struct sockaddr_in));
+    ctx->xrc = xrc;
+    pthread_mutex_init(&(ctx->sess_mtx), NULL);
+    rdma_stats_set_init(&(ctx->stats), "client");
+    ctx->poll_stats = rdma_stats_new(&(ctx->stats), NULL);
+    API_NULL(
+        ctx->poll_stats, { goto free_ctx_fields; },
+        "Unable to allocate poller counters\n");
+    if (ctx->xport) {
+        // No device, CQs or event thread behind a message transport
+        ctx->is_connected = true;
+        ctx->max_sge = RDMA_MAX_SGE;
+        rdma_stats_register(&(ctx->stats));
+        return (ctx);
+    }
+
+    // create an event channel
+    ctx->channel = rdma_create_event_channel();
+    API_NULL(
+        ctx->channel, { goto free_ctx_fields; },
+        "Unable to create RDMA event channel. Reason: %s\n", strerror(errno));
+
+    // initialize event monitor
+    ctx->evt_fn = &client_event_monitor;
+    pthread_mutex_init(&(ctx->evt_mtx), NULL);
+    pthread_cond_init(&(ctx->evt_cv), NULL);
+    rc = rdma_start_thread(&(ctx->evt_thread), ctx->evt_fn, (void *)ctx);
+    API_STATUS(
+        rc,
+        {
+            ctx->evt_exited = true;
+            goto free_channel;
+        },
+        "Unable to create RDMA event channel monitor\n");
+
+    // open a connection
+    API_STATUS(
+        client_resolve(ctx), { goto free_channel; },
+        "Unable to resolve server\n");
+
+    // init RDMA device resources - CQs/PDs/etc
+    ctx->verbs = ctx->cm_id->verbs;
+    ctx->pd = ibv_alloc_pd(ctx->verbs);
+    API_NULL(
+        ctx->pd, { goto free_cm_id; },
+        "Unable to alloc RDMA Protection Domain. Reason: %s\n",
+        strerror(errno));
+
+    // Scatter/gather as many SGEs per WR as the device allows
+    struct ibv_device_attr dev_attr = {};
+    rc = ibv_query_device(ctx->verbs, &dev_attr);
+    EXT_API_STATUS(
+        rc, { goto free_pd; }, "Unable to query RDMA device. Reason: %s\n",
+        strerror(rc));
+    ctx->max_sge =
+        (dev_attr.max_sge < RDMA_MAX_SGE) ? dev_attr.max_sge : RDMA_MAX_SGE;
+    // An XRC_SEND QP completes on the send CQ next to the RC QP
+    if (qp_cfg) {
+        ctx->qp_cfg = *qp_cfg;
     }
+    EXT_API_STATUS(
+        (ctx->qp_cfg.nqps > MAX_CONN_QPS || (xrc && ctx->qp_cfg.nqps > 1)),
+        { goto free_pd; }, "Unsupported %u RC QPs, up to %d without XRC\n",
+        ctx->qp_cfg.nqps, MAX_CONN_QPS);
+    API_STATUS(
+        rdma_size_qp(&dev_attr, &(ctx->qp_cfg), (xrc) ? (2) : (1)),
+        { goto free_pd; }, "Unable to size client queues\n");
+    API_STATUS(
+        rdma_check_mr_mode(ctx->verbs, ctx->qp_cfg.mr_mode,
+                           ctx->qp_cfg.odp_ops),
+        { goto free_pd; }, "Unable to register client buffers on demand\n");
+
+    API_STATUS(
+        rdma_create_cqs(ctx->verbs, &(ctx->qp_cfg), &(ctx->scq), &(ctx->rcq)),
+        { goto free_pd; }, "Unable to create client CQs\n");
+
+    API_STATUS(
+        client_connect_qp(ctx), { goto free_cq; },
+        "Unable to connect to server\n");
+    // Reported without a stats block, the connection runs regardless
+    rdma_stats_register(&(ctx->stats));
+    return (ctx);
+
+free_cq:
+    rdma_destroy_cqs(ctx->scq, ctx->rcq);
 free_pd:
     ibv_dealloc_pd(ctx->pd);
 free_cm_id:
     rdma_destroy_id(ctx->cm_id);
 free_channel:
+    client_stop_events(ctx);
     rdma_destroy_event_channel(ctx->channel);
 free_ctx_fields:
+    if (ctx->xport) {
+        ctx->xport->close(ctx->xport);
+    }
+    free(ctx->poll_stats);
     free(ctx);
     return (NULL);
 }
 
-static void *client_wcq_monitor(void *arg) {
-    client_ctx_t *ctx = (client_ctx_t *)(arg);
+void destroy_client(client_ctx_t *ctx) {
+    size_t wrpc_sz = WRPC_RING_SZ + (WRPC_SLOTS * CACHE_LINE_SZ);
 
-    int ncqe = 0;
-    struct ibv_wc wc[MAX_CQE] = {0};
+    if (ctx->xport) {
+        ctx->xport->close(ctx->xport);
+    } else {
+        // Poller first, it must not route completions of QPs going away
+        pthread_mutex_lock(&(ctx->evt_mtx));
+        ctx->is_connected = false;
+        pthread_mutex_unlock(&(ctx->evt_mtx));
+        rdma_disconnect(ctx->cm_id);
+        client_wait_poller(ctx);
+        client_stop_events(ctx);
 
-    while (ctx->is_connected) {
-        ncqe = ibv_poll_cq(ctx->scq, MAX_CQE, &wc[0]);
-        for (int i = 0; i < ncqe; i++) {
-            // Check for errors
-            if (wc[i].status != IBV_WC_SUCCESS) {
-                printf("WCQE for WR[%ld] Status: %s\n", wc[i].wr_id,
-                       ibv_wc_status_str(wc[i].status));
-            } else {
-#if 0
-                printf("WCQE for WR[%ld] Opcode: %s\n", wc[i].wr_id,
-                       wc_opcode_str(wc[i].opcode));
-#endif
-            }
+        if (ctx->retired_xrc_qp) {
+            ibv_destroy_qp(ctx->retired_xrc_qp);
+        }
+        if (ctx->retired_id) {
+            rdma_destroy_qp(ctx->retired_id);
+            rdma_destroy_id(ctx->retired_id);
+        }
+        if (ctx->xrc_qp) {
+            ibv_destroy_qp(ctx->xrc_qp);
+        }
+        for (uint32_t i = 1; i < ctx->nqps; i++) {
+            ibv_destroy_qp(ctx->extra_qp[i - 1]);
+        }
+        rdma_destroy_qp(ctx->cm_id);
+        rdma_destroy_id(ctx->cm_id);
 
-            // Based on the opcode decide the action
-            switch (wc[i].opcode) {
-            case IBV_WC_RECV:
-            case IBV_WC_RECV_RDMA_WITH_IMM:
-                pthread_mutex_lock(&(ctx->wcq_mtx));
-                ctx->rtt_done[wc[i].wr_id] = 1;
-                pthread_cond_signal(&(ctx->wcq_cv));
-                pthread_mutex_unlock(&(ctx->wcq_mtx));
-                break;
-            case IBV_WC_RDMA_WRITE:
-            case IBV_WC_SEND:
-                break;
-            default:
-                break;
-            }
+        rdma_dereg_buf(ctx->send_buf_mr, ctx->implicit_mr);
+        rdma_dereg_buf(ctx->recv_buf_mr, ctx->implicit_mr);
+        rdma_dereg_buf(ctx->bounce_buf_mr, ctx->implicit_mr);
+        rdma_dereg_buf(ctx->wrpc_buf_mr, ctx->implicit_mr);
+        for (int i = 0; i < ctx->nuser_mr; i++) {
+            rdma_dereg_buf(ctx->user_mr[i], ctx->implicit_mr);
+        }
+        if (ctx->implicit_mr) {
+            ibv_dereg_mr(ctx->implicit_mr);
         }
+        rdma_destroy_cqs(ctx->scq, ctx->rcq);
+        ibv_dealloc_pd(ctx->pd);
+        rdma_destroy_event_channel(ctx->channel);
     }
 
-    return (NULL);
+    if (ctx->send_client_buf) {
+        munmap(ctx->send_client_buf, ctx->send_client_buf_sz);
+        munmap(ctx->recv_client_buf, ctx->recv_client_buf_sz);
+    }
+    if (ctx->bounce_client_buf) {
+        munmap(ctx->bounce_client_buf, ctx->send_client_buf_sz);
+    }
+    if (ctx->wrpc_client_buf) {
+        munmap(ctx->wrpc_client_buf, wrpc_sz);
+    }
+
+    // The counter blocks go with the set, once the stats thread forgot it
+    rdma_stats_unregister(&(ctx->stats));
+    for (uint32_t d = 0; d < ctx->ndp && d < MAX_CLIENT_DP; d++) {
+        free(ctx->dp[d]);
+    }
+    rdma_stats_set_free(&(ctx->stats));
+    if (tls_ctx == ctx) {
+        tls_ctx = NULL;
+        tls_dp = NULL;
+    }
+    free(ctx);
 }
 
-int prepare_client_data(client_ctx_t *ctx, int opc) {
-    size_t send_sz = (MAX_MR_SZ);
-    size_t recv_sz = (MAX_MR_SZ);
-    int rc = 0;
-    // Based on the opcode, allocate req & response structures
-    // Register memory with RDMA stack, if needed
-    // Save keys and mrs into ctx, if needed
-    // Exchange addresses with server for OPC_RDMA_READ/WRITE
+/**
+ * wr_id layout: datapath block index in the upper 32 bits so the CQ poller
+ * can route a completion without any shared lookup, per-thread sequence in
+ * the lower 32 bits
+ */
+#define WR_ID(dp) (((uint64_t)((dp)->idx) << 32) | (uint32_t)((dp)->wr_seq++))
+#define WR_ID_DP(wr_id) ((uint32_t)((wr_id) >> 32))
 
-    // Allocate 1MB of buffer space
-    void *send_buf = mmap(NULL, send_sz, PROT_READ | PROT_WRITE,
-                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    EXT_API_STATUS(
-        send_buf == MAP_FAILED, { return (-1); },
-        "Unable to allocate 1MB send buffer. Reason: %s\n", strerror(errno));
-    void *recv_buf = mmap(NULL, recv_sz, PROT_READ | PROT_WRITE,
-                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    EXT_API_STATUS(
-        recv_buf == MAP_FAILED,
-        {
-            munmap(send_buf, send_sz);
-            return (-1);
-        },
-        "Unable to allocate 1MB recv buffer. Reason: %s\n", strerror(errno));
+// Move the calling thread onto the session of the last reconnect. Nothing
+// it posted before survives, so whatever is left in its ring is stale
+static void client_refresh_dp(client_ctx_t *ctx, client_dp_t *dp) {
+    cq_rec_t rec = {0};
+    pthread_mutex_lock(&(ctx->sess_mtx));
+    while (cq_ring_try_pop(&(dp->ring), &rec)) {
+    }
+    dp->qp = ctx->cm_id->qp;
+    dp->qpx = (ctx->qp_cfg.ex_verbs) ? (ibv_qp_to_qp_ex(dp->qp)) : (NULL);
+    dp->xrc_qp = ctx->xrc_qp;
+    dp->xrc_qpx = (ctx->qp_cfg.ex_verbs && dp->xrc_qp)
+                      ? (ibv_qp_to_qp_ex(dp->xrc_qp))
+                      : (NULL);
+    dp->xrc_srqn = ctx->server_priv.xrc_srqn;
+    dp->rx_posted = 0;
+    dp->gen = ctx->gen;
+    pthread_mutex_unlock(&(ctx->sess_mtx));
+}
 
-    ctx->send_client_buf = send_buf;
-    ctx->send_client_buf_sz = send_sz;
-    ctx->recv_client_buf = recv_buf;
-    ctx->recv_client_buf_sz = recv_sz;
+client_dp_t *attach_client_thread(client_ctx_t *ctx) {
+    if (tls_ctx == ctx) {
+        if (__builtin_expect(
+                tls_dp->gen != __atomic_load_n(&(ctx->gen), __ATOMIC_ACQUIRE),
+                0)) {
+            client_refresh_dp(ctx, tls_dp);
+        }
+        return (tls_dp);
+    }
 
-    // IBV_OPC_SEND_ONLY: allocate in buf, register in/out, no exchg
-    // OPC_RDMA_READ/WRITE: allocate in/out buf, register in/out, exchg in/out
-    // and keys
-    ctx->send_buf_mr =
-        ibv_reg_mr(ctx->pd, send_buf, send_sz, RDMA_ACCESS_FLAGS);
+    EXT_API_STATUS(
+        !ctx->send_client_buf, { return (NULL); },
+        "Unable to attach thread before client data is prepared\n");
+    // Coming back from another ctx: the block this thread left here stays
+    // owned by ctx, pick it up again rather than take a new slot
+    pthread_t self = pthread_self();
+    uint32_t ndp = __atomic_load_n(&(ctx->ndp), __ATOMIC_ACQUIRE);
+    for (uint32_t d = 0; d < ndp && d < MAX_CLIENT_DP; d++) {
+        client_dp_t *dp = __atomic_load_n(&(ctx->dp[d]), __ATOMIC_ACQUIRE);
+        if (dp && pthread_equal(dp->owner, self)) {
+            tls_ctx = ctx;
+            tls_dp = dp;
+            if (dp->gen != __atomic_load_n(&(ctx->gen), __ATOMIC_ACQUIRE)) {
+                client_refresh_dp(ctx, dp);
+            }
+            return (dp);
+        }
+    }
+
+    // Claim a slot only while one is left, ndp never runs past the array
+    uint32_t idx = __atomic_load_n(&(ctx->ndp), __ATOMIC_RELAXED);
+    do {
+        EXT_API_STATUS(
+            idx >= MAX_CLIENT_DP, { return (NULL); },
+            "Unable to attach more than %d requester threads\n",
+            MAX_CLIENT_DP);
+    } while (!__atomic_compare_exchange_n(&(ctx->ndp), &idx, idx + 1, true,
+                                          __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    client_dp_t *dp = aligned_alloc(CACHE_LINE_SZ, sizeof(client_dp_t));
     API_NULL(
-        ctx->send_buf_mr,
-        {
-            munmap(send_buf, send_sz);
-            munmap(recv_buf, recv_sz);
-            return (-1);
-        },
-        "Unable to register send buf with RDMA. Reason: %s\n", strerror(errno));
-    ctx->recv_buf_mr =
-        ibv_reg_mr(ctx->pd, recv_buf, recv_sz, RDMA_ACCESS_FLAGS);
+        dp, { return (NULL); }, "Unable to allocate datapath state\n");
+    memset(dp, 0, sizeof(client_dp_t));
+    dp->send_buf = ctx->send_client_buf;
+    dp->recv_buf = ctx->recv_client_buf;
+    dp->bounce_buf = ctx->bounce_client_buf;
+    // Message transports have neither a QP nor MRs
+    if (!ctx->xport) {
+        dp->qp = ctx->cm_id->qp;
+        dp->qpx =
+            (ctx->qp_cfg.ex_verbs) ? (ibv_qp_to_qp_ex(dp->qp)) : (NULL);
+        dp->xrc_qp = ctx->xrc_qp;
+        dp->xrc_qpx = (ctx->qp_cfg.ex_verbs && dp->xrc_qp)
+                          ? (ibv_qp_to_qp_ex(dp->xrc_qp))
+                          : (NULL);
+        dp->xrc_srqn = ctx->server_priv.xrc_srqn;
+        dp->send_lkey = ctx->send_buf_mr->lkey;
+        dp->recv_lkey = ctx->recv_buf_mr->lkey;
+        dp->bounce_lkey = ctx->bounce_buf_mr->lkey;
+    }
+    dp->idx = idx;
+    dp->owner = self;
+    dp->gen = ctx->gen;
+    dp->max_sge = ctx->max_sge;
+    dp->quiet = ctx->quiet;
+    cq_ring_init(&(dp->ring));
+    dp->stats = rdma_stats_new(&(ctx->stats), &(dp->ring));
     API_NULL(
-        ctx->recv_buf_mr,
+        dp->stats,
         {
-            munmap(send_buf, send_sz);
-            munmap(recv_buf, recv_sz);
-            ibv_dereg_mr(ctx->send_buf_mr);
-            return (-1);
+            free(dp);
+            return (NULL);
         },
-        "Unable to register recv buf with RDMA. Reason: %s\n", strerror(errno));
+        "Unable to allocate requester counters\n");
+    __atomic_store_n(&(ctx->dp[idx]), dp, __ATOMIC_RELEASE);
+    tls_ctx = ctx;
+    tls_dp = dp;
+    return (dp);
+}
 
-    randomize_buf(&(ctx->send_client_buf), ctx->send_client_buf_sz);
-    // Start a separate thread to poll for completion
-    pthread_attr_t tattr;
-    pthread_attr_init(&tattr);
-    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
-    pthread_mutex_init(&(ctx->wcq_mtx), NULL);
-    pthread_cond_init(&(ctx->wcq_cv), NULL);
-    ctx->wcq_fn = &(client_wcq_monitor);
-    rc = pthread_create(&(ctx->wcq_thread), &tattr, ctx->wcq_fn, (void *)ctx);
-    API_STATUS(
-        rc, { return (-1); },
-        "Unable to create WCQ shared send/recv monitor\n");
+// Pop completions of the calling thread until wr_id shows up
+// The first request completed after a reconnect ends the outage
+static inline void client_note_resume(client_ctx_t *ctx, uint64_t now) {
+    if (__builtin_expect(
+            !__atomic_load_n(&(ctx->resume_nsec), __ATOMIC_RELAXED), 1)) {
+        return;
+    }
 
-    // TODO: Use TCP-IP client/server socket to exchg this
-    if (opc == OPC_RDMA_READ || opc == OPC_RDMA_WRITE) {
-        return (-1);
+    uint64_t start = __atomic_exchange_n(&(ctx->resume_nsec), 0,
+                                         __ATOMIC_ACQ_REL);
+    if (start) {
+        uint32_t n = __atomic_fetch_add(&(ctx->noutages), 1,
+                                        __ATOMIC_RELAXED);
+        if (n < MAX_CLIENT_OUTAGES) {
+            ctx->outage_nsec[n] = (now > start) ? (now - start) : (0);
+        }
+        printf("Resumed %lu nsec after the failure\n",
+               (now > start) ? (now - start) : (0));
+    }
+}
+
+static int client_wait_wr(client_ctx_t *ctx, client_dp_t *dp,
+                          uint64_t wr_id) {
+    cq_rec_t rec = {0};
+    // A fiber yields to the others until the scheduler hands it wr_id
+    if (fiber_self()) {
+        EXT_API_STATUS(
+            fiber_wait(wr_id, &rec), { return (-1); },
+            "WR[%lx] aborted, client disconnected\n", wr_id);
+        EXT_API_STATUS(
+            rec.status != IBV_WC_SUCCESS, { return (-1); },
+            "WR[%lx] failed. Status: %s\n", rec.wr_id,
+            ibv_wc_status_str(rec.status));
+        client_note_resume(ctx, rec.ts_nsec);
+        return (0);
     }
 
-    return 0;
+    while (cq_ring_pop(&(dp->ring), &rec, &(ctx->is_connected))) {
+        EXT_API_STATUS(
+            rec.status != IBV_WC_SUCCESS, { return (-1); },
+            "WR[%lx] failed. Status: %s\n", rec.wr_id,
+            ibv_wc_status_str(rec.status));
+        if (rec.wr_id == wr_id) {
+            client_note_resume(ctx, rec.ts_nsec);
+            return (0);
+        }
+    }
+
+    printf("WR[%lx] aborted, client disconnected\n", wr_id);
+    return (-1);
 }
 
-int send_client_request(client_ctx_t *ctx, int opc, size_t msg_sz) {
-    uint64_t rtt_send_nsec = 0;
-    static int count = 0;
-    int rc = 0;
-    // Based on the opcode, prepare wqe structures
-    // use IMM: to distinguish between no RDMA vs RDMA follow-up
-    // OPC_SEND_ONLY: lkey, no rkey is needed, zcopy local send, 1-copy remote
+static bool client_owns_qpn(const client_ctx_t *ctx, uint32_t qpn) {
+    if (qpn == ctx->qpn || qpn == ctx->xrc_qpn) {
+        return (true);
+    }
+    for (uint32_t i = 1; i < ctx->nqps; i++) {
+        if (qpn == ctx->extra_qp[i - 1]->qp_num) {
+            return (true);
+        }
+    }
+
+    return (false);
+}
+
+static void *client_wcq_monitor(void *arg) {
+    client_ctx_t *ctx = (client_ctx_t *)(arg);
+    rdma_cq_poller_t poller = {.scq = ctx->scq,
+                               .rcq = ctx->rcq,
+                               .ex = ctx->qp_cfg.ex_verbs,
+                               .stats = ctx->poll_stats};
+    struct ibv_wc wc[CQ_POLL_BATCH] = {0};
+    cq_rec_t rec = {0};
+    int ncqe = 0;
+
+    while (ctx->is_connected) {
+        ncqe = rdma_cq_poll(&poller, &wc[0]);
+        uint64_t now = (ncqe > 0) ? cq_ring_now() : 0;
+        for (int i = 0; i < ncqe; i++) {
+            // Flushes of a retired session share the CQs, nobody waits
+            if (!client_owns_qpn(ctx, wc[i].qp_num)) {
+                continue;
+            }
+
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                printf("WCQE for WR[%ld] Status: %s\n", wc[i].wr_id,
+                       ibv_wc_status_str(wc[i].status));
+                client_note_fault(ctx, now);
+            }
+
+            // Hand off to the requester thread that owns the wr_id
+            // A wr_id past the attached blocks is not ours to route
+            uint32_t d = WR_ID_DP(wc[i].wr_id);
+            client_dp_t *dp = (d < MAX_CLIENT_DP)
+                                  ? (__atomic_load_n(&(ctx->dp[d]),
+                                                     __ATOMIC_ACQUIRE))
+                                  : (NULL);
+            if (dp && rdma_wc_routed(&wc[i])) {
+                cq_ring_rec_from_wc(&rec, &wc[i], now);
+                cq_ring_push(&(dp->ring), &rec);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->wcq_running = false;
+    pthread_cond_broadcast(&(ctx->evt_cv));
+    pthread_mutex_unlock(&(ctx->evt_mtx));
+    return (NULL);
+}
+
+static int client_start_poller(client_ctx_t *ctx) {
+    ctx->wcq_fn = &(client_wcq_monitor);
+    ctx->wcq_running = true;
+    int rc = rdma_start_thread(&(ctx->wcq_thread), ctx->wcq_fn, (void *)ctx);
+    if (rc) {
+        ctx->wcq_running = false;
+    }
+    return (rc);
+}
+
+// Fail everything in flight on the current session and retire it. Its QPs
+// move to the error state but are only destroyed by the next reconnect, so
+// a requester that has not noticed yet still posts to a valid QP
+static void client_retire_session(client_ctx_t *ctx) {
+    struct ibv_qp_attr attr = {.qp_state = IBV_QPS_ERR};
+
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->is_connected = false;
+    pthread_mutex_unlock(&(ctx->evt_mtx));
+    for (uint32_t d = 0; d < ctx->ndp && d < MAX_CLIENT_DP; d++) {
+        if (ctx->dp[d]) {
+            cq_ring_wake(&(ctx->dp[d]->ring));
+        }
+    }
+
+    rdma_disconnect(ctx->cm_id);
+    ibv_modify_qp(ctx->cm_id->qp, &attr, IBV_QP_STATE);
+    if (ctx->xrc_qp) {
+        ibv_modify_qp(ctx->xrc_qp, &attr, IBV_QP_STATE);
+    }
+    // The poller must not route anything once sessions are swapped
+    client_wait_poller(ctx);
+
+    if (ctx->retired_xrc_qp) {
+        ibv_destroy_qp(ctx->retired_xrc_qp);
+    }
+    if (ctx->retired_id) {
+        rdma_destroy_qp(ctx->retired_id);
+        rdma_destroy_id(ctx->retired_id);
+    }
+    ctx->retired_id = ctx->cm_id;
+    ctx->retired_xrc_qp = ctx->xrc_qp;
+    ctx->xrc_qp = NULL;
+    ctx->qpn = ctx->xrc_qpn = 0;
+}
+
+int reconnect_client(client_ctx_t *ctx, int max_attempts) {
+    uint64_t backoff = RECONNECT_BACKOFF_MIN_NSEC;
+    uint32_t gen = (tls_ctx == ctx) ? (tls_dp->gen) : (ctx->gen);
+    int attempt = 0;
+
+    EXT_API_STATUS(
+        ctx->xport, { return (-1); },
+        "%s sessions end with the server, no reconnect\n", ctx->xport->name);
+    EXT_API_STATUS(
+        ctx->nqps > 1, { return (-1); },
+        "Sessions of %u RC QPs end with the server, no reconnect\n",
+        ctx->nqps);
+    pthread_mutex_lock(&(ctx->sess_mtx));
+    // Another requester already replaced the session this one failed on
+    if (gen != ctx->gen) {
+        pthread_mutex_unlock(&(ctx->sess_mtx));
+        return (0);
+    }
+
+    client_note_fault(ctx, cq_ring_now());
+    client_retire_session(ctx);
+    for (attempt = 1; attempt <= max_attempts; attempt++) {
+        printf("Reconnect attempt %d/%d\n", attempt, max_attempts);
+        if (!client_resolve(ctx)) {
+            // MRs are only valid on the device the PD was allocated on
+            if (ctx->cm_id->verbs != ctx->verbs) {
+                printf("Server now resolves through another device\n");
+            } else if (!client_connect_qp(ctx)) {
+                break;
+            }
+            pthread_mutex_lock(&(ctx->evt_mtx));
+            struct rdma_cm_id *id = ctx->cm_id;
+            ctx->cm_id = NULL;
+            pthread_mutex_unlock(&(ctx->evt_mtx));
+            rdma_destroy_id(id);
+        }
+
+        if (attempt < max_attempts) {
+            struct timespec ts = {backoff / NSEC_TO_SEC, backoff % NSEC_TO_SEC};
+            nanosleep(&ts, NULL);
+            backoff = (backoff * 2 < RECONNECT_BACKOFF_MAX_NSEC)
+                          ? (backoff * 2)
+                          : (RECONNECT_BACKOFF_MAX_NSEC);
+        }
+    }
+
+    // Without a session, keep the retired one so that stale dp->qp are valid
+    EXT_API_STATUS(
+        attempt > max_attempts,
+        {
+            ctx->cm_id = ctx->retired_id;
+            ctx->xrc_qp = ctx->retired_xrc_qp;
+            ctx->retired_id = NULL;
+            ctx->retired_xrc_qp = NULL;
+            pthread_mutex_unlock(&(ctx->sess_mtx));
+            return (-1);
+        },
+        "Unable to reconnect after %d attempts\n", max_attempts);
+
+    if (ctx->wcq_fn) {
+        API_STATUS(
+            client_start_poller(ctx),
+            {
+                pthread_mutex_unlock(&(ctx->sess_mtx));
+                return (-1);
+            },
+            "Unable to restart WCQ shared send/recv monitor\n");
+    }
+    __atomic_store_n(&(ctx->resume_nsec),
+                     __atomic_exchange_n(&(ctx->fault_nsec), 0,
+                                         __ATOMIC_RELAXED),
+                     __ATOMIC_RELAXED);
+    ctx->reconnects++;
+    __atomic_store_n(&(ctx->gen), ctx->gen + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&(ctx->sess_mtx));
+    return (0);
+}
+
+int storm_client_connect(client_storm_t *st, struct sockaddr *src_addr,
+                         struct sockaddr *dst_addr) {
+    struct ibv_qp_init_attr qp_attr = {};
+    struct rdma_conn_param conn_param = {};
+    struct rdma_cm_id *id = NULL;
+    struct ibv_qp *xqp = NULL;
+    client_priv_t priv = {0};
+    int rc = 0;
+
+    TIME_DECLARATIONS();
+    TIME_START();
+    // No event channel, every CM call below returns once its event arrived
+    rc = rdma_create_id(NULL, &id, NULL, RDMA_PS_TCP);
+    API_STATUS(
+        rc, { return (-1); },
+        "Unable to create RDMA Connection ID. Reason: %s\n", strerror(errno));
+    rc = rdma_resolve_addr(id, src_addr, dst_addr, 2000);
+    API_STATUS(
+        rc, { goto free_cm_id; },
+        "Unable to resolve RDMA address for IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), strerror(errno));
+    rc = rdma_resolve_route(id, 2000);
+    API_STATUS(
+        rc, { goto free_cm_id; },
+        "Unable to resolve RDMA route for IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), strerror(errno));
+
+    if (!st->verbs) {
+        st->verbs = id->verbs;
+        st->pd = ibv_alloc_pd(id->verbs);
+        API_NULL(
+            st->pd, { goto free_cm_id; },
+            "Unable to alloc RDMA Protection Domain. Reason: %s\n",
+            strerror(errno));
+        st->cq = ibv_create_cq(id->verbs, 2, NULL, NULL, 0);
+        API_NULL(
+            st->cq, { goto free_cm_id; },
+            "Unable to create RDMA CQ. Reason: %s\n", strerror(errno));
+    }
+    EXT_API_STATUS(
+        id->verbs != st->verbs, { goto free_cm_id; },
+        "Server now resolves through another device\n");
+
+    qp_attr.cap.max_send_wr = 1;
+    qp_attr.cap.max_recv_wr = 1;
+    qp_attr.cap.max_send_sge = 1;
+    qp_attr.cap.max_recv_sge = 1;
+    qp_attr.qp_type = IBV_QPT_RC;
+    qp_attr.send_cq = st->cq;
+    qp_attr.recv_cq = st->cq;
+    rc = rdma_create_qp(id, st->pd, &qp_attr);
+    API_STATUS(
+        rc, { goto free_cm_id; }, "Unable to RDMA QPs. Reason: %s\n",
+        strerror(errno));
+
+    // The server connects its XRC_RECV QP to this one before accepting
+    if (st->xrc) {
+        struct ibv_qp_init_attr_ex xrc_attr = {0};
+        xrc_attr.qp_type = IBV_QPT_XRC_SEND;
+        xrc_attr.comp_mask = IBV_QP_INIT_ATTR_PD;
+        xrc_attr.pd = st->pd;
+        xrc_attr.send_cq = st->cq;
+        xrc_attr.cap.max_send_wr = 1;
+        xrc_attr.cap.max_send_sge = 1;
+        xqp = ibv_create_qp_ex(st->verbs, &xrc_attr);
+        API_NULL(
+            xqp, { goto free_qp; },
+            "Unable to create XRC_SEND QP. Reason: %s\n", strerror(errno));
+        priv.xrc_qpn = xqp->qp_num;
+        conn_param.private_data = &priv;
+        conn_param.private_data_len = sizeof(client_priv_t);
+    }
+
+    conn_param.initiator_depth = 16;
+    conn_param.responder_resources = 16;
+    conn_param.retry_count = 5;
+    conn_param.rnr_retry_count = 7;
+    rc = rdma_connect(id, &conn_param);
+    API_STATUS(
+        rc, { goto free_qp; },
+        "Unable to connect to RDMA device IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), strerror(errno));
+    if (xqp) {
+        // The ESTABLISHED event of a synchronous id stays readable until
+        // the next CM call
+        server_priv_t spriv = {0};
+        const struct rdma_conn_param *param = &(id->event->param.conn);
+        memcpy(&spriv, param->private_data,
+               (param->private_data_len < sizeof(server_priv_t))
+                   ? param->private_data_len
+                   : sizeof(server_priv_t));
+        EXT_API_STATUS(
+            !spriv.xrc_srqn, { goto disconnect_free_qp; },
+            "Server did not set up an XRC SRQ\n");
+        API_STATUS(
+            xrc_connect_qp(id, xqp, spriv.xrc_qpn),
+            { goto disconnect_free_qp; },
+            "Unable to connect XRC_SEND QP to server QP %u\n",
+            spriv.xrc_qpn);
+    }
+    TIME_GET_ELAPSED_TIME(st->last_nsec);
+
+    rdma_disconnect(id);
+    if (xqp) {
+        ibv_destroy_qp(xqp);
+    }
+    rdma_destroy_qp(id);
+    rdma_destroy_id(id);
+    return (0);
+
+disconnect_free_qp:
+    rdma_disconnect(id);
+free_qp:
+    if (xqp) {
+        ibv_destroy_qp(xqp);
+    }
+    rdma_destroy_qp(id);
+free_cm_id:
+    rdma_destroy_id(id);
+    return (-1);
+}
+
+void storm_client_destroy(client_storm_t *st) {
+    if (st->cq) {
+        ibv_destroy_cq(st->cq);
+    }
+    if (st->pd) {
+        ibv_dealloc_pd(st->pd);
+    }
+    memset(st, 0, sizeof(client_storm_t));
+}
+
+// Anonymous buffer, populated and locked if the client asked for it
+static void *client_map_buf(client_ctx_t *ctx, size_t sz) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    flags |= (ctx->lock_bufs) ? (MAP_POPULATE) : (0);
+    void *buf = mmap(NULL, sz, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (buf != MAP_FAILED && ctx->lock_bufs && mlock(buf, sz)) {
+        printf("Unable to mlock %zu bytes. Reason: %s\n", sz, strerror(errno));
+        munmap(buf, sz);
+        return (MAP_FAILED);
+    }
+
+    return (buf);
+}
+
+int prepare_client_data(client_ctx_t *ctx, int opc) {
+    size_t send_sz = (MAX_MR_SZ);
+    size_t recv_sz = (MAX_MR_SZ);
+    void *bounce_buf = NULL;
+    // Based on the opcode, allocate req & response structures
+    // Register memory with RDMA stack, if needed
+    // Save keys and mrs into ctx, if needed
+    // Exchange addresses with server for OPC_RDMA_READ/WRITE
+
+    // Allocate 1MB of buffer space
+    void *send_buf = client_map_buf(ctx, send_sz);
+    EXT_API_STATUS(
+        send_buf == MAP_FAILED, { return (-1); },
+        "Unable to allocate 1MB send buffer. Reason: %s\n", strerror(errno));
+    void *recv_buf = client_map_buf(ctx, recv_sz);
+    EXT_API_STATUS(
+        recv_buf == MAP_FAILED,
+        {
+            munmap(send_buf, send_sz);
+            return (-1);
+        },
+        "Unable to allocate 1MB recv buffer. Reason: %s\n", strerror(errno));
+
+    ctx->send_client_buf = send_buf;
+    ctx->send_client_buf_sz = send_sz;
+    ctx->recv_client_buf = recv_buf;
+    ctx->recv_client_buf_sz = recv_sz;
+
+    // Message transports carry copies of SEND requests, nothing registered
+    if (ctx->xport) {
+        EXT_API_STATUS(
+            opc != OPC_SEND_ONLY, { return (-1); },
+            "Only SEND requests are served over %s\n", ctx->xport->name);
+        randomize_buf(&(ctx->send_client_buf), ctx->send_client_buf_sz);
+        return (0);
+    }
+
+    // Atomic counter array is advertised by the server through rdma_accept
+    EXT_API_STATUS(
+        ((opc == OPC_ATOMIC_FADD || opc == OPC_ATOMIC_CAS) &&
+         !ctx->server_priv.atomic.len),
+        { goto unmap_bufs; },
+        "Server did not advertise an atomic counter array\n");
+
+    // IBV_OPC_SEND_ONLY: allocate in buf, register in/out, no exchg
+    // OPC_RDMA_READ/WRITE: allocate in/out buf, register in/out, exchg in/out
+    // and keys
+    ctx->send_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                    &(ctx->implicit_mr), send_buf, send_sz);
+    API_NULL(
+        ctx->send_buf_mr, { goto unmap_bufs; },
+        "Unable to register send buf with RDMA. Reason: %s\n", strerror(errno));
+    ctx->recv_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                    &(ctx->implicit_mr), recv_buf, recv_sz);
+    API_NULL(
+        ctx->recv_buf_mr, { goto dereg_send; },
+        "Unable to register recv buf with RDMA. Reason: %s\n", strerror(errno));
+
+    // Bounce buffer to linearize iovecs beyond the device SGE limit
+    bounce_buf = client_map_buf(ctx, send_sz);
+    EXT_API_STATUS(
+        bounce_buf == MAP_FAILED, { goto dereg_recv; },
+        "Unable to allocate 1MB bounce buffer. Reason: %s\n", strerror(errno));
+    ctx->bounce_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                      &(ctx->implicit_mr), bounce_buf, send_sz);
+    API_NULL(
+        ctx->bounce_buf_mr, { goto unmap_bounce; },
+        "Unable to register bounce buf with RDMA. Reason: %s\n",
+        strerror(errno));
+    ctx->bounce_client_buf = bounce_buf;
+
+    randomize_buf(&(ctx->send_client_buf), ctx->send_client_buf_sz);
+    // Start a separate thread to poll for completion
+    API_STATUS(
+        client_start_poller(ctx), { goto dereg_bounce; },
+        "Unable to create WCQ shared send/recv monitor\n");
+
+    // RDMA_WRITE streams exchange buffers at the start of each bw round
+    // TODO: Use TCP-IP client/server socket to exchg this
+    if (opc == OPC_RDMA_READ) {
+        return (-1);
+    }
+
+    return 0;
+
+dereg_bounce:
+    rdma_dereg_buf(ctx->bounce_buf_mr, ctx->implicit_mr);
+    ctx->bounce_buf_mr = NULL;
+    ctx->bounce_client_buf = NULL;
+unmap_bounce:
+    munmap(bounce_buf, send_sz);
+dereg_recv:
+    rdma_dereg_buf(ctx->recv_buf_mr, ctx->implicit_mr);
+    ctx->recv_buf_mr = NULL;
+dereg_send:
+    rdma_dereg_buf(ctx->send_buf_mr, ctx->implicit_mr);
+    ctx->send_buf_mr = NULL;
+unmap_bufs:
+    ctx->send_client_buf = NULL;
+    ctx->recv_client_buf = NULL;
+    munmap(send_buf, send_sz);
+    munmap(recv_buf, recv_sz);
+    return (-1);
+}
+
+struct ibv_mr *register_client_buf(client_ctx_t *ctx, void *buf, size_t len) {
+    if (ctx->xport) {
+        return (NULL);
+    }
+
+    EXT_API_STATUS(
+        ctx->nuser_mr >= MAX_USER_MR, { return (NULL); },
+        "Unable to register more than %d client buffers\n", MAX_USER_MR);
+    API_STATUS(
+        (ctx->lock_bufs) ? (mlock(buf, len)) : (0), { return (NULL); },
+        "Unable to mlock user buf. Reason: %s\n", strerror(errno));
+    struct ibv_mr *mr =
+        rdma_reg_buf(ctx->pd, &(ctx->qp_cfg), &(ctx->implicit_mr), buf, len);
+    API_NULL(
+        mr, { return (NULL); },
+        "Unable to register user buf with RDMA. Reason: %s\n",
+        strerror(errno));
+    ctx->user_mr[ctx->nuser_mr++] = mr;
+    return (mr);
+}
+
+static struct ibv_mr *client_lookup_mr(client_ctx_t *ctx, void *addr,
+                                       size_t len) {
+    struct ibv_mr *mrs[3 + MAX_USER_MR] = {ctx->send_buf_mr, ctx->recv_buf_mr,
+                                           ctx->bounce_buf_mr};
+    memcpy(&mrs[3], ctx->user_mr, sizeof(ctx->user_mr));
+    for (int i = 0; i < (3 + ctx->nuser_mr); i++) {
+        if (mrs[i] && (addr >= mrs[i]->addr) &&
+            ((addr + len) <= (mrs[i]->addr + mrs[i]->length))) {
+            return (mrs[i]);
+        }
+    }
+
+    return (NULL);
+}
+
+static int client_iov_to_sge(client_ctx_t *ctx, const struct iovec *iov,
+                             int iovcnt, struct ibv_sge *sge) {
+    for (int i = 0; i < iovcnt; i++) {
+        struct ibv_mr *mr =
+            client_lookup_mr(ctx, iov[i].iov_base, iov[i].iov_len);
+        API_NULL(
+            mr, { return (-1); },
+            "IOV[%d] %p of %zu bytes is not within a registered buffer\n", i,
+            iov[i].iov_base, iov[i].iov_len);
+        sge[i].addr = (uint64_t)iov[i].iov_base;
+        sge[i].length = iov[i].iov_len;
+        sge[i].lkey = mr->lkey;
+    }
+
+    return (0);
+}
+
+// XRC request to the server SRQ through the ibv_wr_* calls of xrc_qpx
+static int client_post_xrc_ex(client_dp_t *dp, rdma_wr_fn_t wr,
+                              const struct ibv_send_wr *send_wr) {
+    ibv_wr_start(dp->xrc_qpx);
+    dp->xrc_qpx->wr_id = send_wr->wr_id;
+    dp->xrc_qpx->wr_flags = send_wr->send_flags;
+    wr(dp->xrc_qpx, send_wr->wr.rdma.rkey, send_wr->wr.rdma.remote_addr,
+       send_wr->imm_data);
+    ibv_wr_set_xrc_srqn(dp->xrc_qpx, dp->xrc_srqn);
+    ibv_wr_set_sge_list(dp->xrc_qpx, send_wr->num_sge, send_wr->sg_list);
+    return (ibv_wr_complete(dp->xrc_qpx));
+}
+
+// Send requests go to the server SRQ over XRC if connected that way. Posts
+// take the ibv_wr_* calls of builder wr, matching send_wr->opcode, if the
+// QP is extended, else ibv_post_send. Either post is timed
+static int client_post_request(client_dp_t *dp, rdma_wr_fn_t wr,
+                               struct ibv_send_wr *send_wr) {
+    struct ibv_send_wr *send_bad_wr = NULL;
+    int rc = 0;
+
+    uint64_t t0 = rdma_cycles();
+    if (dp->xrc_qpx) {
+        rc = client_post_xrc_ex(dp, wr, send_wr);
+    } else if (dp->xrc_qp) {
+        send_wr->qp_type.xrc.remote_srqn = dp->xrc_srqn;
+        rc = ibv_post_send(dp->xrc_qp, send_wr, &send_bad_wr);
+    } else if (dp->qpx) {
+        rc = rdma_post_ex(dp->qpx, wr, send_wr->wr_id, send_wr->send_flags,
+                          send_wr->imm_data, send_wr->wr.rdma.remote_addr,
+                          send_wr->wr.rdma.rkey, send_wr->sg_list,
+                          send_wr->num_sge);
+    } else {
+        rc = ibv_post_send(dp->qp, send_wr, &send_bad_wr);
+    }
+    STATS_ADD(dp->stats, post_cyc, rdma_cycles() - t0);
+    STATS_ADD(dp->stats, post_n, 1);
+    return (rc);
+}
+
+// Round trip over a message transport: gather the request into a message,
+// scatter the echo out of the response handed out in place
+static int client_xport_call(client_ctx_t *ctx, client_dp_t *dp, int opc,
+                             const struct iovec *siov, int siovcnt,
+                             const struct iovec *riov, int riovcnt) {
+    msg_xport_t *x = ctx->xport;
+    uint64_t rtt_nsec = 0;
+    uint32_t ropc = 0, len = 0, off = 0;
+    size_t msg_sz = 0;
+    void *data = NULL;
+
+    for (int i = 0; i < siovcnt; i++) {
+        msg_sz += siov[i].iov_len;
+    }
+
+    TIME_DECLARATIONS();
+    TIME_START();
+    API_STATUS(
+        x->send(x, opc, siov, siovcnt),
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to send request over %s\n", x->name);
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, msg_sz);
+    EXT_API_STATUS(
+        x->recv(x, &ropc, &data, &len, true) != 1, { return (-1); },
+        "Server left the %s session\n", x->name);
+    for (int i = 0; i < riovcnt && off < len; i++) {
+        uint32_t n = (riov[i].iov_len < (len - off)) ? (riov[i].iov_len)
+                                                      : (len - off);
+        memcpy(riov[i].iov_base, data + off, n);
+        off += n;
+    }
+    x->release(x);
+    TIME_GET_ELAPSED_TIME(rtt_nsec);
+    STATS_ADD(dp->stats, rx_msgs, 1);
+    STATS_ADD(dp->stats, rx_bytes, len);
+
+    dp->last_rtt_nsec = rtt_nsec;
+    if (!dp->quiet) {
+        printf("[%sSEND-RECV] Round Trip Latency: %ld nsec, Size: %zu "
+               "bytes, IOVs: %d\n",
+               x->tag, rtt_nsec, msg_sz, siovcnt);
+    }
+
+    return (0);
+}
+
+// Copy what the write RPC datapath of the calling thread needs into dp
+static int client_wrpc_attach(client_ctx_t *ctx, client_dp_t *dp) {
+    EXT_API_STATUS(
+        !ctx->wrpc_buf_mr, { return (-1); },
+        "Write RPCs are not started, see start_client_wrpc\n");
+    EXT_API_STATUS(
+        dp->idx >= WRPC_SLOTS, { return (-1); },
+        "Write RPC rings serve up to %d requester threads\n", WRPC_SLOTS);
+    dp->wrpc_lkey = ctx->wrpc_buf_mr->lkey;
+    dp->wrpc_rkey = ctx->wrpc_buf_mr->rkey;
+    dp->wrpc_ring = ctx->server_priv.wrpc;
+    dp->wrpc_buf = ctx->wrpc_client_buf;
+    return (0);
+}
+
+// RDMA_WRITE msg_sz bytes of the send buf and a trailer right behind them
+// to the end of the server slot of the calling thread. Unsignaled but one
+// in WRPC_SIGNAL_EVERY, or if wr_id is routed to the thread
+static int client_wrpc_post(client_dp_t *dp, size_t msg_sz, uint32_t opc,
+                            uint64_t wr_id) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge[2] = {0};
+    int nsge = 0;
+
+    // Trailers sent live behind the response slots, a cache line apiece
+    wrpc_tail_t *tail = (wrpc_tail_t *)(dp->wrpc_buf + WRPC_RING_SZ +
+                                        (dp->idx * CACHE_LINE_SZ));
+    // 0 is what the server starts every slot with
+    dp->wrpc_seq = (dp->wrpc_seq + 1) ? (dp->wrpc_seq + 1) : (1);
+    tail->resp_addr =
+        (uint64_t)dp->wrpc_buf + ((uint64_t)dp->idx * WRPC_SLOT_SZ);
+    tail->resp_rkey = dp->wrpc_rkey;
+    tail->len = msg_sz;
+    tail->opc = opc;
+    tail->seq = dp->wrpc_seq;
+    if (msg_sz) {
+        sge[nsge].addr = (uint64_t)dp->send_buf;
+        sge[nsge].length = msg_sz;
+        sge[nsge].lkey = dp->send_lkey;
+        nsge++;
+    }
+    sge[nsge].addr = (uint64_t)tail;
+    sge[nsge].length = sizeof(wrpc_tail_t);
+    sge[nsge].lkey = dp->wrpc_lkey;
+    nsge++;
+
+    send_wr.wr_id = wr_id;
+    send_wr.sg_list = &sge[0];
+    send_wr.num_sge = nsge;
+    send_wr.opcode = IBV_WR_RDMA_WRITE;
+    dp->wrpc_unsig = (dp->wrpc_unsig + 1) % WRPC_SIGNAL_EVERY;
+    send_wr.send_flags = (!dp->wrpc_unsig || (wr_id & BW_WR_FLAG))
+                             ? (IBV_SEND_SIGNALED)
+                             : (0);
+    send_wr.wr.rdma.remote_addr = dp->wrpc_ring.addr +
+                                  ((uint64_t)(dp->idx + 1) * WRPC_SLOT_SZ) -
+                                  sizeof(wrpc_tail_t) - msg_sz;
+    send_wr.wr.rdma.rkey = dp->wrpc_ring.rkey;
+    uint64_t t0 = rdma_cycles();
+    int rc = (dp->qpx)
+                 ? (rdma_post_ex(dp->qpx, rdma_wr_write, send_wr.wr_id,
+                                 send_wr.send_flags, 0,
+                                 send_wr.wr.rdma.remote_addr,
+                                 send_wr.wr.rdma.rkey, &sge[0], nsge))
+                 : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+    STATS_ADD(dp->stats, post_cyc, rdma_cycles() - t0);
+    STATS_ADD(dp->stats, post_n, 1);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post write RPC. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, msg_sz);
+    return (0);
+}
+
+// Round trip of a write RPC: the echo is found by polling the seq closing
+// the response slot, nothing completes locally unless the write failed
+static int client_wrpc_call(client_ctx_t *ctx, client_dp_t *dp,
+                            size_t msg_sz) {
+    uint64_t rtt_nsec = 0;
+    cq_rec_t rec = {0};
+
+    if (!dp->wrpc_buf) {
+        API_STATUS(
+            client_wrpc_attach(ctx, dp), { return (-1); },
+            "Unable to attach thread to write RPCs\n");
+    }
+    EXT_API_STATUS(
+        fiber_self(), { return (-1); },
+        "Write RPC slots are per thread, not callable from fibers\n");
+    EXT_API_STATUS(
+        msg_sz > WRPC_MAX_MSG, { return (-1); },
+        "Write RPC of %zu bytes exceeds %d bytes\n", msg_sz, WRPC_MAX_MSG);
+
+    wrpc_tail_t *resp = wrpc_slot_tail(dp->wrpc_buf, dp->idx);
+    TIME_DECLARATIONS();
+    TIME_START();
+    API_STATUS(
+        client_wrpc_post(dp, msg_sz, OPC_SEND_ONLY, WR_ID(dp)),
+        { return (-1); }, "Unable to send write RPC\n");
+    while (__atomic_load_n(&(resp->seq), __ATOMIC_ACQUIRE) != dp->wrpc_seq) {
+        if (cq_ring_try_pop(&(dp->ring), &rec) &&
+            rec.status != IBV_WC_SUCCESS) {
+            printf("WR[%lx] failed. Status: %s\n", rec.wr_id,
+                   ibv_wc_status_str(rec.status));
+            return (-1);
+        }
+        EXT_API_STATUS(
+            !ctx->is_connected, { return (-1); },
+            "Write RPC aborted, client disconnected\n");
+        cpu_relax();
+    }
+    TIME_GET_ELAPSED_TIME(rtt_nsec);
+
+    dp->last_rtt_nsec = rtt_nsec;
+    if (!dp->quiet) {
+        printf("[WRITE-RPC] Round Trip Latency: %ld nsec, Size: %zu bytes\n",
+               rtt_nsec, msg_sz);
+    }
+
+    return (0);
+}
+
+int send_client_request(client_ctx_t *ctx, int opc, size_t msg_sz) {
+    if (opc == OPC_WRITE_RPC) {
+        client_dp_t *dp = attach_client_thread(ctx);
+        API_NULL(
+            dp, { return (-1); }, "Unable to attach requester thread\n");
+        return (client_wrpc_call(ctx, dp, msg_sz));
+    }
+
+    struct iovec siov = {ctx->send_client_buf,
+                         (msg_sz < ctx->send_client_buf_sz)
+                             ? (msg_sz)
+                             : (ctx->send_client_buf_sz)};
+    struct iovec riov = {ctx->recv_client_buf,
+                         (msg_sz < ctx->recv_client_buf_sz)
+                             ? (msg_sz)
+                             : (ctx->recv_client_buf_sz)};
+    return (send_client_request_iov(ctx, opc, &siov, 1, &riov, 1, false));
+}
+
+int send_client_request_iov(client_ctx_t *ctx, int opc,
+                            const struct iovec *siov, int siovcnt,
+                            const struct iovec *riov, int riovcnt,
+                            bool linearize) {
+    uint64_t rtt_send_nsec = 0;
+    rdma_wr_fn_t wr = NULL;
+    int rc = 0, nsge = 0;
+    size_t msg_sz = 0;
+    // Based on the opcode, prepare wqe structures
+    // use IMM: to distinguish between no RDMA vs RDMA follow-up
+    // OPC_SEND_ONLY: lkey, no rkey is needed, zcopy local send, 1-copy remote
     // recv Protocol-1: Measure RTT time from client<->server
     // ------------------------------------------------
     // time_start()
@@ -355,85 +1477,782 @@ int send_client_request(client_ctx_t *ctx, int opc, size_t msg_sz) {
     //                      based on IMM1, reply with OPC_SEND_ONLY
     // IBV_WC_RECV_RDMA <---IBV_SEND
     // time_end()
-    //
-    if (opc != OPC_SEND_ONLY) {
+    //
+    // Protocol-2: Measure OPC_RDMA_WRITE RTT from client<->server
+    // OPC_RDMA_WRITE: the request lands in the server sink, its IMM consumes
+    // a server recv, the server notifies back with a zero length
+    // RDMA_WRITE_IMM that consumes the client recv
+    // -------------------------------------------------
+    // time_start()
+    // IBV_RECV
+    //                      IBV_RECV
+    // RDMA_WRITE_IMM ----> IBV_WC_RECV_RDMA_WITH_IMM
+    //                      based on IMM2, reply with OPC_RDMA_WRITE IMM notify
+    // IBV_WC_RECV_RDMA <---RDMA_WRITE_IMM
+    // time_end()
+    if (opc != OPC_SEND_ONLY && opc != OPC_RDMA_WRITE) {
         printf("Unsupported opcode\n");
         return (-1);
     }
 
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+    EXT_API_STATUS(
+        (siovcnt < 1 || riovcnt < 1 || riovcnt > dp->max_sge ||
+         siovcnt > RDMA_MAX_SGE),
+        { return (-1); },
+        "Unsupported iovec count send: %d recv: %d, max SGE: %d\n", siovcnt,
+        riovcnt, dp->max_sge);
+    if (ctx->xport) {
+        EXT_API_STATUS(
+            opc != OPC_SEND_ONLY, { return (-1); },
+            "Only SEND requests are served over %s\n", ctx->xport->name);
+        return (client_xport_call(ctx, dp, opc, siov, siovcnt, riov, riovcnt));
+    }
+
     struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
-    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
-    struct ibv_sge sge = {0};
+    struct ibv_send_wr send_wr = {0};
+    struct ibv_sge rsge[RDMA_MAX_SGE] = {0};
+    struct ibv_sge ssge[RDMA_MAX_SGE] = {0};
 
-    sge.addr = (uint64_t)ctx->recv_client_buf;
-    sge.length = (msg_sz < ctx->recv_client_buf_sz) ? (msg_sz)
-                                                    : (ctx->recv_client_buf_sz);
-    sge.lkey = ctx->recv_buf_mr->lkey;
-    recv_wr.wr_id = (count % MAX_SEND_WR);
+    API_STATUS(
+        client_iov_to_sge(ctx, riov, riovcnt, rsge), { return (-1); },
+        "Unable to map response iovecs\n");
+    recv_wr.wr_id = WR_ID(dp);
     recv_wr.next = NULL;
-    recv_wr.sg_list = &sge;
-    recv_wr.num_sge = 1;
+    recv_wr.sg_list = &rsge[0];
+    recv_wr.num_sge = riovcnt;
     TIME_DECLARATIONS();
     TIME_START();
-    rc = ibv_post_recv(ctx->cm_id->qp, &recv_wr, &recv_bad_wr);
+    rc = ibv_post_recv(dp->qp, &recv_wr, &recv_bad_wr);
     API_STATUS(
-        rc, { return (-1); }, "Unable to post receive request. Reason: %s\n",
-        strerror(errno));
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post receive request. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, rx_posted, 1);
+
+    // Gather in place if the device allows, else copy into the bounce buf
+    linearize = linearize || (siovcnt > dp->max_sge);
+    if (linearize) {
+        for (int i = 0; i < siovcnt; i++) {
+            EXT_API_STATUS(
+                (msg_sz + siov[i].iov_len) > MAX_MR_SZ, { return (-1); },
+                "Request exceeds bounce buffer of %d bytes\n", MAX_MR_SZ);
+            memcpy(dp->bounce_buf + msg_sz, siov[i].iov_base,
+                   siov[i].iov_len);
+            msg_sz += siov[i].iov_len;
+        }
+
+        ssge[0].addr = (uint64_t)dp->bounce_buf;
+        ssge[0].length = msg_sz;
+        ssge[0].lkey = dp->bounce_lkey;
+        nsge = 1;
+    } else {
+        API_STATUS(
+            client_iov_to_sge(ctx, siov, siovcnt, ssge), { return (-1); },
+            "Unable to map request iovecs\n");
+        for (int i = 0; i < siovcnt; i++) {
+            msg_sz += siov[i].iov_len;
+        }
+
+        nsge = siovcnt;
+    }
 
-    send_wr.wr_id = (count % MAX_SEND_WR);
-    count++;
+    send_wr.wr_id = recv_wr.wr_id;
     send_wr.next = NULL;
-    sge.addr = (uint64_t)ctx->send_client_buf;
-    sge.length = (msg_sz < ctx->send_client_buf_sz) ? (msg_sz)
-                                                    : (ctx->send_client_buf_sz);
-    sge.lkey = ctx->send_buf_mr->lkey;
-    send_wr.sg_list = &sge;
-    send_wr.num_sge = 1;
+    send_wr.sg_list = &ssge[0];
+    send_wr.num_sge = nsge;
     send_wr.opcode = IBV_WR_SEND_WITH_IMM;
     send_wr.send_flags = IBV_SEND_SIGNALED;
     send_wr.imm_data = opc;
     // for opc = SEND_ONLY, remote address doesn't matter
     send_wr.wr.rdma.remote_addr = 0;
     send_wr.wr.rdma.rkey = 0;
-    rc = ibv_post_send(ctx->cm_id->qp, &send_wr, &send_bad_wr);
+    wr = rdma_wr_send_imm;
+    if (opc == OPC_RDMA_WRITE) {
+        // Contents of the sink are never read, threads share its start
+        EXT_API_STATUS(
+            msg_sz > ctx->server_priv.sink.len, { return (-1); },
+            "RDMA_WRITE of %zu bytes exceeds the %u byte server sink\n",
+            msg_sz, ctx->server_priv.sink.len);
+        send_wr.opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+        send_wr.wr.rdma.remote_addr = ctx->server_priv.sink.addr;
+        send_wr.wr.rdma.rkey = ctx->server_priv.sink.rkey;
+        wr = rdma_wr_write_imm;
+    }
+    rc = client_post_request(dp, wr, &send_wr);
     API_STATUS(
-        rc, { return (-1); }, "Unable to post send request. Reason: %s\n",
-        strerror(errno));
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post send request. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, msg_sz);
 
     // sync with WCQ to make sure RECV_RDMA is consumed
-    pthread_mutex_lock(&(ctx->wcq_mtx));
-    while (!ctx->rtt_done[recv_wr.wr_id]) {
-        pthread_cond_wait(&(ctx->wcq_cv), &(ctx->wcq_mtx));
+    API_STATUS(
+        client_wait_wr(ctx, dp, recv_wr.wr_id), { return (-1); },
+        "Unable to complete send/recv round trip\n");
+
+    TIME_GET_ELAPSED_TIME(rtt_send_nsec);
+    dp->last_rtt_nsec = rtt_send_nsec;
+    if (!dp->quiet) {
+        printf("[%s] Round Trip Latency: %ld nsec, Size: %zu bytes, SGEs: %d\n",
+               ((opc == OPC_SEND_ONLY)
+                    ? (linearize ? "SEND-RECV-COPY" : "SEND-RECV")
+                    : ("WRITE-IMM")),
+               rtt_send_nsec, msg_sz, siovcnt);
     }
 
-    ctx->rtt_done[recv_wr.wr_id] = 0; // Reset for next request
-    pthread_mutex_unlock(&(ctx->wcq_mtx));
+    return (0);
+}
 
-    TIME_GET_ELAPSED_TIME(rtt_send_nsec);
-    printf("[%s] Round Trip Latency: %ld nsec, Size: %zu bytes\n",
-           ((opc == OPC_SEND_ONLY)
-                ? "SEND-RECV"
-                : ((opc == OPC_RDMA_READ) ? "RDMA-READ" : "RDMA_WRITE")),
-           rtt_send_nsec, msg_sz);
+int send_client_atomic(client_ctx_t *ctx, int opc, uint32_t idx,
+                       uint64_t compare_add, uint64_t swap, uint64_t *old) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    int rc = 0;
+    // Protocol-3: one-sided atomic on the server counter array, the server
+    // CPU is not involved
+    // ------------------------------------------------
+    // IBV_WR_ATOMIC_* ---> counter[idx]
+    // IBV_WC_FETCH_ADD/COMP_SWAP <--- prior value of counter[idx]
+    EXT_API_STATUS(
+        (opc != OPC_ATOMIC_FADD && opc != OPC_ATOMIC_CAS), { return (-1); },
+        "Unsupported atomic opcode\n");
+    EXT_API_STATUS(
+        ctx->xport, { return (-1); },
+        "Atomics target server memory over RDMA, not %s\n",
+        ctx->xport->name);
+    EXT_API_STATUS(
+        fiber_self(), { return (-1); },
+        "Atomic results land in a per-thread slot, not callable from fibers\n");
+    EXT_API_STATUS(
+        ((idx + 1) * sizeof(uint64_t)) > ctx->server_priv.atomic.len,
+        { return (-1); }, "Atomic counter %u is not advertised by server\n",
+        idx);
 
-    // Protocol-2: Measure OPC_RDMA_WRITE RTT from client<->server
-    // OPC_RDMA_READ/WRITE: mr and key is needed, zcopy local send, zcopy local
-    // recv
-    // -------------------------------------------------
-    // time_start()
-    //                      IBV_RECV
-    // IBV_SEND --------->  IBV_WC_RECV_RDMA_WITH_IMM
-    //                      based on IMM2, reply with OPC_RDMA_WRITE IMM notify
-    // RDMA_WRITE_IMM -------->
-    //                      IBV_WC_RDMA_WRITE_IMM
-    //              <-------RDMA_WRITE_IMM
-    // IBV_WC_RDMA_WRITE_IMM
-    // time_end()
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+
+    // Each requester thread owns a cache line of the recv buf for results
+    send_wr.wr_id = WR_ID(dp);
+    uint64_t *result = (uint64_t *)(dp->recv_buf + (dp->idx * CACHE_LINE_SZ));
+    sge.addr = (uint64_t)result;
+    sge.length = sizeof(uint64_t);
+    sge.lkey = dp->recv_lkey;
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = (opc == OPC_ATOMIC_FADD) ? IBV_WR_ATOMIC_FETCH_AND_ADD
+                                              : IBV_WR_ATOMIC_CMP_AND_SWP;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.wr.atomic.remote_addr =
+        ctx->server_priv.atomic.addr + (idx * sizeof(uint64_t));
+    send_wr.wr.atomic.rkey = ctx->server_priv.atomic.rkey;
+    send_wr.wr.atomic.compare_add = compare_add;
+    send_wr.wr.atomic.swap = swap;
+    uint64_t t0 = rdma_cycles();
+    if (dp->qpx) {
+        ibv_wr_start(dp->qpx);
+        dp->qpx->wr_id = send_wr.wr_id;
+        dp->qpx->wr_flags = send_wr.send_flags;
+        if (opc == OPC_ATOMIC_FADD) {
+            ibv_wr_atomic_fetch_add(dp->qpx, send_wr.wr.atomic.rkey,
+                                    send_wr.wr.atomic.remote_addr,
+                                    compare_add);
+        } else {
+            ibv_wr_atomic_cmp_swp(dp->qpx, send_wr.wr.atomic.rkey,
+                                  send_wr.wr.atomic.remote_addr, compare_add,
+                                  swap);
+        }
+        ibv_wr_set_sge(dp->qpx, sge.lkey, sge.addr, sge.length);
+        rc = ibv_wr_complete(dp->qpx);
+    } else {
+        rc = ibv_post_send(dp->qp, &send_wr, &send_bad_wr);
+    }
+    STATS_ADD(dp->stats, post_cyc, rdma_cycles() - t0);
+    STATS_ADD(dp->stats, post_n, 1);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post atomic request. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, sizeof(uint64_t));
+
+    // sync with WCQ to make sure the atomic response landed
+    API_STATUS(
+        client_wait_wr(ctx, dp, send_wr.wr_id), { return (-1); },
+        "Unable to complete atomic request\n");
+
+    *old = *result;
+    return (0);
+}
+
+int start_client_wrpc(client_ctx_t *ctx) {
+    struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    size_t sz = WRPC_RING_SZ + (WRPC_SLOTS * CACHE_LINE_SZ);
+    int rc = 0;
+    // Protocol-5: write-based RPC, neither side consumes a recv per request
+    // ------------------------------------------------
+    // SEND_IMM(OPC_WRPC_START)    --> clear slot trailers
+    // IBV_WC_RECV                 <-- SEND_IMM(OPC_WRPC_START)
+    // RDMA_WRITE(payload, tail)   --> poll tail seq of every slot
+    // poll tail seq of own slot   <-- RDMA_WRITE(payload, tail)
+    // RDMA_WRITE(tail FIN)        --> back to SEND requests
+    EXT_API_STATUS(
+        ctx->xport, { return (-1); },
+        "Write RPCs target server memory over RDMA, not %s\n",
+        ctx->xport->name);
+    EXT_API_STATUS(
+        ctx->server_priv.wrpc.len < WRPC_RING_SZ, { return (-1); },
+        "Server did not advertise a write RPC ring\n");
+    EXT_API_STATUS(
+        ctx->max_sge < 2, { return (-1); },
+        "Device supports %d SGE(s), unable to gather request and trailer\n",
+        ctx->max_sge);
+    EXT_API_STATUS(
+        ctx->qp_cfg.send_wr < 2 * WRPC_SIGNAL_EVERY, { return (-1); },
+        "Send queue of %u WRs is below %d for write RPCs\n",
+        ctx->qp_cfg.send_wr, 2 * WRPC_SIGNAL_EVERY);
+
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+
+    // Response slots, then the trailers sent. Kept across rounds
+    if (!ctx->wrpc_buf_mr) {
+        void *wrpc_buf = client_map_buf(ctx, sz);
+        EXT_API_STATUS(
+            wrpc_buf == MAP_FAILED, { return (-1); },
+            "Unable to allocate write RPC ring. Reason: %s\n",
+            strerror(errno));
+        ctx->wrpc_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                        &(ctx->implicit_mr), wrpc_buf, sz);
+        API_NULL(
+            ctx->wrpc_buf_mr,
+            {
+                munmap(wrpc_buf, sz);
+                return (-1);
+            },
+            "Unable to register write RPC ring with RDMA. Reason: %s\n",
+            strerror(errno));
+        ctx->wrpc_client_buf = wrpc_buf;
+    }
+    API_STATUS(
+        client_wrpc_attach(ctx, dp), { return (-1); },
+        "Unable to attach thread to write RPCs\n");
+
+    sge.addr = (uint64_t)dp->recv_buf;
+    sge.length = ctx->recv_client_buf_sz;
+    sge.lkey = dp->recv_lkey;
+    recv_wr.wr_id = WR_ID(dp);
+    recv_wr.sg_list = &sge;
+    recv_wr.num_sge = 1;
+    rc = ibv_post_recv(dp->qp, &recv_wr, &recv_bad_wr);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post receive request. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, rx_posted, 1);
+
+    send_wr.wr_id = WR_ID(dp);
+    send_wr.num_sge = 0;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = 0;
+    send_wr.imm_data = OPC_WRPC_START;
+    rc = (dp->qpx) ? (rdma_post_ex(dp->qpx, rdma_wr_send_imm, send_wr.wr_id,
+                                   0, OPC_WRPC_START, 0, 0, NULL, 0))
+                   : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post write RPC start. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+
+    // Slots are cleared by the time the server replies
+    API_STATUS(
+        client_wait_wr(ctx, dp, recv_wr.wr_id), { return (-1); },
+        "Unable to start write RPCs\n");
+    return (0);
+}
+
+int stop_client_wrpc(client_ctx_t *ctx) {
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+    if (!dp->wrpc_buf) {
+        API_STATUS(
+            client_wrpc_attach(ctx, dp), { return (-1); },
+            "Unable to attach thread to write RPCs\n");
+    }
+
+    // Signaled and waited for, so the FIN has landed before a SEND follows
+    uint64_t wr_id = WR_ID(dp) | BW_WR_FLAG;
+    API_STATUS(
+        client_wrpc_post(dp, 0, OPC_WRPC_FIN, wr_id), { return (-1); },
+        "Unable to send write RPC FIN\n");
+    API_STATUS(
+        client_wait_wr(ctx, dp, wr_id), { return (-1); },
+        "Unable to stop write RPCs\n");
     return (0);
 }
 
 int process_client_response(client_ctx_t *ctx, int opc, size_t msg_sz) {
     // Based on the opcode, inspect the response and compare against request
     // if it matches, operation was successful
+    if (opc == OPC_ATOMIC_FADD || opc == OPC_ATOMIC_CAS) {
+        return (0);
+    }
+
+    // The notify of an RDMA_WRITE carries no payload, its arrival is the
+    // response
+    if (opc == OPC_RDMA_WRITE) {
+        return (0);
+    }
+
+    // A write RPC echo ends at the response slot of the calling thread
+    if (opc == OPC_WRITE_RPC) {
+        client_dp_t *dp = attach_client_thread(ctx);
+        API_NULL(
+            (dp) ? (dp->wrpc_buf) : (NULL), { return (-1); },
+            "No write RPC response for this thread\n");
+        wrpc_tail_t *resp = wrpc_slot_tail(dp->wrpc_buf, dp->idx);
+        return (memcmp(ctx->send_client_buf, (uint8_t *)resp - msg_sz,
+                       msg_sz));
+    }
+
     return (memcmp(ctx->send_client_buf, ctx->recv_client_buf, msg_sz));
 }
+
+// Bandwidth round over a message transport, one-way SEND streams only. A
+// sent message may still sit in a ring or socket buffer, so the stream is
+// reported as the server received it, its totals come back with its FIN
+static int client_xport_stream(client_ctx_t *ctx, const bw_cfg_t *cfg,
+                               bw_result_t *tx, bw_result_t *rx) {
+    msg_xport_t *x = ctx->xport;
+    struct iovec iov = {(void *)cfg, sizeof(bw_cfg_t)};
+    bw_result_t sent = {0};
+    uint64_t n = 0, t0 = 0, total = cfg->warmup + cfg->iterations;
+    uint32_t opc = 0, len = 0;
+    void *data = NULL;
+
+    EXT_API_STATUS(
+        (cfg->opcode != OPC_SEND_ONLY || cfg->bidir ||
+         cfg->msg_sz > x->max_msg),
+        { return (-1); }, "%s streams SEND one way, up to %u bytes\n",
+        x->name, x->max_msg);
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+
+    API_STATUS(
+        x->send(x, OPC_BW_START, &iov, 1), { return (-1); },
+        "Unable to start bw round over %s\n", x->name);
+    EXT_API_STATUS(
+        (x->recv(x, &opc, &data, &len, true) != 1 || opc != OPC_BW_START),
+        { return (-1); }, "Server did not start the bw round\n");
+    x->release(x);
+
+    iov.iov_base = dp->send_buf;
+    iov.iov_len = cfg->msg_sz;
+    for (n = 0; cfg->duration_nsec || n < total; n++) {
+        if (n == cfg->warmup) {
+            t0 = cq_ring_now();
+        }
+        if (cfg->duration_nsec && n >= cfg->warmup &&
+            (cq_ring_now() - t0) >= cfg->duration_nsec) {
+            break;
+        }
+
+        API_STATUS(
+            x->send(x, (n < cfg->warmup) ? (OPC_BW_WARMUP) : (OPC_BW_DATA),
+                    &iov, 1),
+            {
+                STATS_ADD(dp->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to stream over %s\n", x->name);
+        STATS_ADD(dp->stats, tx_msgs, 1);
+        STATS_ADD(dp->stats, tx_bytes, cfg->msg_sz);
+    }
+
+    sent.messages = (n > cfg->warmup) ? (n - cfg->warmup) : (0);
+    sent.bytes = sent.messages * cfg->msg_sz;
+    sent.elapsed_nsec = cq_ring_now() - t0;
+    iov.iov_base = &sent;
+    iov.iov_len = sizeof(bw_result_t);
+    API_STATUS(
+        x->send(x, OPC_BW_FIN, &iov, 1), { return (-1); },
+        "Unable to end bw round over %s\n", x->name);
+    EXT_API_STATUS(
+        (x->recv(x, &opc, &data, &len, true) != 1 || opc != OPC_BW_FIN ||
+         len != sizeof(bw_result_t)),
+        { return (-1); }, "Server did not end the bw round\n");
+    memcpy(tx, data, sizeof(bw_result_t));
+    x->release(x);
+    memset(rx, 0, sizeof(bw_result_t));
+    return (0);
+}
+
+int stream_client_bw(client_ctx_t *ctx, bw_cfg_t *cfg, bw_result_t *tx,
+                     bw_result_t *rx) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    bw_stream_t s = {0};
+    int rc = 0;
+    // Protocol-4: bandwidth round, one per message size
+    // ------------------------------------------------
+    // IBV_RECV x N
+    // SEND_IMM(OPC_BW_START, cfg) --> IBV_RECV x N
+    // IBV_WC_RECV                 <-- SEND_IMM(OPC_BW_START)
+    // SEND/RDMA_WRITE x (warmup+n) -> count, replenish recvs
+    // (bibw: server streams to the client at the same time)
+    // SEND_IMM(OPC_BW_FIN, totals) ->
+    //                             <-- SEND_IMM(OPC_BW_FIN, totals)
+    if (ctx->xport) {
+        return (client_xport_stream(ctx, cfg, tx, rx));
+    }
+
+    EXT_API_STATUS(
+        (cfg->opcode != OPC_SEND_ONLY && cfg->opcode != OPC_RDMA_WRITE),
+        { return (-1); }, "Unsupported bandwidth opcode\n");
+    EXT_API_STATUS(
+        (cfg->qdepth < 1 || cfg->qdepth > MAX_BW_QDEPTH ||
+         cfg->msg_sz > ctx->send_client_buf_sz),
+        { return (-1); }, "Unsupported queue depth %u or size %u bytes\n",
+        cfg->qdepth, cfg->msg_sz);
+    EXT_API_STATUS(
+        (cfg->opcode == OPC_RDMA_WRITE &&
+         cfg->msg_sz > ctx->server_priv.sink.len),
+        { return (-1); }, "Server sink of %u bytes is below %u bytes\n",
+        ctx->server_priv.sink.len, cfg->msg_sz);
+    // Every QP streamed over takes at least one WR, every stripe a byte
+    EXT_API_STATUS(
+        (bw_nqps(cfg) > ctx->nqps || bw_nqps(cfg) > cfg->qdepth ||
+         (cfg->stripe && bw_nqps(cfg) > cfg->msg_sz)),
+        { return (-1); },
+        "Unable to stream over %u QPs, %u connected, depth %u, size %u\n",
+        bw_nqps(cfg), ctx->nqps, cfg->qdepth, cfg->msg_sz);
+    // The stream plus START and FIN must fit the queues sized at setup
+    EXT_API_STATUS(
+        (1 + bw_rx_total(cfg, cfg->bidir) > ctx->qp_cfg.recv_wr ||
+         cfg->qdepth + 2 > ctx->qp_cfg.send_wr),
+        { return (-1); }, "Queue depth %u exceeds send: %u recv: %u WRs\n",
+        cfg->qdepth, ctx->qp_cfg.send_wr, ctx->qp_cfg.recv_wr);
+
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+
+    s.qp[0] = dp->qp;
+    s.rx_posted[0] = dp->rx_posted;
+    for (uint32_t q = 1; q < bw_nqps(cfg); q++) {
+        s.qp[q] = ctx->extra_qp[q - 1];
+        s.rx_posted[q] = ctx->extra_rx_posted[q - 1];
+    }
+    for (uint32_t q = 0; ctx->qp_cfg.ex_verbs && q < bw_nqps(cfg); q++) {
+        s.qpx[q] = ibv_qp_to_qp_ex(s.qp[q]);
+    }
+    s.ring = &(dp->ring);
+    s.stats = dp->stats;
+    s.alive = &(ctx->is_connected);
+    s.wr_id_base = ((uint64_t)dp->idx << 32) | BW_WR_FLAG;
+    s.send_buf = dp->send_buf;
+    s.send_lkey = dp->send_lkey;
+    s.recv_sge[0].addr = (uint64_t)dp->recv_buf;
+    s.recv_sge[0].length = ctx->recv_client_buf_sz;
+    s.recv_sge[0].lkey = dp->recv_lkey;
+    s.recv_nsge = 1;
+    s.fin_buf = dp->bounce_buf + RDMA_MSG_HDR_SZ;
+    s.fin_lkey = dp->bounce_lkey;
+    s.sink = ctx->server_priv.sink;
+    s.tx = true;
+    s.peer_tx = cfg->bidir;
+    cfg->sink.addr = (uint64_t)ctx->recv_client_buf;
+    cfg->sink.rkey = ctx->recv_buf_mr->rkey;
+    cfg->sink.len = ctx->recv_client_buf_sz;
+    s.cfg = *cfg;
+
+    // The server reply, the stream and its FIN all land in the recv buf
+    API_STATUS(
+        bw_post_recvs(&s, 1), { return (-1); },
+        "Unable to post stream recvs\n");
+
+    memcpy(dp->bounce_buf, cfg, sizeof(bw_cfg_t));
+    sge.addr = (uint64_t)dp->bounce_buf;
+    sge.length = sizeof(bw_cfg_t);
+    sge.lkey = dp->bounce_lkey;
+    send_wr.wr_id = WR_ID(dp);
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = 0;
+    send_wr.imm_data = OPC_BW_START;
+    rc = (dp->qpx) ? (rdma_post_ex(dp->qpx, rdma_wr_send_imm, send_wr.wr_id,
+                                   0, OPC_BW_START, 0, 0, &sge, 1))
+                   : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post bw round start. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, sizeof(bw_cfg_t));
+
+    // Server recvs are posted by the time its reply arrives
+    rc = bw_wait_start(&s);
+    if (rc == 0) {
+        rc = bw_stream_run(&s, tx, rx);
+    }
+
+    // Recvs the server never filled are used by the next round
+    dp->rx_posted = s.rx_posted[0];
+    for (uint32_t q = 1; q < bw_nqps(cfg); q++) {
+        ctx->extra_rx_posted[q - 1] = s.rx_posted[q];
+    }
+    return (rc);
+}
+
+int post_client_recvs(client_ctx_t *ctx, uint32_t n) {
+    struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    int rc = 0;
+
+    // Responses land in the transport's own buffers
+    if (ctx->xport) {
+        return (0);
+    }
+
+    EXT_API_STATUS(
+        n > ctx->qp_cfg.recv_wr, { return (-1); },
+        "%u recvs exceed the receive queue of %u WRs\n", n,
+        ctx->qp_cfg.recv_wr);
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+
+    // Responses overwrite each other, open-loop only measures their arrival
+    sge.addr = (uint64_t)dp->recv_buf;
+    sge.length = ctx->recv_client_buf_sz;
+    sge.lkey = dp->recv_lkey;
+    recv_wr.next = NULL;
+    recv_wr.sg_list = &sge;
+    recv_wr.num_sge = 1;
+    while (dp->rx_posted < n) {
+        recv_wr.wr_id = WR_ID(dp);
+        rc = ibv_post_recv(dp->qp, &recv_wr, &recv_bad_wr);
+        API_STATUS(
+            rc,
+            {
+                STATS_ADD(dp->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to post receive wr. Reason: %s\n", strerror(errno));
+        dp->rx_posted++;
+        STATS_ADD(dp->stats, rx_posted, 1);
+    }
+
+    return (0);
+}
+
+// RDMA_WRITE from the send buffer into the server sink, or RDMA_READ of the
+// sink into the recv buffer. The server CPU takes no part, the completion is
+// the response: BW_WR_FLAG routes it to poll_client_response
+static int client_post_one_sided(client_ctx_t *ctx, client_dp_t *dp, int opc,
+                                 size_t msg_sz) {
+    struct ibv_send_wr send_wr = {0};
+    struct ibv_sge sge = {0};
+    rdma_rbuf_t sink = ctx->server_priv.sink;
+    bool read = (opc == OPC_RDMA_READ);
+    int rc = 0;
+
+    EXT_API_STATUS(
+        (msg_sz > sink.len || (read && msg_sz > ctx->recv_client_buf_sz)),
+        { return (-1); }, "%s of %zu bytes exceeds the server sink of %u\n",
+        (read) ? "RDMA_READ" : "RDMA_WRITE", msg_sz, sink.len);
+    sge.addr = (read) ? ((uint64_t)dp->recv_buf) : ((uint64_t)dp->send_buf);
+    sge.length = msg_sz;
+    sge.lkey = (read) ? (dp->recv_lkey) : (dp->send_lkey);
+    send_wr.wr_id = WR_ID(dp) | BW_WR_FLAG;
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = (read) ? (IBV_WR_RDMA_READ) : (IBV_WR_RDMA_WRITE);
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.wr.rdma.remote_addr = sink.addr;
+    send_wr.wr.rdma.rkey = sink.rkey;
+    rc = client_post_request(dp, (read) ? (rdma_wr_read) : (rdma_wr_write),
+                             &send_wr);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post %s request. Reason: %s\n",
+        (read) ? "RDMA_READ" : "RDMA_WRITE", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, msg_sz);
+    return (0);
+}
+
+int post_client_request(client_ctx_t *ctx, int opc, size_t msg_sz) {
+    struct ibv_send_wr send_wr = {0};
+    struct ibv_sge sge = {0};
+    int rc = 0;
+
+    EXT_API_STATUS(
+        ((opc != OPC_SEND_ONLY && opc != OPC_RDMA_WRITE &&
+          opc != OPC_RDMA_READ) ||
+         msg_sz > ctx->send_client_buf_sz),
+        { return (-1); }, "Unsupported opcode or size %zu bytes\n", msg_sz);
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+    if (ctx->xport) {
+        EXT_API_STATUS(
+            opc != OPC_SEND_ONLY, { return (-1); },
+            "%s sessions carry SEND requests only\n", ctx->xport->name);
+        struct iovec iov = {dp->send_buf, msg_sz};
+        API_STATUS(
+            ctx->xport->send(ctx->xport, opc, &iov, 1),
+            {
+                STATS_ADD(dp->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to send request over %s\n", ctx->xport->name);
+        STATS_ADD(dp->stats, tx_msgs, 1);
+        STATS_ADD(dp->stats, tx_bytes, msg_sz);
+        return (0);
+    }
+    if (opc != OPC_SEND_ONLY) {
+        return (client_post_one_sided(ctx, dp, opc, msg_sz));
+    }
+
+    // The poller drops send completions without BW_WR_FLAG, signaling only
+    // keeps the SQ drained
+    sge.addr = (uint64_t)dp->send_buf;
+    sge.length = msg_sz;
+    sge.lkey = dp->send_lkey;
+    send_wr.wr_id = WR_ID(dp);
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.imm_data = opc;
+    rc = client_post_request(dp, rdma_wr_send_imm, &send_wr);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post send request. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, msg_sz);
+    return (0);
+}
+
+// Next response of a message transport, arrival taken as it is seen
+static int client_xport_poll(client_dp_t *dp, msg_xport_t *x, cq_rec_t *rec) {
+    uint32_t opc = 0, len = 0;
+    void *data = NULL;
+
+    int rc = x->recv(x, &opc, &data, &len, false);
+    if (rc != 1) {
+        return (rc);
+    }
+
+    x->release(x);
+    memset(rec, 0, sizeof(cq_rec_t));
+    rec->ts_nsec = cq_ring_now();
+    rec->byte_len = len;
+    rec->imm = opc;
+    rec->opcode = IBV_WC_RECV;
+    rec->status = IBV_WC_SUCCESS;
+    STATS_ADD(dp->stats, rx_msgs, 1);
+    STATS_ADD(dp->stats, rx_bytes, len);
+    return (1);
+}
+
+int poll_client_response(client_ctx_t *ctx, cq_rec_t *rec) {
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+    if (ctx->xport) {
+        return (client_xport_poll(dp, ctx->xport, rec));
+    }
+
+    while (cq_ring_try_pop(&(dp->ring), rec)) {
+        EXT_API_STATUS(
+            rec->status != IBV_WC_SUCCESS, { return (-1); },
+            "WR[%lx] failed. Status: %s\n", rec->wr_id,
+            ibv_wc_status_str(rec->status));
+        if (rec->opcode == IBV_WC_RECV ||
+            rec->opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+            dp->rx_posted--;
+            client_note_resume(ctx, rec->ts_nsec);
+            return (1);
+        }
+        if (rec->opcode == IBV_WC_RDMA_WRITE ||
+            rec->opcode == IBV_WC_RDMA_READ) {
+            return (1);
+        }
+    }
+
+    return ((ctx->is_connected) ? (0) : (-1));
+}
+
+// Block until the ring of the thread has completions and hand each one to
+// the fiber waiting on its wr_id. Records nobody waits on are stale
+static int client_fiber_poll(fiber_sched_t *s, void *arg) {
+    client_ctx_t *ctx = (client_ctx_t *)arg;
+    cq_rec_t rec = {0};
+
+    if (!cq_ring_pop(&(tls_dp->ring), &rec, &(ctx->is_connected))) {
+        return (-1);
+    }
+    do {
+        fiber_wake(s, &rec);
+    } while (cq_ring_try_pop(&(tls_dp->ring), &rec));
+    return (0);
+}
+
+int run_client_fibers(client_ctx_t *ctx, fiber_sched_t *s) {
+    EXT_API_STATUS(
+        ctx->xport, { return (-1); },
+        "Fibers overlap verbs requests, %s sessions block on each one\n",
+        ctx->xport->name);
+    // Each fiber keeps a recv and a send of its own in flight
+    EXT_API_STATUS(
+        (s->nfibers > ctx->qp_cfg.recv_wr || s->nfibers > ctx->qp_cfg.send_wr),
+        { return (-1); }, "%u fibers exceed send: %u recv: %u WRs\n",
+        s->nfibers, ctx->qp_cfg.send_wr, ctx->qp_cfg.recv_wr);
+
+    client_dp_t *dp = attach_client_thread(ctx);
+    API_NULL(
+        dp, { return (-1); }, "Unable to attach requester thread\n");
+    return (fiber_sched_run(s, client_fiber_poll, ctx));
+}
@@ -0,0 +1,249 @@
+#include "rdma_core.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+int rdma_start_thread(pthread_t *thread, thread_fn_t fn, void *arg) {
+    pthread_attr_t tattr;
+    pthread_attr_init(&tattr);
+    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
+    int rc = pthread_create(thread, &tattr, fn, arg);
+    pthread_attr_destroy(&tattr);
+    return ((rc) ? (-1) : (0));
+}
+
+// Extended CQs only report what cq_ring_rec_from_wc reads
+static struct ibv_cq *rdma_create_cq(struct ibv_context *verbs,
+                                     const rdma_qp_cfg_t *cfg) {
+    if (!cfg->ex_verbs) {
+        return (ibv_create_cq(verbs, cfg->cqe, NULL, NULL, 0));
+    }
+
+    struct ibv_cq_init_attr_ex attr = {
+        .cqe = cfg->cqe,
+        .wc_flags = IBV_WC_EX_WITH_BYTE_LEN | IBV_WC_EX_WITH_IMM |
+                    IBV_WC_EX_WITH_QP_NUM,
+    };
+    struct ibv_cq_ex *cq = ibv_create_cq_ex(verbs, &attr);
+    return ((cq) ? (ibv_cq_ex_to_cq(cq)) : (NULL));
+}
+
+int rdma_create_cqs(struct ibv_context *verbs, const rdma_qp_cfg_t *cfg,
+                    struct ibv_cq **scq, struct ibv_cq **rcq) {
+    *scq = rdma_create_cq(verbs, cfg);
+    API_NULL(
+        *scq, { return (-1); },
+        "Unable to create RDMA Send CQE of size %u entries. Reason: %s\n",
+        cfg->cqe, strerror(errno));
+    *rcq = *scq;
+    if (cfg->split_cq) {
+        *rcq = rdma_create_cq(verbs, cfg);
+        API_NULL(
+            *rcq,
+            {
+                ibv_destroy_cq(*scq);
+                *scq = NULL;
+                return (-1);
+            },
+            "Unable to create RDMA Recv CQE of size %u entries. Reason: %s\n",
+            cfg->cqe, strerror(errno));
+    }
+
+    return (0);
+}
+
+void rdma_destroy_cqs(struct ibv_cq *scq, struct ibv_cq *rcq) {
+    if (rcq && rcq != scq) {
+        ibv_destroy_cq(rcq);
+    }
+    if (scq) {
+        ibv_destroy_cq(scq);
+    }
+}
+
+uint32_t rdma_odp_ops(struct ibv_context *verbs) {
+    struct ibv_device_attr_ex attr = {0};
+
+    int rc = ibv_query_device_ex(verbs, NULL, &attr);
+    EXT_API_STATUS(
+        rc, { return (0); },
+        "Unable to query RDMA device ODP capabilities. Reason: %s\n",
+        strerror(rc));
+    if (!(attr.odp_caps.general_caps & IBV_ODP_SUPPORT)) {
+        return (0);
+    }
+
+    return (attr.odp_caps.per_transport_caps.rc_odp_caps);
+}
+
+int rdma_check_mr_mode(struct ibv_context *verbs, int mr_mode, uint32_t ops) {
+    struct ibv_device_attr_ex attr = {0};
+    // Only the ops the run posts, a device paging no atomics still runs
+    // SEND or RDMA_WRITE over ODP
+    uint32_t need = IBV_ODP_SUPPORT_SEND | IBV_ODP_SUPPORT_RECV | ops;
+    if (mr_mode == MR_MODE_PINNED) {
+        return (0);
+    }
+
+    int rc = ibv_query_device_ex(verbs, NULL, &attr);
+    EXT_API_STATUS(
+        rc, { return (-1); },
+        "Unable to query RDMA device ODP capabilities. Reason: %s\n",
+        strerror(rc));
+    uint64_t caps = attr.odp_caps.general_caps;
+    uint32_t rc_caps = attr.odp_caps.per_transport_caps.rc_odp_caps;
+    EXT_API_STATUS(
+        (!(caps & IBV_ODP_SUPPORT) || (rc_caps & need) != need),
+        { return (-1); },
+        "%s does not page RC ops 0x%x on demand (rc_odp_caps 0x%x)\n",
+        ibv_get_device_name(verbs->device), need, rc_caps);
+    EXT_API_STATUS(
+        (mr_mode == MR_MODE_IMPLICIT && !(caps & IBV_ODP_SUPPORT_IMPLICIT)),
+        { return (-1); }, "%s does not support implicit ODP MRs\n",
+        ibv_get_device_name(verbs->device));
+    return (0);
+}
+
+// Fault buf in ahead of the first access, one SGE per GB as lengths are
+// 32-bit. FLUSH returns once the pages are mapped
+static int rdma_prefetch_buf(struct ibv_pd *pd, struct ibv_mr *mr, void *buf,
+                             size_t len) {
+    for (size_t off = 0; off < len; off += (1UL << 30)) {
+        size_t chunk = len - off;
+        struct ibv_sge sge = {0};
+        sge.addr = (uint64_t)buf + off;
+        sge.length = (chunk < (1UL << 30)) ? (chunk) : (1UL << 30);
+        sge.lkey = mr->lkey;
+        int rc = ibv_advise_mr(pd, IBV_ADVISE_MR_ADVICE_PREFETCH_WRITE,
+                               IBV_ADVISE_MR_FLAG_FLUSH, &sge, 1);
+        EXT_API_STATUS(
+            rc, { return (-1); },
+            "Unable to prefetch %zu bytes of ODP buf. Reason: %s\n", len,
+            strerror(rc));
+    }
+
+    return (0);
+}
+
+struct ibv_mr *rdma_reg_buf(struct ibv_pd *pd, const rdma_qp_cfg_t *cfg,
+                            struct ibv_mr **implicit, void *buf, size_t len) {
+    struct ibv_mr *mr = NULL;
+
+    switch (cfg->mr_mode) {
+    case MR_MODE_ODP:
+        mr = ibv_reg_mr(pd, buf, len,
+                        RDMA_ACCESS_FLAGS | IBV_ACCESS_ON_DEMAND);
+        break;
+    case MR_MODE_IMPLICIT:
+        if (!*implicit) {
+            *implicit = ibv_reg_mr(pd, NULL, SIZE_MAX,
+                                   RDMA_ACCESS_FLAGS | IBV_ACCESS_ON_DEMAND);
+            API_NULL(
+                *implicit, { return (NULL); },
+                "Unable to register implicit ODP MR. Reason: %s\n",
+                strerror(errno));
+        }
+        mr = *implicit;
+        break;
+    default:
+        return (ibv_reg_mr(pd, buf, len, RDMA_ACCESS_FLAGS));
+    }
+
+    if (mr && cfg->mr_prefetch && rdma_prefetch_buf(pd, mr, buf, len)) {
+        rdma_dereg_buf(mr, *implicit);
+        return (NULL);
+    }
+
+    return (mr);
+}
+
+void rdma_dereg_buf(struct ibv_mr *mr, const struct ibv_mr *implicit) {
+    if (mr && mr != implicit) {
+        ibv_dereg_mr(mr);
+    }
+}
+
+struct ibv_qp *rdma_create_rc_qp(struct ibv_pd *pd,
+                                 struct ibv_qp_init_attr *attr, bool ex) {
+    struct ibv_qp_init_attr_ex attr_ex;
+
+    if (!ex) {
+        return (ibv_create_qp(pd, attr));
+    }
+
+    rdma_qp_attr_ex(pd, attr, &attr_ex);
+    return (ibv_create_qp_ex(pd->context, &attr_ex));
+}
+
+void rdma_qp_attr_ex(struct ibv_pd *pd, const struct ibv_qp_init_attr *attr,
+                     struct ibv_qp_init_attr_ex *ex) {
+    memset(ex, 0, sizeof(struct ibv_qp_init_attr_ex));
+    ex->qp_context = attr->qp_context;
+    ex->send_cq = attr->send_cq;
+    ex->recv_cq = attr->recv_cq;
+    ex->srq = attr->srq;
+    ex->cap = attr->cap;
+    ex->qp_type = attr->qp_type;
+    ex->sq_sig_all = attr->sq_sig_all;
+    ex->pd = pd;
+    ex->comp_mask = IBV_QP_INIT_ATTR_PD | IBV_QP_INIT_ATTR_SEND_OPS_FLAGS;
+    ex->send_ops_flags = RDMA_QP_EX_SEND_OPS;
+}
+
+// One batch of an extended CQ into wc, in the layout of ibv_poll_cq
+static int rdma_cq_poll_ex(struct ibv_cq *cq, struct ibv_wc *wc) {
+    // ibv_cq_ex_to_cq is a plain cast, and so is its inverse
+    struct ibv_cq_ex *cqx = (struct ibv_cq_ex *)cq;
+    struct ibv_poll_cq_attr attr = {0};
+    int n = 0;
+
+    int rc = ibv_start_poll(cqx, &attr);
+    if (rc) {
+        return ((rc == ENOENT) ? (0) : (-rc));
+    }
+    do {
+        wc[n].wr_id = cqx->wr_id;
+        wc[n].status = cqx->status;
+        wc[n].opcode = ibv_wc_read_opcode(cqx);
+        wc[n].byte_len = ibv_wc_read_byte_len(cqx);
+        wc[n].wc_flags = ibv_wc_read_wc_flags(cqx);
+        wc[n].imm_data = ibv_wc_read_imm_data(cqx);
+        wc[n].qp_num = ibv_wc_read_qp_num(cqx);
+        n++;
+    } while (n < CQ_POLL_BATCH && ibv_next_poll(cqx) == 0);
+    ibv_end_poll(cqx);
+
+    return (n);
+}
+
+int rdma_cq_poll(rdma_cq_poller_t *p, struct ibv_wc *wc) {
+    rdma_stats_t *st = p->stats;
+
+    // Split CQs are drained in turns, one batch each
+    struct ibv_cq *cq = (p->rx_turn) ? (p->rcq) : (p->scq);
+    p->rx_turn = !p->rx_turn && (p->rcq != p->scq);
+    uint64_t t0 = rdma_cycles();
+    int ncqe = (p->ex) ? (rdma_cq_poll_ex(cq, wc))
+                       : (ibv_poll_cq(cq, CQ_POLL_BATCH, wc));
+    if (ncqe <= 0) {
+        STATS_ADD(st, poll_miss, 1);
+        return (ncqe);
+    }
+
+    STATS_ADD(st, poll_cyc, rdma_cycles() - t0);
+    STATS_ADD(st, poll_hit, 1);
+    STATS_ADD(st, cqe, ncqe);
+    for (int i = 0; i < ncqe; i++) {
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            rdma_stats_wc_err(st, wc[i].status);
+        } else if (wc[i].opcode == IBV_WC_RECV ||
+                   wc[i].opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+            STATS_ADD(st, rx_msgs, 1);
+            STATS_ADD(st, rx_bytes, wc[i].byte_len);
+        }
+    }
+
+    return (ncqe);
+}
@@ -0,0 +1,187 @@
+#include "rdma_fiber.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+static __thread fiber_t *tls_fiber = NULL;
+
+int fiber_sched_init(fiber_sched_t *s, uint32_t max_fibers, size_t stack_sz) {
+    uint32_t nbuckets = 1;
+
+    memset(s, 0, sizeof(fiber_sched_t));
+    EXT_API_STATUS(
+        (max_fibers < 1 || max_fibers > MAX_FIBERS), { return (-1); },
+        "Unsupported fiber count %u, up to %d\n", max_fibers, MAX_FIBERS);
+    // A wait table at least twice the fibers keeps the chains short
+    while (nbuckets < (2 * max_fibers)) {
+        nbuckets <<= 1;
+    }
+
+    s->max_fibers = max_fibers;
+    s->stack_sz = (stack_sz) ? (stack_sz) : (FIBER_STACK_SZ);
+    s->wait_mask = nbuckets - 1;
+    s->fibers = calloc(max_fibers, sizeof(fiber_t));
+    s->runq = calloc(max_fibers, sizeof(fiber_t *));
+    s->wait = calloc(nbuckets, sizeof(fiber_t *));
+    EXT_API_STATUS(
+        (!s->fibers || !s->runq || !s->wait),
+        {
+            fiber_sched_destroy(s);
+            return (-1);
+        },
+        "Unable to allocate scheduler of %u fibers\n", max_fibers);
+    return (0);
+}
+
+void fiber_sched_destroy(fiber_sched_t *s) {
+    for (uint32_t i = 0; s->fibers && i < s->nfibers; i++) {
+        munmap(s->fibers[i].stack, s->stack_sz);
+    }
+    free(s->fibers);
+    free(s->runq);
+    free(s->wait);
+    memset(s, 0, sizeof(fiber_sched_t));
+}
+
+static void fiber_runq_push(fiber_sched_t *s, fiber_t *f) {
+    // A fiber is queued at most once, so max_fibers entries never overflow
+    s->runq[s->runq_tail % s->max_fibers] = f;
+    s->runq_tail++;
+}
+
+static fiber_t *fiber_runq_pop(fiber_sched_t *s) {
+    if (s->runq_head == s->runq_tail) {
+        return (NULL);
+    }
+
+    return (s->runq[(s->runq_head++) % s->max_fibers]);
+}
+
+// Entered through makecontext, which only passes ints: the fiber to run is
+// the one the scheduler switched to
+static void fiber_entry(void) {
+    fiber_t *f = tls_fiber;
+    f->fn(f->arg);
+    // uc_link returns to fiber_sched_run
+    f->done = true;
+}
+
+int fiber_spawn(fiber_sched_t *s, void (*fn)(void *), void *arg) {
+    EXT_API_STATUS(
+        s->nfibers >= s->max_fibers, { return (-1); },
+        "Unable to spawn more than %u fibers\n", s->max_fibers);
+    fiber_t *f = &(s->fibers[s->nfibers]);
+    memset(f, 0, sizeof(fiber_t));
+    f->stack = mmap(NULL, s->stack_sz, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_STACK, -1, 0);
+    EXT_API_STATUS(
+        f->stack == MAP_FAILED, { return (-1); },
+        "Unable to allocate fiber stack. Reason: %s\n", strerror(errno));
+    // An overflow faults on the guard page instead of corrupting memory
+    API_STATUS(
+        mprotect(f->stack, sysconf(_SC_PAGESIZE), PROT_NONE),
+        {
+            munmap(f->stack, s->stack_sz);
+            return (-1);
+        },
+        "Unable to protect fiber stack. Reason: %s\n", strerror(errno));
+    API_STATUS(
+        getcontext(&(f->uc)),
+        {
+            munmap(f->stack, s->stack_sz);
+            return (-1);
+        },
+        "Unable to get fiber context. Reason: %s\n", strerror(errno));
+    f->uc.uc_stack.ss_sp = f->stack;
+    f->uc.uc_stack.ss_size = s->stack_sz;
+    f->uc.uc_link = &(s->main);
+    makecontext(&(f->uc), fiber_entry, 0);
+    f->fn = fn;
+    f->arg = arg;
+    f->sched = s;
+    s->nfibers++;
+    s->nlive++;
+    fiber_runq_push(s, f);
+    return (0);
+}
+
+// Wake every waiting fiber without a completion, its wait returns -1
+static void fiber_abort_all(fiber_sched_t *s) {
+    for (uint32_t b = 0; b <= s->wait_mask; b++) {
+        while (s->wait[b]) {
+            fiber_t *f = s->wait[b];
+            s->wait[b] = f->next;
+            f->waiting = false;
+            f->aborted = true;
+            fiber_runq_push(s, f);
+        }
+    }
+}
+
+int fiber_sched_run(fiber_sched_t *s, fiber_poll_fn poll, void *arg) {
+    while (s->nlive) {
+        fiber_t *f = fiber_runq_pop(s);
+        if (!f) {
+            if (poll(s, arg)) {
+                fiber_abort_all(s);
+            }
+            continue;
+        }
+
+        tls_fiber = f;
+        API_STATUS(
+            swapcontext(&(s->main), &(f->uc)), { return (-1); },
+            "Unable to switch to fiber. Reason: %s\n", strerror(errno));
+        tls_fiber = NULL;
+        if (f->done) {
+            s->nlive--;
+        }
+    }
+
+    return (0);
+}
+
+fiber_t *fiber_self(void) { return (tls_fiber); }
+
+int fiber_wait(uint64_t key, cq_rec_t *rec) {
+    fiber_t *f = tls_fiber;
+    fiber_sched_t *s = f->sched;
+    uint32_t b = key & s->wait_mask;
+
+    f->key = key;
+    f->waiting = true;
+    f->aborted = false;
+    f->next = s->wait[b];
+    s->wait[b] = f;
+    // Back to the scheduler, resumed once fiber_wake queued this fiber
+    API_STATUS(
+        swapcontext(&(f->uc), &(s->main)), { return (-1); },
+        "Unable to switch to scheduler. Reason: %s\n", strerror(errno));
+    if (f->aborted) {
+        return (-1);
+    }
+
+    *rec = f->rec;
+    return (0);
+}
+
+bool fiber_wake(fiber_sched_t *s, const cq_rec_t *rec) {
+    fiber_t **pf = &(s->wait[rec->wr_id & s->wait_mask]);
+    while (*pf) {
+        fiber_t *f = *pf;
+        if (f->key == rec->wr_id) {
+            *pf = f->next;
+            f->waiting = false;
+            f->rec = *rec;
+            fiber_runq_push(s, f);
+            return (true);
+        }
+        pf = &(f->next);
+    }
+
+    return (false);
+}
@@ -0,0 +1,140 @@
+#include "rdma_perf.h"
+#include "client_server_shared.h"
+#include <dirent.h>
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} perf_ctrs[PERF_NCTR] = {
+    [PERF_CYCLES] = {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    [PERF_INSTRUCTIONS] = {"instructions", PERF_TYPE_HARDWARE,
+                           PERF_COUNT_HW_INSTRUCTIONS},
+    [PERF_CACHE_MISSES] = {"cache-misses", PERF_TYPE_HARDWARE,
+                           PERF_COUNT_HW_CACHE_MISSES},
+    [PERF_CTX_SW] = {"context-switches", PERF_TYPE_SOFTWARE,
+                     PERF_COUNT_SW_CONTEXT_SWITCHES},
+};
+
+// Counter c of thread tid, created disabled. inherit folds the threads it
+// spawns into it once they exit
+static int perf_open(const perf_set_t *p, int c, pid_t tid) {
+    struct perf_event_attr attr = {0};
+    attr.size = sizeof(attr);
+    attr.type = perf_ctrs[c].type;
+    attr.config = perf_ctrs[c].config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_hv = 1;
+    attr.exclude_kernel = p->user_only;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return ((int)syscall(SYS_perf_event_open, &attr, tid, -1, -1, 0));
+}
+
+int perf_init(perf_set_t *p) {
+    int navail = 0;
+
+    memset(p, 0, sizeof(perf_set_t));
+    for (int c = 0; c < PERF_NCTR; c++) {
+        int fd = perf_open(p, c, 0);
+        // Kernel time stays out under perf_event_paranoid 2 and up
+        if (fd < 0 && (errno == EACCES || errno == EPERM) && !p->user_only) {
+            p->user_only = true;
+            fd = perf_open(p, c, 0);
+        }
+        if (fd < 0) {
+            printf("Counter %s is not available. Reason: %s\n",
+                   perf_ctrs[c].name, strerror(errno));
+            continue;
+        }
+        close(fd);
+        p->avail[c] = true;
+        navail++;
+    }
+
+    EXT_API_STATUS(
+        navail == 0, { return (-1); },
+        "Unable to open any performance counter\n");
+    p->on = true;
+    return (0);
+}
+
+int perf_start(perf_set_t *p) {
+    struct dirent *ent = NULL;
+
+    if (!p->on) {
+        return (0);
+    }
+
+    DIR *dir = opendir("/proc/self/task");
+    API_NULL(
+        dir, { return (-1); }, "Unable to list threads. Reason: %s\n",
+        strerror(errno));
+    p->ntask = 0;
+    while ((ent = readdir(dir)) && p->ntask < MAX_PERF_TASKS) {
+        if (ent->d_name[0] == '.') {
+            continue;
+        }
+        pid_t tid = (pid_t)atoi(ent->d_name);
+        for (int c = 0; c < PERF_NCTR; c++) {
+            // A thread may exit while listed, its counters are left out
+            p->fd[p->ntask][c] = (p->avail[c]) ? (perf_open(p, c, tid)) : (-1);
+        }
+        p->ntask++;
+    }
+    closedir(dir);
+
+    for (uint32_t t = 0; t < p->ntask; t++) {
+        for (int c = 0; c < PERF_NCTR; c++) {
+            if (p->fd[t][c] >= 0) {
+                ioctl(p->fd[t][c], PERF_EVENT_IOC_ENABLE, 0);
+            }
+        }
+    }
+
+    return (0);
+}
+
+void perf_stop(perf_set_t *p, perf_sample_t *s) {
+    memset(s, 0, sizeof(perf_sample_t));
+    if (!p->on) {
+        return;
+    }
+
+    for (uint32_t t = 0; t < p->ntask; t++) {
+        for (int c = 0; c < PERF_NCTR; c++) {
+            if (p->fd[t][c] >= 0) {
+                ioctl(p->fd[t][c], PERF_EVENT_IOC_DISABLE, 0);
+            }
+        }
+    }
+
+    for (uint32_t t = 0; t < p->ntask; t++) {
+        for (int c = 0; c < PERF_NCTR; c++) {
+            // value, time enabled, time running
+            uint64_t v[3] = {0};
+            if (p->fd[t][c] < 0) {
+                continue;
+            }
+            if (read(p->fd[t][c], v, sizeof(v)) == sizeof(v) && v[2]) {
+                // Multiplexed with other events: extrapolate to the window
+                s->val[c] += (v[2] < v[1])
+                                 ? ((uint64_t)((double)v[0] * v[1] / v[2]))
+                                 : (v[0]);
+                s->valid[c] = true;
+            }
+            close(p->fd[t][c]);
+            p->fd[t][c] = -1;
+        }
+    }
+    p->ntask = 0;
+}
@@ -0,0 +1,486 @@
+#include "rdma_report.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+static const char *report_fmt_str[] = {"text", "json", "csv"};
+
+int report_parse_fmt(const char *str, report_fmt_t *fmt) {
+    for (int i = 0; i <= REPORT_CSV; i++) {
+        if (strcmp(str, report_fmt_str[i]) == 0) {
+            *fmt = (report_fmt_t)i;
+            return (0);
+        }
+    }
+
+    return (-1);
+}
+
+report_t *report_create(report_fmt_t fmt, const char *role, const char *path) {
+    report_t *r = calloc(1, sizeof(report_t));
+    API_NULL(
+        r, { return (NULL); }, "Unable to allocate report\n");
+    r->fmt = fmt;
+    r->role = role;
+    r->out = stdout;
+
+    if (path && strcmp(path, "-") != 0) {
+        r->out = fopen(path, "w");
+        API_NULL(
+            r->out,
+            {
+                free(r);
+                return (NULL);
+            },
+            "Unable to open report %s. Reason: %s\n", path, strerror(errno));
+    } else if (fmt != REPORT_TEXT) {
+        // Keep stdout machine-readable: report on the original stdout,
+        // every free-form printf goes to stderr from now on
+        fflush(stdout);
+        int fd = dup(STDOUT_FILENO);
+        API_STATUS(
+            fd,
+            {
+                free(r);
+                return (NULL);
+            },
+            "Unable to dup stdout. Reason: %s\n", strerror(errno));
+        r->out = fdopen(fd, "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+
+    getrusage(RUSAGE_SELF, &(r->ru_start));
+    clock_gettime(CLOCK_MONOTONIC, &(r->ts_start));
+    return (r);
+}
+
+static report_kv_t *report_kv(report_t *r, const char *key) {
+    for (int i = 0; i < r->nconfig; i++) {
+        if (strcmp(r->config[i].key, key) == 0) {
+            return (&(r->config[i]));
+        }
+    }
+
+    if (r->nconfig >= MAX_REPORT_CONFIG) {
+        return (NULL);
+    }
+
+    snprintf(r->config[r->nconfig].key, sizeof(r->config[r->nconfig].key),
+             "%s", key);
+    return (&(r->config[r->nconfig++]));
+}
+
+void report_config_str(report_t *r, const char *key, const char *val) {
+    report_kv_t *kv = report_kv(r, key);
+    if (kv) {
+        snprintf(kv->val, sizeof(kv->val), "%s", val);
+        kv->is_num = false;
+    }
+}
+
+void report_config_num(report_t *r, const char *key, double val) {
+    report_kv_t *kv = report_kv(r, key);
+    if (kv) {
+        snprintf(kv->val, sizeof(kv->val), "%.15g", val);
+        kv->is_num = true;
+    }
+}
+
+int report_device(report_t *r, struct ibv_context *verbs, uint8_t port_num) {
+    int rc = ibv_query_device(verbs, &(r->dev));
+    EXT_API_STATUS(
+        rc, { return (-1); }, "Unable to query RDMA device. Reason: %s\n",
+        strerror(rc));
+    r->port_num = port_num ? port_num : 1;
+    rc = ibv_query_port(verbs, r->port_num, &(r->port));
+    EXT_API_STATUS(
+        rc, { return (-1); }, "Unable to query RDMA port. Reason: %s\n",
+        strerror(rc));
+    snprintf(r->dev_name, sizeof(r->dev_name), "%s",
+             ibv_get_device_name(verbs->device));
+    r->has_device = true;
+    return (0);
+}
+
+int report_add_result(report_t *r, const report_result_t *res) {
+    EXT_API_STATUS(
+        r->nresults >= MAX_REPORT_RESULTS, { return (-1); },
+        "Unable to record more than %d results\n", MAX_REPORT_RESULTS);
+    r->results[r->nresults++] = *res;
+    return (0);
+}
+
+void report_result_rates(report_result_t *res) {
+    if (res->elapsed_sec > 0) {
+        res->msg_rate = (double)res->messages / res->elapsed_sec;
+        res->bw_gbps =
+            (double)res->messages * res->msg_sz * 8 / res->elapsed_sec / 1e9;
+    }
+}
+
+void report_result_cycles(report_result_t *res,
+                          const rdma_stats_snap_t *start,
+                          const rdma_stats_snap_t *end) {
+    const rdma_ctr_t *a = &(start->sum), *b = &(end->sum);
+    if (b->post_n > a->post_n) {
+        res->post_cyc =
+            (double)(b->post_cyc - a->post_cyc) / (b->post_n - a->post_n);
+    }
+    if (b->cqe > a->cqe) {
+        res->poll_cyc = (double)(b->poll_cyc - a->poll_cyc) / (b->cqe - a->cqe);
+    }
+}
+
+int report_add_stream(report_t *r, const char *test, size_t msg_sz,
+                      uint64_t messages, uint64_t elapsed_nsec) {
+    report_result_t res = {0};
+    snprintf(res.test, sizeof(res.test), "%s", test);
+    res.msg_sz = msg_sz;
+    res.messages = messages;
+    res.elapsed_sec = (double)elapsed_nsec / 1e9;
+    report_result_rates(&res);
+    return (report_add_result(r, &res));
+}
+
+int lat_stats_init(lat_stats_t *s, size_t cap) {
+    s->nsec = calloc(cap ? cap : 1, sizeof(uint64_t));
+    API_NULL(
+        s->nsec, { return (-1); },
+        "Unable to allocate %zu latency samples\n", cap);
+    s->n = 0;
+    s->cap = cap;
+    return (0);
+}
+
+void lat_stats_free(lat_stats_t *s) {
+    free(s->nsec);
+    s->nsec = NULL;
+    s->n = s->cap = 0;
+}
+
+void lat_stats_merge(lat_stats_t *dst, const lat_stats_t *src) {
+    for (size_t i = 0; i < src->n; i++) {
+        lat_stats_add(dst, src->nsec[i]);
+    }
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return ((x > y) - (x < y));
+}
+
+// Nearest-rank percentile over the sorted samples
+static uint64_t lat_pct(const lat_stats_t *s, double pct) {
+    size_t rank = (size_t)((pct / 100.0) * s->n + 0.999999);
+    rank = (rank < 1) ? 1 : ((rank > s->n) ? s->n : rank);
+    return (s->nsec[rank - 1]);
+}
+
+void lat_stats_summarize(lat_stats_t *s, lat_summary_t *sum) {
+    uint64_t total = 0;
+    memset(sum, 0, sizeof(lat_summary_t));
+    if (!s->n) {
+        return;
+    }
+
+    qsort(s->nsec, s->n, sizeof(uint64_t), cmp_u64);
+    for (size_t i = 0; i < s->n; i++) {
+        total += s->nsec[i];
+        sum->outliers += (s->outlier_nsec && s->nsec[i] > s->outlier_nsec);
+    }
+
+    sum->n = s->n;
+    sum->outlier_nsec = s->outlier_nsec;
+    sum->min = s->nsec[0];
+    sum->max = s->nsec[s->n - 1];
+    sum->avg = total / s->n;
+    sum->p50 = lat_pct(s, 50.0);
+    sum->p90 = lat_pct(s, 90.0);
+    sum->p99 = lat_pct(s, 99.0);
+    sum->p999 = lat_pct(s, 99.9);
+    sum->p9999 = lat_pct(s, 99.99);
+}
+
+/**
+ * @struct report_cpu_t
+ * @brief CPU usage of the process since report_create
+ */
+typedef struct report_cpu_s {
+    double wall_sec;
+    double user_sec;
+    double sys_sec;
+    double util_pct; //< (user + sys) / wall, > 100 with several busy threads
+    long vol_ctx_sw;
+    long invol_ctx_sw;
+} report_cpu_t;
+
+#define TV_SEC(tv) ((double)(tv).tv_sec + (double)(tv).tv_usec / 1e6)
+
+static void report_cpu(const report_t *r, report_cpu_t *cpu) {
+    struct rusage ru;
+    struct timespec ts;
+    getrusage(RUSAGE_SELF, &ru);
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    cpu->wall_sec = (double)(ts.tv_sec - r->ts_start.tv_sec) +
+                    (double)(ts.tv_nsec - r->ts_start.tv_nsec) / 1e9;
+    cpu->user_sec = TV_SEC(ru.ru_utime) - TV_SEC(r->ru_start.ru_utime);
+    cpu->sys_sec = TV_SEC(ru.ru_stime) - TV_SEC(r->ru_start.ru_stime);
+    cpu->util_pct = (cpu->wall_sec > 0)
+                        ? (100.0 * (cpu->user_sec + cpu->sys_sec) /
+                           cpu->wall_sec)
+                        : 0;
+    cpu->vol_ctx_sw = ru.ru_nvcsw - r->ru_start.ru_nvcsw;
+    cpu->invol_ctx_sw = ru.ru_nivcsw - r->ru_start.ru_nivcsw;
+}
+
+static const char *port_state_str(enum ibv_port_state s) {
+    return (ibv_port_state_str(s));
+}
+
+static const char *link_layer_str(uint8_t ll) {
+    switch (ll) {
+    case IBV_LINK_LAYER_INFINIBAND:
+        return "InfiniBand";
+    case IBV_LINK_LAYER_ETHERNET:
+        return "Ethernet";
+    default:
+        return "Unknown";
+    }
+}
+
+// Counter c of a result per message, IPC for PERF_NCTR. False if it was
+// not counted
+static bool report_perf_msg(const report_result_t *res, int c, double *v) {
+    const perf_sample_t *s = &(res->perf);
+    if (c == PERF_NCTR) {
+        *v = (s->val[PERF_CYCLES])
+                 ? ((double)s->val[PERF_INSTRUCTIONS] / s->val[PERF_CYCLES])
+                 : (0);
+        return (s->valid[PERF_CYCLES] && s->valid[PERF_INSTRUCTIONS]);
+    }
+
+    *v = (res->messages) ? ((double)s->val[c] / res->messages) : (0);
+    return (s->valid[c] && res->messages);
+}
+
+// JSON/CSV names of the counters per message, IPC last
+static const char *report_perf_key[PERF_NCTR + 1] = {
+    [PERF_CYCLES] = "cycles",
+    [PERF_INSTRUCTIONS] = "instructions",
+    [PERF_CACHE_MISSES] = "cache_misses",
+    [PERF_CTX_SW] = "ctx_sw",
+    [PERF_NCTR] = "ipc",
+};
+
+// Counters per message and IPC, in the order of the report fields
+static const int report_perf_order[] = {PERF_CYCLES, PERF_INSTRUCTIONS,
+                                        PERF_NCTR, PERF_CACHE_MISSES,
+                                        PERF_CTX_SW};
+#define REPORT_NPERF (int)(sizeof(report_perf_order) / sizeof(int))
+
+static void report_write_text(report_t *r, const report_cpu_t *cpu) {
+    FILE *f = r->out;
+    for (int i = 0; i < r->nresults; i++) {
+        const report_result_t *res = &(r->results[i]);
+        fprintf(f,
+                "[%s] Size: %zu bytes, Messages: %lu, BW: %.3f Gb/s, Rate: "
+                "%.0f msg/sec",
+                res->test, res->msg_sz, res->messages, res->bw_gbps,
+                res->msg_rate);
+        if (res->lat.n) {
+            fprintf(f,
+                    ", Latency min/avg/p50/p99/p99.9/p99.99/max: "
+                    "%lu/%lu/%lu/%lu/%lu/%lu/%lu nsec",
+                    res->lat.min, res->lat.avg, res->lat.p50, res->lat.p99,
+                    res->lat.p999, res->lat.p9999, res->lat.max);
+        }
+        if (res->lat.outlier_nsec) {
+            fprintf(f, ", Outliers > %lu nsec: %lu", res->lat.outlier_nsec,
+                    res->lat.outliers);
+        }
+        if (res->offered_rate) {
+            fprintf(f, ", Offered: %.0f msg/sec", res->offered_rate);
+        }
+        if (res->post_cyc) {
+            fprintf(f, ", Cycles post/poll: %.1f/%.1f", res->post_cyc,
+                    res->poll_cyc);
+        }
+        bool any = false;
+        for (int c = 0; c < PERF_NCTR; c++) {
+            any = any || res->perf.valid[c];
+        }
+        if (any) {
+            fprintf(f, ", Per msg cycles/instructions/IPC/cache misses/ctx "
+                       "sw: ");
+            for (int p = 0; p < REPORT_NPERF; p++) {
+                double v = 0;
+                if (report_perf_msg(res, report_perf_order[p], &v)) {
+                    fprintf(f, "%s%.*f", p ? "/" : "",
+                            (report_perf_order[p] == PERF_CTX_SW) ? 4 : 2, v);
+                } else {
+                    fprintf(f, "%s-", p ? "/" : "");
+                }
+            }
+        }
+        fprintf(f, "\n");
+    }
+
+    fprintf(f, "[CPU] Role: %s, User: %.3f sec, Sys: %.3f sec, Util: %.1f%%\n",
+            r->role, cpu->user_sec, cpu->sys_sec, cpu->util_pct);
+}
+
+static void report_write_json(report_t *r, const report_cpu_t *cpu) {
+    FILE *f = r->out;
+    fprintf(f, "{\"schema\":\"%s\",\"role\":\"%s\",\"config\":{",
+            REPORT_SCHEMA, r->role);
+    for (int i = 0; i < r->nconfig; i++) {
+        fprintf(f, (r->config[i].is_num) ? "%s\"%s\":%s" : "%s\"%s\":\"%s\"",
+                i ? "," : "", r->config[i].key, r->config[i].val);
+    }
+
+    fprintf(f, "},\"device\":");
+    if (r->has_device) {
+        fprintf(f,
+                "{\"name\":\"%s\",\"fw_ver\":\"%s\",\"vendor_id\":%u,"
+                "\"vendor_part_id\":%u,\"hw_ver\":%u,\"max_qp_wr\":%d,"
+                "\"max_sge\":%d,\"max_cqe\":%d,\"max_mr_size\":%lu,"
+                "\"max_qp_rd_atom\":%d,\"atomic_cap\":%d,\"phys_port_cnt\":%u}",
+                r->dev_name, r->dev.fw_ver, r->dev.vendor_id,
+                r->dev.vendor_part_id, r->dev.hw_ver, r->dev.max_qp_wr,
+                r->dev.max_sge, r->dev.max_cqe, r->dev.max_mr_size,
+                r->dev.max_qp_rd_atom, r->dev.atomic_cap,
+                r->dev.phys_port_cnt);
+        fprintf(f,
+                ",\"port\":{\"num\":%u,\"state\":\"%s\",\"max_mtu\":%d,"
+                "\"active_mtu\":%d,\"active_width\":%u,\"active_speed\":%u,"
+                "\"link_layer\":\"%s\",\"lid\":%u,\"gid_tbl_len\":%d}",
+                r->port_num, port_state_str(r->port.state),
+                128 << r->port.max_mtu, 128 << r->port.active_mtu,
+                r->port.active_width, r->port.active_speed,
+                link_layer_str(r->port.link_layer), r->port.lid,
+                r->port.gid_tbl_len);
+    } else {
+        fprintf(f, "null,\"port\":null");
+    }
+
+    fprintf(f, ",\"results\":[");
+    for (int i = 0; i < r->nresults; i++) {
+        const report_result_t *res = &(r->results[i]);
+        fprintf(f,
+                "%s{\"test\":\"%s\",\"msg_sz\":%zu,\"messages\":%lu,"
+                "\"elapsed_sec\":%.9f,\"bw_gbps\":%.6f,\"msg_rate\":%.3f,"
+                "\"lat_ns\":{\"n\":%lu,\"min\":%lu,\"avg\":%lu,\"p50\":%lu,"
+                "\"p90\":%lu,\"p99\":%lu,\"p99_9\":%lu,\"p99_99\":%lu,"
+                "\"max\":%lu,\"outlier_ns\":%lu,\"outliers\":%lu},"
+                "\"offered_rate\":%.3f,\"post_cyc\":%.3f,"
+                "\"poll_cyc\":%.3f,\"perf\":{",
+                i ? "," : "", res->test, res->msg_sz, res->messages,
+                res->elapsed_sec, res->bw_gbps, res->msg_rate, res->lat.n,
+                res->lat.min, res->lat.avg, res->lat.p50, res->lat.p90,
+                res->lat.p99, res->lat.p999, res->lat.p9999, res->lat.max,
+                res->lat.outlier_nsec, res->lat.outliers, res->offered_rate,
+                res->post_cyc, res->poll_cyc);
+        for (int p = 0; p < REPORT_NPERF; p++) {
+            double v = 0;
+            fprintf(f, "%s\"%s\":", p ? "," : "",
+                    report_perf_key[report_perf_order[p]]);
+            if (report_perf_msg(res, report_perf_order[p], &v)) {
+                fprintf(f, "%.6f", v);
+            } else {
+                fprintf(f, "null");
+            }
+        }
+        fprintf(f, "}}");
+    }
+
+    fprintf(f,
+            "],\"cpu\":{\"wall_sec\":%.6f,\"user_sec\":%.6f,\"sys_sec\":%.6f,"
+            "\"util_pct\":%.3f,\"vol_ctx_sw\":%ld,\"invol_ctx_sw\":%ld}}\n",
+            cpu->wall_sec, cpu->user_sec, cpu->sys_sec, cpu->util_pct,
+            cpu->vol_ctx_sw, cpu->invol_ctx_sw);
+}
+
+static void report_write_csv(report_t *r, const report_cpu_t *cpu) {
+    FILE *f = r->out;
+    fprintf(f, "schema,role,test,msg_sz,messages,elapsed_sec,bw_gbps,"
+               "msg_rate,lat_n,lat_min_ns,lat_avg_ns,lat_p50_ns,lat_p90_ns,"
+               "lat_p99_ns,lat_p99_9_ns,lat_p99_99_ns,lat_max_ns,"
+               "cpu_wall_sec,cpu_user_sec,cpu_sys_sec,cpu_util_pct,"
+               "dev_name,fw_ver,vendor_id,vendor_part_id,hw_ver,port_num,"
+               "port_state,active_mtu,active_width,active_speed,link_layer,"
+               "lat_outlier_ns,lat_outliers,offered_rate,post_cyc,poll_cyc");
+    for (int p = 0; p < REPORT_NPERF; p++) {
+        fprintf(f, ",perf_%s", report_perf_key[report_perf_order[p]]);
+    }
+    for (int i = 0; i < r->nconfig; i++) {
+        fprintf(f, ",cfg_%s", r->config[i].key);
+    }
+    fprintf(f, "\n");
+
+    for (int i = 0; i < r->nresults; i++) {
+        const report_result_t *res = &(r->results[i]);
+        fprintf(f,
+                "%s,%s,%s,%zu,%lu,%.9f,%.6f,%.3f,%lu,%lu,%lu,%lu,%lu,%lu,%lu,"
+                "%lu,%lu,%.6f,%.6f,%.6f,%.3f",
+                REPORT_SCHEMA, r->role, res->test, res->msg_sz, res->messages,
+                res->elapsed_sec, res->bw_gbps, res->msg_rate, res->lat.n,
+                res->lat.min, res->lat.avg, res->lat.p50, res->lat.p90,
+                res->lat.p99, res->lat.p999, res->lat.p9999, res->lat.max,
+                cpu->wall_sec, cpu->user_sec, cpu->sys_sec, cpu->util_pct);
+        if (r->has_device) {
+            fprintf(f, ",%s,%s,%u,%u,%u,%u,%s,%d,%u,%u,%s", r->dev_name,
+                    r->dev.fw_ver, r->dev.vendor_id, r->dev.vendor_part_id,
+                    r->dev.hw_ver, r->port_num, port_state_str(r->port.state),
+                    128 << r->port.active_mtu, r->port.active_width,
+                    r->port.active_speed, link_layer_str(r->port.link_layer));
+        } else {
+            fprintf(f, ",,,,,,,,,,,");
+        }
+        fprintf(f, ",%lu,%lu,%.3f,%.3f,%.3f", res->lat.outlier_nsec,
+                res->lat.outliers, res->offered_rate, res->post_cyc,
+                res->poll_cyc);
+        for (int p = 0; p < REPORT_NPERF; p++) {
+            double v = 0;
+            if (report_perf_msg(res, report_perf_order[p], &v)) {
+                fprintf(f, ",%.6f", v);
+            } else {
+                fprintf(f, ",");
+            }
+        }
+        for (int c = 0; c < r->nconfig; c++) {
+            fprintf(f, ",%s", r->config[c].val);
+        }
+        fprintf(f, "\n");
+    }
+}
+
+int report_finish(report_t *r) {
+    report_cpu_t cpu = {0};
+    report_cpu(r, &cpu);
+
+    switch (r->fmt) {
+    case REPORT_JSON:
+        report_write_json(r, &cpu);
+        break;
+    case REPORT_CSV:
+        report_write_csv(r, &cpu);
+        break;
+    case REPORT_TEXT:
+    default:
+        report_write_text(r, &cpu);
+        break;
+    }
+
+    fflush(r->out);
+    if (r->out != stdout) {
+        fclose(r->out);
+    }
+
+    free(r);
+    return (0);
+}
@@ -1,7 +1,14 @@
 #include "client_server_shared.h"
+#include "rdma_perf.h"
+#include "rdma_report.h"
 #include "rdma_server_lib.h"
+#include "rdma_stats.h"
+#include "rdma_ud.h"
 #include <errno.h>
 #include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -12,37 +19,420 @@
 
 #define SERVER_ARGS 2
 
-int start_server(server_info_t *sv) {
+static const struct option server_opts[] = {
+    {"format", required_argument, NULL, 'F'},
+    {"output", required_argument, NULL, 'o'},
+    {"transport", required_argument, NULL, 'T'},
+    {"send-wr", required_argument, NULL, 'S'},
+    {"recv-wr", required_argument, NULL, 'R'},
+    {"cqe", required_argument, NULL, 'C'},
+    {"split-cq", no_argument, NULL, 'P'},
+    {"accept-workers", required_argument, NULL, 'W'},
+    {"accept-storm", required_argument, NULL, 'A'},
+    {"stats-interval", required_argument, NULL, 'i'},
+    {"stats-sock", required_argument, NULL, 'u'},
+    {"shm", required_argument, NULL, 'M'},
+    {"mr", required_argument, NULL, 'g'},
+    {"prefetch", no_argument, NULL, 'p'},
+    {"verbs", required_argument, NULL, 'V'},
+    {"perf", no_argument, NULL, 'K'},
+    {NULL, 0, NULL, 0},
+};
+
+static void usage(void) {
+    printf("Usage: ./server [options] <server IP:port>\n"
+           "  --format <fmt>    report format: text (default), json, csv\n"
+           "  --output <path>   write the report to path instead of stdout\n"
+           "  --transport <t>   rc (default), ud: serve every client from "
+           "one QP until SIGINT/SIGTERM, tcp, uring: serve a client over a "
+           "kernel TCP socket with socket calls or io_uring, no device\n"
+           "  --send-wr <n>     send queue depth, default %d capped by the "
+           "device (rc)\n"
+           "  --recv-wr <n>     receive queue depth, at least %d, default %d "
+           "capped by the device (rc)\n"
+           "  --cqe <n>         entries per CQ, default what the queues need "
+           "(rc)\n"
+           "  --split-cq        complete sends and recvs on separate CQs "
+           "(rc)\n"
+           "  --accept-workers <n> threads accepting connections, up to %d, "
+           "default %d (rc)\n"
+           "  --accept-storm <n>   accept n connections without serving "
+           "them, report the accept rate and exit (rc)\n"
+           "  --stats-interval <t> print datapath counters every t, e.g. 1s "
+           "(rc)\n"
+           "  --stats-sock <path>  serve datapath counters to every "
+           "connection on a Unix socket (rc)\n"
+           "  --shm <on|off>    also serve a client on this host over shared "
+           "memory, default on (rc)\n"
+           "  --mr <mode>       register buffers pinned (default), odp: "
+           "paged in by the device on first touch, implicit: one ODP MR "
+           "over the whole address space (rc)\n"
+           "  --prefetch        fault ODP buffers in at registration with "
+           "ibv_advise_mr (rc)\n"
+           "  --verbs <api>     legacy (default): ibv_post_send and "
+           "ibv_poll_cq, ex: post through ibv_qp_ex and poll extended CQs "
+           "(rc)\n"
+           "  --perf            count CPU cycles, instructions, cache misses "
+           "and context switches of every thread while serving a client "
+           "with perf_event_open\n",
+           DEFAULT_SEND_WR, SERVER_RX_DEPTH, DEFAULT_RECV_WR,
+           MAX_ACCEPT_WORKERS, DEFAULT_ACCEPT_WORKERS);
+}
+
+static const char *transport_str[] = {
+    [TRANSPORT_RC] = "rc",
+    [TRANSPORT_UD] = "ud",
+    [TRANSPORT_TCP] = "tcp",
+    [TRANSPORT_URING] = "uring",
+};
+
+static const char *verbs_api_str[] = {"legacy", "ex"};
+
+static const char *mr_mode_str[] = {
+    [MR_MODE_PINNED] = "pinned",
+    [MR_MODE_ODP] = "odp",
+    [MR_MODE_IMPLICIT] = "implicit",
+};
+
+// UD has no disconnect to end the run on
+static volatile sig_atomic_t ud_stop = 0;
+
+// Counters of the serving loop with --perf, left off otherwise
+static perf_set_t server_perf;
+
+static void ud_stop_handler(int sig) { ud_stop = 1; }
+
+static int start_ud_server(server_info_t *sv, report_t *r) {
+    report_result_t res = {0};
+    uint64_t nsec = 0;
+
+    ud_ctx_t *ctx = ud_setup_server(sv->ip_addr);
+    API_NULL(
+        ctx, { return (-1); }, "UD Server Setup Failed\n");
+    report_device(r, ctx->verbs, ctx->port_num);
+    signal(SIGINT, ud_stop_handler);
+    signal(SIGTERM, ud_stop_handler);
+
+    API_STATUS(
+        perf_start(&server_perf), { return (-1); },
+        "Unable to start CPU counters\n");
+    TIME_DECLARATIONS();
+    TIME_START();
+    while (!ud_stop) {
+        API_STATUS(
+            ud_serve_server(ctx), { return (-1); },
+            "Unable to serve UD requests\n");
+    }
+    TIME_GET_ELAPSED_TIME(nsec);
+    perf_stop(&server_perf, &(res.perf));
+    printf("[UD-SERVER] Peers: %u, Retransmits echoed: %lu\n", ctx->npeers,
+           ctx->dup_msgs);
+
+    snprintf(res.test, sizeof(res.test), "UD-SERVER");
+    res.msg_sz = (ctx->rx_msgs) ? (ctx->rx_bytes / ctx->rx_msgs) : (0);
+    res.messages = ctx->rx_msgs;
+    res.elapsed_sec = (double)nsec / NSEC_TO_SEC;
+    report_result_rates(&res);
+    report_add_result(r, &res);
+    return (0);
+}
+
+// Client stream as seen by the server, plus the server stream for bibw
+static void report_server_bw(report_t *r, const server_dp_t *dp,
+                             const char *tag) {
+    const char *opc =
+        (dp->bw_cfg.opcode == OPC_RDMA_WRITE) ? "RDMA_WRITE" : "SEND";
+    char test[32] = {0};
+
+    snprintf(test, sizeof(test), "%s%s-%s-RX", tag,
+             dp->bw_cfg.bidir ? "BIBW" : "BW", opc);
+    report_add_stream(r, test, dp->bw_cfg.msg_sz, dp->bw_rx.messages,
+                      dp->bw_rx.elapsed_nsec);
+    if (dp->bw_cfg.bidir) {
+        snprintf(test, sizeof(test), "%sBIBW-%s-TX", tag, opc);
+        report_add_stream(r, test, dp->bw_cfg.msg_sz, dp->bw_tx.messages,
+                          dp->bw_tx.elapsed_nsec);
+    }
+}
+
+// Connection storm: accept rate from the first request to the last
+// connection established, latency from request to ESTABLISHED
+static int start_storm_server(server_ctx_t *ctx, const server_info_t *sv,
+                              report_t *r) {
+    report_result_t res = {0};
+    lat_stats_t lat = {0};
+
+    API_STATUS(
+        wait_server_accepts(ctx, sv->accept_storm), { return (-1); },
+        "Unable to wait for %lu connections\n", (uint64_t)sv->accept_storm);
+
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    uint64_t n = (ctx->accepted < MAX_ACCEPT_SAMPLES) ? (ctx->accepted)
+                                                      : (MAX_ACCEPT_SAMPLES);
+    if (lat_stats_init(&lat, n) == 0) {
+        for (uint64_t i = 0; i < n; i++) {
+            lat_stats_add(&lat, ctx->accept_nsec[i]);
+        }
+    }
+    res.messages = ctx->accepted;
+    res.elapsed_sec =
+        (double)(ctx->last_est_nsec - ctx->first_req_nsec) / NSEC_TO_SEC;
+    uint64_t rejected = ctx->rejected;
+    // What connections held at once, XRC ones share their SRQ
+    uint32_t peak_conns = ctx->peak_conns, peak_qps = ctx->peak_qps;
+    uint64_t peak_rq_wrs = ctx->peak_rq_wrs;
+    bool xrc = ctx->xrc_srq_held;
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+
+    pthread_mutex_lock(&(ctx->pool.mtx));
+    uint64_t hits = ctx->pool.hits, misses = ctx->pool.misses;
+    pthread_mutex_unlock(&(ctx->pool.mtx));
+
+    snprintf(res.test, sizeof(res.test), "ACCEPT");
+    report_result_rates(&res);
+    lat_stats_summarize(&lat, &(res.lat));
+    report_add_result(r, &res);
+    printf("[ACCEPT] Connections: %lu, Rejected: %lu, Warm QPs: %lu, Cold "
+           "QPs: %lu, Workers: %u, Rate: %.0f conn/sec\n",
+           res.messages, rejected, hits, misses, ctx->nworkers, res.msg_rate);
+    printf("[ACCEPT] Peak Connections: %u, QPs: %u, Recv WRs: %lu, XRC: %s\n",
+           peak_conns, peak_qps, peak_rq_wrs, xrc ? "yes" : "no");
+    report_config_num(r, "peak_conns", peak_conns);
+    report_config_num(r, "peak_qps", peak_qps);
+    report_config_num(r, "peak_recv_wrs", (double)peak_rq_wrs);
+    lat_stats_free(&lat);
+    return (0);
+}
+
+int start_server(server_info_t *sv, report_t *r) {
+    report_result_t res = {0};
+    rdma_stats_snap_t start = {0}, end = {0};
+    uint64_t nsec = 0;
 
     // Setup Server control plane
-    server_ctx_t *ctx = setup_server(sv->ip_addr, sv->app_port);
+    rdma_qp_cfg_t qp_cfg = sv->qp_cfg;
+    server_ctx_t *ctx =
+        (sv->transport == TRANSPORT_TCP || sv->transport == TRANSPORT_URING)
+            ? (setup_server_tcp(sv->ip_addr,
+                                sv->transport == TRANSPORT_URING))
+            : (setup_server(sv->ip_addr, sv->app_port, &qp_cfg,
+                            sv->accept_workers, sv->shm && !sv->accept_storm));
     API_NULL(
         ctx, { return (-1); }, "Server Setup Failed\n");
 
+    if (sv->accept_storm) {
+        return (start_storm_server(ctx, sv, r));
+    }
+
     // Connect server to a client
     API_STATUS(
         connect_server(ctx), { return (-1); }, "Server Connect Failed\n");
+    // The client served decides the datapath, the device is not on it
+    const char *tag = (ctx->xport) ? (ctx->xport->tag) : ("");
+    report_config_str(r, "datapath",
+                      (ctx->xport) ? (ctx->xport->name) : ("verbs"));
+    if (!ctx->xport) {
+        report_config_num(r, "send_wr", ctx->qp_cfg.send_wr);
+        report_config_num(r, "recv_wr", ctx->qp_cfg.recv_wr);
+        report_config_num(r, "cqe", ctx->qp_cfg.cqe);
+        report_config_num(r, "split_cq", ctx->qp_cfg.split_cq);
+        report_device(r, ctx->cm_id->verbs, ctx->cm_id->port_num);
+    }
 
     // Prepare request/response structures
     API_STATUS(
         prepare_server_data(ctx), { return -1; },
         "Unable to prepare the server request data\n");
 
+    server_dp_t *dp = ctx->dp;
+    uint32_t bw_rounds = 0;
+    rdma_stats_snap(&(ctx->stats), &start);
+    API_STATUS(
+        perf_start(&server_perf), { return (-1); },
+        "Unable to start CPU counters\n");
+    TIME_DECLARATIONS();
+    TIME_START();
     while (ctx->is_connected) {
         API_STATUS(
             send_recv_server(ctx), { return -1; },
             "Unable to send/recv request/response to/from server\n");
+        if (dp->bw_rounds != bw_rounds) {
+            report_server_bw(r, dp, tag);
+            bw_rounds = dp->bw_rounds;
+        }
     }
+    TIME_GET_ELAPSED_TIME(nsec);
+    perf_stop(&server_perf, &(res.perf));
+    rdma_stats_snap(&(ctx->stats), &end);
+    // Nobody else will attach, remove the segment name
+    shm_close(ctx->shm);
 
+    snprintf(res.test, sizeof(res.test), "%sSERVER", tag);
+    res.msg_sz = (dp->rx_msgs) ? (dp->rx_bytes / dp->rx_msgs) : (0);
+    res.messages = dp->rx_msgs;
+    res.elapsed_sec = (double)nsec / NSEC_TO_SEC;
+    report_result_rates(&res);
+    report_result_cycles(&res, &start, &end);
+    report_add_result(r, &res);
     return (0);
 }
 
 int main(int argc, char *argv[]) {
-    if (argc < SERVER_ARGS) {
-        printf("Usage: ./server <server IP:port>\n");
+    report_fmt_t fmt = REPORT_TEXT;
+    const char *path = NULL;
+    int opt = 0, transport = TRANSPORT_RC;
+    rdma_qp_cfg_t qp_cfg = {0};
+    uint32_t accept_workers = 0;
+    uint64_t accept_storm = 0, stats_nsec = 0;
+    const char *stats_sock = NULL;
+    bool shm = true, perf = false;
+
+    while ((opt = getopt_long(argc, argv, "", server_opts, NULL)) != -1) {
+        switch (opt) {
+        case 'F':
+            if (report_parse_fmt(optarg, &fmt)) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'o':
+            path = optarg;
+            break;
+        case 'T':
+            if (strcmp(optarg, "rc") == 0) {
+                transport = TRANSPORT_RC;
+            } else if (strcmp(optarg, "ud") == 0) {
+                transport = TRANSPORT_UD;
+            } else if (strcmp(optarg, "tcp") == 0) {
+                transport = TRANSPORT_TCP;
+            } else if (strcmp(optarg, "uring") == 0) {
+                transport = TRANSPORT_URING;
+            } else {
+                usage();
+                return 1;
+            }
+            break;
+        case 'S':
+            qp_cfg.send_wr = strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            qp_cfg.recv_wr = strtoul(optarg, NULL, 0);
+            break;
+        case 'C':
+            qp_cfg.cqe = strtoul(optarg, NULL, 0);
+            break;
+        case 'P':
+            qp_cfg.split_cq = true;
+            break;
+        case 'W':
+            accept_workers = strtoul(optarg, NULL, 0);
+            if (!accept_workers || accept_workers > MAX_ACCEPT_WORKERS) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'A':
+            accept_storm = strtoull(optarg, NULL, 0);
+            break;
+        case 'i':
+            stats_nsec = parse_duration_nsec(optarg);
+            if (!stats_nsec) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'u':
+            stats_sock = optarg;
+            break;
+        case 'M':
+            if (strcmp(optarg, "on") && strcmp(optarg, "off")) {
+                usage();
+                return 1;
+            }
+            shm = (strcmp(optarg, "on") == 0);
+            break;
+        case 'g':
+            for (qp_cfg.mr_mode = MR_MODE_IMPLICIT;
+                 qp_cfg.mr_mode >= MR_MODE_PINNED; qp_cfg.mr_mode--) {
+                if (strcmp(optarg, mr_mode_str[qp_cfg.mr_mode]) == 0) {
+                    break;
+                }
+            }
+            if (qp_cfg.mr_mode < MR_MODE_PINNED) {
+                usage();
+                return 1;
+            }
+            break;
+        case 'p':
+            qp_cfg.mr_prefetch = true;
+            break;
+        case 'V':
+            if (strcmp(optarg, "legacy") && strcmp(optarg, "ex")) {
+                usage();
+                return 1;
+            }
+            qp_cfg.ex_verbs = (strcmp(optarg, "ex") == 0);
+            break;
+        case 'K':
+            perf = true;
+            break;
+        default:
+            usage();
+            return 1;
+        }
+    }
+
+    if ((argc - optind + 1) < SERVER_ARGS ||
+        (accept_storm && transport != TRANSPORT_RC) ||
+        ((qp_cfg.mr_mode != MR_MODE_PINNED || qp_cfg.mr_prefetch) &&
+         transport != TRANSPORT_RC) ||
+        (qp_cfg.mr_prefetch && qp_cfg.mr_mode == MR_MODE_PINNED) ||
+        (qp_cfg.ex_verbs && transport != TRANSPORT_RC)) {
+        usage();
         return 1;
     }
 
+    // Created first so that every log line is kept off a json/csv stdout
+    report_t *r = report_create(fmt, "server", path);
+    API_NULL(
+        r, { return 1; }, "Unable to create run report\n");
+
+    argv += (optind - 1);
     server_info_t *sv = parse_saddress_info(argv[1]);
-    return (start_server(sv));
+    API_NULL(
+        sv, { return 1; }, "Unable to parse server address\n");
+    sv->report_fmt = fmt;
+    sv->report_path = path;
+    sv->transport = transport;
+    sv->qp_cfg = qp_cfg;
+    sv->accept_workers = accept_workers;
+    sv->accept_storm = accept_storm;
+    sv->shm = shm;
+    report_config_str(r, "listen", argv[1]);
+    report_config_str(r, "transport", transport_str[transport]);
+    report_config_num(r, "accept_workers",
+                      (accept_workers) ? (accept_workers)
+                                       : (DEFAULT_ACCEPT_WORKERS));
+    report_config_num(r, "accept_storm", accept_storm);
+    report_config_str(r, "shm", (shm) ? ("on") : ("off"));
+    report_config_str(r, "mr", mr_mode_str[qp_cfg.mr_mode]);
+    report_config_num(r, "prefetch", qp_cfg.mr_prefetch);
+    report_config_str(r, "verbs", verbs_api_str[qp_cfg.ex_verbs]);
+    report_config_num(r, "stats_interval_sec", (double)stats_nsec / 1e9);
+    report_config_str(r, "stats_sock", (stats_sock) ? (stats_sock) : (""));
+    report_config_num(r, "perf", perf);
+    API_STATUS(
+        rdma_stats_start(stats_nsec, stats_sock), { return 1; },
+        "Unable to start stats thread\n");
+    API_STATUS(
+        (perf) ? (perf_init(&server_perf)) : (0), { return 1; },
+        "Unable to count CPU events with perf_event_open\n");
+
+    // A client gone mid-write fails the write instead of killing the server
+    signal(SIGPIPE, SIG_IGN);
+
+    int rc = (transport == TRANSPORT_UD) ? start_ud_server(sv, r)
+                                         : start_server(sv, r);
+    report_finish(r);
+    return (rc);
 }
@@ -1,5 +1,7 @@
 #include "rdma_server_lib.h"
 #include "client_server_shared.h"
+#include "rdma_xrc.h"
+#include <fcntl.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <pthread.h>
@@ -14,9 +16,43 @@
 #include <time.h>
 #include <unistd.h>
 
+// Connection requests and teardowns travel to an accept worker as ring
+// records: wr_id carries the cm_id, opcode the CM event and byte_len the
+// RDMA READ/atomic depths the client asked for. The client private data,
+// its XRC_SEND and extra RC QPs, follows in the priv slots of the worker
+static void server_hand_off(server_ctx_t *ctx, struct rdma_cm_event *event,
+                            uint64_t now) {
+    uint64_t h = (uint64_t)(uintptr_t)(event->id);
+    h = (h >> 4) * 0x9E3779B97F4A7C15ULL;
+    // Every event of a cm_id lands on the same worker, in order
+    server_acc_worker_t *w = &(ctx->workers[(h >> 32) % ctx->nworkers]);
+    cq_rec_t rec = {0};
+
+    rec.wr_id = (uint64_t)(uintptr_t)(event->id);
+    rec.ts_nsec = now;
+    rec.opcode = (uint16_t)(event->event);
+    if (event->event == RDMA_CM_EVENT_CONNECT_REQUEST) {
+        // Private data is only valid until the event is acked. The record
+        // published by cq_ring_push makes the copy visible to the worker
+        client_priv_t *cpriv = &(w->priv[w->priv_head++ % ACC_PRIV_SZ]);
+        memset(cpriv, 0, sizeof(client_priv_t));
+        if (event->param.conn.private_data) {
+            memcpy(cpriv, event->param.conn.private_data,
+                   (event->param.conn.private_data_len < sizeof(client_priv_t))
+                       ? event->param.conn.private_data_len
+                       : sizeof(client_priv_t));
+        }
+        rec.byte_len = event->param.conn.initiator_depth |
+                       (event->param.conn.responder_resources << 8);
+    }
+    cq_ring_push(&(w->ring), &rec);
+}
+
 static void *server_event_monitor(void *arg) {
     server_ctx_t *ctx = (server_ctx_t *)(arg);
     struct rdma_cm_event *event = malloc(sizeof(struct rdma_cm_event));
+    server_conn_t *conn = NULL;
+    bool served = false;
     int rc = 0;
 
     while (1) {
@@ -29,25 +65,53 @@ static void *server_event_monitor(void *arg) {
             },
             "Invalid RDMA CM Event. Reason: %s\n", strerror(errno));
         printf("Got RDMA CM Event: %s\n", rdma_event_str(event->event));
+        uint64_t now = cq_ring_now();
         switch (event->event) {
         case RDMA_CM_EVENT_CONNECT_REQUEST: {
-            pthread_mutex_lock(&(ctx->evt_mtx));
-            ctx->listen_id = (event->id);
-            pthread_cond_signal(&(ctx->evt_cv));
-            pthread_mutex_unlock(&(ctx->evt_mtx));
+            // Accepted by a worker, so requests are accepted in parallel
+            // and this thread never waits on a verbs call
+            if (!ctx->first_req_nsec) {
+                ctx->first_req_nsec = now;
+            }
+            server_hand_off(ctx, event, now);
         } break;
         case RDMA_CM_EVENT_ESTABLISHED: {
-            pthread_mutex_lock(&(ctx->evt_mtx));
-            ctx->is_connected = true;
-            pthread_cond_signal(&(ctx->evt_cv));
-            pthread_mutex_unlock(&(ctx->evt_mtx));
+            pthread_mutex_lock(&(ctx->acc_mtx));
+            conn = (server_conn_t *)(event->id->context);
+            if (conn && conn->state == SERVER_CONN_ACCEPTING) {
+                conn->state = SERVER_CONN_ESTABLISHED;
+                if (ctx->accepted < MAX_ACCEPT_SAMPLES) {
+                    ctx->accept_nsec[ctx->accepted] = now - conn->req_nsec;
+                }
+                ctx->accepted++;
+                ctx->last_est_nsec = now;
+                pthread_cond_broadcast(&(ctx->acc_cv));
+            }
+            pthread_mutex_unlock(&(ctx->acc_mtx));
         } break;
-        case RDMA_CM_EVENT_DISCONNECTED: {
-            pthread_mutex_lock(&(ctx->evt_mtx));
-            ctx->is_connected = false;
-            pthread_cond_signal(&(ctx->evt_cv));
-            pthread_cond_signal(&(ctx->wcq_cv));
-            pthread_mutex_unlock(&(ctx->evt_mtx));
+        case RDMA_CM_EVENT_DISCONNECTED:
+        case RDMA_CM_EVENT_CONNECT_ERROR:
+        case RDMA_CM_EVENT_UNREACHABLE:
+        case RDMA_CM_EVENT_REJECTED: {
+            pthread_mutex_lock(&(ctx->acc_mtx));
+            conn = (server_conn_t *)(event->id->context);
+            served = (conn && conn == ctx->conn);
+            if (served) {
+                // Taken under acc_mtx, see connect_server
+                pthread_mutex_lock(&(ctx->evt_mtx));
+                ctx->is_connected = false;
+                pthread_cond_signal(&(ctx->evt_cv));
+                pthread_mutex_unlock(&(ctx->evt_mtx));
+            } else if (conn) {
+                conn->state = SERVER_CONN_CLOSED;
+            }
+            pthread_mutex_unlock(&(ctx->acc_mtx));
+            if (served && ctx->dp) {
+                cq_ring_wake(&(ctx->dp->ring));
+            } else if (conn && !served) {
+                // Nobody serves it, its worker tears it down
+                server_hand_off(ctx, event, now);
+            }
         } break;
         default:
             break;
@@ -60,9 +124,571 @@ static void *server_event_monitor(void *arg) {
     return (NULL);
 }
 
-server_ctx_t *setup_server(struct sockaddr *addr, uint16_t port_id) {
+static int prepare_server_atomics(server_ctx_t *ctx) {
+    size_t atomic_sz = MAX_ATOMIC_CTR * sizeof(uint64_t);
+    rdma_qp_cfg_t cfg = ctx->qp_cfg;
+    // Counter array targeted by client atomics, zeroed by the mmap
+    void *atomic_buf = mmap(NULL, atomic_sz, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    EXT_API_STATUS(
+        atomic_buf == MAP_FAILED, { return (-1); },
+        "Unable to allocate atomic counter array. Reason: %s\n",
+        strerror(errno));
+    ctx->atomic_server_buf = atomic_buf;
+    // A device that pages no atomics gets the few counter pages pinned
+    if (cfg.mr_mode != MR_MODE_PINNED &&
+        !(rdma_odp_ops(ctx->verbs) & IBV_ODP_SUPPORT_ATOMIC)) {
+        printf("Atomic counter array pinned, %s does not page atomics\n",
+               ibv_get_device_name(ctx->verbs->device));
+        cfg.mr_mode = MR_MODE_PINNED;
+    }
+    ctx->atomic_buf_mr = rdma_reg_buf(ctx->pd, &cfg, &(ctx->implicit_mr),
+                                      atomic_buf, atomic_sz);
+    API_NULL(
+        ctx->atomic_buf_mr,
+        {
+            munmap(atomic_buf, atomic_sz);
+            return (-1);
+        },
+        "Unable to register atomic counter array with RDMA. Reason: %s\n",
+        strerror(errno));
+    return (0);
+}
+
+static int prepare_server_sink(server_ctx_t *ctx) {
+    // Target of client RDMA_WRITE streams, contents are never read
+    void *sink_buf = mmap(NULL, MAX_MR_SZ, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    EXT_API_STATUS(
+        sink_buf == MAP_FAILED, { return (-1); },
+        "Unable to allocate stream sink. Reason: %s\n", strerror(errno));
+    ctx->sink_server_buf = sink_buf;
+    ctx->sink_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                    &(ctx->implicit_mr), sink_buf, MAX_MR_SZ);
+    API_NULL(
+        ctx->sink_buf_mr,
+        {
+            munmap(sink_buf, MAX_MR_SZ);
+            return (-1);
+        },
+        "Unable to register stream sink with RDMA. Reason: %s\n",
+        strerror(errno));
+    return (0);
+}
+
+static int prepare_server_wrpc(server_ctx_t *ctx) {
+    // Request slots clients RDMA_WRITE into, polled by send_recv_server
+    void *wrpc_buf = mmap(NULL, WRPC_RING_SZ, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    EXT_API_STATUS(
+        wrpc_buf == MAP_FAILED, { return (-1); },
+        "Unable to allocate write RPC ring. Reason: %s\n", strerror(errno));
+    ctx->wrpc_server_buf = wrpc_buf;
+    ctx->wrpc_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                    &(ctx->implicit_mr), wrpc_buf,
+                                    WRPC_RING_SZ);
+    API_NULL(
+        ctx->wrpc_buf_mr,
+        {
+            munmap(wrpc_buf, WRPC_RING_SZ);
+            return (-1);
+        },
+        "Unable to register write RPC ring with RDMA. Reason: %s\n",
+        strerror(errno));
+    return (0);
+}
+
+// XRC domain and SRQ shared by every XRC connection. Requests sent to the
+// SRQ complete on the server CQ like RC receives. A device without XRC
+// leaves both NULL and only XRC clients are turned away
+static void prepare_server_xrc_shared(server_ctx_t *ctx) {
+    struct ibv_xrcd_init_attr xrcd_attr = {0};
+    struct ibv_srq_init_attr_ex srq_attr = {0};
+
+    xrcd_attr.comp_mask = IBV_XRCD_INIT_ATTR_FD | IBV_XRCD_INIT_ATTR_OFLAGS;
+    xrcd_attr.fd = -1;
+    xrcd_attr.oflags = O_CREAT;
+    ctx->xrcd = ibv_open_xrcd(ctx->verbs, &xrcd_attr);
+    API_NULL(
+        ctx->xrcd, { return; },
+        "XRC clients not served, no XRC domain. Reason: %s\n",
+        strerror(errno));
+
+    srq_attr.attr.max_wr = SERVER_RX_DEPTH;
+    srq_attr.attr.max_sge = ctx->max_sge;
+    srq_attr.comp_mask = IBV_SRQ_INIT_ATTR_TYPE | IBV_SRQ_INIT_ATTR_PD |
+                         IBV_SRQ_INIT_ATTR_XRCD | IBV_SRQ_INIT_ATTR_CQ;
+    srq_attr.srq_type = IBV_SRQT_XRC;
+    srq_attr.pd = ctx->pd;
+    srq_attr.xrcd = ctx->xrcd;
+    srq_attr.cq = ctx->rcq;
+    ctx->xrc_srq = ibv_create_srq_ex(ctx->verbs, &srq_attr);
+    API_NULL(
+        ctx->xrc_srq,
+        {
+            ibv_close_xrcd(ctx->xrcd);
+            ctx->xrcd = NULL;
+        },
+        "XRC clients not served, no XRC SRQ. Reason: %s\n", strerror(errno));
+}
+
+static void destroy_server_xrc_shared(server_ctx_t *ctx) {
+    if (ctx->xrc_srq) {
+        ibv_destroy_srq(ctx->xrc_srq);
+    }
+    if (ctx->xrcd) {
+        ibv_close_xrcd(ctx->xrcd);
+    }
+    ctx->xrc_srq = NULL;
+    ctx->xrcd = NULL;
+}
+
+// XRC_RECV QP facing the client XRC_SEND QP, the one XRC object of a
+// connection
+static int prepare_server_xrc(server_ctx_t *ctx, server_conn_t *conn) {
+    struct ibv_qp_init_attr_ex qp_attr = {0};
+
+    EXT_API_STATUS(
+        !ctx->xrc_srq, { return (-1); }, "XRC is not available on %s\n",
+        ibv_get_device_name(ctx->verbs->device));
+    qp_attr.qp_type = IBV_QPT_XRC_RECV;
+    qp_attr.comp_mask = IBV_QP_INIT_ATTR_XRCD;
+    qp_attr.xrcd = ctx->xrcd;
+    conn->xrc_qp = ibv_create_qp_ex(ctx->verbs, &qp_attr);
+    API_NULL(
+        conn->xrc_qp, { return (-1); },
+        "Unable to create XRC_RECV QP. Reason: %s\n", strerror(errno));
+    API_STATUS(
+        xrc_connect_qp(conn->id, conn->xrc_qp, conn->peer_xrc_qpn),
+        { return (-1); }, "Unable to connect XRC_RECV QP to client QP %u\n",
+        conn->peer_xrc_qpn);
+
+    printf("XRC_RECV QP %u facing client QP %u\n", conn->xrc_qp->qp_num,
+           conn->peer_xrc_qpn);
+    return (0);
+}
+
+// Deregister and unmap the atomic counters, stream sink and write RPC ring
+// prepared so far
+static void server_release_bufs(server_ctx_t *ctx) {
+    if (ctx->wrpc_buf_mr) {
+        rdma_dereg_buf(ctx->wrpc_buf_mr, ctx->implicit_mr);
+        munmap(ctx->wrpc_server_buf, WRPC_RING_SZ);
+        ctx->wrpc_buf_mr = NULL;
+    }
+    if (ctx->sink_buf_mr) {
+        rdma_dereg_buf(ctx->sink_buf_mr, ctx->implicit_mr);
+        munmap(ctx->sink_server_buf, MAX_MR_SZ);
+        ctx->sink_buf_mr = NULL;
+    }
+    if (ctx->atomic_buf_mr) {
+        rdma_dereg_buf(ctx->atomic_buf_mr, ctx->implicit_mr);
+        munmap(ctx->atomic_server_buf, MAX_ATOMIC_CTR * sizeof(uint64_t));
+        ctx->atomic_buf_mr = NULL;
+    }
+    if (ctx->implicit_mr) {
+        ibv_dereg_mr(ctx->implicit_mr);
+        ctx->implicit_mr = NULL;
+    }
+}
+
+// PD, CQs, atomic counters, stream sink, write RPC ring and warm QPs shared
+// by every connection, created once for the device of the bound address or
+// of the first connection request. Later requests must come in on the same
+// device
+static int server_prepare_shared(server_ctx_t *ctx,
+                                 struct ibv_context *verbs) {
+    struct ibv_device_attr dev_attr = {};
+    struct ibv_qp_init_attr qp_attr = {};
+    int rc = 0;
+
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    if (ctx->shared_ready) {
+        rc = (ctx->verbs == verbs) ? (0) : (-1);
+        pthread_mutex_unlock(&(ctx->acc_mtx));
+        API_STATUS(
+            rc, { return (-1); },
+            "Connection request on another RDMA device than %s\n",
+            ibv_get_device_name(ctx->verbs->device));
+        return (0);
+    }
+
+    // init RDMA device resources - CQs/PDs/etc
+    ctx->verbs = verbs;
+    rc = ibv_query_device(ctx->verbs, &dev_attr);
+    EXT_API_STATUS(
+        rc, { goto unlock; }, "Unable to query RDMA device. Reason: %s\n",
+        strerror(rc));
+    ctx->max_sge =
+        (dev_attr.max_sge < RDMA_MAX_SGE) ? dev_attr.max_sge : RDMA_MAX_SGE;
+    ctx->max_rd_atom = dev_attr.max_qp_rd_atom;
+    ctx->max_init_rd_atom = dev_attr.max_qp_init_rd_atom;
+    API_STATUS(
+        rdma_size_qp(&dev_attr, &(ctx->qp_cfg), 1), { goto unlock; },
+        "Unable to size server queues\n");
+    API_STATUS(
+        rdma_check_mr_mode(ctx->verbs, ctx->qp_cfg.mr_mode,
+                           IBV_ODP_SUPPORT_WRITE | IBV_ODP_SUPPORT_READ),
+        { goto unlock; }, "Unable to register server buffers on demand\n");
+    EXT_API_STATUS(
+        ctx->qp_cfg.recv_wr < SERVER_RX_DEPTH, { goto unlock; },
+        "Receive queue of %u WRs cannot hold the %d posted recvs\n",
+        ctx->qp_cfg.recv_wr, SERVER_RX_DEPTH);
+
+    ctx->pd = ibv_alloc_pd(ctx->verbs);
+    API_NULL(
+        ctx->pd, { goto unlock; },
+        "Unable to alloc RDMA Protection Domain. Reason: %s\n",
+        strerror(errno));
+
+    API_STATUS(
+        rdma_create_cqs(ctx->verbs, &(ctx->qp_cfg), &(ctx->scq), &(ctx->rcq)),
+        { goto free_pd; }, "Unable to create server CQs\n");
+
+    // Advertised to every client at accept
+    API_STATUS(
+        prepare_server_atomics(ctx), { goto free_cq; },
+        "Unable to prepare atomic counter array\n");
+    API_STATUS(
+        prepare_server_sink(ctx), { goto free_mr; },
+        "Unable to prepare stream sink\n");
+    API_STATUS(
+        prepare_server_wrpc(ctx), { goto free_mr; },
+        "Unable to prepare write RPC ring\n");
+
+    prepare_server_xrc_shared(ctx);
+
+    // Template of the RC QPs of every connection
+    qp_attr.cap.max_send_sge = ctx->max_sge;
+    qp_attr.cap.max_recv_sge = ctx->max_sge;
+    qp_attr.cap.max_send_wr = ctx->qp_cfg.send_wr;
+    qp_attr.cap.max_recv_wr = ctx->qp_cfg.recv_wr;
+    qp_attr.qp_context = NULL;
+    qp_attr.sq_sig_all = 0;
+    qp_attr.srq = NULL;
+    qp_attr.qp_type = IBV_QPT_RC;
+    qp_attr.send_cq = ctx->scq;
+    qp_attr.recv_cq = ctx->rcq;
+    API_STATUS(
+        accept_pool_init(&(ctx->pool), ctx->pd, &qp_attr,
+                         ctx->qp_cfg.ex_verbs),
+        { goto free_xrc; }, "Unable to initialize QP pool\n");
+
+    __atomic_store_n(&(ctx->shared_ready), true, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+    return (0);
+
+free_xrc:
+    destroy_server_xrc_shared(ctx);
+free_mr:
+    server_release_bufs(ctx);
+free_cq:
+    rdma_destroy_cqs(ctx->scq, ctx->rcq);
+free_pd:
+    ibv_dealloc_pd(ctx->pd);
+unlock:
+    // The next request tries again
+    ctx->verbs = NULL;
+    ctx->pd = NULL;
+    ctx->scq = ctx->rcq = NULL;
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+    return (-1);
+}
+
+// Release what server_prepare_shared set up, once no connection holds any
+// of it
+static void server_destroy_shared(server_ctx_t *ctx) {
+    if (!ctx->shared_ready) {
+        return;
+    }
+
+    accept_pool_destroy(&(ctx->pool));
+    destroy_server_xrc_shared(ctx);
+    server_release_bufs(ctx);
+    rdma_destroy_cqs(ctx->scq, ctx->rcq);
+    ibv_dealloc_pd(ctx->pd);
+    ctx->verbs = NULL;
+    ctx->pd = NULL;
+    ctx->scq = ctx->rcq = NULL;
+    ctx->shared_ready = false;
+}
+
+// Called with acc_mtx held. Later events of the cm_id no longer find conn
+static void server_unlink_conn(server_ctx_t *ctx, server_conn_t *conn) {
+    server_conn_t **p = &(ctx->conns);
+    while (*p && *p != conn) {
+        p = &((*p)->next);
+    }
+    if (*p) {
+        *p = conn->next;
+    }
+    conn->id->context = NULL;
+}
+
+static void server_destroy_conn(server_ctx_t *ctx, server_conn_t *conn) {
+    if (conn->held_qps) {
+        pthread_mutex_lock(&(ctx->acc_mtx));
+        ctx->live_conns--;
+        ctx->live_qps -= conn->held_qps;
+        ctx->live_rq_wrs -= conn->held_rq_wrs;
+        pthread_mutex_unlock(&(ctx->acc_mtx));
+    }
+    if (conn->xrc_qp) {
+        ibv_destroy_qp(conn->xrc_qp);
+    }
+    if (conn->qp) {
+        ibv_destroy_qp(conn->qp);
+    }
+    for (uint32_t i = 0; i < MAX_CONN_QPS - 1; i++) {
+        if (conn->extra_qp[i]) {
+            ibv_destroy_qp(conn->extra_qp[i]);
+        }
+    }
+    rdma_destroy_id(conn->id);
+    free(conn);
+}
+
+// Extra RC QPs of a client that asked for several, warm ones as well, each
+// connected to the client QP it faces
+static int prepare_server_extra_qps(server_ctx_t *ctx, server_conn_t *conn,
+                                    const client_priv_t *cpriv,
+                                    server_priv_t *priv) {
+    EXT_API_STATUS(
+        (cpriv->nqps > MAX_CONN_QPS || (cpriv->nqps > 1 && cpriv->xrc_qpn)),
+        { return (-1); }, "Unsupported %u RC QPs, up to %d without XRC\n",
+        cpriv->nqps, MAX_CONN_QPS);
+
+    for (conn->nqps = 1; conn->nqps < cpriv->nqps; conn->nqps++) {
+        uint32_t i = conn->nqps - 1;
+        conn->extra_qp[i] = accept_pool_get(&(ctx->pool));
+        API_NULL(
+            conn->extra_qp[i], { return (-1); },
+            "Unable to get an extra QP for the client\n");
+        API_STATUS(
+            accept_connect_extra_qp(conn->id, conn->extra_qp[i],
+                                    cpriv->qpn[i]),
+            { return (-1); }, "Unable to connect extra QP to client QP %u\n",
+            cpriv->qpn[i]);
+        priv->qpn[i] = conn->extra_qp[i]->qp_num;
+    }
+
+    if (conn->nqps > 1) {
+        printf("%u extra RC QPs facing the client\n", conn->nqps - 1);
+    }
+    return (0);
+}
+
+// Called with acc_mtx held. Counts the QPs and receive WRs conn keeps, the
+// XRC SRQ once with the first XRC connection, for the XRC/RC comparison of
+// an accept storm
+static void server_hold_conn(server_ctx_t *ctx, server_conn_t *conn) {
+    conn->held_qps = conn->nqps + ((conn->xrc_qp) ? (1) : (0));
+    conn->held_rq_wrs =
+        (conn->xrc_qp) ? (0) : (conn->nqps * ctx->pool.attr.cap.max_recv_wr);
+    if (conn->xrc_qp && !ctx->xrc_srq_held) {
+        ctx->xrc_srq_held = true;
+        ctx->live_rq_wrs += SERVER_RX_DEPTH;
+    }
+    ctx->live_conns++;
+    ctx->live_qps += conn->held_qps;
+    ctx->live_rq_wrs += conn->held_rq_wrs;
+    ctx->peak_conns = (ctx->live_conns > ctx->peak_conns) ? (ctx->live_conns)
+                                                          : (ctx->peak_conns);
+    ctx->peak_qps =
+        (ctx->live_qps > ctx->peak_qps) ? (ctx->live_qps) : (ctx->peak_qps);
+    ctx->peak_rq_wrs = (ctx->live_rq_wrs > ctx->peak_rq_wrs)
+                           ? (ctx->live_rq_wrs)
+                           : (ctx->peak_rq_wrs);
+}
+
+// Accept a connection request onto a warm QP. The QP is moved to RTS before
+// rdma_accept, so only the CM exchange is left once the client hears back
+static void server_accept_conn(server_ctx_t *ctx, struct rdma_cm_id *id,
+                               const cq_rec_t *req,
+                               const client_priv_t *cpriv) {
+    struct rdma_conn_param conn_param = {};
+    server_priv_t priv = {};
+    int rc = 0;
+
+    server_conn_t *conn = calloc(1, sizeof(server_conn_t));
+    API_NULL(
+        conn, { goto reject; }, "Unable to allocate connection state\n");
+    conn->id = id;
+    conn->req_nsec = req->ts_nsec;
+    conn->nqps = 1;
+    conn->peer_xrc_qpn = cpriv->xrc_qpn;
+    conn->peer_initiator_depth = req->byte_len & 0xff;
+    conn->peer_responder_resources = (req->byte_len >> 8) & 0xff;
+
+    API_STATUS(
+        server_prepare_shared(ctx, id->verbs), { goto reject; },
+        "Unable to prepare shared connection resources\n");
+    // Requests of an XRC client land on the shared SRQ, its RC QP only
+    // carries the responses and needs no receive queue
+    if (conn->peer_xrc_qpn) {
+        struct ibv_qp_init_attr qp_attr = ctx->pool.attr;
+        qp_attr.cap.max_recv_wr = 0;
+        conn->qp = rdma_create_rc_qp(ctx->pd, &qp_attr, ctx->pool.ex);
+    } else {
+        conn->qp = accept_pool_get(&(ctx->pool));
+    }
+    API_NULL(
+        conn->qp, { goto reject; }, "Unable to get a QP for the client\n");
+
+    conn_param.responder_resources =
+        (conn->peer_initiator_depth < ctx->max_rd_atom)
+            ? conn->peer_initiator_depth
+            : ctx->max_rd_atom;
+    conn_param.initiator_depth =
+        (conn->peer_responder_resources < ctx->max_init_rd_atom)
+            ? conn->peer_responder_resources
+            : ctx->max_init_rd_atom;
+    API_STATUS(
+        accept_connect_qp(id, conn->qp, conn_param.responder_resources,
+                          conn_param.initiator_depth),
+        { goto reject; }, "Unable to connect QP of the client\n");
+
+    // Advertise the atomic counter array and the stream sink at accept. The
+    // lengths are the buffers', an implicit MR spans the address space
+    priv.atomic.addr = (uint64_t)ctx->atomic_server_buf;
+    priv.atomic.rkey = ctx->atomic_buf_mr->rkey;
+    priv.atomic.len = MAX_ATOMIC_CTR * sizeof(uint64_t);
+    priv.sink.addr = (uint64_t)ctx->sink_server_buf;
+    priv.sink.rkey = ctx->sink_buf_mr->rkey;
+    priv.sink.len = MAX_MR_SZ;
+    priv.wrpc.addr = (uint64_t)ctx->wrpc_server_buf;
+    priv.wrpc.rkey = ctx->wrpc_buf_mr->rkey;
+    priv.wrpc.len = WRPC_RING_SZ;
+    if (conn->peer_xrc_qpn) {
+        API_STATUS(
+            prepare_server_xrc(ctx, conn), { goto reject; },
+            "Unable to prepare XRC receive side\n");
+        uint32_t srqn = 0;
+        ibv_get_srq_num(ctx->xrc_srq, &srqn);
+        priv.xrc_srqn = srqn;
+        priv.xrc_qpn = conn->xrc_qp->qp_num;
+    }
+    API_STATUS(
+        prepare_server_extra_qps(ctx, conn, cpriv, &priv), { goto reject; },
+        "Unable to prepare extra QPs\n");
+    conn_param.private_data = &priv;
+    conn_param.private_data_len = sizeof(server_priv_t);
+    conn_param.retry_count = 5;
+    conn_param.rnr_retry_count = 7;
+    conn_param.qp_num = conn->qp->qp_num;
+
+    // ESTABLISHED finds the connection through its cm_id
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    conn->state = SERVER_CONN_ACCEPTING;
+    conn->next = ctx->conns;
+    ctx->conns = conn;
+    id->context = conn;
+    server_hold_conn(ctx, conn);
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+    rc = rdma_accept(id, &conn_param);
+    API_STATUS(
+        rc,
+        {
+            pthread_mutex_lock(&(ctx->acc_mtx));
+            server_unlink_conn(ctx, conn);
+            pthread_mutex_unlock(&(ctx->acc_mtx));
+            goto reject;
+        },
+        "Unable to accept RDMA connection rqst. Reason: %s\n", strerror(errno));
+    return;
+
+reject:
+    rdma_reject(id, NULL, 0);
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    ctx->rejected++;
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+    if (conn) {
+        server_destroy_conn(ctx, conn);
+    } else {
+        rdma_destroy_id(id);
+    }
+}
+
+// Tear down a connection that went away before anyone served it
+static void server_close_conn(server_ctx_t *ctx, struct rdma_cm_id *id) {
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    server_conn_t *conn = (server_conn_t *)(id->context);
+    if (conn && conn != ctx->conn) {
+        server_unlink_conn(ctx, conn);
+    } else {
+        conn = NULL;
+    }
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+
+    if (conn) {
+        rdma_disconnect(conn->id);
+        server_destroy_conn(ctx, conn);
+    }
+}
+
+static void *server_accept_worker(void *arg) {
+    server_acc_worker_t *w = (server_acc_worker_t *)(arg);
+    server_ctx_t *ctx = w->ctx;
+    cq_rec_t rec = {0};
+
+    while (1) {
+        if (!cq_ring_try_pop(&(w->ring), &rec)) {
+            // Idle, put back the QPs the last requests took from the pool
+            if (__atomic_load_n(&(ctx->shared_ready), __ATOMIC_ACQUIRE)) {
+                accept_pool_fill(&(ctx->pool));
+            }
+            if (!cq_ring_pop(&(w->ring), &rec, &(ctx->acc_running))) {
+                break;
+            }
+        }
+
+        struct rdma_cm_id *id = (struct rdma_cm_id *)(uintptr_t)(rec.wr_id);
+        if (rec.opcode == RDMA_CM_EVENT_CONNECT_REQUEST) {
+            server_accept_conn(ctx, id, &rec,
+                               &(w->priv[w->priv_tail++ % ACC_PRIV_SZ]));
+        } else {
+            server_close_conn(ctx, id);
+        }
+    }
+
+    return (NULL);
+}
+
+static void server_xport_ready(server_ctx_t *ctx, msg_xport_t *x) {
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    ctx->xport_next = x;
+    pthread_cond_broadcast(&(ctx->acc_cv));
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+}
+
+// Hand a client attaching to the segment to connect_server
+static void *server_shm_monitor(void *arg) {
+    server_ctx_t *ctx = (server_ctx_t *)(arg);
+    if (shm_server_wait_attach(ctx->shm)) {
+        return (NULL);
+    }
+
+    server_xport_ready(ctx, &(ctx->shm->xport));
+    return (NULL);
+}
+
+// Hand the next TCP client to connect_server
+static void *server_tcp_monitor(void *arg) {
+    server_ctx_t *ctx = (server_ctx_t *)(arg);
+    tcp_ctx_t *tcp = tcp_accept(ctx->listen_fd, ctx->uring);
+    if (!tcp) {
+        return (NULL);
+    }
+
+    server_xport_ready(ctx, &(tcp->xport));
+    return (NULL);
+}
+
+server_ctx_t *setup_server(struct sockaddr *addr, uint16_t port_id,
+                           const rdma_qp_cfg_t *qp_cfg, uint32_t nworkers,
+                           bool shm) {
     int rc = 0;
-    pthread_attr_t tattr;
+    uint32_t w = 0;
     int ndevices = 0;
     struct ibv_context **rdma_verbs = NULL;
     // Check if any RDMA devices exist
@@ -76,6 +702,26 @@ server_ctx_t *setup_server(struct sockaddr *addr, uint16_t port_id) {
     server_ctx_t *ctx = calloc(1, sizeof(server_ctx_t));
     API_NULL(
         ctx, { return (NULL); }, "Unable to allocate server context\n");
+    if (qp_cfg) {
+        ctx->qp_cfg = *qp_cfg;
+    }
+    rdma_stats_set_init(&(ctx->stats), "server");
+    ctx->nworkers = (nworkers) ? (nworkers) : (DEFAULT_ACCEPT_WORKERS);
+    EXT_API_STATUS(
+        ctx->nworkers > MAX_ACCEPT_WORKERS, { goto free_ctx_fields; },
+        "Up to %d accept workers are supported\n", MAX_ACCEPT_WORKERS);
+    ctx->accept_nsec = calloc(MAX_ACCEPT_SAMPLES, sizeof(uint64_t));
+    API_NULL(
+        ctx->accept_nsec, { goto free_ctx_fields; },
+        "Unable to allocate accept latency samples\n");
+    ctx->workers = aligned_alloc(CACHE_LINE_SZ,
+                                 ctx->nworkers * sizeof(server_acc_worker_t));
+    API_NULL(
+        ctx->workers, { goto free_ctx_fields; },
+        "Unable to allocate accept workers\n");
+    memset(ctx->workers, 0, ctx->nworkers * sizeof(server_acc_worker_t));
+    pthread_mutex_init(&(ctx->acc_mtx), NULL);
+    pthread_cond_init(&(ctx->acc_cv), NULL);
 
     // create an event channel
     ctx->channel = rdma_create_event_channel();
@@ -96,173 +742,265 @@ server_ctx_t *setup_server(struct sockaddr *addr, uint16_t port_id) {
         "Unable to bind RDMA device IP: %s. Reason: %s\n", SKADDR_TO_IP(addr),
         strerror(errno));
 
+    // Hand out ready resources from the first request on if the device is
+    // known already
+    if (ctx->cm_id->verbs) {
+        API_STATUS(
+            server_prepare_shared(ctx, ctx->cm_id->verbs), { goto free_cm_id; },
+            "Unable to prepare shared connection resources\n");
+        API_STATUS(
+            accept_pool_fill(&(ctx->pool)), { goto free_shared; },
+            "Unable to fill QP pool\n");
+        printf("%u warm QPs on %s\n", ctx->pool.nqp,
+               ibv_get_device_name(ctx->verbs->device));
+    }
+
+    // start the accept workers before any request can reach them
+    ctx->acc_running = true;
+    for (w = 0; w < ctx->nworkers; w++) {
+        ctx->workers[w].ctx = ctx;
+        cq_ring_init(&(ctx->workers[w].ring));
+        rc = rdma_start_thread(&(ctx->workers[w].thread),
+                               &server_accept_worker, &(ctx->workers[w]));
+        API_STATUS(
+            rc, { goto stop_workers; }, "Unable to create accept worker %u\n",
+            w);
+    }
+
     // listen for incoming requests on a connection
     rc = rdma_listen(ctx->cm_id, MAX_PENDING_CONNECTIONS);
     API_STATUS(
-        rc, { goto free_cm_id; },
+        rc, { goto stop_workers; },
         "Unable to listen for incoming requests on RDMA device IP: %s. Reason: "
         "%s\n",
         SKADDR_TO_IP(addr), strerror(errno));
 
     // initialize event monitor
     ctx->evt_fn = &server_event_monitor;
-    pthread_attr_init(&tattr);
-    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
     pthread_mutex_init(&(ctx->evt_mtx), NULL);
     pthread_cond_init(&(ctx->evt_cv), NULL);
-    rc = pthread_create(&(ctx->evt_thread), &tattr, ctx->evt_fn, (void *)ctx);
+    rc = rdma_start_thread(&(ctx->evt_thread), ctx->evt_fn, (void *)ctx);
     API_STATUS(
-        rc, { goto free_cm_id; },
+        rc, { goto stop_workers; },
         "Unable to create RDMA event channel monitor\n");
 
-    pthread_attr_destroy(&tattr);
+    // RDMA clients are served regardless of the segment
+    ctx->shm = (shm) ? (shm_server_open(addr)) : (NULL);
+    ctx->xport_fn = &server_shm_monitor;
+    if (ctx->shm &&
+        rdma_start_thread(&(ctx->xport_thread), ctx->xport_fn, ctx)) {
+        printf("Unable to wait for shared-memory clients\n");
+        shm_close(ctx->shm);
+        ctx->shm = NULL;
+    }
+
+    rdma_stats_register(&(ctx->stats));
     return (ctx);
 
+stop_workers:
+    // Without the event thread no request reached the started workers,
+    // which only wait on their rings
+    __atomic_store_n(&(ctx->acc_running), false, __ATOMIC_RELEASE);
+    while (w > 0) {
+        w--;
+        cq_ring_wake(&(ctx->workers[w].ring));
+        pthread_join(ctx->workers[w].thread, NULL);
+    }
+free_shared:
+    server_destroy_shared(ctx);
 free_cm_id:
     rdma_destroy_id(ctx->cm_id);
 free_channel:
     rdma_destroy_event_channel(ctx->channel);
 free_ctx_fields:
+    free(ctx->workers);
+    free(ctx->accept_nsec);
+    rdma_stats_set_free(&(ctx->stats));
     free(ctx);
     return (NULL);
 }
 
-int connect_server(server_ctx_t *ctx) {
-    int rc = 0;
-    struct ibv_qp_init_attr qp_attr = {};
-    memset(&qp_attr, 0, sizeof(struct ibv_qp_init_attr));
+server_ctx_t *setup_server_tcp(struct sockaddr *addr, bool uring) {
+    server_ctx_t *ctx = calloc(1, sizeof(server_ctx_t));
+    API_NULL(
+        ctx, { return (NULL); }, "Unable to allocate server context\n");
+    rdma_stats_set_init(&(ctx->stats), "server");
+    pthread_mutex_init(&(ctx->acc_mtx), NULL);
+    pthread_cond_init(&(ctx->acc_cv), NULL);
+    pthread_mutex_init(&(ctx->evt_mtx), NULL);
+    pthread_cond_init(&(ctx->evt_cv), NULL);
+    ctx->uring = uring;
 
-    // Accept incoming valid client connections
-    pthread_mutex_lock(&ctx->evt_mtx);
-    while (!ctx->listen_id) {
-        pthread_cond_wait(&ctx->evt_cv, &ctx->evt_mtx);
-    }
-    pthread_mutex_unlock(&ctx->evt_mtx);
+    ctx->listen_fd = tcp_listen(addr);
+    API_STATUS(
+        ctx->listen_fd, { goto free_ctx; },
+        "Unable to listen for TCP clients on IP: %s\n", SKADDR_TO_IP(addr));
+    ctx->xport_fn = &server_tcp_monitor;
+    API_STATUS(
+        rdma_start_thread(&(ctx->xport_thread), ctx->xport_fn, ctx),
+        {
+            close(ctx->listen_fd);
+            goto free_ctx;
+        },
+        "Unable to wait for TCP clients\n");
+    printf("Serving TCP clients%s on %s\n", (uring) ? (" over io_uring") : "",
+           SKADDR_TO_IP(addr));
 
-    // init RDMA device resources - CQs/PDs/etc
-    ctx->verbs = ctx->listen_id->verbs;
-    struct ibv_device_attr dev_attr = {};
-    rc = ibv_query_device(ctx->verbs, &dev_attr);
-    assert(!(dev_attr.max_cqe < 1024));
+    rdma_stats_register(&(ctx->stats));
+    return (ctx);
 
-    ctx->pd = ibv_alloc_pd(ctx->verbs);
-    API_NULL(
-        ctx->pd, { return (-1); },
-        "Unable to alloc RDMA Protection Domain. Reason: %s\n",
-        strerror(errno));
+free_ctx:
+    free(ctx);
+    return (NULL);
+}
 
-    ctx->scq = ibv_create_cq(ctx->verbs, MAX_CQE, NULL, NULL, 0);
-    API_NULL(
-        ctx->scq, { goto free_pd; },
-        "Unable to create RDMA Send CQE of size %d entries. Reason: %s\n",
-        MAX_CQE, strerror(errno));
-
-    // Create RDMA QPs for initialized RDMA device rsc
-    qp_attr.cap.max_send_sge = 1;
-    qp_attr.cap.max_recv_sge = 1;
-    qp_attr.cap.max_send_wr = MAX_SEND_WR;
-    qp_attr.cap.max_recv_wr = MAX_RECV_WR;
-    qp_attr.qp_context = NULL;
-    qp_attr.sq_sig_all = 0;
-    qp_attr.srq = NULL;
-    qp_attr.qp_type = IBV_QPT_RC;
-    qp_attr.send_cq = ctx->scq;
-    qp_attr.recv_cq = ctx->scq;
-    rc = rdma_create_qp(ctx->listen_id, ctx->pd, &qp_attr);
-    API_STATUS(
-        rc, { goto disconnect_free_cq; }, "Unable to RDMA QPs. Reason: %s\n",
-        strerror(errno));
+int connect_server(server_ctx_t *ctx) {
+    server_conn_t *conn = NULL, *c = NULL;
 
-    rc = rdma_accept(ctx->listen_id, NULL);
-    API_STATUS(
-        rc, { goto disconnect_free_cq; },
-        "Unable to accept RDMA connection rqst. Reason: %s\n", strerror(errno));
+    // Serve the oldest established connection nobody serves yet
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    while (!conn && !ctx->xport_next) {
+        for (c = ctx->conns; c; c = c->next) {
+            conn = (c->state == SERVER_CONN_ESTABLISHED) ? (c) : (conn);
+        }
+        if (!conn && !ctx->xport_next) {
+            pthread_cond_wait(&(ctx->acc_cv), &(ctx->acc_mtx));
+        }
+    }
 
-    // Assert that connection is established
-    pthread_mutex_lock(&ctx->evt_mtx);
-    while (!ctx->is_connected) {
-        pthread_cond_wait(&ctx->evt_cv, &ctx->evt_mtx);
+    if (!conn) {
+        ctx->xport = ctx->xport_next;
+        ctx->xport_next = NULL;
+        pthread_mutex_lock(&(ctx->evt_mtx));
+        ctx->is_connected = true;
+        pthread_mutex_unlock(&(ctx->evt_mtx));
+        pthread_mutex_unlock(&(ctx->acc_mtx));
+        printf("Serving client over %s\n", ctx->xport->name);
+        return (0);
     }
 
-    pthread_mutex_unlock(&ctx->evt_mtx);
+    conn->state = SERVER_CONN_CLAIMED;
+    ctx->conn = conn;
+    ctx->listen_id = conn->id;
+    ctx->qp = conn->qp;
+    ctx->xrc_qp = conn->xrc_qp;
+    // Still under acc_mtx, so a DISCONNECTED of the connection is either
+    // seen as not served or clears is_connected after this
+    pthread_mutex_lock(&(ctx->evt_mtx));
+    ctx->is_connected = true;
+    pthread_cond_signal(&(ctx->evt_cv));
+    pthread_mutex_unlock(&(ctx->evt_mtx));
+    pthread_mutex_unlock(&(ctx->acc_mtx));
 
+    printf("Serving client on QP %u\n", ctx->qp->qp_num);
     return (0);
-
-disconnect_free_cq:
-    pthread_mutex_unlock(&ctx->evt_mtx);
-    rdma_disconnect(ctx->listen_id);
-    if (ctx->scq || ctx->rcq) {
-        ibv_destroy_cq(ctx->scq);
-    }
-free_pd:
-    ibv_dealloc_pd(ctx->pd);
-    return (-1);
 }
 
 int disconnect_server(server_ctx_t *ctx) {
+    struct ibv_wc wc[CQ_POLL_BATCH];
 
     printf("Tearing down RDMAServer\n");
+    // The client of a transport left, wait for the next one
+    if (ctx->xport) {
+        pthread_mutex_lock(&(ctx->evt_mtx));
+        ctx->is_connected = false;
+        pthread_mutex_unlock(&(ctx->evt_mtx));
+        ctx->xport->close(ctx->xport);
+        ctx->xport = NULL;
+        return (rdma_start_thread(&(ctx->xport_thread), ctx->xport_fn, ctx));
+    }
+
     pthread_mutex_lock(&ctx->evt_mtx);
     while (ctx->is_connected) {
         pthread_cond_wait(&ctx->evt_cv, &ctx->evt_mtx);
     }
+    pthread_mutex_unlock(&ctx->evt_mtx);
 
-    // Release old resources after disconnect
-    rdma_destroy_qp(ctx->listen_id);
-    rdma_disconnect(ctx->listen_id);
-    if (ctx->scq || ctx->rcq) {
-        ibv_destroy_cq(ctx->scq);
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    server_conn_t *conn = ctx->conn;
+    if (conn) {
+        server_unlink_conn(ctx, conn);
+    }
+    ctx->conn = NULL;
+    ctx->listen_id = NULL;
+    ctx->qp = NULL;
+    ctx->xrc_qp = NULL;
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+
+    // Release old resources after disconnect, the shared ones stay
+    if (conn) {
+        rdma_disconnect(conn->id);
+        server_destroy_conn(ctx, conn);
+        // Flushed WRs of the QP must not reach the next connection served
+        while (ibv_poll_cq(ctx->scq, CQ_POLL_BATCH, &wc[0]) > 0) {
+        }
+        while (ctx->rcq != ctx->scq &&
+               ibv_poll_cq(ctx->rcq, CQ_POLL_BATCH, &wc[0]) > 0) {
+        }
     }
 
-    ibv_dealloc_pd(ctx->pd);
-    ctx->listen_id = 0;
-    ctx->pd = NULL;
-    ctx->scq = ctx->rcq = NULL;
-    pthread_mutex_unlock(&ctx->evt_mtx);
     return 0;
 }
 
+int wait_server_accepts(server_ctx_t *ctx, uint64_t n) {
+    pthread_mutex_lock(&(ctx->acc_mtx));
+    while (ctx->accepted < n) {
+        pthread_cond_wait(&(ctx->acc_cv), &(ctx->acc_mtx));
+    }
+    pthread_mutex_unlock(&(ctx->acc_mtx));
+    return (0);
+}
+
 static void *server_wcq_monitor(void *arg) {
     server_ctx_t *ctx = (server_ctx_t *)(arg);
-    struct ibv_wc wc[MAX_CQE] = {0};
+    rdma_cq_poller_t poller = {.scq = ctx->scq,
+                               .rcq = ctx->rcq,
+                               .ex = ctx->qp_cfg.ex_verbs,
+                               .stats = ctx->poll_stats};
+    struct ibv_wc wc[CQ_POLL_BATCH] = {0};
+    cq_rec_t rec = {0};
     int ncqe = 0;
 
     while (ctx->is_connected) {
-        ncqe = ibv_poll_cq(ctx->scq, MAX_CQE, &wc[0]);
+        ncqe = rdma_cq_poll(&poller, &wc[0]);
+        uint64_t now = (ncqe > 0) ? cq_ring_now() : 0;
         for (int i = 0; i < ncqe; i++) {
-            // Check for errors
             if (wc[i].status != IBV_WC_SUCCESS) {
                 printf("WCQE for WR[%ld] Status: %s\n", wc[i].wr_id,
                        ibv_wc_status_str(wc[i].status));
-            } else {
-#if 0
-                printf("WCQE for WR[%ld] Opcode: %s\n", wc[i].wr_id,
-                       wc_opcode_str(wc[i].opcode));
-#endif
             }
-            // Based on the opcode decide the action
-            switch (wc[i].opcode) {
-            case IBV_WC_RECV:
-            case IBV_WC_RECV_RDMA_WITH_IMM:
-                pthread_mutex_lock(&(ctx->wcq_mtx));
-                // This only works because all messages are of the same size and
-                // opcode, else we would need to organize this info by wr_id and
-                // use that to correlate the dispatcher
-                ctx->recv_opc[wc[i].wr_id] = (wc[i].imm_data);
-                ctx->recv_sz = (wc[i].byte_len);
-                pthread_cond_broadcast(&(ctx->wcq_cv));
-                pthread_mutex_unlock(&(ctx->wcq_mtx));
-                break;
-            case IBV_WC_RDMA_WRITE:
-            case IBV_WC_SEND:
-            default:
-                break;
+
+            // Opcode and size travel with each record, so requests of mixed
+            // opcode and size are dispatched correctly
+            if (rdma_wc_routed(&wc[i])) {
+                cq_ring_rec_from_wc(&rec, &wc[i], now);
+                cq_ring_push(&(ctx->dp->ring), &rec);
             }
         }
     }
     return (NULL);
 }
 
+// A transport client is echoed out of the messages handed out, nothing to
+// register or poll
+static int prepare_server_xport(server_ctx_t *ctx) {
+    server_dp_t *dp = aligned_alloc(CACHE_LINE_SZ, sizeof(server_dp_t));
+    API_NULL(
+        dp, { return (-1); }, "Unable to allocate datapath state\n");
+    memset(dp, 0, sizeof(server_dp_t));
+    cq_ring_init(&(dp->ring));
+    dp->stats = rdma_stats_new(&(ctx->stats), NULL);
+    API_NULL(
+        dp->stats,
+        {
+            free(dp);
+            return (-1);
+        },
+        "Unable to allocate datapath counters\n");
+    ctx->dp = dp;
+    return (0);
+}
+
 int prepare_server_data(server_ctx_t *ctx) {
     // Unconditonally allocate req & response structures
     // Register memory with RDMA stack
@@ -271,6 +1009,10 @@ int prepare_server_data(server_ctx_t *ctx) {
     size_t send_sz = (MAX_MR_SZ);
     size_t recv_sz = (MAX_MR_SZ);
     int rc = 0;
+    if (ctx->xport) {
+        return (prepare_server_xport(ctx));
+    }
+
     // Allocate 1MB of buffer space
     void *send_buf = mmap(NULL, send_sz, PROT_READ | PROT_WRITE,
                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
@@ -292,8 +1034,8 @@ int prepare_server_data(server_ctx_t *ctx) {
     ctx->recv_server_buf = recv_buf;
     ctx->recv_server_buf_sz = recv_sz;
 
-    ctx->send_buf_mr =
-        ibv_reg_mr(ctx->pd, send_buf, send_sz, RDMA_ACCESS_FLAGS);
+    ctx->send_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                    &(ctx->implicit_mr), send_buf, send_sz);
     API_NULL(
         ctx->send_buf_mr,
         {
@@ -302,28 +1044,70 @@ int prepare_server_data(server_ctx_t *ctx) {
             return (-1);
         },
         "Unable to register send buf with RDMA. Reason: %s\n", strerror(errno));
-    ctx->recv_buf_mr =
-        ibv_reg_mr(ctx->pd, recv_buf, recv_sz, RDMA_ACCESS_FLAGS);
+    ctx->recv_buf_mr = rdma_reg_buf(ctx->pd, &(ctx->qp_cfg),
+                                    &(ctx->implicit_mr), recv_buf, recv_sz);
     API_NULL(
         ctx->recv_buf_mr,
         {
             munmap(send_buf, send_sz);
             munmap(recv_buf, recv_sz);
-            ibv_dereg_mr(ctx->send_buf_mr);
+            rdma_dereg_buf(ctx->send_buf_mr, ctx->implicit_mr);
             return (-1);
         },
         "Unable to register recv buf with RDMA. Reason: %s\n", strerror(errno));
 
+    // Separate header slot so requests are scattered as header + payload
+    ctx->hdr_server_buf = aligned_alloc(RDMA_MSG_HDR_SZ, RDMA_MSG_HDR_SZ);
+    API_NULL(
+        ctx->hdr_server_buf, { return (-1); },
+        "Unable to allocate msg header buffer\n");
+    ctx->hdr_buf_mr =
+        rdma_reg_buf(ctx->pd, &(ctx->qp_cfg), &(ctx->implicit_mr),
+                     ctx->hdr_server_buf, RDMA_MSG_HDR_SZ);
+    API_NULL(
+        ctx->hdr_buf_mr,
+        {
+            free(ctx->hdr_server_buf);
+            return (-1);
+        },
+        "Unable to register msg header buf with RDMA. Reason: %s\n",
+        strerror(errno));
+
     randomize_buf(&(ctx->send_server_buf), ctx->send_server_buf_sz);
 
-    // Start a separate thread to poll for completion
-    pthread_attr_t tattr;
-    pthread_attr_init(&tattr);
-    pthread_attr_setdetachstate(&tattr, PTHREAD_CREATE_DETACHED);
-    pthread_mutex_init(&(ctx->wcq_mtx), NULL);
-    pthread_cond_init(&(ctx->wcq_cv), NULL);
+    // Hot datapath state, private to send_recv_server and the ring
+    server_dp_t *dp = aligned_alloc(CACHE_LINE_SZ, sizeof(server_dp_t));
+    API_NULL(
+        dp, { return (-1); }, "Unable to allocate datapath state\n");
+    memset(dp, 0, sizeof(server_dp_t));
+    dp->qp = ctx->qp;
+    dp->qpx = (ctx->qp_cfg.ex_verbs) ? (ibv_qp_to_qp_ex(dp->qp)) : (NULL);
+    dp->srq = (ctx->xrc_qp) ? (ctx->xrc_srq) : (NULL);
+    dp->recv_buf = ctx->recv_server_buf;
+    dp->hdr_buf = ctx->hdr_server_buf;
+    dp->recv_buf_sz = ctx->recv_server_buf_sz;
+    dp->recv_lkey = ctx->recv_buf_mr->lkey;
+    dp->hdr_lkey = ctx->hdr_buf_mr->lkey;
+    dp->max_sge = ctx->max_sge;
+    cq_ring_init(&(dp->ring));
+    // Blocks are linked into the set as they are made and released with it
+    // by rdma_stats_set_free. The one pointing at the ring of dp comes last,
+    // so nothing the stats thread reads points into dp if it is freed
+    ctx->poll_stats = rdma_stats_new(&(ctx->stats), NULL);
+    dp->stats = (ctx->poll_stats)
+                    ? (rdma_stats_new(&(ctx->stats), &(dp->ring)))
+                    : (NULL);
+    EXT_API_STATUS(
+        !dp->stats,
+        {
+            free(dp);
+            return (-1);
+        },
+        "Unable to allocate datapath counters\n");
+    ctx->dp = dp;
     ctx->wcq_fn = &(server_wcq_monitor);
-    rc = pthread_create(&(ctx->wcq_thread), &tattr, ctx->wcq_fn, (void *)ctx);
+    // Start a separate thread to poll for completion
+    rc = rdma_start_thread(&(ctx->wcq_thread), ctx->wcq_fn, (void *)ctx);
     API_STATUS(
         rc, { return (-1); },
         "Unable to create WCQ shared send/recv monitor\n");
@@ -332,65 +1116,486 @@ int prepare_server_data(server_ctx_t *ctx) {
     return (0);
 }
 
+// Scatter requests as header + payload if the device allows. Every recv of
+// the server QP has this layout, so a request always starts at sge[0]
+static int server_recv_sge(const server_dp_t *dp, struct ibv_sge *sge) {
+    int nsge = 0;
+    if (dp->max_sge > 1) {
+        sge[nsge].addr = (uint64_t)dp->hdr_buf;
+        sge[nsge].length = RDMA_MSG_HDR_SZ;
+        sge[nsge].lkey = dp->hdr_lkey;
+        nsge++;
+    }
+
+    sge[nsge].addr = (uint64_t)dp->recv_buf;
+    sge[nsge].length = dp->recv_buf_sz;
+    sge[nsge].lkey = dp->recv_lkey;
+    nsge++;
+    return (nsge);
+}
+
+// Keep n recvs posted so pipelined (open-loop) requests never meet an empty
+// RQ. Concurrent requests share the buffers, only the latest is intact
+static int server_post_recvs(server_dp_t *dp, uint32_t n) {
+    struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
+    struct ibv_sge sge[2] = {0};
+    int rc = 0;
+
+    recv_wr.next = NULL;
+    recv_wr.sg_list = &sge[0];
+    recv_wr.num_sge = server_recv_sge(dp, sge);
+    while (dp->rx_posted < n) {
+        recv_wr.wr_id = (dp->wr_seq++);
+        rc = (dp->srq) ? ibv_post_srq_recv(dp->srq, &recv_wr, &recv_bad_wr)
+                       : ibv_post_recv(dp->qp, &recv_wr, &recv_bad_wr);
+        API_STATUS(
+            rc,
+            {
+                STATS_ADD(dp->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to post receive wr. Reason: %s\n", strerror(errno));
+        dp->rx_posted++;
+        STATS_ADD(dp->stats, rx_posted, 1);
+    }
+
+    return (0);
+}
+
+// Serve one bandwidth round requested by OPC_BW_START, see stream_client_bw
+static int stream_server_bw(server_ctx_t *ctx, const bw_cfg_t *cfg) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    server_dp_t *dp = ctx->dp;
+    bw_stream_t s = {0};
+    int rc = 0;
+
+    EXT_API_STATUS(
+        (cfg->qdepth < 1 || cfg->qdepth > MAX_BW_QDEPTH ||
+         cfg->msg_sz > ctx->send_server_buf_sz),
+        { return (-1); }, "Unsupported queue depth %u or size %u bytes\n",
+        cfg->qdepth, cfg->msg_sz);
+    EXT_API_STATUS(
+        dp->srq, { return (-1); },
+        "Bandwidth rounds need an RC connection, not XRC\n");
+    EXT_API_STATUS(
+        (cfg->bidir && cfg->opcode == OPC_RDMA_WRITE &&
+         cfg->msg_sz > cfg->sink.len),
+        { return (-1); }, "Client sink of %u bytes is below %u bytes\n",
+        cfg->sink.len, cfg->msg_sz);
+    EXT_API_STATUS(
+        (bw_nqps(cfg) > ctx->conn->nqps || bw_nqps(cfg) > cfg->qdepth ||
+         (cfg->stripe && bw_nqps(cfg) > cfg->msg_sz)),
+        { return (-1); },
+        "Unable to stream over %u QPs, %u connected, depth %u, size %u\n",
+        bw_nqps(cfg), ctx->conn->nqps, cfg->qdepth, cfg->msg_sz);
+    EXT_API_STATUS(
+        (bw_rx_total(cfg, true) > ctx->qp_cfg.recv_wr ||
+         cfg->qdepth + 2 > ctx->qp_cfg.send_wr),
+        { return (-1); }, "Queue depth %u exceeds send: %u recv: %u WRs\n",
+        cfg->qdepth, ctx->qp_cfg.send_wr, ctx->qp_cfg.recv_wr);
+
+    s.qp[0] = dp->qp;
+    s.rx_posted[0] = dp->rx_posted;
+    for (uint32_t q = 1; q < bw_nqps(cfg); q++) {
+        s.qp[q] = ctx->conn->extra_qp[q - 1];
+        s.rx_posted[q] = ctx->conn->extra_rx_posted[q - 1];
+    }
+    for (uint32_t q = 0; ctx->qp_cfg.ex_verbs && q < bw_nqps(cfg); q++) {
+        s.qpx[q] = ibv_qp_to_qp_ex(s.qp[q]);
+    }
+    s.ring = &(dp->ring);
+    s.stats = dp->stats;
+    s.alive = &(ctx->is_connected);
+    s.wr_id_base = BW_WR_FLAG;
+    s.send_buf = ctx->send_server_buf;
+    s.send_lkey = ctx->send_buf_mr->lkey;
+    s.recv_nsge = server_recv_sge(dp, s.recv_sge);
+    // The reply carries no payload and the FIN follows all data
+    s.fin_buf = ctx->send_server_buf;
+    s.fin_lkey = ctx->send_buf_mr->lkey;
+    s.sink = cfg->sink;
+    s.cfg = *cfg;
+    s.tx = cfg->bidir;
+    s.peer_tx = true;
+    // The client must not start its next round before this FIN is read
+    s.fin_after_rx = true;
+
+    // Recvs first, so the client never streams into an empty RQ
+    API_STATUS(
+        bw_post_recvs(&s, 0), { return (-1); },
+        "Unable to post stream recvs\n");
+
+    send_wr.wr_id = (dp->wr_seq++);
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 0;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = 0;
+    send_wr.imm_data = OPC_BW_START;
+    rc = (dp->qpx) ? (rdma_post_ex(dp->qpx, rdma_wr_send_imm, send_wr.wr_id,
+                                   0, OPC_BW_START, 0, 0, NULL, 0))
+                   : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post bw round reply. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+
+    rc = bw_stream_run(&s, &(dp->bw_tx), &(dp->bw_rx));
+    // Recvs the client never filled serve the next requests
+    dp->rx_posted = s.rx_posted[0];
+    for (uint32_t q = 1; q < bw_nqps(cfg); q++) {
+        ctx->conn->extra_rx_posted[q - 1] = s.rx_posted[q];
+    }
+    API_STATUS(
+        rc, { return (-1); }, "Unable to complete bandwidth round\n");
+    dp->bw_cfg = *cfg;
+    dp->bw_rounds++;
+    return (0);
+}
+
+// Echo the request in slot idx of the write RPC ring, payload and trailer,
+// into the response slot the trailer names, with one RDMA_WRITE
+static int server_wrpc_reply(server_ctx_t *ctx, uint32_t idx,
+                             const wrpc_tail_t *tail) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    server_dp_t *dp = ctx->dp;
+    uint32_t len = tail->len + sizeof(wrpc_tail_t);
+
+    EXT_API_STATUS(
+        tail->len > WRPC_MAX_MSG, { return (-1); },
+        "Write RPC of %u bytes overruns slot %u\n", tail->len, idx);
+    sge.addr = (uint64_t)(tail + 1) - len;
+    sge.length = len;
+    sge.lkey = ctx->wrpc_buf_mr->lkey;
+    send_wr.wr_id = (dp->wr_seq++);
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = IBV_WR_RDMA_WRITE;
+    // Only every so often signaled, to retire the writes in the SQ
+    dp->wrpc_unsig = (dp->wrpc_unsig + 1) % WRPC_SIGNAL_EVERY;
+    send_wr.send_flags = (dp->wrpc_unsig) ? (0) : (IBV_SEND_SIGNALED);
+    send_wr.wr.rdma.remote_addr = tail->resp_addr + WRPC_SLOT_SZ - len;
+    send_wr.wr.rdma.rkey = tail->resp_rkey;
+    uint64_t t0 = rdma_cycles();
+    int rc = (dp->qpx)
+                 ? (rdma_post_ex(dp->qpx, rdma_wr_write, send_wr.wr_id,
+                                 send_wr.send_flags, 0,
+                                 send_wr.wr.rdma.remote_addr,
+                                 send_wr.wr.rdma.rkey, &sge, 1))
+                 : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+    STATS_ADD(dp->stats, post_cyc, rdma_cycles() - t0);
+    STATS_ADD(dp->stats, post_n, 1);
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post write RPC response. Reason: %s\n", strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, tail->len);
+    return (0);
+}
+
+// Serve write RPCs requested by OPC_WRPC_START, see start_client_wrpc. No
+// recv is consumed: requests are found by polling the seq closing each slot
+// of the ring, until a trailer carries OPC_WRPC_FIN
+static int serve_server_wrpc(server_ctx_t *ctx) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    uint32_t last[WRPC_SLOTS] = {0};
+    server_dp_t *dp = ctx->dp;
+    cq_rec_t rec = {0};
+    int rc = 0;
+
+    EXT_API_STATUS(
+        dp->srq, { return (-1); },
+        "Write RPCs need an RC connection, not XRC\n");
+    EXT_API_STATUS(
+        ctx->qp_cfg.send_wr < 2 * WRPC_SIGNAL_EVERY, { return (-1); },
+        "Send queue of %u WRs is below %d for write RPCs\n",
+        ctx->qp_cfg.send_wr, 2 * WRPC_SIGNAL_EVERY);
+
+    // Trailers of an earlier client must not pass for requests. Nobody
+    // writes the ring before the reply below
+    for (uint32_t i = 0; i < WRPC_SLOTS; i++) {
+        wrpc_slot_tail(ctx->wrpc_server_buf, i)->seq = 0;
+    }
+    send_wr.wr_id = (dp->wr_seq++);
+    send_wr.num_sge = 0;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = 0;
+    send_wr.imm_data = OPC_WRPC_START;
+    rc = (dp->qpx) ? (rdma_post_ex(dp->qpx, rdma_wr_send_imm, send_wr.wr_id,
+                                   0, OPC_WRPC_START, 0, 0, NULL, 0))
+                   : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+    API_STATUS(
+        rc,
+        {
+            STATS_ADD(dp->stats, post_err, 1);
+            return (-1);
+        },
+        "Unable to post write RPC start reply. Reason: %s\n",
+        strerror(errno));
+    STATS_ADD(dp->stats, tx_msgs, 1);
+
+    while (ctx->is_connected) {
+        // Only failed responses and stray requests reach the ring
+        if (cq_ring_try_pop(&(dp->ring), &rec)) {
+            if (rec.status == IBV_WC_WR_FLUSH_ERR) {
+                break;
+            }
+            EXT_API_STATUS(
+                rec.status != IBV_WC_SUCCESS, { return (-1); },
+                "WR[%ld] failed. Status: %s\n", rec.wr_id,
+                ibv_wc_status_str(rec.status));
+            printf("SEND request received while serving write RPCs\n");
+            return (-1);
+        }
+
+        bool idle = true;
+        for (uint32_t i = 0; i < WRPC_SLOTS; i++) {
+            wrpc_tail_t *tail = wrpc_slot_tail(ctx->wrpc_server_buf, i);
+            uint32_t seq = __atomic_load_n(&(tail->seq), __ATOMIC_ACQUIRE);
+            if (seq == last[i]) {
+                continue;
+            }
+
+            idle = false;
+            last[i] = seq;
+            if (tail->opc == OPC_WRPC_FIN) {
+                return (0);
+            }
+            dp->rx_msgs++;
+            dp->rx_bytes += tail->len;
+            API_STATUS(
+                server_wrpc_reply(ctx, i, tail), { return (-1); },
+                "Unable to serve write RPC of slot %u\n", i);
+        }
+
+        if (idle) {
+            cpu_relax();
+        }
+    }
+
+    disconnect_server(ctx);
+    return (0);
+}
+
+// Serve one bandwidth round of a transport client, see client_xport_stream
+static int server_xport_stream(server_ctx_t *ctx, const bw_cfg_t *cfg) {
+    msg_xport_t *x = ctx->xport;
+    server_dp_t *dp = ctx->dp;
+    bw_result_t *res = &(dp->bw_rx);
+    struct iovec iov = {NULL, 0};
+    uint32_t opc = 0, len = 0;
+    uint64_t t0 = 0;
+    void *data = NULL;
+    int rc = 0;
+
+    memset(&(dp->bw_tx), 0, sizeof(bw_result_t));
+    memset(res, 0, sizeof(bw_result_t));
+    API_STATUS(
+        x->send(x, OPC_BW_START, &iov, 0), { return (-1); },
+        "Unable to reply to bw round start\n");
+    STATS_ADD(dp->stats, tx_msgs, 1);
+
+    // Timed from the first to the last data message consumed
+    while ((rc = x->recv(x, &opc, &data, &len, true)) == 1 &&
+           opc != OPC_BW_FIN) {
+        STATS_ADD(dp->stats, rx_msgs, 1);
+        STATS_ADD(dp->stats, rx_bytes, len);
+        if (opc == OPC_BW_DATA) {
+            uint64_t now = cq_ring_now();
+            t0 = (res->messages) ? (t0) : (now);
+            res->messages++;
+            res->bytes += len;
+            res->elapsed_nsec = now - t0;
+        }
+    }
+    EXT_API_STATUS(
+        rc != 1, { return (-1); }, "Client left during the bw round\n");
+    x->release(x);
+
+    iov.iov_base = res;
+    iov.iov_len = sizeof(bw_result_t);
+    API_STATUS(
+        x->send(x, OPC_BW_FIN, &iov, 1), { return (-1); },
+        "Unable to end bw round\n");
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, sizeof(bw_result_t));
+    dp->bw_cfg = *cfg;
+    dp->bw_rounds++;
+    return (0);
+}
+
+// Serve one request of a transport client, echoed straight out of the
+// message handed out
+static int server_xport_serve(server_ctx_t *ctx) {
+    msg_xport_t *x = ctx->xport;
+    server_dp_t *dp = ctx->dp;
+    uint32_t opc = 0, len = 0;
+    void *data = NULL;
+    bw_cfg_t cfg = {0};
+
+    if (x->recv(x, &opc, &data, &len, true) != 1) {
+        // Client closed the session or exited, tear down with it
+        disconnect_server(ctx);
+        return (0);
+    }
+
+    dp->rx_msgs++;
+    dp->rx_bytes += len;
+    STATS_ADD(dp->stats, rx_msgs, 1);
+    STATS_ADD(dp->stats, rx_bytes, len);
+    if (opc == OPC_BW_START) {
+        EXT_API_STATUS(
+            len < sizeof(bw_cfg_t), { return (-1); },
+            "Short bw round start of %u bytes\n", len);
+        memcpy(&cfg, data, sizeof(bw_cfg_t));
+        x->release(x);
+        return (server_xport_stream(ctx, &cfg));
+    }
+
+    EXT_API_STATUS(
+        opc != OPC_SEND_ONLY, { return (-1); }, "Unsupported OPC received\n");
+    struct iovec iov = {data, len};
+    if (x->send(x, OPC_SEND_ONLY, &iov, 1)) {
+        disconnect_server(ctx);
+        return (0);
+    }
+    x->release(x);
+    STATS_ADD(dp->stats, tx_msgs, 1);
+    STATS_ADD(dp->stats, tx_bytes, len);
+    return (0);
+}
+
 int send_recv_server(server_ctx_t *ctx) {
-    static int count = 0;
+    server_dp_t *dp = ctx->dp;
     int rc = 0, opc = 0;
     // Based on the IMM data opc, prepare wqe structures for response
     // IBV_SEND: lkey, no rkey is needed, zcopy local send, 1-copy remote
     // Protocol-1: Measure RTT time from client<->server
-    struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
     struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
-    struct ibv_sge sge = {0};
+    struct ibv_sge sge[2] = {0};
+    cq_rec_t rec = {0};
+    int nsge = server_recv_sge(dp, sge);
+
+    if (ctx->xport) {
+        return (server_xport_serve(ctx));
+    }
 
-    sge.addr = (uint64_t)ctx->recv_server_buf;
-    sge.length = ctx->recv_server_buf_sz;
-    sge.lkey = ctx->recv_buf_mr->lkey;
-    recv_wr.wr_id = (count % MAX_SEND_WR);
-    recv_wr.next = NULL;
-    recv_wr.sg_list = &sge;
-    recv_wr.num_sge = 1;
-    rc = ibv_post_recv(ctx->listen_id->qp, &recv_wr, &recv_bad_wr);
     API_STATUS(
-        rc, { return (-1); }, "Unable to post receive wr. Reason: %s\n",
-        strerror(errno));
+        server_post_recvs(dp, SERVER_RX_DEPTH), { return (-1); },
+        "Unable to replenish request recvs\n");
 
     // sync with WCQ to make sure RECV_RDMA is consumed
-    pthread_mutex_lock(&(ctx->wcq_mtx));
-    while (ctx->recv_opc[recv_wr.wr_id] == OPC_INVALID && ctx->is_connected) {
-        pthread_cond_wait(&(ctx->wcq_cv), &(ctx->wcq_mtx));
-    }
+    while (cq_ring_pop(&(dp->ring), &rec, &(ctx->is_connected))) {
+        if (rec.status == IBV_WC_WR_FLUSH_ERR) {
+            // QP flushed by the client disconnecting, tear down with it
+            disconnect_server(ctx);
+            return (0);
+        }
 
-    opc = ctx->recv_opc[recv_wr.wr_id];
-    ctx->recv_opc[recv_wr.wr_id] = OPC_INVALID; // Reset for next request
-    pthread_mutex_unlock(&(ctx->wcq_mtx));
+        EXT_API_STATUS(
+            rec.status != IBV_WC_SUCCESS, { return (-1); },
+            "WR[%ld] failed. Status: %s\n", rec.wr_id,
+            ibv_wc_status_str(rec.status));
+        // Requests are served in arrival order, one per recv
+        if (rec.opcode == IBV_WC_RECV ||
+            rec.opcode == IBV_WC_RECV_RDMA_WITH_IMM) {
+            opc = rec.imm;
+            dp->rx_posted--;
+            dp->rx_msgs++;
+            dp->rx_bytes += rec.byte_len;
+            break;
+        }
+    }
 
     if (!ctx->is_connected) {
         disconnect_server(ctx);
         return (0);
     }
 
-    if (opc == OPC_SEND_ONLY) {
-        send_wr.wr_id = (count % MAX_SEND_WR);
-        count++;
+    if (opc == OPC_BW_START) {
+        // Round parameters fit the header slot if the request was scattered
+        bw_cfg_t cfg = {0};
+        memcpy(&cfg, (void *)sge[0].addr, sizeof(bw_cfg_t));
+        return (stream_server_bw(ctx, &cfg));
+    } else if (opc == OPC_WRPC_START) {
+        return (serve_server_wrpc(ctx));
+    } else if (opc == OPC_SEND_ONLY) {
+        send_wr.wr_id = (dp->wr_seq++);
         send_wr.next = NULL;
-        sge.addr = (uint64_t)ctx->recv_server_buf; // zcopy round about !
-        sge.length = ctx->recv_sz;
-        sge.lkey = ctx->recv_buf_mr->lkey;
-        send_wr.sg_list = &sge;
-        send_wr.num_sge = 1;
+        // zcopy round about ! gather back exactly what was scattered
+        if (nsge > 1) {
+            sge[0].length = (rec.byte_len < RDMA_MSG_HDR_SZ)
+                                ? (rec.byte_len)
+                                : (RDMA_MSG_HDR_SZ);
+            sge[1].length = rec.byte_len - sge[0].length;
+            nsge = (sge[1].length) ? (2) : (1);
+        } else {
+            sge[0].length = rec.byte_len;
+        }
+
+        send_wr.sg_list = &sge[0];
+        send_wr.num_sge = nsge;
         send_wr.opcode = IBV_WR_SEND;
         send_wr.send_flags = IBV_SEND_SIGNALED;
         // remote address doesn't matter
         send_wr.wr.rdma.remote_addr = 0;
         send_wr.wr.rdma.rkey = 0;
-        rc = ibv_post_send(ctx->listen_id->qp, &send_wr, &send_bad_wr);
+        uint64_t t0 = rdma_cycles();
+        rc = (dp->qpx) ? (rdma_post_ex(dp->qpx, rdma_wr_send, send_wr.wr_id,
+                                       send_wr.send_flags, 0, 0, 0, &sge[0],
+                                       nsge))
+                       : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+        STATS_ADD(dp->stats, post_cyc, rdma_cycles() - t0);
+        STATS_ADD(dp->stats, post_n, 1);
         API_STATUS(
-            rc, { return (-1); }, "Unable to post send request. Reason: %s\n",
-            strerror(errno));
+            rc,
+            {
+                STATS_ADD(dp->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to post send request. Reason: %s\n", strerror(errno));
+        STATS_ADD(dp->stats, tx_msgs, 1);
+        STATS_ADD(dp->stats, tx_bytes, rec.byte_len);
         // Ignore the processing of send completion as client synchronizes for
         // it!
+    } else if (opc == OPC_RDMA_WRITE) {
+        // Protocol-2: Measure RDMA_WRITE RTT from client<->server. The
+        // request sits in the sink, notify back with a zero length write
+        // whose IMM consumes a client recv, no rkey of the client needed
+        send_wr.wr_id = (dp->wr_seq++);
+        send_wr.next = NULL;
+        send_wr.sg_list = NULL;
+        send_wr.num_sge = 0;
+        send_wr.opcode = IBV_WR_RDMA_WRITE_WITH_IMM;
+        send_wr.send_flags = IBV_SEND_SIGNALED;
+        send_wr.imm_data = OPC_RDMA_WRITE;
+        send_wr.wr.rdma.remote_addr = 0;
+        send_wr.wr.rdma.rkey = 0;
+        uint64_t t0 = rdma_cycles();
+        rc = (dp->qpx) ? (rdma_post_ex(dp->qpx, rdma_wr_write_imm,
+                                       send_wr.wr_id, send_wr.send_flags,
+                                       OPC_RDMA_WRITE, 0, 0, &sge[0], 0))
+                       : (ibv_post_send(dp->qp, &send_wr, &send_bad_wr));
+        STATS_ADD(dp->stats, post_cyc, rdma_cycles() - t0);
+        STATS_ADD(dp->stats, post_n, 1);
+        API_STATUS(
+            rc,
+            {
+                STATS_ADD(dp->stats, post_err, 1);
+                return (-1);
+            },
+            "Unable to post write notify. Reason: %s\n", strerror(errno));
+        STATS_ADD(dp->stats, tx_msgs, 1);
     } else {
-        // Protocol-2: Measure RDMA_WRITE RTT from client<->server
         printf("Unsupported OPC received\n");
         return (-1);
     }
@@ -0,0 +1,344 @@
+#include "rdma_shm.h"
+#include "client_server_shared.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <ifaddrs.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define SHM_MAGIC 0x31736d6863616472ULL
+
+static void shm_futex_wake(uint32_t *word) {
+    syscall(SYS_futex, word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+// The peer left if it closed the segment, the server reset it or the
+// process died without a word
+static bool shm_peer_alive(shm_ctx_t *shm) {
+    shm_seg_t *seg = shm->seg;
+    if (__atomic_load_n(&(seg->state), __ATOMIC_ACQUIRE) != SHM_SEG_ATTACHED) {
+        return (false);
+    }
+
+    pid_t pid = (shm->server) ? (seg->client_pid) : (seg->server_pid);
+    return (kill(pid, 0) == 0 || errno != ESRCH);
+}
+
+// Spin until *word moves off val, then park on it for at most
+// CQ_RING_PARK_NSEC. The caller re-checks its condition either way
+static int shm_wait(shm_ctx_t *shm, uint32_t *word, uint32_t val,
+                    uint32_t *parked) {
+    struct timespec park = {0, CQ_RING_PARK_NSEC};
+    for (int i = 0; i < CQ_RING_SPIN; i++) {
+        if (__atomic_load_n(word, __ATOMIC_ACQUIRE) != val) {
+            return (0);
+        }
+        cpu_relax();
+    }
+
+    if (!shm_peer_alive(shm)) {
+        return (-1);
+    }
+
+    // Pairs with the fence of the waking side, as in cq_ring_pop
+    __atomic_store_n(parked, 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) == val) {
+        syscall(SYS_futex, word, FUTEX_WAIT, val, &park, NULL, 0);
+    }
+    __atomic_store_n(parked, 0, __ATOMIC_RELAXED);
+    return (0);
+}
+
+bool shm_peer_is_local(const struct sockaddr *addr) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    struct ifaddrs *ifa = NULL, *i = NULL;
+    bool local = false;
+
+    if (addr->sa_family != AF_INET) {
+        return (false);
+    }
+    if ((ntohl(in->sin_addr.s_addr) >> IN_CLASSA_NSHIFT) == IN_LOOPBACKNET) {
+        return (true);
+    }
+    if (getifaddrs(&ifa)) {
+        return (false);
+    }
+
+    for (i = ifa; i && !local; i = i->ifa_next) {
+        local = i->ifa_addr && i->ifa_addr->sa_family == AF_INET &&
+                ((struct sockaddr_in *)i->ifa_addr)->sin_addr.s_addr ==
+                    in->sin_addr.s_addr;
+    }
+    freeifaddrs(ifa);
+    return (local);
+}
+
+static int shm_xport_send(msg_xport_t *x, uint32_t opc,
+                          const struct iovec *iov, int iovcnt) {
+    return (shm_send((shm_ctx_t *)x, opc, iov, iovcnt));
+}
+
+static int shm_xport_recv(msg_xport_t *x, uint32_t *opc, void **data,
+                          uint32_t *len, bool wait) {
+    return (shm_recv((shm_ctx_t *)x, opc, data, len, wait));
+}
+
+static void shm_xport_release(msg_xport_t *x) {
+    shm_release((shm_ctx_t *)x);
+}
+
+static void shm_xport_close(msg_xport_t *x) {
+    shm_ctx_t *shm = (shm_ctx_t *)x;
+    if (shm->server) {
+        shm_server_reset(shm);
+    } else {
+        shm_close(shm);
+    }
+}
+
+// Map the segment of the server at addr, creating it for the server. A
+// client finding none is not an error, it takes the verbs path
+static shm_ctx_t *shm_map(const struct sockaddr *addr, bool server) {
+    const struct sockaddr_in *in = (const struct sockaddr_in *)addr;
+    char ip[INET_ADDRSTRLEN] = {0};
+    struct stat st = {0};
+
+    shm_ctx_t *shm = calloc(1, sizeof(shm_ctx_t));
+    API_NULL(
+        shm, { return (NULL); }, "Unable to allocate shared-memory context\n");
+    inet_ntop(AF_INET, &(in->sin_addr), ip, sizeof(ip));
+    snprintf(shm->name, sizeof(shm->name), "/rdmacs-%s-%u", ip,
+             ntohs(in->sin_port));
+    shm->server = server;
+    shm->xport.name = "shm";
+    shm->xport.tag = "SHM-";
+    shm->xport.max_msg = SHM_SLOT_SZ;
+    shm->xport.send = shm_xport_send;
+    shm->xport.recv = shm_xport_recv;
+    shm->xport.release = shm_xport_release;
+    shm->xport.close = shm_xport_close;
+
+    if (server) {
+        // A server bound to this address before us is gone
+        shm_unlink(shm->name);
+    }
+    int fd = shm_open(shm->name, (server) ? (O_RDWR | O_CREAT | O_EXCL)
+                                          : (O_RDWR),
+                      0600);
+    if (fd < 0) {
+        if (server) {
+            printf("Unable to create shared memory %s. Reason: %s\n",
+                   shm->name, strerror(errno));
+        }
+        free(shm);
+        return (NULL);
+    }
+
+    int rc = (server) ? (ftruncate(fd, sizeof(shm_seg_t))) : (fstat(fd, &st));
+    // A segment of another layout would fault on first touch
+    if (rc || (!server && st.st_size != sizeof(shm_seg_t))) {
+        printf("Unable to size shared memory %s\n", shm->name);
+        close(fd);
+        free(shm);
+        return (NULL);
+    }
+
+    shm->seg = mmap(NULL, sizeof(shm_seg_t), PROT_READ | PROT_WRITE,
+                    MAP_SHARED, fd, 0);
+    close(fd);
+    EXT_API_STATUS(
+        shm->seg == MAP_FAILED,
+        {
+            free(shm);
+            return (NULL);
+        },
+        "Unable to map shared memory %s. Reason: %s\n", shm->name,
+        strerror(errno));
+    shm->tx = (server) ? (&(shm->seg->resp)) : (&(shm->seg->req));
+    shm->rx = (server) ? (&(shm->seg->req)) : (&(shm->seg->resp));
+    return (shm);
+}
+
+shm_ctx_t *shm_server_open(const struct sockaddr *addr) {
+    shm_ctx_t *shm = shm_map(addr, true);
+    if (!shm) {
+        return (NULL);
+    }
+
+    // ftruncate zeroed the rings, the magic tells clients they are ready
+    shm->seg->server_pid = getpid();
+    shm->seg->state = SHM_SEG_FREE;
+    __atomic_store_n(&(shm->seg->magic), SHM_MAGIC, __ATOMIC_RELEASE);
+    printf("Serving same-host clients on shared memory %s\n", shm->name);
+    return (shm);
+}
+
+int shm_server_wait_attach(shm_ctx_t *shm) {
+    uint32_t *word = &(shm->seg->state);
+    uint32_t state = 0;
+
+    while ((state = __atomic_load_n(word, __ATOMIC_ACQUIRE)) ==
+           SHM_SEG_FREE) {
+        syscall(SYS_futex, word, FUTEX_WAIT, SHM_SEG_FREE, NULL, NULL, 0);
+    }
+
+    return ((state == SHM_SEG_ATTACHED) ? (0) : (-1));
+}
+
+void shm_server_reset(shm_ctx_t *shm) {
+    shm_ring_t *rings[2] = {&(shm->seg->req), &(shm->seg->resp)};
+
+    for (int r = 0; r < 2; r++) {
+        rings[r]->tail = 0;
+        rings[r]->rx_parked = 0;
+        rings[r]->tx_parked = 0;
+        for (int i = 0; i < SHM_SLOTS; i++) {
+            rings[r]->slot[i].seq = 0;
+        }
+    }
+    shm->tx_head = 0;
+    shm->tx_tail = 0;
+    shm->rx_next = 0;
+    shm->rx_held = false;
+    shm->rx_miss = 0;
+
+    // A client claims the segment by client_pid, only once it is FREE again
+    __atomic_store_n(&(shm->seg->state), SHM_SEG_FREE, __ATOMIC_RELEASE);
+    __atomic_store_n(&(shm->seg->client_pid), 0, __ATOMIC_RELEASE);
+}
+
+shm_ctx_t *shm_client_attach(const struct sockaddr *addr) {
+    pid_t none = 0;
+
+    shm_ctx_t *shm = shm_map(addr, false);
+    if (!shm) {
+        return (NULL);
+    }
+
+    shm_seg_t *seg = shm->seg;
+    bool ready =
+        __atomic_load_n(&(seg->magic), __ATOMIC_ACQUIRE) == SHM_MAGIC &&
+        __atomic_load_n(&(seg->state), __ATOMIC_ACQUIRE) == SHM_SEG_FREE &&
+        kill(seg->server_pid, 0) == 0;
+    if (!ready || !__atomic_compare_exchange_n(&(seg->client_pid), &none,
+                                               getpid(), false,
+                                               __ATOMIC_ACQ_REL,
+                                               __ATOMIC_RELAXED)) {
+        printf("Shared memory %s is not served or serves pid %d\n",
+               shm->name, seg->client_pid);
+        munmap(seg, sizeof(shm_seg_t));
+        free(shm);
+        return (NULL);
+    }
+
+    __atomic_store_n(&(seg->state), SHM_SEG_ATTACHED, __ATOMIC_RELEASE);
+    shm_futex_wake(&(seg->state));
+    printf("Attached to server pid %d on shared memory %s\n", seg->server_pid,
+           shm->name);
+    return (shm);
+}
+
+int shm_send(shm_ctx_t *shm, uint32_t opc, const struct iovec *iov,
+             int iovcnt) {
+    shm_ring_t *r = shm->tx;
+    size_t len = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        len += iov[i].iov_len;
+    }
+    EXT_API_STATUS(
+        len > SHM_SLOT_SZ, { return (-1); },
+        "Message of %zu bytes exceeds the shared-memory slot of %d bytes\n",
+        len, SHM_SLOT_SZ);
+
+    // Slots come back in order, so this only waits on a full ring
+    while ((shm->tx_head - shm->tx_tail) >= SHM_SLOTS) {
+        uint32_t tail = __atomic_load_n(&(r->tail), __ATOMIC_ACQUIRE);
+        if (tail != shm->tx_tail) {
+            shm->tx_tail = tail;
+        } else if (shm_wait(shm, &(r->tail), tail, &(r->tx_parked))) {
+            return (-1);
+        }
+    }
+
+    shm_slot_t *slot = &(r->slot[shm->tx_head % SHM_SLOTS]);
+    uint8_t *dst = slot->data;
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(dst, iov[i].iov_base, iov[i].iov_len);
+        dst += iov[i].iov_len;
+    }
+    slot->len = len;
+    slot->opc = opc;
+    shm->tx_head++;
+    __atomic_store_n(&(slot->seq), shm->tx_head, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(r->rx_parked), __ATOMIC_RELAXED)) {
+        shm_futex_wake(&(slot->seq));
+    }
+
+    return (0);
+}
+
+int shm_recv(shm_ctx_t *shm, uint32_t *opc, void **data, uint32_t *len,
+             bool wait) {
+    shm_ring_t *r = shm->rx;
+    uint32_t seq = 0;
+
+    shm_release(shm);
+    shm_slot_t *slot = &(r->slot[shm->rx_next % SHM_SLOTS]);
+    while ((seq = __atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE)) !=
+           shm->rx_next + 1) {
+        if (!wait) {
+            // Liveness takes a syscall, a polling caller pays it rarely
+            if (++(shm->rx_miss) < CQ_RING_SPIN) {
+                return (0);
+            }
+            shm->rx_miss = 0;
+            return ((shm_peer_alive(shm)) ? (0) : (-1));
+        }
+
+        if (shm_wait(shm, &(slot->seq), seq, &(r->rx_parked))) {
+            return (-1);
+        }
+    }
+
+    *opc = slot->opc;
+    *data = slot->data;
+    *len = slot->len;
+    shm->rx_held = true;
+    return (1);
+}
+
+void shm_release(shm_ctx_t *shm) {
+    shm_ring_t *r = shm->rx;
+    if (!shm->rx_held) {
+        return;
+    }
+
+    shm->rx_held = false;
+    shm->rx_next++;
+    __atomic_store_n(&(r->tail), shm->rx_next, __ATOMIC_RELEASE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&(r->tx_parked), __ATOMIC_RELAXED)) {
+        shm_futex_wake(&(r->tail));
+    }
+}
+
+void shm_close(shm_ctx_t *shm) {
+    if (!shm) {
+        return;
+    }
+
+    __atomic_store_n(&(shm->seg->state), SHM_SEG_CLOSED, __ATOMIC_RELEASE);
+    shm_futex_wake(&(shm->seg->state));
+    if (shm->server) {
+        shm_unlink(shm->name);
+    }
+}
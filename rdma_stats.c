@@ -0,0 +1,269 @@
+#include "rdma_stats.h"
+#include "client_server_shared.h"
+#include "rdma_core.h"
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define STATS_LINE_SZ 1024
+
+// Connections of the process, until rdma_stats_unregister
+static pthread_mutex_t stats_mtx = PTHREAD_MUTEX_INITIALIZER;
+static rdma_stats_set_t *stats_sets[MAX_STATS_SETS];
+static uint32_t nstats_sets = 0;
+
+int rdma_stats_set_init(rdma_stats_set_t *set, const char *name) {
+    memset(set, 0, sizeof(rdma_stats_set_t));
+    snprintf(set->name, sizeof(set->name), "%s", name);
+    return (pthread_mutex_init(&(set->mtx), NULL) ? -1 : 0);
+}
+
+int rdma_stats_register(rdma_stats_set_t *set) {
+    pthread_mutex_lock(&stats_mtx);
+    int rc = (nstats_sets < MAX_STATS_SETS) ? (0) : (-1);
+    if (rc == 0) {
+        stats_sets[nstats_sets++] = set;
+    }
+    pthread_mutex_unlock(&stats_mtx);
+    EXT_API_STATUS(
+        rc, { return (-1); }, "Unable to report more than %d connections\n",
+        MAX_STATS_SETS);
+    return (0);
+}
+
+void rdma_stats_unregister(rdma_stats_set_t *set) {
+    pthread_mutex_lock(&stats_mtx);
+    for (uint32_t i = 0; i < nstats_sets; i++) {
+        if (stats_sets[i] == set) {
+            stats_sets[i] = stats_sets[--nstats_sets];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stats_mtx);
+}
+
+void rdma_stats_set_free(rdma_stats_set_t *set) {
+    for (uint32_t b = 0; b < set->nblock; b++) {
+        free(set->block[b]);
+    }
+    set->nblock = 0;
+    pthread_mutex_destroy(&(set->mtx));
+}
+
+rdma_stats_t *rdma_stats_new(rdma_stats_set_t *set, const cq_ring_t *ring) {
+    rdma_stats_t *s = aligned_alloc(CACHE_LINE_SZ, sizeof(rdma_stats_t));
+    API_NULL(
+        s, { return (NULL); }, "Unable to allocate counters\n");
+    memset(s, 0, sizeof(rdma_stats_t));
+    s->ring = ring;
+
+    pthread_mutex_lock(&(set->mtx));
+    if (set->nblock < MAX_STATS_BLOCKS) {
+        set->block[set->nblock++] = s;
+    }
+    pthread_mutex_unlock(&(set->mtx));
+    // Beyond MAX_STATS_BLOCKS the thread still counts, nobody reports it
+    return (s);
+}
+
+void rdma_stats_snap(rdma_stats_set_t *set, rdma_stats_snap_t *snap) {
+    uint64_t *sum = (uint64_t *)&(snap->sum);
+    size_t nctr = sizeof(rdma_ctr_t) / sizeof(uint64_t);
+
+    memset(snap, 0, sizeof(rdma_stats_snap_t));
+    pthread_mutex_lock(&(set->mtx));
+    for (uint32_t b = 0; b < set->nblock; b++) {
+        const uint64_t *ctr = (const uint64_t *)&(set->block[b]->ctr);
+        for (size_t i = 0; i < nctr; i++) {
+            sum[i] += __atomic_load_n(&ctr[i], __ATOMIC_RELAXED);
+        }
+
+        // Read from this thread only, the ring lines bounce once per snap
+        const cq_ring_t *r = set->block[b]->ring;
+        if (r) {
+            uint32_t head = __atomic_load_n(&(r->head), __ATOMIC_RELAXED);
+            uint32_t tail = __atomic_load_n(&(r->tail), __ATOMIC_RELAXED);
+            snap->ring_backlog += head - tail;
+        }
+    }
+    pthread_mutex_unlock(&(set->mtx));
+}
+
+int rdma_stats_format(char *buf, size_t len, const char *name,
+                      const rdma_stats_snap_t *snap) {
+    const rdma_ctr_t *c = &(snap->sum);
+    return (snprintf(buf, len,
+                     "%s tx_msgs=%lu tx_bytes=%lu rx_posted=%lu rx_msgs=%lu "
+                     "rx_bytes=%lu post_err=%lu cqe=%lu cqe_err=%lu "
+                     "rnr_err=%lu flush_err=%lu poll_hit=%lu poll_miss=%lu "
+                     "ring_backlog=%lu post_n=%lu post_cyc=%lu poll_cyc=%lu\n",
+                     name, c->tx_msgs, c->tx_bytes, c->rx_posted, c->rx_msgs,
+                     c->rx_bytes, c->post_err, c->cqe, c->cqe_err, c->rnr_err,
+                     c->flush_err, c->poll_hit, c->poll_miss,
+                     snap->ring_backlog, c->post_n, c->post_cyc, c->poll_cyc));
+}
+
+// One line per connection with the rates since the previous one
+static void stats_print(uint64_t interval_nsec) {
+    char line[STATS_LINE_SZ];
+    double sec = (double)interval_nsec / NSEC_TO_SEC;
+
+    // A set is not unregistered while it is walked
+    pthread_mutex_lock(&stats_mtx);
+    for (uint32_t i = 0; i < nstats_sets; i++) {
+        rdma_stats_set_t *set = stats_sets[i];
+        rdma_stats_snap_t snap = {0};
+        rdma_stats_snap(set, &snap);
+        rdma_stats_format(line, sizeof(line), set->name, &snap);
+        printf("[STATS] tx_rate=%.0f rx_rate=%.0f %s",
+               (double)(snap.sum.tx_msgs - set->last.sum.tx_msgs) / sec,
+               (double)(snap.sum.rx_msgs - set->last.sum.rx_msgs) / sec, line);
+        set->last = snap;
+    }
+    pthread_mutex_unlock(&stats_mtx);
+    fflush(stdout);
+}
+
+// Lines of every connection, then their total
+static void stats_answer(int fd) {
+    char line[STATS_LINE_SZ];
+    rdma_stats_snap_t total = {0};
+    uint64_t *sum = (uint64_t *)&(total.sum);
+    size_t nctr = sizeof(rdma_ctr_t) / sizeof(uint64_t);
+
+    pthread_mutex_lock(&stats_mtx);
+    for (uint32_t i = 0; i < nstats_sets; i++) {
+        rdma_stats_snap_t snap = {0};
+        const uint64_t *ctr = (const uint64_t *)&(snap.sum);
+        rdma_stats_snap(stats_sets[i], &snap);
+        for (size_t c = 0; c < nctr; c++) {
+            sum[c] += ctr[c];
+        }
+        total.ring_backlog += snap.ring_backlog;
+
+        int n = rdma_stats_format(line, sizeof(line), stats_sets[i]->name,
+                                  &snap);
+        if (write(fd, line, n) != n) {
+            pthread_mutex_unlock(&stats_mtx);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&stats_mtx);
+
+    int n = rdma_stats_format(line, sizeof(line), "total", &total);
+    if (write(fd, line, n) != n) {
+        return;
+    }
+}
+
+static int stats_listen(const char *sock_path) {
+    struct sockaddr_un addr = {0};
+
+    EXT_API_STATUS(
+        strlen(sock_path) >= sizeof(addr.sun_path), { return (-1); },
+        "Stats socket path %s is too long\n", sock_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    API_STATUS(
+        fd, { return (-1); }, "Unable to create stats socket. Reason: %s\n",
+        strerror(errno));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, sock_path);
+    // A previous run may have left its socket behind
+    unlink(sock_path);
+    API_STATUS(
+        bind(fd, (struct sockaddr *)&addr, sizeof(addr)),
+        {
+            close(fd);
+            return (-1);
+        },
+        "Unable to bind stats socket %s. Reason: %s\n", sock_path,
+        strerror(errno));
+    API_STATUS(
+        listen(fd, 4),
+        {
+            close(fd);
+            return (-1);
+        },
+        "Unable to listen on stats socket %s. Reason: %s\n", sock_path,
+        strerror(errno));
+    return (fd);
+}
+
+typedef struct stats_thread_arg_s {
+    uint64_t interval_nsec;
+    int fd;
+} stats_thread_arg_t;
+
+static void *stats_monitor(void *arg) {
+    stats_thread_arg_t a = *(stats_thread_arg_t *)arg;
+    struct pollfd pfd = {.fd = a.fd, .events = POLLIN};
+    uint64_t next = cq_ring_now() + a.interval_nsec;
+    free(arg);
+
+    while (1) {
+        int timeout = -1;
+        if (a.interval_nsec) {
+            uint64_t now = cq_ring_now();
+            timeout = (next > now) ? (int)((next - now) / 1000000) : (0);
+        }
+
+        // Without a socket, poll only sleeps until the next line is due
+        int rc = poll(&pfd, (a.fd >= 0) ? (1) : (0), timeout);
+        if (rc > 0 && (pfd.revents & POLLIN)) {
+            int cfd = accept(a.fd, NULL, NULL);
+            if (cfd >= 0) {
+                stats_answer(cfd);
+                close(cfd);
+            }
+        }
+
+        if (a.interval_nsec && cq_ring_now() >= next) {
+            stats_print(a.interval_nsec);
+            next += a.interval_nsec;
+        }
+    }
+
+    return (NULL);
+}
+
+int rdma_stats_start(uint64_t interval_nsec, const char *sock_path) {
+    pthread_t thread;
+
+    if (!interval_nsec && !sock_path) {
+        return (0);
+    }
+
+    stats_thread_arg_t *a = calloc(1, sizeof(stats_thread_arg_t));
+    API_NULL(
+        a, { return (-1); }, "Unable to allocate stats thread state\n");
+    a->interval_nsec = interval_nsec;
+    a->fd = -1;
+    if (sock_path) {
+        a->fd = stats_listen(sock_path);
+        API_STATUS(
+            a->fd,
+            {
+                free(a);
+                return (-1);
+            },
+            "Unable to open stats socket\n");
+    }
+
+    API_STATUS(
+        rdma_start_thread(&thread, stats_monitor, a),
+        {
+            if (a->fd >= 0) {
+                close(a->fd);
+            }
+            free(a);
+            return (-1);
+        },
+        "Unable to create stats thread\n");
+    return (0);
+}
@@ -0,0 +1,496 @@
+#include "rdma_tcp.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define TCP_UD_SEND 1
+#define TCP_UD_RECV 2
+
+static int tcp_send(msg_xport_t *x, uint32_t opc, const struct iovec *iov,
+                    int iovcnt);
+static int tcp_recv(msg_xport_t *x, uint32_t *opc, void **data, uint32_t *len,
+                    bool wait);
+static void tcp_release(msg_xport_t *x);
+static void tcp_close(msg_xport_t *x);
+
+// Largest frame on the stream
+static const size_t tcp_frame_max = sizeof(tcp_hdr_t) + MAX_MR_SZ;
+
+static int tcp_uring_setup(tcp_ctx_t *t) {
+    struct iovec reg = {0};
+
+    if (uring_init(&(t->ring), TCP_URING_ENTRIES)) {
+        t->ring.fd = -1;
+        return (-1);
+    }
+
+    t->tx_buf = mmap(NULL, tcp_frame_max, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    EXT_API_STATUS(
+        t->tx_buf == MAP_FAILED,
+        {
+            t->tx_buf = NULL;
+            return (-1);
+        },
+        "Unable to allocate io_uring send buffer. Reason: %s\n",
+        strerror(errno));
+    reg.iov_base = t->tx_buf;
+    reg.iov_len = tcp_frame_max;
+    if (uring_register_buffers(&(t->ring), &reg, 1)) {
+        return (-1);
+    }
+
+    return (uring_provide_bufs(&(t->ring), 0, TCP_URING_BUFS,
+                               TCP_URING_BUF_SZ));
+}
+
+static tcp_ctx_t *tcp_new(int fd, bool server, bool uring) {
+    int one = 1;
+
+    tcp_ctx_t *t = calloc(1, sizeof(tcp_ctx_t));
+    API_NULL(
+        t,
+        {
+            close(fd);
+            return (NULL);
+        },
+        "Unable to allocate TCP context\n");
+    t->fd = fd;
+    t->server = server;
+    t->uring = uring;
+    t->ring.fd = -1;
+    t->xport.name = (uring) ? ("uring") : ("tcp");
+    t->xport.tag = (uring) ? ("URING-") : ("TCP-");
+    t->xport.max_msg = MAX_MR_SZ;
+    t->xport.send = tcp_send;
+    t->xport.recv = tcp_recv;
+    t->xport.release = tcp_release;
+    t->xport.close = tcp_close;
+
+    // Room for a frame short of complete plus what one read brings in,
+    // more only if the peer runs ahead
+    t->rx_sz = tcp_frame_max + TCP_URING_BUF_SZ;
+    t->rx_buf = malloc(t->rx_sz);
+    API_NULL(
+        t->rx_buf,
+        {
+            tcp_close(&(t->xport));
+            return (NULL);
+        },
+        "Unable to allocate TCP receive buffer\n");
+    // Small messages are the latency test, do not hold them back
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (uring && tcp_uring_setup(t)) {
+        tcp_close(&(t->xport));
+        return (NULL);
+    }
+
+    return (t);
+}
+
+int tcp_listen(const struct sockaddr *addr) {
+    int one = 1;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    API_STATUS(
+        fd, { return (-1); }, "Unable to create TCP socket. Reason: %s\n",
+        strerror(errno));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    int rc = bind(fd, addr, sizeof(struct sockaddr_in));
+    if (!rc) {
+        rc = listen(fd, 1);
+    }
+    API_STATUS(
+        rc,
+        {
+            close(fd);
+            return (-1);
+        },
+        "Unable to listen on TCP socket. Reason: %s\n", strerror(errno));
+    return (fd);
+}
+
+tcp_ctx_t *tcp_accept(int lfd, bool uring) {
+    int fd = -1;
+
+    do {
+        fd = accept(lfd, NULL, NULL);
+    } while (fd < 0 && errno == EINTR);
+    API_STATUS(
+        fd, { return (NULL); }, "Unable to accept TCP client. Reason: %s\n",
+        strerror(errno));
+    return (tcp_new(fd, true, uring));
+}
+
+tcp_ctx_t *tcp_connect(const struct sockaddr *src, const struct sockaddr *dst,
+                       bool uring) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    API_STATUS(
+        fd, { return (NULL); }, "Unable to create TCP socket. Reason: %s\n",
+        strerror(errno));
+
+    if (src) {
+        // Pin the source address, the kernel picks the port
+        struct sockaddr_in in = *(const struct sockaddr_in *)src;
+        in.sin_port = 0;
+        API_STATUS(
+            bind(fd, (struct sockaddr *)&in, sizeof(in)),
+            {
+                close(fd);
+                return (NULL);
+            },
+            "Unable to bind TCP socket. Reason: %s\n", strerror(errno));
+    }
+    API_STATUS(
+        connect(fd, dst, sizeof(struct sockaddr_in)),
+        {
+            close(fd);
+            return (NULL);
+        },
+        "Unable to connect TCP socket. Reason: %s\n", strerror(errno));
+    return (tcp_new(fd, false, uring));
+}
+
+// Make room for need more bytes behind the unread ones, moving them to the
+// front first and growing rx_buf if a sender runs ahead of us. Only called
+// with no message handed out
+static int tcp_reserve(tcp_ctx_t *t, size_t need) {
+    if (t->rx_off + t->rx_len + need <= t->rx_sz) {
+        return (0);
+    }
+
+    memmove(t->rx_buf, t->rx_buf + t->rx_off, t->rx_len);
+    t->rx_off = 0;
+    if (t->rx_len + need <= t->rx_sz) {
+        return (0);
+    }
+
+    size_t sz = t->rx_sz;
+    while (sz < t->rx_len + need) {
+        sz *= 2;
+    }
+    uint8_t *buf = realloc(t->rx_buf, sz);
+    API_NULL(
+        buf,
+        {
+            t->rx_eof = true;
+            return (-1);
+        },
+        "Unable to grow TCP receive buffer to %zu bytes\n", sz);
+    t->rx_buf = buf;
+    t->rx_sz = sz;
+    return (0);
+}
+
+// One read of whatever the stream has, returning -1 once the peer is gone
+static int tcp_read(tcp_ctx_t *t, bool wait) {
+    ssize_t n = 0;
+
+    if (tcp_reserve(t, TCP_URING_BUF_SZ)) {
+        return (-1);
+    }
+    do {
+        n = recv(t->fd, t->rx_buf + t->rx_off + t->rx_len,
+                 t->rx_sz - t->rx_off - t->rx_len,
+                 (wait) ? (0) : (MSG_DONTWAIT));
+    } while (n < 0 && errno == EINTR);
+    if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return (0);
+    }
+    if (n <= 0) {
+        t->rx_eof = true;
+        return (-1);
+    }
+
+    t->rx_len += n;
+    return (0);
+}
+
+// Both ends may block on sends at once, e.g. a window of large requests
+// against their echoes. An end holding no message reads while it waits, so
+// one of them always drains the other
+static int tcp_send_plain(tcp_ctx_t *t, struct iovec *v, int vcnt) {
+    struct msghdr msg = {0};
+    struct pollfd pfd = {.fd = t->fd};
+    bool drain = !t->rx_held;
+
+    while (vcnt) {
+        msg.msg_iov = v;
+        msg.msg_iovlen = vcnt;
+        ssize_t n = sendmsg(t->fd, &msg,
+                            MSG_NOSIGNAL | ((drain) ? (MSG_DONTWAIT) : (0)));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0 && drain && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            pfd.events = POLLOUT | ((t->rx_eof) ? (0) : (POLLIN));
+            poll(&pfd, 1, -1);
+            if (pfd.revents & POLLIN) {
+                tcp_read(t, false);
+            }
+            continue;
+        }
+        API_STATUS(
+            n, { return (-1); }, "Unable to write TCP socket. Reason: %s\n",
+            strerror(errno));
+
+        // Skip what went out, a short write resumes mid-iovec
+        while (vcnt && (size_t)n >= v->iov_len) {
+            n -= v->iov_len;
+            v++;
+            vcnt--;
+        }
+        if (vcnt) {
+            v->iov_base = (uint8_t *)v->iov_base + n;
+            v->iov_len -= n;
+        }
+    }
+
+    return (0);
+}
+
+static int tcp_uring_arm(tcp_ctx_t *t) {
+    struct io_uring_sqe *sqe = uring_get_sqe(&(t->ring));
+    API_NULL(
+        sqe, { return (-1); }, "io_uring submission ring is full\n");
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = t->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = t->ring.bgid;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = TCP_UD_RECV;
+    t->rx_armed = true;
+    return (0);
+}
+
+// Take one receive completion: its bytes move to rx_buf and the buffer goes
+// back to the kernel. The multishot ends on errors, EOF and running out of
+// buffers, the last only until the next receive re-arms it
+static void tcp_uring_take(tcp_ctx_t *t, const struct io_uring_cqe *cqe) {
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        t->rx_armed = false;
+    }
+
+    if (cqe->res > 0) {
+        uint16_t bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+        if (!tcp_reserve(t, cqe->res)) {
+            memcpy(t->rx_buf + t->rx_off + t->rx_len,
+                   uring_buf(&(t->ring), bid), cqe->res);
+            t->rx_len += cqe->res;
+        }
+        uring_recycle_buf(&(t->ring), bid);
+    } else if (cqe->res == 0) {
+        t->rx_eof = true;
+    } else if (cqe->res != -ENOBUFS) {
+        printf("Unable to read TCP socket over io_uring. Reason: %s\n",
+               strerror(-(cqe->res)));
+        t->rx_eof = true;
+    }
+}
+
+// Receive completions reaped while a message is handed out wait here, in
+// their provided buffers, until it is released
+static void tcp_uring_stash(tcp_ctx_t *t, const struct io_uring_cqe *cqe) {
+    uint32_t cap = TCP_URING_BUFS + 1;
+    t->rx_stash[(t->stash_head + t->stash_cnt) % cap] = *cqe;
+    t->stash_cnt++;
+}
+
+static void tcp_uring_unstash(tcp_ctx_t *t) {
+    while (t->stash_cnt) {
+        tcp_uring_take(t, &(t->rx_stash[t->stash_head]));
+        t->stash_head = (t->stash_head + 1) % (TCP_URING_BUFS + 1);
+        t->stash_cnt--;
+    }
+}
+
+static int tcp_send_uring(tcp_ctx_t *t, const struct iovec *v, int vcnt) {
+    uring_t *u = &(t->ring);
+    size_t len = 0, off = 0;
+    bool drain = !t->rx_held;
+
+    // The payload goes out of the registered buffer, no page pinning per
+    // write
+    for (int i = 0; i < vcnt; i++) {
+        memcpy(t->tx_buf + len, v[i].iov_base, v[i].iov_len);
+        len += v[i].iov_len;
+    }
+    // Same as the plain engine, an end holding no message drains the peer
+    if (drain) {
+        tcp_uring_unstash(t);
+        if (!t->rx_armed && !t->rx_eof && tcp_uring_arm(t)) {
+            return (-1);
+        }
+    }
+
+    while (off < len) {
+        struct io_uring_sqe *sqe = uring_get_sqe(u);
+        API_NULL(
+            sqe, { return (-1); }, "io_uring submission ring is full\n");
+        sqe->opcode = IORING_OP_WRITE_FIXED;
+        sqe->fd = t->fd;
+        sqe->addr = (uint64_t)(t->tx_buf + off);
+        sqe->len = len - off;
+        sqe->buf_index = 0;
+        sqe->user_data = TCP_UD_SEND;
+        t->tx_done = false;
+
+        while (!t->tx_done) {
+            if (uring_enter(u, 1) < 0) {
+                return (-1);
+            }
+
+            struct io_uring_cqe *cqe = NULL;
+            while ((cqe = uring_peek_cqe(u))) {
+                if (cqe->user_data == TCP_UD_SEND) {
+                    t->tx_res = cqe->res;
+                    t->tx_done = true;
+                } else if (drain) {
+                    tcp_uring_take(t, cqe);
+                } else {
+                    tcp_uring_stash(t, cqe);
+                }
+                uring_cqe_seen(u);
+            }
+        }
+
+        EXT_API_STATUS(
+            t->tx_res <= 0, { return (-1); },
+            "Unable to write TCP socket over io_uring. Reason: %s\n",
+            strerror(-(t->tx_res)));
+        off += t->tx_res;
+    }
+
+    return (0);
+}
+
+static int tcp_send(msg_xport_t *x, uint32_t opc, const struct iovec *iov,
+                    int iovcnt) {
+    tcp_ctx_t *t = (tcp_ctx_t *)x;
+    struct iovec v[RDMA_MAX_SGE + 1];
+    tcp_hdr_t hdr = {.opc = opc, .len = 0};
+
+    EXT_API_STATUS(
+        iovcnt > RDMA_MAX_SGE, { return (-1); },
+        "Message of %d segments exceeds %d\n", iovcnt, RDMA_MAX_SGE);
+    for (int i = 0; i < iovcnt; i++) {
+        hdr.len += iov[i].iov_len;
+        v[i + 1] = iov[i];
+    }
+    EXT_API_STATUS(
+        hdr.len > x->max_msg, { return (-1); },
+        "Message of %u bytes exceeds the %s limit of %u bytes\n", hdr.len,
+        x->name, x->max_msg);
+    v[0].iov_base = &hdr;
+    v[0].iov_len = sizeof(hdr);
+
+    return ((t->uring) ? (tcp_send_uring(t, v, iovcnt + 1))
+                       : (tcp_send_plain(t, v, iovcnt + 1)));
+}
+
+// Bring in more of the stream, returning -1 once the peer is gone
+static int tcp_fill(tcp_ctx_t *t, bool wait) {
+    uring_t *u = &(t->ring);
+    struct io_uring_cqe *cqe = NULL;
+    size_t len = t->rx_len;
+
+    if (!t->uring) {
+        return (tcp_read(t, wait));
+    }
+
+    tcp_uring_unstash(t);
+    while (t->rx_len == len && !t->rx_eof) {
+        if ((cqe = uring_peek_cqe(u))) {
+            tcp_uring_take(t, cqe);
+            uring_cqe_seen(u);
+            continue;
+        }
+
+        if (!t->rx_armed && tcp_uring_arm(t)) {
+            return (-1);
+        }
+        if (uring_enter(u, (wait) ? (1) : (0)) < 0) {
+            t->rx_eof = true;
+        }
+        if (!wait && !uring_peek_cqe(u)) {
+            return (0);
+        }
+    }
+
+    return ((t->rx_eof && t->rx_len == len) ? (-1) : (0));
+}
+
+static int tcp_recv(msg_xport_t *x, uint32_t *opc, void **data, uint32_t *len,
+                    bool wait) {
+    tcp_ctx_t *t = (tcp_ctx_t *)x;
+    tcp_hdr_t hdr = {0};
+
+    tcp_release(x);
+    while (1) {
+        if (t->rx_len >= sizeof(hdr)) {
+            memcpy(&hdr, t->rx_buf + t->rx_off, sizeof(hdr));
+            EXT_API_STATUS(
+                hdr.len > x->max_msg,
+                {
+                    t->rx_eof = true;
+                    return (-1);
+                },
+                "Frame of %u bytes exceeds the %s limit of %u bytes\n",
+                hdr.len, x->name, x->max_msg);
+            if (t->rx_len >= sizeof(hdr) + hdr.len) {
+                break;
+            }
+        }
+        if (t->rx_eof) {
+            return (-1);
+        }
+
+        size_t have = t->rx_len;
+        if (tcp_fill(t, wait)) {
+            return (-1);
+        }
+        if (t->rx_len == have) {
+            return (0);
+        }
+    }
+
+    *opc = hdr.opc;
+    *data = t->rx_buf + t->rx_off + sizeof(hdr);
+    *len = hdr.len;
+    t->rx_held = sizeof(hdr) + hdr.len;
+    return (1);
+}
+
+static void tcp_release(msg_xport_t *x) {
+    tcp_ctx_t *t = (tcp_ctx_t *)x;
+
+    t->rx_off += t->rx_held;
+    t->rx_len -= t->rx_held;
+    t->rx_held = 0;
+    if (!t->rx_len) {
+        t->rx_off = 0;
+    }
+}
+
+static void tcp_close(msg_xport_t *x) {
+    tcp_ctx_t *t = (tcp_ctx_t *)x;
+
+    close(t->fd);
+    if (t->ring.fd >= 0) {
+        uring_destroy(&(t->ring));
+    }
+    if (t->tx_buf) {
+        munmap(t->tx_buf, tcp_frame_max);
+    }
+    free(t->rx_buf);
+    free(t);
+}
@@ -0,0 +1,579 @@
+#include "rdma_ud.h"
+#include "client_server_shared.h"
+#include "completion_ring.h"
+#include "rdma_core.h"
+#include <errno.h>
+#include <pthread.h>
+#include <rdma/rdma_cma.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#define UD_POLL_BATCH 32
+
+// Wait for the next CM event of a client, which must be the expected one.
+// The caller acks it once the event parameters are consumed
+static int ud_wait_event(ud_ctx_t *ctx, enum rdma_cm_event_type expected,
+                         struct rdma_cm_event **event) {
+    int rc = rdma_get_cm_event(ctx->channel, event);
+    API_STATUS(
+        rc, { return (-1); }, "Invalid RDMA CM Event. Reason: %s\n",
+        strerror(errno));
+    printf("Got RDMA CM Event: %s\n", rdma_event_str((*event)->event));
+    if ((*event)->event != expected) {
+        printf("Expected RDMA CM Event: %s, Status: %d\n",
+               rdma_event_str(expected), (*event)->status);
+        rdma_ack_cm_event(*event);
+        return (-1);
+    }
+
+    return (0);
+}
+
+static int ud_post_slot(ud_ctx_t *ctx, uint32_t slot) {
+    struct ibv_recv_wr recv_wr = {0}, *recv_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+
+    // The GRH, present or not, always takes the first UD_GRH_SZ bytes
+    sge.addr = (uint64_t)ctx->slots + (uint64_t)slot * ctx->slot_sz;
+    sge.length = ctx->slot_sz;
+    sge.lkey = ctx->slot_mr->lkey;
+    recv_wr.wr_id = slot;
+    recv_wr.next = NULL;
+    recv_wr.sg_list = &sge;
+    recv_wr.num_sge = 1;
+    int rc = ibv_post_recv(ctx->qp, &recv_wr, &recv_bad_wr);
+    API_STATUS(
+        rc, { return (-1); }, "Unable to post UD recv slot. Reason: %s\n",
+        strerror(errno));
+    return (0);
+}
+
+// PD, CQ and QP on the device cm_id is bound to, then the receive slots
+static int ud_prepare(ud_ctx_t *ctx, uint32_t nslots) {
+    struct ibv_qp_init_attr qp_attr = {0};
+    struct ibv_port_attr port_attr = {0};
+    int rc = 0;
+
+    ctx->verbs = ctx->cm_id->verbs;
+    ctx->port_num = ctx->cm_id->port_num;
+    rc = ibv_query_port(ctx->verbs, ctx->port_num, &port_attr);
+    EXT_API_STATUS(
+        rc, { return (-1); }, "Unable to query RDMA port. Reason: %s\n",
+        strerror(rc));
+    // A UD message is a single packet
+    ctx->mtu = 128 << port_attr.active_mtu;
+
+    ctx->pd = ibv_alloc_pd(ctx->verbs);
+    API_NULL(
+        ctx->pd, { return (-1); },
+        "Unable to alloc RDMA Protection Domain. Reason: %s\n",
+        strerror(errno));
+    ctx->cq = ibv_create_cq(ctx->verbs, 2 * nslots, NULL, NULL, 0);
+    API_NULL(
+        ctx->cq, { return (-1); },
+        "Unable to create RDMA CQ of size %u entries. Reason: %s\n",
+        2 * nslots, strerror(errno));
+
+    qp_attr.cap.max_send_wr = nslots;
+    qp_attr.cap.max_recv_wr = nslots;
+    qp_attr.cap.max_send_sge = 1;
+    qp_attr.cap.max_recv_sge = 1;
+    qp_attr.qp_type = IBV_QPT_UD;
+    qp_attr.sq_sig_all = 0;
+    qp_attr.send_cq = ctx->cq;
+    qp_attr.recv_cq = ctx->cq;
+    // RDMA CM moves a UD QP to RTS with the RDMA_UDP_QKEY of the port space
+    rc = rdma_create_qp(ctx->cm_id, ctx->pd, &qp_attr);
+    API_STATUS(
+        rc, { return (-1); }, "Unable to create UD QP. Reason: %s\n",
+        strerror(errno));
+    ctx->qp = ctx->cm_id->qp;
+
+    ctx->nslots = nslots;
+    ctx->slot_sz = UD_GRH_SZ + ctx->mtu;
+    ctx->slots = mmap(NULL, nslots * ctx->slot_sz, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    EXT_API_STATUS(
+        ctx->slots == MAP_FAILED,
+        {
+            ctx->slots = NULL;
+            return (-1);
+        },
+        "Unable to allocate UD recv slots. Reason: %s\n", strerror(errno));
+    ctx->slot_mr = ibv_reg_mr(ctx->pd, ctx->slots, nslots * ctx->slot_sz,
+                              IBV_ACCESS_LOCAL_WRITE);
+    API_NULL(
+        ctx->slot_mr, { return (-1); },
+        "Unable to register UD recv slots with RDMA. Reason: %s\n",
+        strerror(errno));
+
+    for (uint32_t s = 0; s < nslots; s++) {
+        API_STATUS(
+            ud_post_slot(ctx, s), { return (-1); },
+            "Unable to post UD recv slots\n");
+    }
+
+    return (0);
+}
+
+static void *ud_server_event_monitor(void *arg) {
+    ud_ctx_t *ctx = (ud_ctx_t *)(arg);
+    struct rdma_cm_event *event = NULL;
+    struct rdma_conn_param conn_param = {0};
+    struct rdma_cm_id *id = NULL;
+    int rc = 0;
+
+    // Every client is answered with the one server QP, its cm_id is not
+    // needed past the reply
+    conn_param.qp_num = ctx->qp->qp_num;
+    while (1) {
+        rc = rdma_get_cm_event(ctx->channel, &event);
+        API_STATUS(
+            rc, { return (NULL); }, "Invalid RDMA CM Event. Reason: %s\n",
+            strerror(errno));
+        if (event->event != RDMA_CM_EVENT_CONNECT_REQUEST) {
+            printf("Got RDMA CM Event: %s\n", rdma_event_str(event->event));
+            rdma_ack_cm_event(event);
+            continue;
+        }
+
+        id = event->id;
+        rc = rdma_accept(id, &conn_param);
+        API_STATUS(
+            rc, {}, "Unable to answer UD resolution. Reason: %s\n",
+            strerror(errno));
+        rdma_ack_cm_event(event);
+        rdma_destroy_id(id);
+    }
+
+    return (NULL);
+}
+
+ud_ctx_t *ud_setup_server(struct sockaddr *addr) {
+    int rc = 0;
+
+    ud_ctx_t *ctx = calloc(1, sizeof(ud_ctx_t));
+    API_NULL(
+        ctx, { return (NULL); }, "Unable to allocate UD server context\n");
+    ctx->peers = calloc(UD_MAX_PEERS, sizeof(ud_peer_t));
+    API_NULL(
+        ctx->peers, { goto free_ctx; }, "Unable to allocate UD peer cache\n");
+
+    ctx->channel = rdma_create_event_channel();
+    API_NULL(
+        ctx->channel, { goto free_ctx; },
+        "Unable to create RDMA event channel. Reason: %s\n", strerror(errno));
+    rc = rdma_create_id(ctx->channel, &(ctx->cm_id), NULL, RDMA_PS_UDP);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to create RDMA UDP ID. Reason: %s\n", strerror(errno));
+
+    // Binding to an IP binds the listen id to its device, the QP lives there
+    rc = rdma_bind_addr(ctx->cm_id, addr);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to bind RDMA device IP: %s. Reason: %s\n", SKADDR_TO_IP(addr),
+        strerror(errno));
+    API_NULL(
+        ctx->cm_id->verbs, { goto free_ctx; },
+        "UD server must listen on the IP of an RDMA device\n");
+    API_STATUS(
+        ud_prepare(ctx, UD_SERVER_SLOTS), { goto free_ctx; },
+        "Unable to prepare UD server QP\n");
+    ctx->slot_ah = calloc(ctx->nslots, sizeof(ud_ah_t *));
+    API_NULL(
+        ctx->slot_ah, { goto free_ctx; },
+        "Unable to allocate UD echo address handles\n");
+
+    rc = rdma_listen(ctx->cm_id, MAX_PENDING_CONNECTIONS);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to listen for UD resolutions on IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(addr), strerror(errno));
+
+    rc = rdma_start_thread(&(ctx->evt_thread), ud_server_event_monitor,
+                           (void *)ctx);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to create RDMA event channel monitor\n");
+
+    printf("UD server QP %u listening on %s, MTU: %u bytes\n",
+           ctx->qp->qp_num, SKADDR_TO_IP(addr), ctx->mtu);
+    return (ctx);
+
+free_ctx:
+    ud_destroy(ctx);
+    return (NULL);
+}
+
+// Drop a reference, the handle goes once no echo or cache entry holds it
+static void ud_ah_put(ud_ah_t *a) {
+    if (a && --a->refs == 0) {
+        ibv_destroy_ah(a->ah);
+        free(a);
+    }
+}
+
+// Address handle of the request source, created on the first request
+static ud_peer_t *ud_lookup_peer(ud_ctx_t *ctx, const struct ibv_wc *wc,
+                                 const struct ibv_grh *grh) {
+    union ibv_gid gid = {0};
+    if (wc->wc_flags & IBV_WC_GRH) {
+        gid = grh->sgid;
+    }
+
+    uint64_t h = ((uint64_t)wc->src_qp << 16) ^ wc->slid ^
+                 gid.global.interface_id ^ gid.global.subnet_prefix;
+    h *= 0x9E3779B97F4A7C15ULL;
+    uint32_t idx = (uint32_t)(h >> 32) % UD_MAX_PEERS;
+    for (uint32_t n = 0; n < UD_MAX_PEERS; n++) {
+        ud_peer_t *p = &(ctx->peers[(idx + n) % UD_MAX_PEERS]);
+        if (p->qp_num == 0) {
+            break;
+        }
+        if (p->qp_num == wc->src_qp && p->lid == wc->slid &&
+            memcmp(&(p->gid), &gid, sizeof(gid)) == 0) {
+            return (p);
+        }
+    }
+
+    // Full cache: the peer this one hashes to is resolved again if it returns
+    ud_peer_t *p = &(ctx->peers[idx]);
+    for (uint32_t n = 0; n < UD_MAX_PEERS && ctx->npeers < UD_MAX_PEERS;
+         n++) {
+        if (ctx->peers[(idx + n) % UD_MAX_PEERS].qp_num == 0) {
+            p = &(ctx->peers[(idx + n) % UD_MAX_PEERS]);
+            break;
+        }
+    }
+
+    ud_ah_t *a = malloc(sizeof(ud_ah_t));
+    API_NULL(
+        a, { return (NULL); }, "Unable to allocate address handle\n");
+    a->ah = ibv_create_ah_from_wc(ctx->pd, (struct ibv_wc *)wc,
+                                  (struct ibv_grh *)grh, ctx->port_num);
+    API_NULL(
+        a->ah,
+        {
+            free(a);
+            return (NULL);
+        },
+        "Unable to create address handle of QP %u. Reason: %s\n", wc->src_qp,
+        strerror(errno));
+    a->refs = 1;
+    // Echoes to the evicted peer still in flight keep its handle alive
+    if (p->qp_num) {
+        ud_ah_put(p->ah);
+    } else {
+        ctx->npeers++;
+    }
+
+    p->qp_num = wc->src_qp;
+    p->lid = wc->slid;
+    p->gid = gid;
+    p->ah = a;
+    // Any sequence is new to a peer seen for the first time
+    p->seq = 0;
+    return (p);
+}
+
+static int ud_echo(ud_ctx_t *ctx, const struct ibv_wc *wc) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+    uint32_t slot = (uint32_t)wc->wr_id;
+    void *buf = ctx->slots + (uint64_t)slot * ctx->slot_sz;
+
+    ud_peer_t *p = ud_lookup_peer(ctx, wc, (struct ibv_grh *)buf);
+    API_NULL(
+        p, { return (-1); }, "Unable to resolve UD request source\n");
+    // Lost responses come back as retransmits, echo those again uncounted
+    if (p->seq == 0 || (int32_t)(wc->imm_data - p->seq) > 0) {
+        p->seq = wc->imm_data;
+        ctx->rx_msgs++;
+        ctx->rx_bytes += wc->byte_len - UD_GRH_SZ;
+    } else {
+        ctx->dup_msgs++;
+    }
+
+    // zcopy round about ! the slot is posted again once the echo completes
+    sge.addr = (uint64_t)buf + UD_GRH_SZ;
+    sge.length = wc->byte_len - UD_GRH_SZ;
+    sge.lkey = ctx->slot_mr->lkey;
+    send_wr.wr_id = UD_WR_SEND | slot;
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.imm_data = wc->imm_data;
+    send_wr.wr.ud.ah = p->ah->ah;
+    send_wr.wr.ud.remote_qpn = wc->src_qp;
+    send_wr.wr.ud.remote_qkey = RDMA_UDP_QKEY;
+    int rc = ibv_post_send(ctx->qp, &send_wr, &send_bad_wr);
+    API_STATUS(
+        rc, { return (-1); }, "Unable to post UD echo. Reason: %s\n",
+        strerror(errno));
+    // Released by the send completion of the slot
+    p->ah->refs++;
+    ctx->slot_ah[slot] = p->ah;
+    return (0);
+}
+
+int ud_serve_server(ud_ctx_t *ctx) {
+    struct ibv_wc wc[UD_POLL_BATCH] = {0};
+    int ncqe = ibv_poll_cq(ctx->cq, UD_POLL_BATCH, &wc[0]);
+    API_STATUS(
+        ncqe, { return (-1); }, "Unable to poll UD CQ\n");
+
+    for (int i = 0; i < ncqe; i++) {
+        uint32_t slot = (uint32_t)wc[i].wr_id;
+        // A failed echo only loses a response, the client retransmits
+        if (wc[i].status != IBV_WC_SUCCESS) {
+            printf("UD WR[%lx] Status: %s\n", wc[i].wr_id,
+                   ibv_wc_status_str(wc[i].status));
+        }
+
+        if ((wc[i].wr_id & UD_WR_SEND) || wc[i].status != IBV_WC_SUCCESS) {
+            if (wc[i].wr_id & UD_WR_SEND) {
+                ud_ah_put(ctx->slot_ah[slot]);
+                ctx->slot_ah[slot] = NULL;
+            }
+            API_STATUS(
+                ud_post_slot(ctx, slot), { return (-1); },
+                "Unable to recycle UD recv slot\n");
+            continue;
+        }
+
+        if (ud_echo(ctx, &wc[i]) < 0) {
+            API_STATUS(
+                ud_post_slot(ctx, slot), { return (-1); },
+                "Unable to recycle UD recv slot\n");
+        }
+    }
+
+    return (ncqe);
+}
+
+ud_ctx_t *ud_setup_client(struct sockaddr *src_addr,
+                          struct sockaddr *dst_addr) {
+    struct rdma_conn_param conn_param = {0};
+    struct rdma_cm_event *event = NULL;
+    int rc = 0;
+
+    ud_ctx_t *ctx = calloc(1, sizeof(ud_ctx_t));
+    API_NULL(
+        ctx, { return (NULL); }, "Unable to allocate UD client context\n");
+    ctx->channel = rdma_create_event_channel();
+    API_NULL(
+        ctx->channel, { goto free_ctx; },
+        "Unable to create RDMA event channel. Reason: %s\n", strerror(errno));
+    rc = rdma_create_id(ctx->channel, &(ctx->cm_id), NULL, RDMA_PS_UDP);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to create RDMA UDP ID. Reason: %s\n", strerror(errno));
+
+    printf("Attempting to resolve between src: %s dst: %s\n",
+           SKADDR_TO_IP(src_addr), SKADDR_TO_IP(dst_addr));
+    rc = rdma_resolve_addr(ctx->cm_id, src_addr, dst_addr, 2000);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to resolve RDMA address for IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), strerror(errno));
+    API_STATUS(
+        ud_wait_event(ctx, RDMA_CM_EVENT_ADDR_RESOLVED, &event),
+        { goto free_ctx; }, "Unable to resolve RDMA address\n");
+    rdma_ack_cm_event(event);
+
+    rc = rdma_resolve_route(ctx->cm_id, 2000);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to resolve RDMA route for IP: %s. Reason: %s\n",
+        SKADDR_TO_IP(dst_addr), strerror(errno));
+    API_STATUS(
+        ud_wait_event(ctx, RDMA_CM_EVENT_ROUTE_RESOLVED, &event),
+        { goto free_ctx; }, "Unable to resolve RDMA route\n");
+    rdma_ack_cm_event(event);
+
+    API_STATUS(
+        ud_prepare(ctx, UD_CLIENT_SLOTS), { goto free_ctx; },
+        "Unable to prepare UD client QP\n");
+    ctx->send_buf = mmap(NULL, ctx->mtu, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    EXT_API_STATUS(
+        ctx->send_buf == MAP_FAILED,
+        {
+            ctx->send_buf = NULL;
+            goto free_ctx;
+        },
+        "Unable to allocate UD request buf. Reason: %s\n", strerror(errno));
+    randomize_buf(&(ctx->send_buf), ctx->mtu);
+    ctx->send_mr = ibv_reg_mr(ctx->pd, ctx->send_buf, ctx->mtu,
+                              IBV_ACCESS_LOCAL_WRITE);
+    API_NULL(
+        ctx->send_mr, { goto free_ctx; },
+        "Unable to register UD request buf with RDMA. Reason: %s\n",
+        strerror(errno));
+
+    // SIDR: the reply carries the server QP, Q_Key and address
+    rc = rdma_connect(ctx->cm_id, &conn_param);
+    API_STATUS(
+        rc, { goto free_ctx; },
+        "Unable to resolve UD server QP. Reason: %s\n", strerror(errno));
+    API_STATUS(
+        ud_wait_event(ctx, RDMA_CM_EVENT_ESTABLISHED, &event),
+        { goto free_ctx; }, "Unable to resolve UD server QP\n");
+    ctx->remote_qpn = event->param.ud.qp_num;
+    ctx->remote_qkey = event->param.ud.qkey;
+    ctx->ah = ibv_create_ah(ctx->pd, &(event->param.ud.ah_attr));
+    rdma_ack_cm_event(event);
+    API_NULL(
+        ctx->ah, { goto free_ctx; },
+        "Unable to create address handle of the server. Reason: %s\n",
+        strerror(errno));
+
+    printf("Resolved RDMA_UD between src: %s dst: %s, Server QP: %u, MTU: %u "
+           "bytes\n",
+           SKADDR_TO_IP(rdma_get_local_addr(ctx->cm_id)),
+           SKADDR_TO_IP(rdma_get_peer_addr(ctx->cm_id)), ctx->remote_qpn,
+           ctx->mtu);
+    return (ctx);
+
+free_ctx:
+    ud_destroy(ctx);
+    return (NULL);
+}
+
+static int ud_post_request(ud_ctx_t *ctx, size_t msg_sz) {
+    struct ibv_send_wr send_wr = {0}, *send_bad_wr = NULL;
+    struct ibv_sge sge = {0};
+
+    sge.addr = (uint64_t)ctx->send_buf;
+    sge.length = msg_sz;
+    sge.lkey = ctx->send_mr->lkey;
+    send_wr.wr_id = UD_WR_SEND;
+    send_wr.next = NULL;
+    send_wr.sg_list = &sge;
+    send_wr.num_sge = 1;
+    send_wr.opcode = IBV_WR_SEND_WITH_IMM;
+    send_wr.send_flags = IBV_SEND_SIGNALED;
+    send_wr.imm_data = ctx->seq;
+    send_wr.wr.ud.ah = ctx->ah;
+    send_wr.wr.ud.remote_qpn = ctx->remote_qpn;
+    send_wr.wr.ud.remote_qkey = ctx->remote_qkey;
+    int rc = ibv_post_send(ctx->qp, &send_wr, &send_bad_wr);
+    API_STATUS(
+        rc, { return (-1); }, "Unable to post UD request. Reason: %s\n",
+        strerror(errno));
+    return (0);
+}
+
+int ud_call_client(ud_ctx_t *ctx, size_t msg_sz) {
+    struct ibv_wc wc[UD_POLL_BATCH] = {0};
+    uint64_t t0 = 0, deadline = 0, now = 0;
+    bool done = false;
+    int rc = 0;
+
+    EXT_API_STATUS(
+        msg_sz > ctx->mtu, { return (-1); },
+        "UD message of %zu bytes exceeds the %u byte MTU\n", msg_sz,
+        ctx->mtu);
+    // Zero is how a server marks a peer it has not served yet
+    ctx->seq = (ctx->seq + 1) ? (ctx->seq + 1) : (1);
+    t0 = cq_ring_now();
+    for (int attempt = 0; !done && attempt <= UD_MAX_RETRIES; attempt++) {
+        API_STATUS(
+            ud_post_request(ctx, msg_sz), { return (-1); },
+            "Unable to send UD request\n");
+        ctx->retransmits += (attempt > 0);
+        deadline = cq_ring_now() + UD_RTO_NSEC;
+        while (!done && (now = cq_ring_now()) < deadline) {
+            int ncqe = ibv_poll_cq(ctx->cq, UD_POLL_BATCH, &wc[0]);
+            API_STATUS(
+                ncqe, { return (-1); }, "Unable to poll UD CQ\n");
+            for (int i = 0; i < ncqe; i++) {
+                EXT_API_STATUS(
+                    wc[i].status != IBV_WC_SUCCESS, { return (-1); },
+                    "UD WR[%lx] failed. Status: %s\n", wc[i].wr_id,
+                    ibv_wc_status_str(wc[i].status));
+                if (wc[i].wr_id & UD_WR_SEND) {
+                    continue;
+                }
+
+                // Echoes of earlier attempts or requests are dropped
+                uint32_t slot = (uint32_t)wc[i].wr_id;
+                void *buf = ctx->slots + (uint64_t)slot * ctx->slot_sz;
+                if (!done && wc[i].imm_data == ctx->seq) {
+                    ctx->last_rtt_nsec = now - t0;
+                    EXT_API_STATUS(
+                        (wc[i].byte_len - UD_GRH_SZ != msg_sz ||
+                         memcmp(buf + UD_GRH_SZ, ctx->send_buf, msg_sz)),
+                        { rc = -1; }, "UD response does not match request\n");
+                    done = true;
+                }
+
+                API_STATUS(
+                    ud_post_slot(ctx, slot), { return (-1); },
+                    "Unable to recycle UD recv slot\n");
+            }
+        }
+    }
+
+    EXT_API_STATUS(
+        !done, { return (-1); }, "UD request %u lost after %d retries\n",
+        ctx->seq, UD_MAX_RETRIES);
+    return (rc);
+}
+
+void ud_destroy(ud_ctx_t *ctx) {
+    if (!ctx) {
+        return;
+    }
+
+    if (ctx->slot_ah) {
+        for (uint32_t s = 0; s < ctx->nslots; s++) {
+            ud_ah_put(ctx->slot_ah[s]);
+        }
+        free(ctx->slot_ah);
+    }
+    if (ctx->peers) {
+        for (uint32_t p = 0; p < UD_MAX_PEERS; p++) {
+            if (ctx->peers[p].qp_num) {
+                ud_ah_put(ctx->peers[p].ah);
+            }
+        }
+        free(ctx->peers);
+    }
+    if (ctx->ah) {
+        ibv_destroy_ah(ctx->ah);
+    }
+    if (ctx->qp) {
+        rdma_destroy_qp(ctx->cm_id);
+    }
+    if (ctx->send_mr) {
+        ibv_dereg_mr(ctx->send_mr);
+    }
+    if (ctx->send_buf) {
+        munmap(ctx->send_buf, ctx->mtu);
+    }
+    if (ctx->slot_mr) {
+        ibv_dereg_mr(ctx->slot_mr);
+    }
+    if (ctx->slots) {
+        munmap(ctx->slots, ctx->nslots * ctx->slot_sz);
+    }
+    if (ctx->cq) {
+        ibv_destroy_cq(ctx->cq);
+    }
+    if (ctx->pd) {
+        ibv_dealloc_pd(ctx->pd);
+    }
+    if (ctx->cm_id) {
+        rdma_destroy_id(ctx->cm_id);
+    }
+    if (ctx->channel) {
+        rdma_destroy_event_channel(ctx->channel);
+    }
+    free(ctx);
+}
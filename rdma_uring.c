@@ -0,0 +1,176 @@
+#include "rdma_uring.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+int uring_init(uring_t *u, uint32_t entries) {
+    struct io_uring_params p = {0};
+
+    memset(u, 0, sizeof(uring_t));
+    u->fd = syscall(__NR_io_uring_setup, entries, &p);
+    API_STATUS(
+        u->fd, { return (-1); }, "Unable to set up io_uring. Reason: %s\n",
+        strerror(errno));
+    EXT_API_STATUS(
+        !(p.features & IORING_FEAT_SINGLE_MMAP),
+        {
+            close(u->fd);
+            return (-1);
+        },
+        "io_uring of this kernel maps its rings apart, unsupported\n");
+
+    // Both rings share one mapping, the SQEs have their own
+    size_t sq_sz = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    size_t cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    u->sq_ring_sz = (sq_sz > cq_sz) ? (sq_sz) : (cq_sz);
+    u->sq_ring = mmap(NULL, u->sq_ring_sz, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    EXT_API_STATUS(
+        u->sq_ring == MAP_FAILED,
+        {
+            close(u->fd);
+            return (-1);
+        },
+        "Unable to map io_uring rings. Reason: %s\n", strerror(errno));
+    u->sqes_sz = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_sz, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    EXT_API_STATUS(
+        u->sqes == MAP_FAILED,
+        {
+            munmap(u->sq_ring, u->sq_ring_sz);
+            close(u->fd);
+            return (-1);
+        },
+        "Unable to map io_uring SQEs. Reason: %s\n", strerror(errno));
+
+    uint8_t *ring = u->sq_ring;
+    u->sq_head = (uint32_t *)(ring + p.sq_off.head);
+    u->sq_tail = (uint32_t *)(ring + p.sq_off.tail);
+    u->sq_mask = (uint32_t *)(ring + p.sq_off.ring_mask);
+    u->sq_array = (uint32_t *)(ring + p.sq_off.array);
+    u->cq_head = (uint32_t *)(ring + p.cq_off.head);
+    u->cq_tail = (uint32_t *)(ring + p.cq_off.tail);
+    u->cq_mask = (uint32_t *)(ring + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)(ring + p.cq_off.cqes);
+    u->sq_local = *(u->sq_tail);
+    return (0);
+}
+
+void uring_destroy(uring_t *u) {
+    if (u->bufs) {
+        munmap(u->bufs, (size_t)u->nbufs * u->buf_sz);
+    }
+    if (u->br) {
+        munmap(u->br, u->nbufs * sizeof(struct io_uring_buf));
+    }
+    munmap(u->sqes, u->sqes_sz);
+    munmap(u->sq_ring, u->sq_ring_sz);
+    // Closing the instance drops the registrations with it
+    close(u->fd);
+}
+
+struct io_uring_sqe *uring_get_sqe(uring_t *u) {
+    uint32_t head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if ((u->sq_local - head) > *(u->sq_mask)) {
+        return (NULL);
+    }
+
+    uint32_t idx = u->sq_local & *(u->sq_mask);
+    struct io_uring_sqe *sqe = &(u->sqes[idx]);
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    u->sq_array[idx] = idx;
+    u->sq_local++;
+    u->sq_pending++;
+    return (sqe);
+}
+
+int uring_enter(uring_t *u, uint32_t wait_nr) {
+    int rc = 0;
+
+    if (!u->sq_pending && !wait_nr) {
+        return (0);
+    }
+
+    // SQEs are filled in by now, publish them with the tail
+    __atomic_store_n(u->sq_tail, u->sq_local, __ATOMIC_RELEASE);
+    do {
+        rc = syscall(__NR_io_uring_enter, u->fd, u->sq_pending, wait_nr,
+                     (wait_nr) ? (IORING_ENTER_GETEVENTS) : (0), NULL, 0);
+    } while (rc < 0 && errno == EINTR);
+    API_STATUS(
+        rc, { return (-1); }, "Unable to enter io_uring. Reason: %s\n",
+        strerror(errno));
+    u->sq_pending -= rc;
+    return (rc);
+}
+
+struct io_uring_cqe *uring_peek_cqe(uring_t *u) {
+    uint32_t head = *(u->cq_head);
+    if (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        return (NULL);
+    }
+
+    return (&(u->cqes[head & *(u->cq_mask)]));
+}
+
+void uring_cqe_seen(uring_t *u) {
+    __atomic_store_n(u->cq_head, *(u->cq_head) + 1, __ATOMIC_RELEASE);
+}
+
+int uring_register_buffers(uring_t *u, const struct iovec *iov, uint32_t nr) {
+    int rc = syscall(__NR_io_uring_register, u->fd, IORING_REGISTER_BUFFERS,
+                     iov, nr);
+    API_STATUS(
+        rc, { return (-1); },
+        "Unable to register io_uring buffers. Reason: %s\n", strerror(errno));
+    return (0);
+}
+
+int uring_provide_bufs(uring_t *u, uint16_t bgid, uint32_t nbufs,
+                       uint32_t buf_sz) {
+    struct io_uring_buf_reg reg = {0};
+
+    u->nbufs = nbufs;
+    u->buf_sz = buf_sz;
+    u->bgid = bgid;
+    u->br = mmap(NULL, nbufs * sizeof(struct io_uring_buf),
+                 PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    u->bufs = mmap(NULL, (size_t)nbufs * buf_sz, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (u->br == MAP_FAILED || u->bufs == MAP_FAILED) {
+        printf("Unable to allocate %u provided buffers. Reason: %s\n", nbufs,
+               strerror(errno));
+        u->br = (u->br == MAP_FAILED) ? (NULL) : (u->br);
+        u->bufs = (u->bufs == MAP_FAILED) ? (NULL) : (u->bufs);
+        return (-1);
+    }
+
+    reg.ring_addr = (uint64_t)u->br;
+    reg.ring_entries = nbufs;
+    reg.bgid = bgid;
+    int rc = syscall(__NR_io_uring_register, u->fd,
+                     IORING_REGISTER_PBUF_RING, &reg, 1);
+    API_STATUS(
+        rc, { return (-1); },
+        "Unable to register provided buffer ring. Reason: %s\n",
+        strerror(errno));
+
+    for (uint32_t bid = 0; bid < nbufs; bid++) {
+        uring_recycle_buf(u, bid);
+    }
+    return (0);
+}
+
+void uring_recycle_buf(uring_t *u, uint16_t bid) {
+    struct io_uring_buf *buf = &(u->br->bufs[u->br_tail & (u->nbufs - 1)]);
+    buf->addr = (uint64_t)uring_buf(u, bid);
+    buf->len = u->buf_sz;
+    buf->bid = bid;
+    u->br_tail++;
+    __atomic_store_n(&(u->br->tail), u->br_tail, __ATOMIC_RELEASE);
+}
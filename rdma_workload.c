@@ -0,0 +1,343 @@
+#include "rdma_workload.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const struct {
+    const char *name;
+    const char *tag;
+    int opc;
+} wl_ops[WL_MAX_OPS] = {
+    {"SEND", "SEND", OPC_SEND_ONLY},
+    {"RDMA_WRITE", "WRITE", OPC_RDMA_WRITE},
+    {"RDMA_READ", "READ", OPC_RDMA_READ},
+};
+
+// Uniform double in [0, 1)
+static double wl_rand_unit(uint64_t *seed) {
+    return ((double)(fast_rand(seed) >> 11) / (double)(1ULL << 53));
+}
+
+void wl_spec_init(wl_spec_t *w, int opc, size_t msg_sz) {
+    memset(w, 0, sizeof(wl_spec_t));
+    w->size_dist = WL_SIZE_FIXED;
+    w->size_lo = msg_sz;
+    w->size_hi = msg_sz;
+    w->ops[0] = opc;
+    w->op_cum[0] = 1.0;
+    w->nops = 1;
+    w->seed = 0x9E3779B97F4A7C15ULL;
+}
+
+void wl_spec_free(wl_spec_t *w) {
+    free(w->cdf_sz);
+    free(w->cdf_p);
+    free(w->trace);
+    w->cdf_sz = NULL;
+    w->cdf_p = NULL;
+    w->trace = NULL;
+    w->ncdf = 0;
+    w->ntrace = 0;
+}
+
+// Whole string as a size, -1 if malformed
+static int wl_parse_size(const char *str, size_t *sz) {
+    char *end = NULL;
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 0);
+    if (errno || end == str || *end != '\0') {
+        return (-1);
+    }
+
+    *sz = (size_t)v;
+    return (0);
+}
+
+static int wl_load_cdf(wl_spec_t *w, const char *path) {
+    char line[256];
+    int rc = -1;
+
+    FILE *f = fopen(path, "r");
+    API_NULL(
+        f, { return (-1); }, "Unable to open size CDF %s. Reason: %s\n", path,
+        strerror(errno));
+    w->cdf_sz = calloc(WL_MAX_CDF, sizeof(size_t));
+    w->cdf_p = calloc(WL_MAX_CDF, sizeof(double));
+    EXT_API_STATUS(
+        (!w->cdf_sz || !w->cdf_p), { goto close_file; },
+        "Unable to allocate size CDF\n");
+
+    w->ncdf = 0;
+    while (fgets(line, sizeof(line), f)) {
+        unsigned long long sz = 0;
+        double p = 0;
+        char *hash = strchr(line, '#');
+        if (hash) {
+            *hash = '\0';
+        }
+        if (strspn(line, " \t\r\n") == strlen(line)) {
+            continue;
+        }
+
+        EXT_API_STATUS(
+            (sscanf(line, "%llu %lf", &sz, &p) != 2 || w->ncdf >= WL_MAX_CDF),
+            { goto close_file; }, "Malformed size CDF line, up to %d: %s",
+            WL_MAX_CDF, line);
+        // Points must grow in size and probability for the search to hold
+        EXT_API_STATUS(
+            (p <= 0 || p > 1 ||
+             (w->ncdf &&
+              (sz <= w->cdf_sz[w->ncdf - 1] || p <= w->cdf_p[w->ncdf - 1]))),
+            { goto close_file; }, "Size CDF point %llu %g is out of order\n",
+            sz, p);
+        w->cdf_sz[w->ncdf] = (size_t)sz;
+        w->cdf_p[w->ncdf] = p;
+        w->ncdf++;
+    }
+
+    EXT_API_STATUS(
+        (w->ncdf == 0 || w->cdf_p[w->ncdf - 1] < 1.0 - 1e-9),
+        { goto close_file; }, "Size CDF %s does not reach probability 1\n",
+        path);
+    w->cdf_p[w->ncdf - 1] = 1.0;
+    rc = 0;
+
+close_file:
+    fclose(f);
+    return (rc);
+}
+
+int wl_parse_sizes(wl_spec_t *w, const char *str) {
+    char *spec = strdup(str);
+    char *arg = strchr(spec, ':');
+    int rc = -1;
+
+    if (!arg) {
+        goto free_spec;
+    }
+    *arg++ = '\0';
+    if (strcmp(spec, "fixed") == 0) {
+        if (wl_parse_size(arg, &(w->size_lo)) == 0) {
+            w->size_hi = w->size_lo;
+            w->size_dist = WL_SIZE_FIXED;
+            rc = 0;
+        }
+    } else if (strcmp(spec, "uniform") == 0) {
+        char *hi = strchr(arg, '-');
+        if (hi) {
+            *hi++ = '\0';
+            if (wl_parse_size(arg, &(w->size_lo)) == 0 &&
+                wl_parse_size(hi, &(w->size_hi)) == 0 &&
+                w->size_lo <= w->size_hi) {
+                w->size_dist = WL_SIZE_UNIFORM;
+                rc = 0;
+            }
+        }
+    } else if (strcmp(spec, "bimodal") == 0) {
+        unsigned long long a = 0, b = 0;
+        double p = 0;
+        if (sscanf(arg, "%llu,%llu,%lf", &a, &b, &p) == 3 && p >= 0 &&
+            p <= 1) {
+            w->size_lo = a;
+            w->size_hi = b;
+            w->p_lo = p;
+            w->size_dist = WL_SIZE_BIMODAL;
+            rc = 0;
+        }
+    } else if (strcmp(spec, "cdf") == 0) {
+        if (wl_load_cdf(w, arg) == 0) {
+            w->size_dist = WL_SIZE_CDF;
+            rc = 0;
+        }
+    }
+
+free_spec:
+    free(spec);
+    return (rc);
+}
+
+int wl_parse_mix(wl_spec_t *w, const char *str) {
+    char *list = strdup(str), *save = NULL, *tok = NULL;
+    double weights[WL_MAX_OPS] = {0}, sum = 0;
+    int nops = 0, rc = -1;
+
+    w->nops = 0;
+    for (tok = strtok_r(list, ",", &save); tok;
+         tok = strtok_r(NULL, ",", &save)) {
+        char *weight = strchr(tok, ':');
+        int op = 0;
+        if (!weight || nops >= WL_MAX_OPS) {
+            goto free_list;
+        }
+        *weight++ = '\0';
+        for (op = 0; op < WL_MAX_OPS; op++) {
+            if (strcmp(tok, wl_ops[op].name) == 0) {
+                break;
+            }
+        }
+        weights[nops] = atof(weight);
+        if (op == WL_MAX_OPS || weights[nops] <= 0 ||
+            wl_op_index(w, wl_ops[op].opc) >= 0) {
+            goto free_list;
+        }
+        // Listed as parsed so that a repeated opcode is caught above
+        w->ops[nops] = wl_ops[op].opc;
+        w->nops = ++nops;
+        sum += weights[nops - 1];
+    }
+
+    if (nops == 0) {
+        goto free_list;
+    }
+    for (int i = 0; i < nops; i++) {
+        w->op_cum[i] = ((i) ? (w->op_cum[i - 1]) : (0)) + weights[i] / sum;
+    }
+    w->op_cum[nops - 1] = 1.0;
+    rc = 0;
+
+free_list:
+    free(list);
+    return (rc);
+}
+
+int wl_trace_load(wl_spec_t *w, const char *path) {
+    wl_trace_hdr_t hdr = {0};
+    int rc = -1;
+
+    FILE *f = fopen(path, "rb");
+    API_NULL(
+        f, { return (-1); }, "Unable to open trace %s. Reason: %s\n", path,
+        strerror(errno));
+    EXT_API_STATUS(
+        (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+         memcmp(hdr.magic, WL_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+         hdr.version != WL_TRACE_VERSION),
+        { goto close_file; }, "%s is not a version %d request trace\n", path,
+        WL_TRACE_VERSION);
+    EXT_API_STATUS(
+        (hdr.nrec == 0 || hdr.nrec > WL_MAX_TRACE), { goto close_file; },
+        "Trace of %lu requests, 1 to %d are replayed\n", hdr.nrec,
+        WL_MAX_TRACE);
+
+    w->trace = calloc(hdr.nrec, sizeof(wl_trace_rec_t));
+    API_NULL(
+        w->trace, { goto close_file; },
+        "Unable to allocate trace of %lu requests\n", hdr.nrec);
+    EXT_API_STATUS(
+        fread(w->trace, sizeof(wl_trace_rec_t), hdr.nrec, f) != hdr.nrec,
+        { goto close_file; }, "Trace %s is truncated\n", path);
+
+    w->nops = 0;
+    for (uint64_t i = 0; i < hdr.nrec; i++) {
+        const wl_trace_rec_t *rec = &(w->trace[i]);
+        EXT_API_STATUS(
+            (i && rec->t_nsec < w->trace[i - 1].t_nsec), { goto close_file; },
+            "Trace request %lu goes back in time\n", i);
+        EXT_API_STATUS(
+            (rec->opcode != OPC_SEND_ONLY && rec->opcode != OPC_RDMA_WRITE &&
+             rec->opcode != OPC_RDMA_READ),
+            { goto close_file; }, "Trace request %lu has opcode 0x%x\n", i,
+            rec->opcode);
+        if (wl_op_index(w, rec->opcode) < 0) {
+            w->ops[w->nops] = rec->opcode;
+            w->op_cum[w->nops] = 1.0;
+            w->nops++;
+        }
+    }
+
+    w->ntrace = hdr.nrec;
+    rc = 0;
+
+close_file:
+    fclose(f);
+    if (rc) {
+        free(w->trace);
+        w->trace = NULL;
+    }
+    return (rc);
+}
+
+size_t wl_next_size(wl_spec_t *w) {
+    switch (w->size_dist) {
+    case WL_SIZE_UNIFORM:
+        return (w->size_lo +
+                fast_rand(&(w->seed)) % (w->size_hi - w->size_lo + 1));
+    case WL_SIZE_BIMODAL:
+        return ((wl_rand_unit(&(w->seed)) < w->p_lo) ? (w->size_lo)
+                                                     : (w->size_hi));
+    case WL_SIZE_CDF: {
+        // First point whose cumulative probability covers the draw
+        double u = wl_rand_unit(&(w->seed));
+        uint32_t lo = 0, hi = w->ncdf - 1;
+        while (lo < hi) {
+            uint32_t mid = (lo + hi) / 2;
+            if (w->cdf_p[mid] > u) {
+                hi = mid;
+            } else {
+                lo = mid + 1;
+            }
+        }
+        return (w->cdf_sz[lo]);
+    }
+    default:
+        return (w->size_lo);
+    }
+}
+
+int wl_next_op(wl_spec_t *w) {
+    if (w->nops == 1) {
+        return (0);
+    }
+
+    double u = wl_rand_unit(&(w->seed));
+    for (int i = 0; i < w->nops - 1; i++) {
+        if (u < w->op_cum[i]) {
+            return (i);
+        }
+    }
+
+    return (w->nops - 1);
+}
+
+int wl_op_index(const wl_spec_t *w, int opc) {
+    for (int i = 0; i < w->nops; i++) {
+        if (w->ops[i] == opc) {
+            return (i);
+        }
+    }
+
+    return (-1);
+}
+
+size_t wl_max_size(const wl_spec_t *w) {
+    size_t max = 0;
+
+    if (w->trace) {
+        for (uint64_t i = 0; i < w->ntrace; i++) {
+            max = (w->trace[i].msg_sz > max) ? (w->trace[i].msg_sz) : (max);
+        }
+        return (max);
+    }
+    if (w->size_dist == WL_SIZE_CDF) {
+        return (w->cdf_sz[w->ncdf - 1]);
+    }
+
+    return ((w->size_lo > w->size_hi) ? (w->size_lo) : (w->size_hi));
+}
+
+bool wl_one_sided(const wl_spec_t *w) {
+    return (wl_op_index(w, OPC_RDMA_WRITE) >= 0 ||
+            wl_op_index(w, OPC_RDMA_READ) >= 0);
+}
+
+const char *wl_op_str(int opc) {
+    for (int op = 0; op < WL_MAX_OPS; op++) {
+        if (wl_ops[op].opc == opc) {
+            return (wl_ops[op].tag);
+        }
+    }
+
+    return ("UNKNOWN");
+}
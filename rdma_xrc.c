@@ -0,0 +1,70 @@
+#include "rdma_xrc.h"
+#include "client_server_shared.h"
+#include <errno.h>
+#include <rdma/rdma_cma.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+// Path attributes of id for state, restricted to what an XRC QP accepts
+static int xrc_modify_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                         enum ibv_qp_state state, uint32_t dest_qpn) {
+    struct ibv_qp_attr attr = {0};
+    bool tgt = (qp->qp_type == IBV_QPT_XRC_RECV);
+    int mask = 0, rc = 0;
+
+    attr.qp_state = state;
+    rc = rdma_init_qp_attr(id, &attr, &mask);
+    API_STATUS(
+        rc, { return (-1); },
+        "Unable to get QP attributes of state %d. Reason: %s\n", state,
+        strerror(errno));
+
+    attr.qp_state = state;
+    switch (state) {
+    case IBV_QPS_INIT:
+        mask = IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT;
+        mask |= (tgt) ? (IBV_QP_ACCESS_FLAGS) : (0);
+        break;
+    case IBV_QPS_RTR:
+        attr.dest_qp_num = dest_qpn;
+        attr.rq_psn = XRC_PSN;
+        mask = IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN |
+               IBV_QP_RQ_PSN;
+        mask |= (tgt) ? (IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER)
+                      : (0);
+        break;
+    case IBV_QPS_RTS:
+        attr.sq_psn = XRC_PSN;
+        mask = IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT |
+               IBV_QP_RNR_RETRY | IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC;
+        break;
+    default:
+        return (-1);
+    }
+
+    rc = ibv_modify_qp(qp, &attr, mask);
+    EXT_API_STATUS(
+        rc, { return (-1); },
+        "Unable to move XRC QP %u to state %d. Reason: %s\n", qp->qp_num,
+        state, strerror(rc));
+    return (0);
+}
+
+int xrc_connect_qp(struct rdma_cm_id *id, struct ibv_qp *qp,
+                   uint32_t dest_qpn) {
+    API_STATUS(
+        xrc_modify_qp(id, qp, IBV_QPS_INIT, dest_qpn), { return (-1); },
+        "Unable to initialize XRC QP\n");
+    API_STATUS(
+        xrc_modify_qp(id, qp, IBV_QPS_RTR, dest_qpn), { return (-1); },
+        "Unable to connect XRC QP\n");
+    // The receive side never sends
+    if (qp->qp_type == IBV_QPT_XRC_SEND) {
+        API_STATUS(
+            xrc_modify_qp(id, qp, IBV_QPS_RTS, dest_qpn), { return (-1); },
+            "Unable to connect XRC QP\n");
+    }
+
+    return (0);
+}